@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <optional>
 #include <cstdint>
@@ -11,6 +13,12 @@
 #include "configuration.hpp"
 #include "types.hpp"
 #include "memory.hpp"
+#include "block_cache.hpp"
+#include "trace.hpp"
+#include "checkpoint.hpp"
+#include "profiler.hpp"
+#include "cpuid.hpp"
+#include "syscall_table.hpp"
 
 #ifdef min
 #undef min
@@ -33,29 +41,159 @@
 
 namespace kubera
 {
-	// Type alias for instruction handler function
-	using InstructionHandler = void ( * ) ( const iced::Instruction&, class KUBERA& state );
-
 	// Type alias for array of instruction handlers
 	using InstructionHandlerList = std::array<InstructionHandler, static_cast< std::size_t > ( Mnemonic::COUNT )>;
 
 	// Optional function to override target address
 	inline bool ( *platform_target_override )( uint64_t ) = nullptr;
 
-	// Pointer to the instruction dispatch table
-	inline std::unique_ptr<InstructionHandlerList> instruction_dispatch_table = nullptr;
-	// Memory Management Unit
-	inline std::unique_ptr<VirtualMemory> memory = nullptr;
+	// Instruction dispatch table shared by every instance, built on first use and immutable afterwards
+	const InstructionHandlerList& dispatch_table ( );
+
+	// Variant of generic specialized for the operand size and form of instr, or generic itself when there is none.
+	// The variants read their operands from the lowered descriptors, so they are only installed on cached instructions.
+	InstructionHandler specialized_handler ( const iced::Instruction& instr, InstructionHandler generic );
+
+	// Superinstruction for first directly followed by second, nullptr when the pair is not fused.
+	// Fused handlers leave the same registers, flags and RIP behind as the two instructions run one after the other.
+	FusedHandler fused_handler ( const iced::Instruction& first, const iced::Instruction& second );
+
+	// Full machine state of one instance: register file plus its address space
+	struct Snapshot {
+		CPU cpu;
+		std::shared_ptr<const MemorySnapshot> memory;
+	};
+
+	// Why KUBERA::run returned
+	enum class StopReason : uint8_t {
+		None, // still running, only seen as the pending stop
+		Budget, // the instruction budget is spent
+		Timeout, // the deadline passed
+		Breakpoint, // RIP reached stop_rip, or an INT3 ran
+		Fault, // an instruction could not be fetched, or a fault was recorded with stop_on_fault set
+		Halt, // HLT at CPL 0
+		StopRequested, // request_stop
+	};
+
+	struct RunOptions {
+		std::size_t budget { SIZE_MAX };
+		// Checked every deadline_interval instructions, so a run can overshoot it by that much
+		std::chrono::steady_clock::time_point deadline { std::chrono::steady_clock::time_point::max ( ) };
+		// Execution stops before the instruction at stop_rip
+		uint64_t stop_rip { UINT64_MAX };
+		// Stop at the end of a block that recorded a memory fault, last_fault holds it
+		bool stop_on_fault { false };
+	};
+
+	struct RunResult {
+		StopReason reason { StopReason::None };
+		std::size_t instructions { 0 };
+	};
 
 	class KUBERA {
 	private:
+		// Memory Management Unit, shared with other instances only when passed in explicitly
+		std::shared_ptr<VirtualMemory> memory = nullptr;
+		const InstructionHandlerList* dispatch = nullptr;
 		std::unique_ptr<CPU> cpu = nullptr;
 		uint8_t instr_buffer [ 15 ] = { 0 };
+		BlockCache block_cache { };
+		// Descriptors of the instruction being dispatched, scratch_operands backs instructions from outside the block cache
+		const LoweredOperands* current_operands = nullptr;
+		LoweredOperands scratch_operands { };
+		// Cached block the instruction being dispatched belongs to, its live links let branches skip the exec check
+		const BasicBlock* current_block = nullptr;
+		// Receives a record of every executed instruction while tracing, hooked into memory for the accesses
+		TraceStream* trace_stream = nullptr;
+		uint64_t trace_hook = 0;
+
+		void trace_end_step ( );
+
+		// Collects per-mnemonic and per-block host cycles while attached
+		Profiler* profiler = nullptr;
+
+		// Host frame of the stack page stack_slot last resolved, checked against memory's TLB generation
+		uint64_t stack_window_page = 0;
+		uint8_t* stack_window = nullptr;
+		uint64_t stack_window_generation = UINT64_MAX;
+
+		uint8_t* refill_stack_window ( uint64_t address );
+
+		// Platform handlers for SYSCALL and software interrupts
+		SyscallTable syscalls { };
+		InterruptTable interrupts { };
+
+		// Set from any thread by request_stop, run consumes it at the next block boundary
+		std::atomic<bool> stop_requested { false };
+		// Set by handlers (HLT, INT3) that end a run, the block they terminate is the last one
+		StopReason pending_stop = StopReason::None;
+
+		// Last failed guest access, memory records into it while this instance is executing
+		MemoryFault fault { };
+
+		void bind_fault_slot ( ) noexcept {
+			memory->bind_fault_slot ( &fault, &cpu->registers [ KubRegister::RIP ] );
+		}
+
+		// Answers guest CPUID and XGETBV, the process-wide host capture unless replaced
+		std::shared_ptr<const CpuidTable> cpuid_table = nullptr;
+
+		// Edge coverage bitmap while attached, see set_coverage_map
+		uint8_t* coverage_map = nullptr;
+		std::size_t coverage_mask = 0;
+		uint64_t coverage_prev = 0;
+
+		void record_edge ( uint64_t block_start ) noexcept {
+			// Block location hash of AFL's QEMU mode
+			const uint64_t cur = ( ( block_start >> 4 ) ^ ( block_start << 8 ) ) & coverage_mask;
+			++coverage_map [ cur ^ coverage_prev ];
+			coverage_prev = cur >> 1;
+		}
+
+		// Decodes the basic block starting at address and inserts it into the block cache
+		BasicBlock* build_block ( uint64_t address );
+
+		// Returns the cached block starting at address, building it on a miss
+		BasicBlock* lookup_block ( uint64_t address );
+
+		// Block at address that execution continues in after leaving from, through from's links when they are live.
+		// Links the block into from on a miss.
+		BasicBlock* chain_block ( BasicBlock& from, uint64_t address );
+
+		// Returns the decoded instruction at address, continuing through the current block when possible
+		DecodedInstruction* next_decoded_instruction ( uint64_t address );
+
+		// Retires blocks on code pages written since the last sync
+		void invalidate_modified_code ( );
+
+		void sync_block_cache ( ) {
+			if ( memory->code_write_sequence ( ) != block_cache.synced_sequence ) {
+				invalidate_modified_code ( );
+			}
+		}
+
+		// Runs instructions of block until control leaves it, RIP reaches stop_rip or budget is spent
+		std::size_t execute_block ( BasicBlock& block, uint64_t stop_rip, std::size_t budget );
+		// execute_block with every handler timed, taken when a profiler is attached
+		std::size_t execute_block_profiled ( BasicBlock& block, uint64_t stop_rip, std::size_t budget );
+		// One step of either loop, false once the block has to be left. Profiled runs time the handler into block_profile.
+		template<bool Profiled>
+		bool execute_entry ( DecodedInstruction& entry, uint64_t stop_rip, std::size_t budget, std::size_t& executed,
+			Profiler::BlockProfile* block_profile );
+
+		// Writes the deferred flags into cpu->rflags and clears them
+		void materialize_flags ( ) noexcept;
+
+		// Copy of rflags with the deferred flags applied
+		x86::Flags evaluated_flags ( ) const noexcept;
 
 	public:
 		std::unique_ptr<iced::Decoder> decoder = nullptr;
 		KUBERA ( );
-		~KUBERA ( ) = default;
+		// Runs on an existing address space, e.g. another thread of the same guest.
+		// Instances sharing memory must not execute concurrently.
+		explicit KUBERA ( std::shared_ptr<VirtualMemory> shared_memory );
+		~KUBERA ( );
 
 		uint64_t alloc_memory ( std::size_t size, uint8_t prot, std::size_t alignment = 0x1000 ) {
 			return memory->alloc ( size, prot, alignment );
@@ -69,6 +207,11 @@ namespace kubera
 			return memory.get ( );
 		}
 
+		// Owning handle to the address space, for constructing instances that share it
+		std::shared_ptr<VirtualMemory> shared_virtual_memory ( ) const noexcept {
+			return memory;
+		}
+
 		uint64_t stack_base ( ) const noexcept {
 			return cpu->stack_base;
 		}
@@ -77,12 +220,60 @@ namespace kubera
 			return cpu->stack_base + cpu->stack_size;
 		}
 
-		// Returns a mutable reference to cpu->rflags
+		// Returns a mutable reference to cpu->rflags, writing back any deferred flags first
 		// Warning! This function can overwrite reserved bits!
 		x86::Flags& get_flags ( ) noexcept {
+			if ( cpu->lazy_flags.op != FlagOp::None ) {
+				materialize_flags ( );
+			}
 			return cpu->rflags;
 		}
 
+		// Defers CF/PF/AF/ZF/SF/OF of a flag-producing operation until something reads them.
+		// Operands and result must already be masked to `size` bytes.
+		void set_lazy_flags ( FlagOp op, size_t size, uint64_t src1, uint64_t src2, uint64_t result ) noexcept {
+			auto& lazy = cpu->lazy_flags;
+			// INC/DEC leave CF alone, so it has to be taken from the operation they replace
+			if ( ( op == FlagOp::Inc || op == FlagOp::Dec ) &&
+					( lazy.op == FlagOp::Add || lazy.op == FlagOp::Sub || lazy.op == FlagOp::Logic ) ) {
+				cpu->rflags.CF = lazy.cf ( );
+			}
+			lazy.op = op;
+			lazy.size = static_cast< uint8_t >( size );
+			lazy.src1 = src1;
+			lazy.src2 = src2;
+			lazy.result = result;
+		}
+
+		// Single flag reads for conditional instructions, these never materialize the deferred flags
+		bool flag_cf ( ) const noexcept {
+			const auto& lazy = cpu->lazy_flags;
+			switch ( lazy.op ) {
+				case FlagOp::Add:
+				case FlagOp::Sub:
+				case FlagOp::Logic:
+					return lazy.cf ( );
+				default:
+					return cpu->rflags.CF;
+			}
+		}
+
+		bool flag_pf ( ) const noexcept {
+			return cpu->lazy_flags.op != FlagOp::None ? cpu->lazy_flags.pf ( ) : cpu->rflags.PF;
+		}
+
+		bool flag_zf ( ) const noexcept {
+			return cpu->lazy_flags.op != FlagOp::None ? cpu->lazy_flags.zf ( ) : cpu->rflags.ZF;
+		}
+
+		bool flag_sf ( ) const noexcept {
+			return cpu->lazy_flags.op != FlagOp::None ? cpu->lazy_flags.sf ( ) : cpu->rflags.SF;
+		}
+
+		bool flag_of ( ) const noexcept {
+			return cpu->lazy_flags.op != FlagOp::None ? cpu->lazy_flags.of ( ) : cpu->rflags.OF;
+		}
+
 		// Returns a mutable reference to cpu->mxcsr
 		x86::Mxcsr& get_mxcsr ( ) noexcept {
 			return cpu->mxcsr;
@@ -139,9 +330,7 @@ namespace kubera
 		void reconfigure ( uint64_t new_rip ) {
 			rip ( ) = new_rip;
 			std::size_t bytes_fetched = fetch_instruction_bytes ( new_rip, instr_buffer, 15 );
-			if ( bytes_fetched == 0 ) {
-				std::println ( "!!!!! FAILED TO FETCH INSTRUCTIONS" );
-			}
+			// A failed fetch is recorded as an EXEC fault at new_rip
 			decoder->reconfigure ( instr_buffer, bytes_fetched, new_rip );
 		}
 
@@ -175,21 +364,191 @@ namespace kubera
 		// Returns the value of a specified register
 		uint64_t get_reg ( Register reg, size_t size = 8 ) const noexcept;
 
+		// Operand descriptors of instr, or nullptr when it is not the instruction being dispatched
+		const LoweredOperands* lowered_operands ( const iced::Instruction& instr ) const noexcept {
+			return current_operands && current_operands->source == &instr ? current_operands : nullptr;
+		}
+
+		// Same as get_reg, for a register resolved at decode time
+		uint64_t get_reg ( LoweredRegister reg, size_t size = 8 ) const noexcept {
+			const auto shift = size == 1 ? reg.shift : 0;
+			return ( cpu->registers [ reg.index ] >> shift ) & GET_OPERAND_MASK ( size );
+		}
+
+		// Same as set_reg, for a register resolved at decode time
+		void set_reg ( LoweredRegister reg, uint64_t value, size_t size ) noexcept {
+			auto& full = cpu->registers [ reg.index ];
+			if ( size == 8 || ( size == 4 && reg.index <= KubRegister::R15 ) ) {
+				// 32-bit writes to GPRs zero the upper half
+				full = value & GET_OPERAND_MASK ( size );
+				return;
+			}
+			const auto shift = size == 1 ? reg.shift : 0;
+			const uint64_t mask = GET_OPERAND_MASK ( size ) << shift;
+			full = ( full & ~mask ) | ( ( value << shift ) & mask );
+		}
+
 		// Executes an instruction using the dispatch table
 		inline void execute ( const iced::Instruction& instr ) {
-			( *kubera::instruction_dispatch_table ) [ static_cast< size_t >( instr.mnemonic ( ) ) ] ( instr, *this );
+			bind_fault_slot ( );
+			scratch_operands = lower_operands ( instr );
+			scratch_operands.source = &instr;
+			current_operands = &scratch_operands;
+			current_block = nullptr;
+			if ( profiler ) [[unlikely]] {
+				const uint64_t begin = READ_TSC ( );
+				( *dispatch ) [ static_cast< size_t >( instr.mnemonic ( ) ) ] ( instr, *this );
+				profiler->record_instruction ( instr, READ_TSC ( ) - begin );
+				return;
+			}
+			( *dispatch ) [ static_cast< size_t >( instr.mnemonic ( ) ) ] ( instr, *this );
+		}
+
+		// Starts collecting into profiler, nullptr detaches. Takes effect from the next instruction or block.
+		void set_profiler ( Profiler* attached ) noexcept {
+			profiler = attached;
+		}
+
+		Profiler* get_profiler ( ) const noexcept {
+			return profiler;
+		}
+
+		// Most recent fault while this instance was executing, stays until the next fault or clear_fault.
+		// Compare memory's fault_count around a call to tell whether it faulted at all.
+		const MemoryFault& last_fault ( ) const noexcept {
+			return fault;
+		}
+
+		void clear_fault ( ) noexcept {
+			fault = { };
+		}
+
+		// Handlers SYSCALL dispatches to by the number in EAX, filled in by the platform layer
+		SyscallTable& syscall_table ( ) noexcept {
+			return syscalls;
+		}
+
+		// Handlers INT n, INT3 and INT1 dispatch to by vector
+		InterruptTable& interrupt_table ( ) noexcept {
+			return interrupts;
+		}
+
+		// Guest CPUID results from table instead of the host's, e.g. CpuidTable::profile ( VendorType::AMD ) or an edited capture
+		void set_cpuid_table ( std::shared_ptr<const CpuidTable> table ) noexcept {
+			cpuid_table = std::move ( table );
+		}
+
+		const CpuidTable& get_cpuid_table ( ) const noexcept {
+			return *cpuid_table;
+		}
+
+		// AFL-compatible edge coverage into map, which the caller owns (e.g. the fuzzer's shared memory). Every entry into
+		// a block bumps map[cur ^ prev], cur hashed from the block address and prev the previous cur >> 1.
+		// size must be a power of two, false otherwise. nullptr detaches.
+		bool set_coverage_map ( uint8_t* map, std::size_t size ) noexcept {
+			if ( map && ( size == 0 || ( size & ( size - 1 ) ) != 0 ) ) {
+				return false;
+			}
+			coverage_map = map;
+			coverage_mask = map ? size - 1 : 0;
+			coverage_prev = 0;
+			return true;
+		}
+
+		// Forgets the previous block, so the next edge starts from the entry as in a fresh AFL run. restore() does this too.
+		void reset_coverage_edge ( ) noexcept {
+			coverage_prev = 0;
 		}
 
 		iced::Instruction& emulate ( ) {
 			auto old_rip = rip ( );
-			reconfigure ( rip ( ) );
-			auto& instr = decoder->decode ( );
-			execute ( instr );
+			bind_fault_slot ( );
+			block_cache.collect ( );
+			sync_block_cache ( );
+			auto* decoded = next_decoded_instruction ( old_rip );
+			if ( !decoded ) {
+				reconfigure ( rip ( ) );
+				auto& instr = decoder->decode ( );
+				if ( trace_stream ) [[unlikely]] {
+					trace_stream->begin_step ( old_rip );
+				}
+				execute ( instr );
+				if ( rip ( ) == old_rip ) {
+					rip ( ) += instr.length ( );
+				}
+				increment_tsc ( );
+				if ( trace_stream ) [[unlikely]] {
+					trace_end_step ( );
+				}
+				return instr;
+			}
+
+			if ( decoded->exec_hook ) [[unlikely]] {
+				memory->dispatch_hooks ( old_rip, decoded->instr.length ( ), PageProtection::EXEC );
+				if ( rip ( ) != old_rip ) {
+					return decoded->instr;
+				}
+			}
+
+			if ( trace_stream ) [[unlikely]] {
+				trace_stream->begin_step ( old_rip );
+			}
+			current_operands = &decoded->operands;
+			current_block = block_cache.cursor_block;
+			if ( profiler ) [[unlikely]] {
+				const uint64_t begin = READ_TSC ( );
+				decoded->handler ( decoded->instr, *this );
+				profiler->record_instruction ( decoded->instr, READ_TSC ( ) - begin );
+			}
+			else {
+				decoded->handler ( decoded->instr, *this );
+			}
 			if ( rip ( ) == old_rip ) {
-				rip ( ) += instr.length ( );
+				rip ( ) += decoded->instr.length ( );
 			}
 			increment_tsc ( );
-			return instr;
+			if ( trace_stream ) [[unlikely]] {
+				trace_end_step ( );
+			}
+			return decoded->instr;
+		}
+
+		// Executes the cached basic block at RIP, returns the number of instructions executed
+		std::size_t run_block ( );
+
+		// Executes whole blocks until RIP reaches end_rip or max_instructions have run
+		std::size_t run_until ( uint64_t end_rip, std::size_t max_instructions = SIZE_MAX );
+
+		// Instructions between deadline checks of run, reading the clock per block would cost more than short blocks do
+		static constexpr std::size_t deadline_interval = 4096;
+
+		// Executes whole blocks until a limit in options is hit, the run is stopped, or execution cannot continue.
+		// Stop requests, deadlines and faults are only checked between blocks.
+		RunResult run ( const RunOptions& options );
+
+		RunResult run ( std::size_t budget ) {
+			return run ( RunOptions { .budget = budget } );
+		}
+
+		// Makes a run on another thread return StopRequested at its next block boundary.
+		// A request made while nothing runs stops the next run before its first block.
+		void request_stop ( ) noexcept {
+			stop_requested.store ( true, std::memory_order_relaxed );
+		}
+
+		// Ends the current run after the executing block, for handlers like HLT
+		void signal_stop ( StopReason reason ) noexcept {
+			pending_stop = reason;
+		}
+
+		// Drops all decoded blocks, e.g. after guest code has been modified
+		void flush_block_cache ( ) {
+			block_cache.flush ( );
+		}
+
+		// Drops decoded blocks overlapping [address, address + size)
+		void invalidate_blocks ( uint64_t address, std::size_t size ) {
+			block_cache.invalidate ( address, address + size );
 		}
 
 		// Template function to read data of specified type from memory
@@ -205,12 +564,23 @@ namespace kubera
 		// Template function to write data of specified type to memory
 		template <typename Type>
 		void write_type ( uint64_t address, Type val ) {
+			static_assert( !std::is_same_v<Type, float80_t>, "Use write_type_float80_t to write a float80_t" );
 			memory->write<Type> ( address, val );
 		}
 
+		// Writes 80-bit floating-point data to memory
+		void write_type_float80_t ( uint64_t address, const float80_t& value );
+
 		// Template function to read data from stack with bounds checking
 		template <typename Type>
-		Type get_stack ( uint64_t address ) const {
+		Type get_stack ( uint64_t address ) {
+			if constexpr ( std::is_same_v<Type, uint64_t> ) {
+				if ( const auto* slot = stack_slot ( address ) ) [[likely]] {
+					uint64_t value;
+					std::memcpy ( &value, slot, sizeof ( value ) );
+					return value;
+				}
+			}
 			if ( !is_within_stack_bounds ( address, sizeof ( Type ) ) ) {
 				// TODO: Implement exception handling
 				return Type ( 0 );
@@ -228,12 +598,38 @@ namespace kubera
 		// Sets the RFLAGS register
 		void set_rflags ( uint64_t rflags ) noexcept;
 
+		// Puts the CPU back into its initial state on the same stack, memory is left untouched
+		void reset_cpu ( );
+
+		// Captures CPU and memory state, memory pages are shared copy-on-write until written
+		[[nodiscard]] std::shared_ptr<const Snapshot> snapshot ( );
+
+		// Rewinds to snap. The address space is shared, so this also rewinds memory of other instances using it.
+		void restore ( const Snapshot& snap );
+
+		// Streams an incremental checkpoint into sink: the CPU state and only the pages that differ from base.
+		// False if the sink failed, what it already received is then incomplete.
+		bool serialize_checkpoint ( const Snapshot& base, CheckpointSink sink, trace::Compression compression = trace::Compression::None );
+		bool serialize_checkpoint ( const Snapshot& base, const std::filesystem::path& path, trace::Compression compression = trace::Compression::None );
+
+		// Restores base and applies a checkpoint serialized against it, so many checkpoints can share one base image.
+		// A checkpoint of another base is refused without touching the instance. On a truncated or corrupt one
+		// this returns false with memory partly loaded, restore base to continue from a known state.
+		bool load_checkpoint ( const Snapshot& base, CheckpointSource source );
+		bool load_checkpoint ( const Snapshot& base, const std::filesystem::path& path );
+
 		// Sets the value of a specified register
 		void set_reg ( Register reg, uint64_t val, size_t size );
 
 		// Template function to write data to stack with bounds checking
 		template <typename Type>
 		void set_stack ( uint64_t address, Type val ) {
+			if constexpr ( std::is_same_v<Type, uint64_t> ) {
+				if ( auto* slot = stack_slot ( address ) ) [[likely]] {
+					std::memcpy ( slot, &val, sizeof ( val ) );
+					return;
+				}
+			}
 			if ( !is_within_stack_bounds ( address, sizeof ( Type ) ) ) {
 				return;
 			}
@@ -241,6 +637,50 @@ namespace kubera
 			return write_type<Type> ( address, val );
 		}
 
+		// Host pointer to the quadword at address when its page is stack that reads and writes can go straight to, else nullptr.
+		// A hit is one compare against the cached stack page, the page lying within stack bounds covers the bounds check.
+		// Only valid until the next memory operation.
+		uint8_t* stack_slot ( uint64_t address ) {
+			const uint64_t offset = address - stack_window_page;
+			if ( offset <= memory->page_size - sizeof ( uint64_t ) && stack_window_generation == memory->tlb_generation ( ) ) [[likely]] {
+				return stack_window + offset;
+			}
+			return refill_stack_window ( address );
+		}
+
+		// Pushes a quadword, false when RSP - 8 is outside the stack and nothing changed
+		bool push_stack ( uint64_t value ) {
+			const uint64_t rsp = get_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( ) - sizeof ( uint64_t );
+			if ( auto* slot = stack_slot ( rsp ) ) [[likely]] {
+				std::memcpy ( slot, &value, sizeof ( value ) );
+			}
+			else if ( is_within_stack_bounds ( rsp, sizeof ( uint64_t ) ) ) {
+				write_type<uint64_t> ( rsp, value );
+			}
+			else {
+				return false;
+			}
+			set_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( rsp );
+			return true;
+		}
+
+		// Pops a quadword, RSP has moved past it by the time the caller writes value (as POP RSP and POP [RSP] expect).
+		// False when RSP is outside the stack and nothing changed.
+		bool pop_stack ( uint64_t& value ) {
+			const uint64_t rsp = get_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( );
+			if ( const auto* slot = stack_slot ( rsp ) ) [[likely]] {
+				std::memcpy ( &value, slot, sizeof ( value ) );
+			}
+			else if ( is_within_stack_bounds ( rsp, sizeof ( uint64_t ) ) ) {
+				value = read_type<uint64_t> ( rsp );
+			}
+			else {
+				return false;
+			}
+			set_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( rsp + sizeof ( uint64_t ) );
+			return true;
+		}
+
 		// Template function to write data to memory with permission checking
 		template <typename Type>
 		void set_memory ( uint64_t address, Type val ) {
@@ -250,6 +690,38 @@ namespace kubera
 		// Checks if an address is within stack bounds
 		bool is_within_stack_bounds ( uint64_t address, size_t size ) const noexcept;
 
+		// Index of an XMM, YMM or ZMM register in the vector register file
+		static constexpr std::size_t vector_index ( Register reg ) noexcept {
+			if ( reg >= Register::ZMM0 ) {
+				return static_cast< std::size_t >( reg ) - static_cast< std::size_t >( Register::ZMM0 );
+			}
+			if ( reg >= Register::YMM0 ) {
+				return static_cast< std::size_t >( reg ) - static_cast< std::size_t >( Register::YMM0 );
+			}
+			return static_cast< std::size_t >( reg ) - static_cast< std::size_t >( Register::XMM0 );
+		}
+
+		// Returns the native register backing an XMM, YMM or ZMM register
+		VectorRegister& get_vector ( Register reg ) noexcept {
+			return cpu->vector_registers [ vector_index ( reg ) ];
+		}
+
+		const VectorRegister& get_vector ( Register reg ) const noexcept {
+			return cpu->vector_registers [ vector_index ( reg ) ];
+		}
+
+		// Reads element index of type T from a vector register
+		template <typename T>
+		T get_vector_lane ( Register reg, std::size_t index ) const noexcept {
+			return get_vector ( reg ).lane<T> ( index );
+		}
+
+		// Writes element index of type T of a vector register, leaving the other elements untouched
+		template <typename T>
+		void set_vector_lane ( Register reg, std::size_t index, T value ) noexcept {
+			get_vector ( reg ).set_lane<T> ( index, value );
+		}
+
 		// Retrieves raw XMM register value
 		uint128_t get_xmm_raw ( Register reg ) const;
 
@@ -372,15 +844,18 @@ namespace kubera
 		}
 
 		x86::Flags rflags_dump ( ) const noexcept {
-			return cpu->rflags;
+			return evaluated_flags ( );
 		}
 
 		x86::Mxcsr mxcsr_dump ( ) const noexcept {
 			return cpu->mxcsr;
 		}
 
-		std::vector<std::string> get_register_changes ( const std::array<std::uint64_t, KubRegister::COUNT>& old_registers ) const;
-		std::vector<std::string> get_rflags_changes ( const x86::Flags& old_rflags ) const;
-		std::vector<std::string> get_mxcsr_changes ( const x86::Mxcsr& old_mxcsr ) const;
+		// Records the RIP, register and flag changes and memory accesses of every instruction executed from here on
+		// into stream, which belongs to this thread. Accesses are seen through a memory hook, so they include those
+		// made by other instances sharing the address space.
+		void start_trace ( TraceStream& stream );
+		// Stops recording and flushes the stream to its writer
+		void stop_trace ( );
 	};
 }
\ No newline at end of file
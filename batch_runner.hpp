@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "KUBERA.hpp"
+
+namespace kubera
+{
+	// A single emulation: the code image is mapped into the worker, entered at entry_offset
+	// with the given registers and runs until it returns, its instruction budget is spent or it times out
+	struct BatchJob {
+		// Jobs sharing the same image object skip reloading it (and keep their decoded blocks)
+		std::shared_ptr<const std::vector<uint8_t>> code;
+		uint64_t entry_offset { 0 };
+		// Full 64-bit registers to set before entry, everything else starts zeroed
+		std::vector<std::pair<Register, uint64_t>> registers;
+		// 0 uses the runner's default budget
+		std::size_t instruction_budget { 0 };
+		// Wall-clock limit, 0 uses the runner's default timeout (none unless one was given)
+		std::chrono::nanoseconds timeout { 0 };
+	};
+
+	enum class BatchStatus : uint8_t {
+		Returned, // The entry function returned to the runner
+		BudgetExhausted,
+		TimedOut,
+		Faulted, // Execution stopped before returning, e.g. on an unmapped fetch
+	};
+
+	struct BatchResult {
+		std::size_t job_index { 0 };
+		BatchStatus status { BatchStatus::Faulted };
+		std::size_t instructions { 0 };
+		// Worker context the job ran on, only valid for the duration of the callback
+		KUBERA* context { nullptr };
+	};
+
+	// Fixed pool of worker threads, each owning one KUBERA context and address space that is reused for every job it picks up.
+	// Guest memory is rewound to the freshly loaded image before each job, so jobs never see each other's writes.
+	class BatchRunner {
+	public:
+		// Called on the worker thread that ran the job, concurrently with other workers
+		using Callback = std::function<void ( const BatchResult& )>;
+
+		explicit BatchRunner ( std::size_t worker_count = std::thread::hardware_concurrency ( ), std::size_t default_budget = 1'000'000,
+			std::chrono::nanoseconds default_timeout = std::chrono::nanoseconds::zero ( ) );
+		~BatchRunner ( );
+
+		BatchRunner ( const BatchRunner& ) = delete;
+		BatchRunner& operator=( const BatchRunner& ) = delete;
+
+		// Runs every job and blocks until all of them have been reported through callback
+		void run ( const std::vector<BatchJob>& jobs, const Callback& callback );
+
+		std::size_t worker_count ( ) const noexcept {
+			return workers.size ( );
+		}
+
+	private:
+		struct Worker {
+			KUBERA context;
+			// Guest return address pushed before entry, run_until stops when it is reached
+			uint64_t return_address { 0 };
+			uint64_t code_base { 0 };
+			std::size_t code_capacity { 0 };
+			std::shared_ptr<const std::vector<uint8_t>> loaded_code;
+			// Taken right after loaded_code was mapped, restored before every later job on it
+			std::shared_ptr<const Snapshot> baseline;
+			std::thread thread;
+		};
+
+		void worker_loop ( Worker& worker );
+		void run_job ( Worker& worker, std::size_t index );
+		void load_code ( Worker& worker, const std::shared_ptr<const std::vector<uint8_t>>& code );
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::size_t default_budget;
+		std::chrono::nanoseconds default_timeout;
+
+		std::mutex mutex;
+		std::condition_variable start_cv;
+		std::condition_variable done_cv;
+		uint64_t generation { 0 };
+		std::size_t active_workers { 0 };
+		bool stopping { false };
+
+		// State of the batch in flight
+		const std::vector<BatchJob>* jobs { nullptr };
+		const Callback* callback { nullptr };
+		std::atomic<std::size_t> next_job { 0 };
+	};
+};
@@ -0,0 +1,325 @@
+#include "../KUBERA.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <print>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Instruction throughput suite. Every kernel is a leaf function entered like a call with
+// RCX and R9 = iterations, RSI/RDI = 64 KiB source/destination buffers and RDX = two doubles,
+// and runs until it returns. Micro kernels go through run_until (the block cache), macro
+// workloads through single-step emulate(). One JSON object per line is printed for each result.
+namespace
+{
+	// Dependent integer ALU chain
+	constexpr uint8_t alu_kernel [ ] = {
+		0x48, 0x01, 0xD8,             // 00: add rax, rbx
+		0x48, 0x31, 0xC3,             // 03: xor rbx, rax
+		0x48, 0x8D, 0x54, 0x58, 0x07, // 06: lea rdx, [rax+rbx*2+0x7]
+		0x48, 0x29, 0xD0,             // 0b: sub rax, rdx
+		0x48, 0xC1, 0xE3, 0x03,       // 0e: shl rbx, 0x3
+		0x48, 0xC1, 0xC0, 0x07,       // 12: rol rax, 0x7
+		0x48, 0x09, 0xDA,             // 16: or rdx, rbx
+		0x48, 0x21, 0xD0,             // 19: and rax, rdx
+		0x48, 0x6B, 0xD8, 0x0D,       // 1c: imul rbx, rax, 0xd
+		0x48, 0xFF, 0xC9,             // 20: dec rcx
+		0x75, 0xDB,                   // 23: jne 0x0
+		0xC3,                         // 25: ret
+	};
+
+	// Flag producers feeding adc/sbb, setcc and cmovcc
+	constexpr uint8_t flags_kernel [ ] = {
+		0x48, 0x01, 0xD8,       // 00: add rax, rbx
+		0x48, 0x83, 0xD2, 0x00, // 03: adc rdx, 0x0
+		0x41, 0x0F, 0x92, 0xC0, // 07: setb r8b
+		0x48, 0x39, 0xD0,       // 0b: cmp rax, rdx
+		0x4C, 0x0F, 0x4C, 0xC8, // 0e: cmovl r9, rax
+		0x4D, 0x19, 0xDA,       // 12: sbb r10, r11
+		0x41, 0x0F, 0x9F, 0xC0, // 15: setg r8b
+		0x48, 0x85, 0xD0,       // 19: test rax, rdx
+		0x4C, 0x0F, 0x44, 0xCA, // 1c: cmove r9, rdx
+		0x48, 0x83, 0xEB, 0x03, // 20: sub rbx, 0x3
+		0x48, 0xFF, 0xC9,       // 24: dec rcx
+		0x75, 0xD7,             // 27: jne 0x0
+		0xC3,                   // 29: ret
+	};
+
+	// Loads, a read-modify-write and stores through VirtualMemory over a 32 KiB working set
+	constexpr uint8_t memory_kernel [ ] = {
+		0x45, 0x31, 0xC0,                         // 00: xor r8d, r8d
+		0x4A, 0x8B, 0x04, 0xC6,                   // 03: mov rax, QWORD PTR [rsi+r8*8]
+		0x4A, 0x01, 0x04, 0xC7,                   // 07: add QWORD PTR [rdi+r8*8], rax
+		0x4A, 0x8B, 0x54, 0xC7, 0x08,             // 0b: mov rdx, QWORD PTR [rdi+r8*8+0x8]
+		0x4A, 0x89, 0x54, 0xC6, 0x08,             // 10: mov QWORD PTR [rsi+r8*8+0x8], rdx
+		0x49, 0x83, 0xC0, 0x02,                   // 15: add r8, 0x2
+		0x49, 0x81, 0xE0, 0xFF, 0x0F, 0x00, 0x00, // 19: and r8, 0xfff
+		0x48, 0xFF, 0xC9,                         // 20: dec rcx
+		0x75, 0xDE,                               // 23: jne 0x3
+		0xC3,                                     // 25: ret
+	};
+
+	// 4 KiB rep movsb plus a 4 KiB rep stosq per iteration
+	constexpr uint8_t rep_string_kernel [ ] = {
+		0x48, 0xC7, 0xC1, 0x00, 0x10, 0x00, 0x00, // 00: mov rcx, 0x1000
+		0x49, 0x89, 0xF2,                         // 07: mov r10, rsi
+		0x49, 0x89, 0xFB,                         // 0a: mov r11, rdi
+		0xF3, 0xA4,                               // 0d: rep movs BYTE PTR es:[rdi], BYTE PTR ds:[rsi]
+		0x4C, 0x89, 0xD6,                         // 0f: mov rsi, r10
+		0x4C, 0x89, 0xDF,                         // 12: mov rdi, r11
+		0x48, 0xC7, 0xC1, 0x00, 0x02, 0x00, 0x00, // 15: mov rcx, 0x200
+		0x31, 0xC0,                               // 1c: xor eax, eax
+		0xF3, 0x48, 0xAB,                         // 1e: rep stos QWORD PTR es:[rdi], rax
+		0x4C, 0x89, 0xDF,                         // 21: mov rdi, r11
+		0x49, 0xFF, 0xC9,                         // 24: dec r9
+		0x75, 0xD7,                               // 27: jne 0x0
+		0xC3,                                     // 29: ret
+	};
+
+	// SSE integer and packed single arithmetic
+	constexpr uint8_t simd_kernel [ ] = {
+		0xF3, 0x0F, 0x6F, 0x06,       // 00: movdqu xmm0, XMMWORD PTR [rsi]
+		0xF3, 0x0F, 0x6F, 0x4E, 0x10, // 04: movdqu xmm1, XMMWORD PTR [rsi+0x10]
+		0x66, 0x0F, 0xFE, 0xC1,       // 09: paddd xmm0, xmm1
+		0x66, 0x0F, 0xEF, 0xD0,       // 0d: pxor xmm2, xmm0
+		0x66, 0x0F, 0x70, 0xDA, 0x1B, // 11: pshufd xmm3, xmm2, 0x1b
+		0x66, 0x0F, 0xDB, 0xD8,       // 16: pand xmm3, xmm0
+		0x0F, 0x58, 0xE3,             // 1a: addps xmm4, xmm3
+		0x0F, 0x59, 0xEC,             // 1d: mulps xmm5, xmm4
+		0xF3, 0x0F, 0x7F, 0x1F,       // 20: movdqu XMMWORD PTR [rdi], xmm3
+		0x48, 0xFF, 0xC9,             // 24: dec rcx
+		0x75, 0xD7,                   // 27: jne 0x0
+		0xC3,                         // 29: ret
+	};
+
+	// x87 loads, multiply and popping stores
+	constexpr uint8_t x87_kernel [ ] = {
+		0xDD, 0x02,       // 00: fld QWORD PTR [rdx]
+		0xDD, 0x42, 0x08, // 02: fld QWORD PTR [rdx+0x8]
+		0xD8, 0xC9,       // 05: fmul st, st(1)
+		0xDD, 0x1F,       // 07: fstp QWORD PTR [rdi]
+		0xDD, 0x5F, 0x08, // 09: fstp QWORD PTR [rdi+0x8]
+		0x48, 0xFF, 0xC9, // 0c: dec rcx
+		0x75, 0xEF,       // 0f: jne 0x0
+		0xC3,             // 11: ret
+	};
+
+	// Data dependent branches driven by an LCG
+	constexpr uint8_t branches_kernel [ ] = {
+		0xB8, 0x39, 0x30, 0x00, 0x00,       // 00: mov eax, 0x3039
+		0x69, 0xC0, 0x6D, 0x4E, 0xC6, 0x41, // 05: imul eax, eax, 0x41c64e6d
+		0x05, 0x39, 0x30, 0x00, 0x00,       // 0b: add eax, 0x3039
+		0xA9, 0x00, 0x00, 0x01, 0x00,       // 10: test eax, 0x10000
+		0x74, 0x05,                         // 15: je 0x1c
+		0x48, 0xFF, 0xC3,                   // 17: inc rbx
+		0xEB, 0x03,                         // 1a: jmp 0x1f
+		0x48, 0xFF, 0xCB,                   // 1c: dec rbx
+		0x48, 0x83, 0xFB, 0x05,             // 1f: cmp rbx, 0x5
+		0x7C, 0x02,                         // 23: jl 0x27
+		0x31, 0xDB,                         // 25: xor ebx, ebx
+		0x48, 0xFF, 0xC9,                   // 27: dec rcx
+		0x75, 0xD9,                         // 2a: jne 0x5
+		0xC3,                               // 2c: ret
+	};
+
+	// Call and return of a leaf function
+	constexpr uint8_t call_ret_kernel [ ] = {
+		0xE8, 0x06, 0x00, 0x00, 0x00, // 00: call 0xb
+		0x48, 0xFF, 0xC9,             // 05: dec rcx
+		0x75, 0xF6,                   // 08: jne 0x0
+		0xC3,                         // 0a: ret
+		0x48, 0x83, 0xC0, 0x01,       // 0b: add rax, 0x1
+		0xC3,                         // 0f: ret
+	};
+
+	// qword copy loop over 32 KiB
+	constexpr uint8_t memcpy_kernel [ ] = {
+		0x49, 0x89, 0xF2,                         // 00: mov r10, rsi
+		0x49, 0x89, 0xFB,                         // 03: mov r11, rdi
+		0x48, 0xC7, 0xC1, 0x00, 0x10, 0x00, 0x00, // 06: mov rcx, 0x1000
+		0x49, 0x8B, 0x02,                         // 0d: mov rax, QWORD PTR [r10]
+		0x49, 0x89, 0x03,                         // 10: mov QWORD PTR [r11], rax
+		0x49, 0x83, 0xC2, 0x08,                   // 13: add r10, 0x8
+		0x49, 0x83, 0xC3, 0x08,                   // 17: add r11, 0x8
+		0x48, 0xFF, 0xC9,                         // 1b: dec rcx
+		0x75, 0xED,                               // 1e: jne 0xd
+		0x49, 0xFF, 0xC9,                         // 20: dec r9
+		0x75, 0xDB,                               // 23: jne 0x0
+		0xC3,                                     // 25: ret
+	};
+
+	// Bitwise CRC-32 over 4 KiB
+	constexpr uint8_t crc32_kernel [ ] = {
+		0xB8, 0xFF, 0xFF, 0xFF, 0xFF,             // 00: mov eax, 0xffffffff
+		0x49, 0x89, 0xF2,                         // 05: mov r10, rsi
+		0x48, 0xC7, 0xC1, 0x00, 0x10, 0x00, 0x00, // 08: mov rcx, 0x1000
+		0x41, 0x0F, 0xB6, 0x12,                   // 0f: movzx edx, BYTE PTR [r10]
+		0x31, 0xD0,                               // 13: xor eax, edx
+		0x41, 0xB8, 0x08, 0x00, 0x00, 0x00,       // 15: mov r8d, 0x8
+		0x89, 0xC2,                               // 1b: mov edx, eax
+		0x83, 0xE2, 0x01,                         // 1d: and edx, 0x1
+		0xF7, 0xDA,                               // 20: neg edx
+		0x81, 0xE2, 0x20, 0x83, 0xB8, 0xED,       // 22: and edx, 0xedb88320
+		0xD1, 0xE8,                               // 28: shr eax, 1
+		0x31, 0xD0,                               // 2a: xor eax, edx
+		0x41, 0xFF, 0xC8,                         // 2c: dec r8d
+		0x75, 0xEA,                               // 2f: jne 0x1b
+		0x49, 0xFF, 0xC2,                         // 31: inc r10
+		0x48, 0xFF, 0xC9,                         // 34: dec rcx
+		0x75, 0xD6,                               // 37: jne 0xf
+		0x49, 0xFF, 0xC9,                         // 39: dec r9
+		0x75, 0xC7,                               // 3c: jne 0x5
+		0xF7, 0xD0,                               // 3e: not eax
+		0xC3,                                     // 40: ret
+	};
+
+	// SHA-256 message schedule expansion of one block
+	constexpr uint8_t sha256_schedule_kernel [ ] = {
+		0xB9, 0x10, 0x00, 0x00, 0x00, // 00: mov ecx, 0x10
+		0x8B, 0x44, 0x8F, 0xC4,       // 05: mov eax, DWORD PTR [rdi+rcx*4-0x3c]
+		0x89, 0xC2,                   // 09: mov edx, eax
+		0xC1, 0xC8, 0x07,             // 0b: ror eax, 0x7
+		0x41, 0x89, 0xD0,             // 0e: mov r8d, edx
+		0x41, 0xC1, 0xC8, 0x12,       // 11: ror r8d, 0x12
+		0x44, 0x31, 0xC0,             // 15: xor eax, r8d
+		0xC1, 0xEA, 0x03,             // 18: shr edx, 0x3
+		0x31, 0xD0,                   // 1b: xor eax, edx
+		0x8B, 0x54, 0x8F, 0xF8,       // 1d: mov edx, DWORD PTR [rdi+rcx*4-0x8]
+		0x41, 0x89, 0xD0,             // 21: mov r8d, edx
+		0x41, 0xC1, 0xC8, 0x11,       // 24: ror r8d, 0x11
+		0x41, 0x89, 0xD2,             // 28: mov r10d, edx
+		0x41, 0xC1, 0xCA, 0x13,       // 2b: ror r10d, 0x13
+		0x45, 0x31, 0xD0,             // 2f: xor r8d, r10d
+		0xC1, 0xEA, 0x0A,             // 32: shr edx, 0xa
+		0x41, 0x31, 0xD0,             // 35: xor r8d, edx
+		0x44, 0x01, 0xC0,             // 38: add eax, r8d
+		0x03, 0x44, 0x8F, 0xE4,       // 3b: add eax, DWORD PTR [rdi+rcx*4-0x1c]
+		0x03, 0x44, 0x8F, 0xC0,       // 3f: add eax, DWORD PTR [rdi+rcx*4-0x40]
+		0x89, 0x04, 0x8F,             // 43: mov DWORD PTR [rdi+rcx*4], eax
+		0xFF, 0xC1,                   // 46: inc ecx
+		0x83, 0xF9, 0x40,             // 48: cmp ecx, 0x40
+		0x75, 0xB8,                   // 4b: jne 0x5
+		0x49, 0xFF, 0xC9,             // 4d: dec r9
+		0x75, 0xAE,                   // 50: jne 0x0
+		0xC3,                         // 52: ret
+	};
+	enum class Path {
+		RunUntil,
+		Emulate,
+	};
+
+	struct Benchmark {
+		std::string_view name;
+		std::span<const uint8_t> code;
+		uint64_t iterations;
+		Path path;
+	};
+
+	constexpr Benchmark benchmarks [ ] = {
+		{ "alu", alu_kernel, 2'000'000, Path::RunUntil },
+		{ "flags", flags_kernel, 2'000'000, Path::RunUntil },
+		{ "memory", memory_kernel, 2'000'000, Path::RunUntil },
+		{ "rep_string", rep_string_kernel, 20'000, Path::RunUntil },
+		{ "simd", simd_kernel, 1'000'000, Path::RunUntil },
+		{ "x87", x87_kernel, 1'000'000, Path::RunUntil },
+		{ "branches", branches_kernel, 2'000'000, Path::RunUntil },
+		{ "call_ret", call_ret_kernel, 2'000'000, Path::RunUntil },
+		{ "memcpy", memcpy_kernel, 200, Path::Emulate },
+		{ "crc32", crc32_kernel, 20, Path::Emulate },
+		{ "sha256_schedule", sha256_schedule_kernel, 4'000, Path::Emulate },
+	};
+
+	constexpr std::size_t buffer_size = 0x10000;
+
+	struct Result {
+		uint64_t instructions { 0 };
+		double seconds { 0 };
+		bool returned { false };
+	};
+
+	Result run ( const Benchmark& benchmark, uint64_t iterations ) {
+		using namespace kubera;
+
+		KUBERA context { };
+		const uint64_t code = context.load_memory ( benchmark.code.data ( ), benchmark.code.size ( ), PageProtection::READ | PageProtection::EXEC );
+		// Never executed, the final RET lands on it
+		const uint64_t return_address = context.alloc_memory ( 0x1000, PageProtection::READ | PageProtection::EXEC );
+		const uint64_t source = context.alloc_memory ( buffer_size, PageProtection::READ | PageProtection::WRITE );
+		const uint64_t destination = context.alloc_memory ( buffer_size, PageProtection::READ | PageProtection::WRITE );
+		const uint64_t constants = context.alloc_memory ( 0x1000, PageProtection::READ | PageProtection::WRITE );
+
+		auto* memory = context.get_virtual_memory ( );
+		std::vector<uint8_t> pattern ( buffer_size );
+		for ( std::size_t i = 0; i < pattern.size ( ); ++i ) {
+			pattern [ i ] = static_cast< uint8_t >( i * 131 + 7 );
+		}
+		memory->write_bytes ( source, pattern.data ( ), pattern.size ( ) );
+		memory->write_bytes ( destination, pattern.data ( ), pattern.size ( ) );
+		memory->write<double> ( constants, 1.0000001 );
+		memory->write<double> ( constants + 8, 0.9999999 );
+
+		context.set_reg ( Register::RCX, iterations, 8 );
+		context.set_reg ( Register::R9, iterations, 8 );
+		context.set_reg ( Register::RSI, source, 8 );
+		context.set_reg ( Register::RDI, destination, 8 );
+		context.set_reg ( Register::RDX, constants, 8 );
+		context.set_reg ( Register::RBX, 0x9E3779B97F4A7C15, 8 );
+		const uint64_t rsp = context.stack_limit ( ) - 0x28;
+		context.set_reg ( Register::RSP, rsp, 8 );
+		context.set_stack<uint64_t> ( rsp, return_address );
+		context.rip ( ) = code;
+
+		Result result;
+		const auto start = std::chrono::steady_clock::now ( );
+		if ( benchmark.path == Path::RunUntil ) {
+			result.instructions = context.run_until ( return_address );
+		}
+		else {
+			while ( context.rip ( ) != return_address ) {
+				const uint64_t before = context.rip ( );
+				context.emulate ( );
+				++result.instructions;
+				// Stuck on an instruction that cannot be fetched or executed
+				if ( context.rip ( ) == before ) {
+					break;
+				}
+			}
+		}
+		result.seconds = std::chrono::duration<double> ( std::chrono::steady_clock::now ( ) - start ).count ( );
+		result.returned = context.rip ( ) == return_address;
+		return result;
+	}
+}
+
+int main ( int argc, char** argv ) {
+	// kubera_bench [--scale <factor>] [name...]
+	double scale = 1.0;
+	std::vector<std::string_view> selected;
+	for ( int i = 1; i < argc; ++i ) {
+		const std::string_view arg = argv [ i ];
+		if ( arg == "--scale" && i + 1 < argc ) {
+			scale = std::strtod ( argv [ ++i ], nullptr );
+		}
+		else {
+			selected.push_back ( arg );
+		}
+	}
+
+	bool all_returned = true;
+	for ( const auto& benchmark : benchmarks ) {
+		if ( !selected.empty ( ) && std::ranges::find ( selected, benchmark.name ) == selected.end ( ) ) {
+			continue;
+		}
+
+		const auto iterations = std::max<uint64_t> ( static_cast< uint64_t >( static_cast< double >( benchmark.iterations ) * scale ), 1 );
+		const auto result = run ( benchmark, iterations );
+		const double rate = result.seconds > 0 ? static_cast< double >( result.instructions ) / result.seconds : 0.0;
+		std::println ( R"({{"benchmark":"{}","path":"{}","iterations":{},"instructions":{},"seconds":{:.6f},"instructions_per_second":{:.0f},"completed":{}}})",
+			benchmark.name, benchmark.path == Path::RunUntil ? "run_until" : "emulate", iterations, result.instructions, result.seconds, rate,
+			result.returned );
+		all_returned &= result.returned;
+	}
+	return all_returned ? 0 : 1;
+}
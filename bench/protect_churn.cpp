@@ -0,0 +1,48 @@
+#include "../memory.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <print>
+#include <random>
+
+// Guard page / JIT style VirtualProtect churn over one large allocation, the pattern
+// that used to fragment the region map into one entry per page
+int main ( int argc, char** argv ) {
+	using namespace kubera;
+	using clock = std::chrono::steady_clock;
+
+	const std::size_t heap_size = ( argc > 1 ? std::strtoull ( argv [ 1 ], nullptr, 0 ) : 256 ) * 1024 * 1024;
+	const std::size_t iterations = argc > 2 ? std::strtoull ( argv [ 2 ], nullptr, 0 ) : 200'000;
+
+	VirtualMemory memory;
+	const uint64_t heap = memory.alloc ( heap_size, PageProtection::READ | PageProtection::WRITE );
+	const std::size_t pages = heap_size / memory.page_size;
+
+	std::mt19937_64 rng ( 0x4B5542455241ull );
+	std::uniform_int_distribution<std::size_t> page_dist ( 0, pages - 1 );
+	std::uniform_int_distribution<std::size_t> span_dist ( 1, 16 );
+
+	auto start = clock::now ( );
+	for ( std::size_t i = 0; i < iterations; ++i ) {
+		const std::size_t first = page_dist ( rng );
+		const std::size_t count = std::min ( span_dist ( rng ), pages - first );
+		const uint64_t addr = heap + first * memory.page_size;
+		memory.protect ( addr, count * memory.page_size, PageProtection::READ );
+		memory.protect ( addr, count * memory.page_size, PageProtection::READ | PageProtection::WRITE );
+	}
+	const std::chrono::duration<double> toggled = clock::now ( ) - start;
+
+	start = clock::now ( );
+	memory.protect ( heap, heap_size, PageProtection::READ );
+	memory.protect ( heap, heap_size, PageProtection::READ | PageProtection::WRITE );
+	const std::chrono::duration<double> whole = clock::now ( ) - start;
+
+	start = clock::now ( );
+	memory.free ( heap, heap_size );
+	const std::chrono::duration<double> freed = clock::now ( ) - start;
+
+	std::println ( "heap {} MiB, {} protect pairs: {:.3f} s ({:.0f} ns/call)", heap_size >> 20, iterations, toggled.count ( ),
+		toggled.count ( ) * 1e9 / static_cast< double >( iterations * 2 ) );
+	std::println ( "whole heap protect pair: {:.3f} ms", whole.count ( ) * 1e3 );
+	std::println ( "free: {:.3f} ms", freed.count ( ) * 1e3 );
+	return 0;
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "iced.hpp"
+
+namespace kubera
+{
+	// Type alias for instruction handler function
+	using InstructionHandler = void ( * ) ( const iced::Instruction&, class KUBERA& state );
+
+	// Register operand resolved to its slot in the CPU register file
+	struct LoweredRegister {
+		uint8_t index { 0 };
+		// 8 for AH/BH/CH/DH, only applied to byte accesses
+		uint8_t shift { 0 };
+	};
+
+	enum class AddressMode : uint8_t {
+		Displacement, // Absolute or RIP-relative, the target is folded into the displacement
+		Base,
+		Index,
+		BaseIndex,
+	};
+
+	// Decode-time view of an instruction's operands, so handlers skip the Register
+	// to register file mapping and the addressing mode checks on every execution
+	struct LoweredOperands {
+		static constexpr std::size_t max_operands = 4;
+
+		struct Operand {
+			OpKindSimple kind { OpKindSimple::Invalid };
+			uint8_t size { 0 };
+			LoweredRegister reg { };
+		};
+
+		// Instruction these were lowered from, helpers fall back to the iced accessors for any other
+		const iced::Instruction* source { nullptr };
+		std::array<Operand, max_operands> operands { };
+
+		AddressMode mode { AddressMode::Displacement };
+		bool has_segment { false };
+		uint8_t scale { 1 };
+		LoweredRegister base { };
+		LoweredRegister index { };
+		LoweredRegister segment { };
+		uint64_t displacement { 0 };
+	};
+
+	// Lowers the operands of instr, source is left for the caller to set once instr has its final address
+	LoweredOperands lower_operands ( const iced::Instruction& instr );
+
+	struct DecodedInstruction;
+
+	// Superinstruction standing in for a decoded instruction and the one after it, e.g. cmp + jcc
+	using FusedHandler = void ( * ) ( const DecodedInstruction& first, const DecodedInstruction& second, class KUBERA& state );
+
+	// A decoded instruction together with the handler resolved from the dispatch table
+	struct DecodedInstruction {
+		iced::Instruction instr;
+		InstructionHandler handler { nullptr };
+		// Runs this instruction and the next one at once, handler still covers this one alone
+		FusedHandler fused { nullptr };
+		// An exec hook covers the instruction's bytes, resolved at decode time so unhooked code never looks
+		bool exec_hook { false };
+		LoweredOperands operands { };
+	};
+
+	struct BasicBlock;
+
+	// Edge to the block starting at address. Only followed while the cache has retired no block and no page
+	// protection changed since it was made, so a live link also vouches that address is still executable.
+	struct BlockLink {
+		uint64_t address { UINT64_MAX };
+		BasicBlock* target { nullptr };
+		uint64_t cache_generation { 0 };
+		uint64_t protection_sequence { 0 };
+
+		bool live ( uint64_t addr, uint64_t cache_gen, uint64_t protection_seq ) const noexcept {
+			return address == addr && target && cache_generation == cache_gen && protection_sequence == protection_seq;
+		}
+	};
+
+	// A straight-line run of decoded guest instructions, terminated by the first
+	// instruction that can change control flow (or by the block size limit)
+	struct BasicBlock {
+		uint64_t start { 0 };
+		uint64_t end { 0 };
+		std::vector<DecodedInstruction> instructions;
+
+		// Successors patched in as execution leaves the block: the target of a terminating direct
+		// branch or call, and the instruction after the block
+		BlockLink taken { };
+		BlockLink fallthrough { };
+		// Inline target cache of a terminating RET or indirect branch, replaced round robin
+		bool indirect_exit { false };
+		std::array<BlockLink, 2> indirect { };
+		uint8_t indirect_victim { 0 };
+
+		BasicBlock* linked ( uint64_t address, uint64_t cache_generation, uint64_t protection_sequence ) const noexcept {
+			if ( taken.live ( address, cache_generation, protection_sequence ) ) {
+				return taken.target;
+			}
+			if ( fallthrough.live ( address, cache_generation, protection_sequence ) ) {
+				return fallthrough.target;
+			}
+			for ( const auto& link : indirect ) {
+				if ( link.live ( address, cache_generation, protection_sequence ) ) {
+					return link.target;
+				}
+			}
+			return nullptr;
+		}
+
+		void link ( BasicBlock& target, uint64_t cache_generation, uint64_t protection_sequence ) {
+			const BlockLink edge { target.start, &target, cache_generation, protection_sequence };
+			if ( target.start == taken.address ) {
+				taken = edge;
+			}
+			else if ( target.start == fallthrough.address ) {
+				fallthrough = edge;
+			}
+			else if ( indirect_exit ) {
+				indirect [ indirect_victim ] = edge;
+				indirect_victim = ( indirect_victim + 1 ) % indirect.size ( );
+			}
+		}
+	};
+
+	// Translation cache of decoded basic blocks, keyed on the guest address of their first instruction
+	class BlockCache {
+	public:
+		static constexpr std::size_t max_block_instructions = 64;
+		static constexpr std::size_t max_blocks = 0x10000;
+		static constexpr uint64_t index_granularity = 0x1000;
+
+		BasicBlock* find ( uint64_t address ) {
+			auto it = blocks.find ( address );
+			return it == blocks.end ( ) ? nullptr : it->second.get ( );
+		}
+
+		BasicBlock* insert ( std::unique_ptr<BasicBlock> block ) {
+			if ( blocks.size ( ) >= max_blocks ) {
+				flush ( );
+			}
+			auto* raw = block.get ( );
+			for ( uint64_t granule = raw->start & ~( index_granularity - 1 ); granule < raw->end; granule += index_granularity ) {
+				granule_index [ granule ].push_back ( raw->start );
+			}
+			blocks [ raw->start ] = std::move ( block );
+			return raw;
+		}
+
+		// Retires every block overlapping [start, end)
+		void invalidate ( uint64_t start, uint64_t end ) {
+			for ( uint64_t granule = start & ~( index_granularity - 1 ); granule < end; granule += index_granularity ) {
+				auto index_it = granule_index.find ( granule );
+				if ( index_it == granule_index.end ( ) ) {
+					continue;
+				}
+				for ( const auto block_start : index_it->second ) {
+					auto it = blocks.find ( block_start );
+					if ( it == blocks.end ( ) || it->second->start >= end || start >= it->second->end ) {
+						continue;
+					}
+					if ( it->second.get ( ) == cursor_block ) {
+						cursor_block = nullptr;
+					}
+					++generation;
+					retired.push_back ( std::move ( it->second ) );
+					blocks.erase ( it );
+				}
+				granule_index.erase ( index_it );
+			}
+		}
+
+		void flush ( ) {
+			for ( auto& [address, block] : blocks ) {
+				retired.push_back ( std::move ( block ) );
+			}
+			blocks.clear ( );
+			granule_index.clear ( );
+			cursor_block = nullptr;
+			++generation;
+		}
+
+		// Frees retired blocks. Only call this while no handler is running, since
+		// handlers hold references to the instruction they were dispatched with.
+		void collect ( ) {
+			retired.clear ( );
+		}
+
+		std::size_t size ( ) const noexcept {
+			return blocks.size ( );
+		}
+
+		// Position of the next instruction for single-stepping through a cached block
+		BasicBlock* cursor_block { nullptr };
+		std::size_t cursor_index { 0 };
+
+		// Last VirtualMemory code write sequence the cache was invalidated against
+		uint64_t synced_sequence { 0 };
+
+		// Bumped whenever a block is retired, which breaks every link made before
+		uint64_t generation { 1 };
+
+	private:
+		std::unordered_map<uint64_t, std::unique_ptr<BasicBlock>> blocks;
+		std::vector<std::unique_ptr<BasicBlock>> retired;
+		// Start addresses of the blocks overlapping each granule, may hold stale entries
+		std::unordered_map<uint64_t, std::vector<uint64_t>> granule_index;
+	};
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "trace.hpp"
+
+namespace kubera
+{
+	// Incremental checkpoint layout, all integers little-endian:
+	//   header  "KUBCKPT\0", u16 version, u8 compression, u8 reserved, u64 base fingerprint, u32 page size
+	//   body    records, zstd-compressed as a whole when requested
+	// A checkpoint only holds what differs from the snapshot it was taken against, loading it needs that same base.
+	// The body is a Cpu record, a Layout record, Page and Unmap records in ascending address order, then End.
+	namespace checkpoint
+	{
+		constexpr std::array<char, 8> magic = { 'K', 'U', 'B', 'C', 'K', 'P', 'T', '\0' };
+		constexpr uint16_t format_version = 1;
+
+		enum class RecordKind : uint8_t {
+			Cpu = 1, // GPRs and stack bounds as varint XOR with the base CPU, the other fields as is, then the FPU, non-zero vector registers and shadow stack
+			Layout, // varint region count, the regions, varint next_alloc
+			Page, // varint page number delta to the previous page record, u8 protection, u8 PageContents, page bytes for Data
+			Unmap, // varint page number delta, the page is mapped in the base but no longer
+			End,
+		};
+
+		// FNV-1a over the bytes of value, base fingerprints have to match across hosts and runs unlike std::hash
+		constexpr uint64_t fnv_offset = 0xCBF29CE484222325ULL;
+
+		inline void mix ( uint64_t& hash, uint64_t value ) noexcept {
+			for ( int i = 0; i < 8; ++i ) {
+				hash ^= static_cast< uint8_t >( value >> ( i * 8 ) );
+				hash *= 0x100000001B3ULL;
+			}
+		}
+
+		// mix for bulk data a word at a time, size is a multiple of 8
+		inline void mix_words ( uint64_t& hash, const uint8_t* data, std::size_t size ) noexcept {
+			for ( std::size_t offset = 0; offset < size; offset += sizeof ( uint64_t ) ) {
+				uint64_t word;
+				std::memcpy ( &word, data + offset, sizeof ( word ) );
+				hash = ( hash ^ word ) * 0x100000001B3ULL;
+			}
+		}
+
+		enum class PageContents : uint8_t {
+			Base, // the base snapshot's frame, only the protection changed
+			Uncommitted,
+			Zero,
+			Data,
+		};
+	}
+
+	// Receives the bytes of a checkpoint, false stops the write
+	using CheckpointSink = std::function<bool ( const void* data, std::size_t size )>;
+	// Fills up to size bytes, returns how many it read and 0 at the end of the input
+	using CheckpointSource = std::function<std::size_t ( void* data, std::size_t size )>;
+
+	// Buffered encoder of one checkpoint body, compressing it when requested
+	class CheckpointWriter {
+	public:
+		CheckpointWriter ( CheckpointSink sink, trace::Compression compression, uint64_t base_fingerprint, uint32_t page_size );
+		~CheckpointWriter ( );
+		CheckpointWriter ( const CheckpointWriter& ) = delete;
+		CheckpointWriter& operator=( const CheckpointWriter& ) = delete;
+
+		void put ( uint8_t byte ) {
+			buffer.push_back ( byte );
+			if ( buffer.size ( ) >= flush_threshold ) [[unlikely]] {
+				flush ( false );
+			}
+		}
+		void put_varint ( uint64_t value );
+		void put_bytes ( const void* data, std::size_t size );
+
+		// Writes out everything buffered and ends the compressed frame. False if any write failed.
+		bool finish ( );
+
+	private:
+		static constexpr std::size_t flush_threshold = 0x10000;
+
+		void flush ( bool end );
+		void write_out ( const void* data, std::size_t size );
+
+		CheckpointSink sink;
+		std::vector<uint8_t> buffer;
+		std::vector<uint8_t> compressed;
+		void* zstd_context { nullptr };
+		bool ok { true };
+	};
+
+	// Decoder of one checkpoint, the header is read and checked on construction
+	class CheckpointReader {
+	public:
+		explicit CheckpointReader ( CheckpointSource source );
+		~CheckpointReader ( );
+		CheckpointReader ( const CheckpointReader& ) = delete;
+		CheckpointReader& operator=( const CheckpointReader& ) = delete;
+
+		// False for a bad header, or a compressed body when KUBERA was built without KUBERA_TRACE_ZSTD
+		[[nodiscard]] bool is_open ( ) const noexcept {
+			return open;
+		}
+
+		[[nodiscard]] uint64_t base_fingerprint ( ) const noexcept {
+			return fingerprint;
+		}
+
+		[[nodiscard]] uint32_t page_size ( ) const noexcept {
+			return checkpoint_page_size;
+		}
+
+		bool get ( uint8_t& byte );
+		bool get_varint ( uint64_t& value );
+		bool get_bytes ( void* data, std::size_t size );
+
+	private:
+		bool refill ( );
+
+		CheckpointSource source;
+		std::vector<uint8_t> input;
+		std::size_t input_pos { 0 };
+		std::size_t input_size { 0 };
+		std::vector<uint8_t> raw;
+		std::size_t raw_pos { 0 };
+		std::size_t raw_size { 0 };
+		void* zstd_context { nullptr };
+		uint64_t fingerprint { 0 };
+		uint32_t checkpoint_page_size { 0 };
+		bool open { false };
+	};
+};
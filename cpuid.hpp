@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "configuration.hpp"
+
+namespace kubera
+{
+	struct CpuidLeaf {
+		uint32_t eax { 0 };
+		uint32_t ebx { 0 };
+		uint32_t ecx { 0 };
+		uint32_t edx { 0 };
+	};
+
+	// Register a CPUID feature bit is reported in
+	enum class CpuidRegister : uint8_t {
+		EAX,
+		EBX,
+		ECX,
+		EDX,
+	};
+
+	// Guest CPUID results, answered from the table instead of the host CPU.
+	// Built once and immutable while instances use it, so any number of them can share one.
+	class CpuidTable {
+	public:
+		// Copy of the host's basic and extended leaves, with the subleaves of the leaves that take one.
+		// Captured once per process, on hosts without CPUID this is the Intel profile.
+		static std::shared_ptr<const CpuidTable> host ( );
+
+		// Synthetic CPU of the given vendor, reporting the extensions KUBERA emulates (through AVX-512 and APX)
+		static CpuidTable profile ( VendorType vendor );
+
+		// Result of CPUID with eax=leaf and ecx=subleaf. Leaves above the maximum of their range
+		// behave as on hardware of the table's vendor: Intel repeats the highest basic leaf, AMD returns zeros.
+		[[nodiscard]] CpuidLeaf query ( uint32_t leaf, uint32_t subleaf ) const;
+
+		// Sets leaf, subleaf. indexed marks a leaf whose result depends on the subleaf, others ignore ecx.
+		void set ( uint32_t leaf, uint32_t subleaf, const CpuidLeaf& value, bool indexed = false );
+
+		// Sets or clears one feature bit, e.g. ( 7, 0, CpuidRegister::EBX, 16 ) for AVX512F
+		void set_feature ( uint32_t leaf, uint32_t subleaf, CpuidRegister reg, uint8_t bit, bool enabled );
+
+		// XCR0 as the guest OS would have set it: every state component leaf 0xD lists as supported
+		[[nodiscard]] uint64_t xcr0 ( ) const;
+
+		[[nodiscard]] VendorType vendor ( ) const noexcept {
+			return vendor_type;
+		}
+
+	private:
+		struct Leaf {
+			bool indexed { false };
+			std::vector<CpuidLeaf> subleaves;
+		};
+
+		std::unordered_map<uint32_t, Leaf> leaves;
+		VendorType vendor_type { VendorType::INTEL };
+	};
+};
@@ -181,6 +181,11 @@ namespace kubera
     void movsd ( const iced::Instruction& instr, KUBERA& context );
     void movsq ( const iced::Instruction& instr, KUBERA& context );
     void stos ( const iced::Instruction& instr, KUBERA& context );
+    void cmpsb ( const iced::Instruction& instr, KUBERA& context );
+    void cmpsw ( const iced::Instruction& instr, KUBERA& context );
+    void cmpsd ( const iced::Instruction& instr, KUBERA& context );
+    void cmpsq ( const iced::Instruction& instr, KUBERA& context );
+    void scas ( const iced::Instruction& instr, KUBERA& context );
 
     // SIMD Instructions
     void vpxor ( const iced::Instruction& instr, KUBERA& context );
@@ -207,6 +212,25 @@ namespace kubera
     void paddd(const iced::Instruction& instr, KUBERA& context);
     void paddq(const iced::Instruction& instr, KUBERA& context);
 
+    void pxor ( const iced::Instruction& instr, KUBERA& context );
+    void pand ( const iced::Instruction& instr, KUBERA& context );
+    void pandn ( const iced::Instruction& instr, KUBERA& context );
+    void por ( const iced::Instruction& instr, KUBERA& context );
+    void pcmpeqb ( const iced::Instruction& instr, KUBERA& context );
+    void pcmpeqw ( const iced::Instruction& instr, KUBERA& context );
+    void pcmpeqd ( const iced::Instruction& instr, KUBERA& context );
+    void vpand ( const iced::Instruction& instr, KUBERA& context );
+    void vpandn ( const iced::Instruction& instr, KUBERA& context );
+    void vpor ( const iced::Instruction& instr, KUBERA& context );
+    void vpcmpeqb ( const iced::Instruction& instr, KUBERA& context );
+    void vpcmpeqd ( const iced::Instruction& instr, KUBERA& context );
+    void pshufd ( const iced::Instruction& instr, KUBERA& context );
+    void vpshufd ( const iced::Instruction& instr, KUBERA& context );
+    void vpbroadcastb ( const iced::Instruction& instr, KUBERA& context );
+    void vpbroadcastw ( const iced::Instruction& instr, KUBERA& context );
+    void vpbroadcastd ( const iced::Instruction& instr, KUBERA& context );
+    void vpbroadcastq ( const iced::Instruction& instr, KUBERA& context );
+
     // Floating-Point Instructions
     void addss ( const iced::Instruction& instr, KUBERA& context );
     void subss ( const iced::Instruction& instr, KUBERA& context );
@@ -217,6 +241,12 @@ namespace kubera
     void andps ( const iced::Instruction& instr, KUBERA& context );
     void orps ( const iced::Instruction& instr, KUBERA& context );
     void xorps ( const iced::Instruction& instr, KUBERA& context );
+    void addps ( const iced::Instruction& instr, KUBERA& context );
+    void subps ( const iced::Instruction& instr, KUBERA& context );
+    void mulps ( const iced::Instruction& instr, KUBERA& context );
+    void vaddps ( const iced::Instruction& instr, KUBERA& context );
+    void vsubps ( const iced::Instruction& instr, KUBERA& context );
+    void vmulps ( const iced::Instruction& instr, KUBERA& context );
     void sqrtss ( const iced::Instruction& instr, KUBERA& context );
     void sqrtsd ( const iced::Instruction& instr, KUBERA& context );
     void comiss ( const iced::Instruction& instr, KUBERA& context );
@@ -246,5 +276,7 @@ namespace kubera
 
     // Miscellaneous Instructions
     void nop ( const iced::Instruction& instr, KUBERA& context );
+    // Fallback for every mnemonic without a handler, logs and skips the instruction
+    void unsupported_instruction ( const iced::Instruction& instr, KUBERA& context );
   };
 };
\ No newline at end of file
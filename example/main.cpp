@@ -1,7 +1,6 @@
 #include <KUBERA/KUBERA.hpp>
 #include <print>
 #include <sstream>
-#include <chrono>
 #include <Windows.h>
 
 /*
@@ -34,67 +33,12 @@ e:  48 c1 c9 0b             ror    rcx,0xb
 86: c3                      ret
 */
 const uint8_t test_fn [ ] = { 0x48, 0x01, 0xD1, 0x48, 0xC1, 0xC1, 0x05, 0x48, 0x81, 0xE1, 0xAA, 0xAA, 0x00, 0x00, 0x48, 0xC1, 0xC9, 0x0B, 0x48, 0x81, 0xF1, 0xF0, 0xF0, 0x00, 0x00, 0x48, 0xC1, 0xD1, 0x0D, 0x48, 0x81, 0xC9, 0xCC, 0xCC, 0x00, 0x00, 0x48, 0xC1, 0xE1, 0x08, 0x48, 0x81, 0xE1, 0x55, 0x55, 0x00, 0x00, 0x48, 0xC1, 0xD1, 0x03, 0x48, 0x81, 0xF1, 0xA5, 0xA5, 0x00, 0x00, 0x48, 0xF7, 0xD1, 0x48, 0x81, 0xC9, 0xFF, 0xFF, 0x00, 0x00, 0x48, 0x83, 0xF1, 0x1F, 0x48, 0xC1, 0xE1, 0x04, 0x48, 0x81, 0xE1, 0xAA, 0xAA, 0x00, 0x00, 0x48, 0xC1, 0xE9, 0x07, 0x48, 0xC1, 0xC1, 0x09, 0x48, 0x81, 0xF1, 0x3C, 0x3C, 0x3C, 0x3C, 0x48, 0xC1, 0xE9, 0x02, 0x48, 0x81, 0xC9, 0xFF, 0xFF, 0x00, 0x00, 0x48, 0xC1, 0xC9, 0x06, 0x48, 0x81, 0xE1, 0xF5, 0xF5, 0x00, 0x00, 0x48, 0xC1, 0xE1, 0x05, 0x48, 0x81, 0xF1, 0x5A, 0x5A, 0x00, 0x00, 0x48, 0x89, 0xC8, 0xC3 };
-const uint8_t benchmark_fn [ ] = {
-	0x48, 0x01, 0xD1,				// add rcx, rdx
-	0x48, 0xC1, 0xD1, 0x0D, // rcl rcx, 0xd
-	0x48, 0xF7, 0xD1,				// not rcx
-	0x48, 0x89, 0xC8,				// mov rax, rcx
-};
-
-// This function is a benchmark for the emulation speed.
-void run_emulation_loop ( kubera::KUBERA& ctx, const uint8_t* test_fn, size_t test_fn_size, uint64_t flags_before_running ) {
-	uint64_t instruction_count = 0;
-	auto start_time = std::chrono::high_resolution_clock::now ( );
-	while ( true ) {
-		auto current_time = std::chrono::high_resolution_clock::now ( );
-		auto elapsed_seconds = std::chrono::duration_cast< std::chrono::duration<double> > (
-				current_time - start_time ).count ( );
-
-		if ( elapsed_seconds >= 10.0 ) {
-			break;
-		}
-
-		// We configure the decoder to the start of the shellcode.
-		ctx.decoder->reconfigure ( test_fn, test_fn_size, 0 );
-		// We use set_reg_internal here because we are aware of exactly which registers we want to set,
-		// reducing overhead for getting the correct bits of a 64-bit register
-		ctx.set_reg_internal<kubera::KubRegister::RCX, Register::RCX, uint32_t> ( 0xFFAA );
-		ctx.set_reg_internal<kubera::KubRegister::RDX, Register::RDX, uint32_t> ( 0x0055 );
-		// We reset the EFlags, so the state is reset properly for every iteration
-		ctx.get_flags ( ).value = flags_before_running;
-		// We are only emulating 4 instructions.
-		for ( auto i = 0u; i < 4u; ++i ) {
-			// We decode the instruction with Iced
-			auto instr = ctx.decoder->decode ( );
-			// We execute the instruction within out emulation context
-			ctx.execute ( instr );
-		}
-
-		instruction_count += 4;
-	}
-
-	auto end_time = std::chrono::high_resolution_clock::now ( );
-	auto total_seconds = std::chrono::duration_cast< std::chrono::duration<double> > (
-			end_time - start_time ).count ( );
-	double instructions_per_second = instruction_count / total_seconds;
-
-	std::println ( "Total instructions executed: {}", instruction_count );
-	std::println ( "Total time elapsed: {:.2f} seconds", total_seconds );
-	std::println ( "Instructions per second: {:.2f}", instructions_per_second );
-}
-
-
 /// The following function executes a function on hardware, capturing the result and flags.
 /// Then, it runs the same function with the same entry flags and parameters with the emulator and shows the results.
 int main ( ) {
 	std::println ( "[+] Initializing KUBERA - Windows example" );
-	// Currently, the function is for running a benchmark
+	// Emulation throughput is measured by the kubera_bench target (bench/kubera_bench.cpp)
 	kubera::KUBERA ctx {};
-	run_emulation_loop ( ctx, benchmark_fn, sizeof ( benchmark_fn ), __readeflags ( ) );
-	std::getchar ( );
-	// Comment the emulation loop & getchar, along with the return underneath to test the emulator against hardware
-	// on Windows.
-	return 1;
 	// Generic way to set a register's value
 	ctx.set_reg ( Register::RCX, 0xFFAA, 4 );
 	ctx.set_reg ( Register::RDX, 0x0055, 4 );
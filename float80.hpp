@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#if defined(KUBERA_HOST_X87)
+#if defined(_MSC_VER) || !defined(__x86_64__)
+#error "KUBERA_HOST_X87 needs an x86-64 GCC or Clang host"
+#endif
+// The host's long double is the x87 extended format, so the register stack runs on the host x87.
+// Arithmetic follows the host control word, which the SysV ABI leaves at 64-bit precision and round to nearest,
+// the same as the software backend.
+using float80_t = long double;
+static_assert( std::numeric_limits<float80_t>::digits == 64 && std::numeric_limits<float80_t>::max_exponent == 16384,
+	"KUBERA_HOST_X87 needs an 80-bit long double" );
+#else
+#include <boost/multiprecision/cpp_bin_float.hpp>
+// Software extended precision for hosts without an 80-bit long double, e.g. MSVC and non-x86
+using float80_t =
+boost::multiprecision::number<boost::multiprecision::cpp_bin_float<
+	64,                                   // Number of significand bits (including explicit leading bit when non-zero)
+	boost::multiprecision::digit_base_2,  // Binary representation
+	void, std::int16_t,                   // Use 16-bit exponent type
+	-16382, 16383                         // Min/Max exponent values
+>, boost::multiprecision::et_off>;      // Disable expression templates for simplicity
+#endif
+
+namespace kubera::fp80
+{
+	// Memory format of an 80-bit value: the 64-bit significand with its explicit integer bit, then sign and biased exponent
+	using Bits = std::pair<uint64_t, uint16_t>;
+
+	// Guest values only convert at memory boundaries, the register stack holds float80_t
+	float80_t from_ieee754_80 ( Bits bits );
+	Bits to_ieee754_80 ( const float80_t& value );
+
+	inline int classify ( const float80_t& value ) {
+#if defined(KUBERA_HOST_X87)
+		return std::fpclassify ( value );
+#else
+		return boost::multiprecision::fpclassify ( value );
+#endif
+	}
+
+	inline bool is_nan ( const float80_t& value ) {
+		return classify ( value ) == FP_NAN;
+	}
+
+	inline bool is_inf ( const float80_t& value ) {
+		return classify ( value ) == FP_INFINITE;
+	}
+
+	// Unbiased exponent of a finite non-zero value
+	inline int exponent ( const float80_t& value ) {
+#if defined(KUBERA_HOST_X87)
+		return std::ilogb ( value );
+#else
+		return value.backend ( ).exponent ( );
+#endif
+	}
+
+	inline float80_t remainder ( const float80_t& x, const float80_t& y ) {
+#if defined(KUBERA_HOST_X87)
+		return std::remainder ( x, y );
+#else
+		return boost::multiprecision::remainder ( x, y );
+#endif
+	}
+};
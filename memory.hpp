@@ -6,13 +6,105 @@
 #include <map>
 #include <array>
 #include <cstring>
+#include <filesystem>
+#include <format>
 #include <memory>
+#include <limits>
+#include <mutex>
 #include <print>
+#include <string_view>
+#include <vector>
 #include "types.hpp"
 
 namespace kubera
 {
-	constexpr auto verbose_memory = true;
+	class CheckpointWriter;
+	class CheckpointReader;
+
+	// Called with the address, size and kind (READ, WRITE or EXEC) of a hooked access, before it is performed
+	using MemoryHook = std::function<void ( class VirtualMemory*, uint64_t addr, std::size_t size, uint8_t access )>;
+
+	enum class FaultReason : uint8_t {
+		None,
+		Unmapped, // no page at the address
+		Protection, // the page does not allow the access
+		OutOfMemory, // no host frame could be committed
+	};
+
+	// A failed guest access. The access reads as zero or is dropped, turning it into a guest exception is up to the platform layer.
+	struct MemoryFault {
+		uint64_t address { 0 };
+		// Instruction that made the access, 0 for accesses from outside an executing instance
+		uint64_t rip { 0 };
+		// NONE for translate_bypass, which ignores protection
+		uint8_t access { PageProtection::NONE };
+		FaultReason reason { FaultReason::None };
+	};
+
+	// Called with every fault after it is recorded
+	using FaultSink = std::function<void ( const MemoryFault& fault )>;
+
+	// Sink that prints each fault, the old verbose behaviour
+	void print_fault ( const MemoryFault& fault );
+
+	// Called with allocator diagnostics such as overlapping or failed allocations, without one they are dropped
+	using MemoryLogSink = std::function<void ( std::string_view message )>;
+
+	// Sink that prints each diagnostic, the old verbose_memory behaviour
+	void print_memory_log ( std::string_view message );
+
+	// Reference counts of page frames shared between a VirtualMemory and its snapshots.
+	// Frames with a single owner are not tracked, so the table only grows with snapshots.
+	class FrameRefs {
+	public:
+		// Adds an owner, a frame seen for the first time ends up with two
+		void share ( uint8_t* frame );
+		// Drops an owner and frees the frame once nobody else holds it
+		void release ( uint8_t* frame );
+		[[nodiscard]] bool is_shared ( uint8_t* frame );
+
+	private:
+		std::mutex mutex;
+		std::unordered_map<uint8_t*, uint32_t> counts;
+	};
+
+	// Host memory behind map_host pages, alive for as long as a page of the memory or of a snapshot reads from it
+	struct HostBacking {
+		const uint8_t* end { nullptr };
+		std::vector<std::shared_ptr<const void>> owners;
+		// PAGE_FLAG_HOST pages pointing into the range
+		std::size_t pages { 0 };
+	};
+
+	// Backings by the first byte of their range, ranges never overlap
+	using HostBackings = std::map<const uint8_t*, HostBacking>;
+
+	// Immutable copy of an address space layout whose page frames are shared copy-on-write with the live memory
+	class MemorySnapshot {
+	public:
+		~MemorySnapshot ( );
+
+		// Hash of the layout, protections and page contents, checkpoints record the one of their base.
+		// It reads every committed page, so it is computed on first use and cached.
+		[[nodiscard]] uint64_t fingerprint ( ) const;
+
+	private:
+		friend class VirtualMemory;
+
+		uint64_t id { 0 };
+		std::shared_ptr<FrameRefs> frames;
+		std::map<uint64_t, Region> regions;
+		HostBackings host_backings;
+		// Every mapped page sorted by address, present ones hold a reference to their frame
+		std::vector<std::pair<uint64_t, Page>> pages;
+		uint64_t next_alloc { 0 };
+		std::size_t page_size { 0 };
+		mutable std::once_flag fingerprint_once;
+		mutable uint64_t fingerprint_value { 0 };
+
+		const Page* find ( uint64_t virt_page ) const;
+	};
+
 	class VirtualMemory {
 	public:
 		explicit VirtualMemory ( std::size_t page_sz = 0x1000 );
@@ -20,52 +112,360 @@ namespace kubera
 
 		[[nodiscard]] uint64_t alloc ( std::size_t size, uint8_t prot, std::size_t alignment = 0x1000, bool commit_immediately = false );
 		[[nodiscard]] uint64_t alloc_at ( uint64_t base_addr, std::size_t size, uint8_t prot, std::size_t alignment = 0x1000, bool commit_immediately = false );
-		[[nodiscard]] uint8_t* commit ( std::size_t size );
-		void uncommit ( uint8_t* data );
+		// Returns a zero-filled host frame of size bytes
+		[[nodiscard]] static uint8_t* commit ( std::size_t size );
+		static void uncommit ( uint8_t* data );
+		// Releases many frames at once, letting the frame arena hand long runs back to the OS. Clears frames.
+		static void uncommit ( std::vector<uint8_t*>& frames );
 		[[nodiscard]] uint64_t load ( const void* data, std::size_t size, uint8_t prot, std::size_t alignment = 0x1000 );
+		// Maps size bytes of host memory at data without copying. Guest pages read the host memory directly and get a
+		// private copy on their first write. owner keeps the memory alive for as long as any page or snapshot uses it.
+		[[nodiscard]] uint64_t map_host ( std::shared_ptr<const void> owner, const void* data, std::size_t size, uint8_t prot, std::size_t alignment = 0x1000 );
+		// map_host over a read-only mapping of the whole file, 0 if it cannot be opened or is empty
+		[[nodiscard]] uint64_t map_file ( const std::filesystem::path& path, uint8_t prot, std::size_t alignment = 0x1000 );
 		void free ( uint64_t addr, std::size_t size );
 		bool protect ( uint64_t addr, std::size_t size, uint8_t prot );
 		[[nodiscard]] uint32_t map_to_win_protect ( uint64_t addr );
 		[[nodiscard]] WinMemoryBasicInformation get_memory_basic_information ( uint64_t addr );
 		[[nodiscard]] Page* get_page ( uint64_t addr );
+		// Calls hook on every access of the kinds in access (READ, WRITE and/or EXEC) overlapping [addr, addr + size).
+		// Only pages the range touches leave the TLB, and only for those kinds. Returns an id for remove_hook, 0 if nothing was added.
+		uint64_t add_hook ( uint64_t addr, std::size_t size, uint8_t access, MemoryHook hook );
+		bool remove_hook ( uint64_t id );
+		// Read hook over the whole region holding addr
 		void set_read_hook ( uint64_t addr, std::function<void ( VirtualMemory*, uint64_t addr, std::size_t size )> hook );
+		[[nodiscard]] bool has_hook ( uint64_t addr, std::size_t size, uint8_t access ) const;
+		// Runs the hooks of the given kind overlapping [addr, addr + size), exec hooks are dispatched by the executor
+		void dispatch_hooks ( uint64_t addr, std::size_t size, uint8_t access );
 
 		template<typename T> [[nodiscard]] T read ( uint64_t addr );
 		template<typename T> void write ( uint64_t addr, T val );
 		void read_bytes ( uint64_t addr, void* dest, std::size_t size, uint8_t access = PageProtection::READ );
 		void write_bytes ( uint64_t addr, const void* src, std::size_t size, uint8_t access = PageProtection::WRITE );
-		[[nodiscard]] void* translate ( uint64_t addr, uint8_t access, bool silent = false );
+		// size is the extent of the access within the page, hooks treat 0 as the rest of the page
+		[[nodiscard]] void* translate ( uint64_t addr, uint8_t access, bool silent = false, std::size_t size = 0 );
 		[[nodiscard]] void* translate_bypass ( uint64_t addr, bool silent = false );
+		// True when every page holding a byte of [addr, addr + size) allows access, hooks do not run
 		[[nodiscard]] bool check ( uint64_t addr, std::size_t size, uint8_t access );
+		// Copies guest memory without protection checks, hooks or committing pages, uncommitted pages read as zero.
+		// False if part of the range is unmapped.
+		bool peek ( uint64_t addr, void* dest, std::size_t size ) const;
+
+		// Flags the page holding addr as containing decoded code
+		void mark_code ( uint64_t addr );
+
+		// Captures the current layout and contents. Every present page becomes copy-on-write,
+		// so taking it costs O(mapped pages) and no memory is copied until the guest writes.
+		[[nodiscard]] std::shared_ptr<const MemorySnapshot> snapshot ( );
+
+		// Returns to the state captured in snap. When snap is the latest snapshot (or the one last
+		// restored) and no pages were mapped, unmapped or reprotected since, only dirtied pages are touched.
+		void restore ( const MemorySnapshot& snap );
+
+		// Writes the Layout record and a Page or Unmap record for every page that differs from base.
+		// With base as the baseline and the layout unchanged, only dirtied pages are compared, as in restore.
+		void write_checkpoint ( const MemorySnapshot& base, CheckpointWriter& out );
+
+		// Restores base, then applies the memory records of in up to their End record. False for malformed input,
+		// memory is then partly updated and restoring base again discards the rest.
+		[[nodiscard]] bool load_checkpoint ( const MemorySnapshot& base, CheckpointReader& in );
+
+		[[nodiscard]] uint64_t code_write_sequence ( ) const noexcept {
+			return code_write_seq;
+		}
+
+		// Advances whenever pages are unmapped or reprotected, so anything validated against page permissions
+		// (like block links) stays valid for as long as it is unchanged
+		[[nodiscard]] uint64_t protection_sequence ( ) const noexcept {
+			return protection_seq;
+		}
+
+		// Calls fn with the base of every code page modified since sequence seq.
+		// Returns false if the log wrapped in the meantime and the caller has to assume everything changed.
+		template<typename Fn>
+		bool for_each_code_write ( uint64_t seq, Fn&& fn ) const {
+			if ( code_write_seq - seq > code_write_log.size ( ) ) {
+				return false;
+			}
+			for ( ; seq < code_write_seq; ++seq ) {
+				fn ( code_write_log [ seq % code_write_log.size ( ) ] );
+			}
+			return true;
+		}
+
+		// Host frame of the page holding addr when accesses of kind access can go straight to it, filled into the TLB as translate would.
+		// nullptr when the page faults (not recorded) or is hooked for access. Stays valid while tlb_generation is unchanged.
+		[[nodiscard]] uint8_t* direct_page ( uint64_t addr, uint8_t access );
+
+		// Advances whenever TLB entries may have gone stale, host pointers cached outside the TLB are checked against it
+		[[nodiscard]] uint64_t tlb_generation ( ) const noexcept {
+			return tlb_seq;
+		}
+
+		// Most recent fault of the bound slot, a fault costs a few stores unless a sink is attached
+		[[nodiscard]] const MemoryFault& last_fault ( ) const noexcept {
+			return *fault_slot;
+		}
+
+		// Faults recorded since construction, compared across a call to tell whether it faulted
+		[[nodiscard]] uint64_t fault_count ( ) const noexcept {
+			return fault_seq;
+		}
+
+		void clear_fault ( ) noexcept {
+			*fault_slot = { };
+		}
+
+		// Called on every fault, e.g. print_fault or a callback raising the guest exception. An empty sink detaches.
+		void set_fault_sink ( FaultSink sink ) {
+			fault_sink = std::move ( sink );
+		}
+
+		// Receives the allocator diagnostics, e.g. print_memory_log. An empty sink detaches.
+		void set_log_sink ( MemoryLogSink sink ) {
+			log_sink = std::move ( sink );
+		}
+
+		// Records faults into slot with *rip as their RIP, done by an instance when it starts executing.
+		// nullptr returns to the memory's own slot.
+		void bind_fault_slot ( MemoryFault* slot, const uint64_t* rip ) noexcept {
+			fault_slot = slot ? slot : &own_fault;
+			fault_rip = slot ? rip : nullptr;
+		}
+
+		// Unbinds slot if it is still bound, before its owner goes away
+		void release_fault_slot ( const MemoryFault* slot ) noexcept {
+			if ( fault_slot == slot ) {
+				bind_fault_slot ( nullptr, nullptr );
+			}
+		}
 
 		std::size_t page_size;
 
 	private:
-		std::unordered_map<uint64_t, std::unique_ptr<Page>> pages;
+		// 4-level page table, three 512-entry levels below a sparse root keyed on the remaining upper bits.
+		// The root is a hash map so non-canonical guest layouts (like the default stack) need no special casing.
+		static constexpr std::size_t table_bits = 9;
+		static constexpr std::size_t table_entries = 1ULL << table_bits;
+
+		struct PageTable {
+			std::array<Page, table_entries> pages { };
+			std::size_t mapped { 0 };
+		};
+
+		struct PageDirectory {
+			std::array<std::unique_ptr<PageTable>, table_entries> tables { };
+			std::size_t used { 0 };
+		};
+
+		struct PageDirectoryPointerTable {
+			std::array<std::unique_ptr<PageDirectory>, table_entries> directories { };
+			std::size_t used { 0 };
+		};
+
+		std::unordered_map<uint64_t, std::unique_ptr<PageDirectoryPointerTable>> page_map_root;
 		std::map<uint64_t, Region> regions;
 		uint64_t next_alloc { 0x100000000ULL };
+		std::size_t page_shift;
+
+		// Direct-mapped software TLB, one set per access type. Entries are only filled for pages
+		// that need no extra work on access (no hook for the access type, no decoded code for writes).
+		enum TlbKind : uint8_t {
+			TLB_READ,
+			TLB_WRITE,
+			TLB_EXEC,
+			TLB_COUNT
+		};
 
-		struct CacheEntry { uint64_t virt; Page* page; };
-		std::array<CacheEntry, 16> cache;
-		std::size_t cache_pos { 0 };
+		struct TlbEntry {
+			uint64_t virt { UINT64_MAX };
+			uint8_t* data { nullptr };
+			uint8_t prot { PageProtection::NONE };
+		};
+
+		static constexpr std::size_t tlb_entries = 256;
+		std::array<std::array<TlbEntry, tlb_entries>, TLB_COUNT> tlb { };
+		uint64_t tlb_seq { 0 };
+
+		static constexpr TlbKind tlb_kind ( uint8_t access ) noexcept {
+			if ( access & PageProtection::WRITE ) {
+				return TLB_WRITE;
+			}
+			if ( access & PageProtection::EXEC ) {
+				return TLB_EXEC;
+			}
+			return TLB_READ;
+		}
+
+		[[nodiscard]] std::size_t tlb_index ( uint64_t virt_page ) const noexcept {
+			return ( virt_page >> page_shift ) & ( tlb_entries - 1 );
+		}
+
+		void flush_tlb ( uint64_t virt_page );
+		void flush_tlb ( );
+
+		[[nodiscard]] Page* lookup_page ( uint64_t virt_page ) const;
+		[[nodiscard]] Page* map_page ( uint64_t virt_page );
+		// Frames of unshared pages are queued on batch instead of being released immediately, when given
+		void unmap_page ( uint64_t virt_page, std::vector<uint8_t*>* batch = nullptr );
+		// Unmaps every page in [start, end), resolving each page table once
+		void unmap_range ( uint64_t start, uint64_t end, std::vector<uint8_t*>* batch = nullptr );
+		// Calls fn with every mapped page in [start, end), skipping absent tables as a whole
+		template<typename Fn>
+		void for_each_page_in_range ( uint64_t start, uint64_t end, Fn&& fn );
+		[[nodiscard]] bool commit_page ( Page* page );
+		// Checks and commits the page for access without running hooks or filling the TLB
+		[[nodiscard]] Page* resolve_page ( uint64_t addr, uint8_t access, bool silent );
+		[[nodiscard]] void* translate_slow ( uint64_t addr, uint8_t access, bool silent, std::size_t size );
+		// check() for a single page: the TLB is filled like translate does, but no hooks fire
+		[[nodiscard]] bool probe ( uint64_t addr, uint8_t access );
+
+		// Vector sized accesses, done with a single translation when they stay within a page
+		template<typename Wide> [[nodiscard]] Wide read_wide ( uint64_t addr );
+		template<typename Wide> void write_wide ( uint64_t addr, const Wide& val );
+
+		MemoryFault own_fault { };
+		MemoryFault* fault_slot { &own_fault };
+		const uint64_t* fault_rip { nullptr };
+		uint64_t fault_seq { 0 };
+		FaultSink fault_sink;
+		MemoryLogSink log_sink;
+
+		// Formats only when a sink is attached, so a default build pays one branch per diagnostic
+		template<typename... Args>
+		void log_message ( std::format_string<Args...> fmt, Args&&... args ) const {
+			if ( log_sink ) [[unlikely]] {
+				log_sink ( std::format ( fmt, std::forward<Args> ( args )... ) );
+			}
+		}
+
+		// Only for accesses without silent set, those probe memory and are not guest faults
+		void record_fault ( uint64_t addr, uint8_t access, FaultReason reason );
+
+		std::array<uint64_t, 256> code_write_log { };
+		uint64_t code_write_seq { 0 };
+		uint64_t protection_seq { 0 };
+
+		void log_code_write ( uint64_t virt_page, Page* page ) {
+			page->has_code = false;
+			++page->code_generation;
+			code_write_log [ code_write_seq % code_write_log.size ( ) ] = virt_page;
+			++code_write_seq;
+		}
+
+		// Snapshot bookkeeping, dirty tracking only runs while a baseline snapshot exists
+		std::shared_ptr<FrameRefs> frame_refs { std::make_shared<FrameRefs> ( ) };
+		uint64_t next_snapshot_id { 1 };
+		uint64_t baseline_snapshot { 0 };
+		bool layout_changed { false };
+		std::vector<uint64_t> dirty_pages;
+
+		void mark_dirty ( uint64_t virt_page, Page* page ) {
+			if ( baseline_snapshot != 0 && ( page->flags & PageFlags::PAGE_FLAG_DIRTY ) == 0 ) {
+				page->flags |= PageFlags::PAGE_FLAG_DIRTY;
+				dirty_pages.push_back ( virt_page );
+			}
+		}
+
+		// Gives the page a private copy of its frame before it is written, false if no frame could be committed
+		bool break_cow ( uint64_t virt_page, Page* page );
+		// Adds a snapshot reference to a present page and makes it copy-on-write
+		void share_frame ( Page& page );
+		// Keeps map_host memory alive while pages read from it, copied into snapshots since their pages may still point into it
+		HostBackings host_backings;
+		// Adds the range, merging it with backings it overlaps so that their owners live as long as the pages of either
+		void add_host_backing ( const uint8_t* begin, HostBacking backing );
+		// Counts a PAGE_FLAG_HOST page reading frame. A backing the memory dropped since is taken back from saved.
+		void retain_host ( const uint8_t* frame, const HostBackings* saved = nullptr );
+		// Uncounts it, the owners are released once no page reads from the backing any more
+		void drop_host ( const uint8_t* frame );
+		// Drops the page's reference to its frame
+		void release_frame ( Page* page, std::vector<uint8_t*>* batch = nullptr );
+		void restore_page ( uint64_t virt_page, Page* page, const Page& saved, const HostBackings& saved_backings );
+
+		template<typename Fn>
+		void for_each_mapped_page ( Fn&& fn );
+
+		// Hooks by id, indexed by the pages they overlap. Map nodes never move, so the buckets point straight at them.
+		struct HookEntry {
+			uint64_t start { 0 };
+			uint64_t end { 0 };
+			uint8_t access { PageProtection::NONE };
+			// Set by remove_hook while a dispatch is running, the entry is erased once the outermost one returns
+			bool removed { false };
+			MemoryHook callback;
+		};
+
+		// Hooks over more pages than this skip the buckets and are checked against every query
+		static constexpr uint64_t wide_hook_pages = 256;
+
+		std::map<uint64_t, HookEntry> hooks;
+		// Page number to the hooks overlapping that page, in the order they were added
+		std::unordered_map<uint64_t, std::vector<HookEntry*>> hook_pages;
+		std::vector<HookEntry*> wide_hooks;
+		std::vector<uint64_t> removed_hooks;
+		uint32_t hook_dispatch_depth { 0 };
+		uint64_t next_hook_id { 1 };
+
+		static constexpr uint8_t hook_flag_mask = PageFlags::PAGE_FLAG_READ_HOOK | PageFlags::PAGE_FLAG_WRITE_HOOK | PageFlags::PAGE_FLAG_EXEC_HOOK;
+
+		static constexpr uint8_t hook_flags_for ( uint8_t access ) noexcept {
+			return ( ( access & PageProtection::READ ) ? PageFlags::PAGE_FLAG_READ_HOOK : 0 ) |
+				( ( access & PageProtection::WRITE ) ? PageFlags::PAGE_FLAG_WRITE_HOOK : 0 ) |
+				( ( access & PageProtection::EXEC ) ? PageFlags::PAGE_FLAG_EXEC_HOOK : 0 );
+		}
+
+		// Kind of hook an access fires. Instruction fetches are not data accesses, exec hooks fire when the decoded instruction runs.
+		static constexpr uint8_t hooked_access ( uint8_t access ) noexcept {
+			return ( access & PageProtection::EXEC ) ? 0 : access;
+		}
+
+		// Calls fn once for every live hook overlapping [start, end). Hooks added by fn are not visited.
+		template<typename Fn>
+		void for_each_hook ( uint64_t start, uint64_t end, Fn&& fn ) const;
+		void link_hook ( HookEntry* entry );
+		void erase_hook ( uint64_t id );
+		// Hook flag bits a page at virt_page should carry
+		[[nodiscard]] uint8_t hook_flags ( uint64_t virt_page ) const;
+		void refresh_hook_flags ( uint64_t start, uint64_t end );
 
 		const Region* find_region ( uint64_t addr ) const;
 		void split_region ( uint64_t base, uint64_t split_start, uint64_t split_end, uint8_t new_protect );
+		// Merges adjacent regions of one allocation whose attributes became equal again, around [start, end)
+		void coalesce_regions ( uint64_t start, uint64_t end );
 	};
 
 	constexpr auto PAGE_ALIGN = 4096;
 
+	inline void* VirtualMemory::translate ( uint64_t addr, uint8_t access, bool silent, std::size_t size ) {
+		const uint64_t virt_page = addr & ~( page_size - 1 );
+		const auto& entry = tlb [ tlb_kind ( access ) ] [ tlb_index ( virt_page ) ];
+		if ( entry.virt == virt_page && ( entry.prot & access ) == access ) [[likely]] {
+			return entry.data + ( addr - virt_page );
+		}
+		return translate_slow ( addr, access, silent, size );
+	}
+
 	template<typename T>
 	inline T VirtualMemory::read ( uint64_t addr ) {
+		// Fast path, the access stays within a single page
+		if ( ( addr & ( page_size - 1 ) ) + sizeof ( T ) <= page_size ) [[likely]] {
+			const void* src = translate ( addr, PageProtection::READ, false, sizeof ( T ) );
+			if ( !src ) return T {};
+			T val;
+			std::memcpy ( &val, src, sizeof ( T ) );
+			return val;
+		}
+
 		T val {0};
 		uint8_t* dest = reinterpret_cast< uint8_t* >( &val );
 		std::size_t remaining = sizeof ( T );
 		uint64_t current = addr;
 		while ( remaining > 0 ) {
-			void* src = translate ( current, PageProtection::READ );
-			if ( !src ) return T {};
 			std::size_t offset = current % page_size;
 			std::size_t to_copy = std::min ( remaining, page_size - offset );
+			void* src = translate ( current, PageProtection::READ, false, to_copy );
+			if ( !src ) return T {};
 			std::memcpy ( dest, src, to_copy );
 			dest += to_copy;
 			current += to_copy;
@@ -74,46 +474,57 @@ namespace kubera
 		return val;
 	}
 
+	template<typename Wide>
+	inline Wide VirtualMemory::read_wide ( uint64_t addr ) {
+		constexpr std::size_t size = std::numeric_limits<Wide>::digits / 8;
+		uint64_t parts [ size / 8 ];
+		if ( ( addr & ( page_size - 1 ) ) + size <= page_size ) [[likely]] {
+			const void* src = translate ( addr, PageProtection::READ, false, size );
+			if ( !src ) return Wide { 0 };
+			std::memcpy ( parts, src, size );
+		}
+		else {
+			read_bytes ( addr, parts, size );
+		}
+
+		Wide result;
+		mp::import_bits ( result, parts, parts + size / 8, 64, false );
+		return result;
+	}
+
 	template<>
 	inline uint128_t VirtualMemory::read ( uint64_t addr ) {
-		uint64_t low = read<uint64_t> ( addr );
-		uint64_t high = read<uint64_t> ( addr + 8 );
-		uint128_t result = uint128_t ( high );
-		result <<= 64;
-		result |= low;
-		return result;
+		return read_wide<uint128_t> ( addr );
 	}
 
 	template<>
 	inline uint256_t VirtualMemory::read ( uint64_t addr ) {
-		uint256_t result = 0;
-		for ( int i = 0; i < 4; i++ ) {
-			uint64_t part = read<uint64_t> ( addr + i * 8 );
-			result |= uint256_t ( part ) << ( i * 64 );
-		}
-		return result;
+		return read_wide<uint256_t> ( addr );
 	}
 
 	template<>
 	inline uint512_t VirtualMemory::read ( uint64_t addr ) {
-		uint512_t result = 0;
-		for ( int i = 0; i < 8; i++ ) {
-			uint64_t part = read<uint64_t> ( addr + i * 8 );
-			result |= uint512_t ( part ) << ( i * 64 );
-		}
-		return result;
+		return read_wide<uint512_t> ( addr );
 	}
 
 	template<typename T>
 	inline void VirtualMemory::write ( uint64_t addr, T val ) {
+		// Fast path, the access stays within a single page
+		if ( ( addr & ( page_size - 1 ) ) + sizeof ( T ) <= page_size ) [[likely]] {
+			void* dest = translate ( addr, PageProtection::WRITE, false, sizeof ( T ) );
+			if ( !dest ) return;
+			std::memcpy ( dest, &val, sizeof ( T ) );
+			return;
+		}
+
 		const uint8_t* src = reinterpret_cast< const uint8_t* > ( &val );
 		std::size_t remaining = sizeof ( T );
 		uint64_t current = addr;
 		while ( remaining > 0 ) {
-			void* dest = translate ( current, PageProtection::WRITE );
-			if ( !dest ) return;
 			std::size_t offset = current % page_size;
 			std::size_t to_copy = std::min ( remaining, page_size - offset );
+			void* dest = translate ( current, PageProtection::WRITE, false, to_copy );
+			if ( !dest ) return;
 			std::memcpy ( dest, src, to_copy );
 			src += to_copy;
 			current += to_copy;
@@ -121,28 +532,35 @@ namespace kubera
 		}
 	}
 
+	template<typename Wide>
+	inline void VirtualMemory::write_wide ( uint64_t addr, const Wide& val ) {
+		constexpr std::size_t size = std::numeric_limits<Wide>::digits / 8;
+		// export_bits only emits the significant limbs
+		uint64_t parts [ size / 8 ] = { 0 };
+		mp::export_bits ( val, parts, 64, false );
+
+		if ( ( addr & ( page_size - 1 ) ) + size <= page_size ) [[likely]] {
+			void* dest = translate ( addr, PageProtection::WRITE, false, size );
+			if ( !dest ) return;
+			std::memcpy ( dest, parts, size );
+			return;
+		}
+		write_bytes ( addr, parts, size );
+	}
+
 	template<>
 	inline void VirtualMemory::write ( uint64_t addr, uint128_t val ) {
-		uint64_t low = static_cast< uint64_t >( val & uint128_t ( 0xFFFFFFFFFFFFFFFFULL ) );
-		uint64_t high = static_cast< uint64_t >( val >> 64 );
-		write<uint64_t> ( addr, low );
-		write<uint64_t> ( addr + 8, high );
+		write_wide ( addr, val );
 	}
 
 	template<>
 	inline void VirtualMemory::write ( uint64_t addr, uint256_t val ) {
-		for ( int i = 0; i < 4; i++ ) {
-			uint64_t part = static_cast< uint64_t > ( ( val >> ( i * 64 ) ) & uint256_t ( 0xFFFFFFFFFFFFFFFFULL ) );
-			write<uint64_t> ( addr + i * 8, part );
-		}
+		write_wide ( addr, val );
 	}
 
 	template<>
 	inline void VirtualMemory::write ( uint64_t addr, uint512_t val ) {
-		for ( int i = 0; i < 8; i++ ) {
-			uint64_t part = static_cast< uint64_t > ( ( val >> ( i * 64 ) ) & uint512_t ( 0xFFFFFFFFFFFFFFFFULL ) );
-			write<uint64_t> ( addr + i * 8, part );
-		}
+		write_wide ( addr, val );
 	}
 
 	inline void VirtualMemory::read_bytes ( uint64_t addr, void* dest, std::size_t size, uint8_t access ) {
@@ -150,13 +568,13 @@ namespace kubera
 		std::size_t remaining = size;
 		uint64_t current = addr;
 		while ( remaining > 0 ) {
-			void* src = translate ( current, access );
+			std::size_t offset = current % page_size;
+			std::size_t to_copy = std::min ( remaining, page_size - offset );
+			void* src = translate ( current, access, false, to_copy );
 			if ( !src ) {
 				std::memset ( d, 0, remaining );
 				return;
 			}
-			std::size_t offset = current % page_size;
-			std::size_t to_copy = std::min ( remaining, page_size - offset );
 			std::memcpy ( d, src, to_copy );
 			d += to_copy;
 			current += to_copy;
@@ -169,10 +587,10 @@ namespace kubera
 		std::size_t remaining = size;
 		uint64_t current = addr;
 		while ( remaining > 0 ) {
-			void* dest = translate ( current, access );
-			if ( !dest ) return;
 			std::size_t offset = current % page_size;
 			std::size_t to_copy = std::min ( remaining, page_size - offset );
+			void* dest = translate ( current, access, false, to_copy );
+			if ( !dest ) return;
 			std::memcpy ( dest, s, to_copy );
 			s += to_copy;
 			current += to_copy;
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "iced.hpp"
+
+namespace kubera
+{
+	// Execution counts and host cycles (READ_TSC) per mnemonic and per guest basic block.
+	// Attached to an instance with KUBERA::set_profiler, which can be done and undone between runs.
+	class Profiler {
+	public:
+		struct MnemonicProfile {
+			uint64_t count { 0 };
+			uint64_t cycles { 0 };
+		};
+
+		struct BlockProfile {
+			uint64_t start { 0 };
+			uint64_t end { 0 };
+			uint64_t executions { 0 };
+			uint64_t instructions { 0 };
+			// Whole execute_block cost, including dispatch around the handlers
+			uint64_t cycles { 0 };
+			// Handler cycles of the block's instructions by mnemonic
+			std::vector<std::pair<Mnemonic, uint64_t>> mnemonic_cycles;
+		};
+
+		// block is the profile of the block the instruction ran from, if any
+		void record_instruction ( const iced::Instruction& instr, uint64_t cycles, BlockProfile* block = nullptr ) {
+			const auto index = static_cast< std::size_t >( instr.mnemonic ( ) );
+			auto& profile = mnemonics [ index ];
+			if ( profile.count++ == 0 ) {
+				name_mnemonic ( instr );
+			}
+			profile.cycles += cycles;
+
+			if ( !block ) {
+				unblocked_cycles [ index ] += cycles;
+				return;
+			}
+			for ( auto& [mnemonic, block_cycles] : block->mnemonic_cycles ) {
+				if ( mnemonic == instr.mnemonic ( ) ) {
+					block_cycles += cycles;
+					return;
+				}
+			}
+			block->mnemonic_cycles.emplace_back ( instr.mnemonic ( ), cycles );
+		}
+
+		// Profile of the block at start, looked up once per block execution
+		BlockProfile& block ( uint64_t start, uint64_t end ) {
+			auto& profile = blocks [ start ];
+			profile.start = start;
+			profile.end = end;
+			return profile;
+		}
+
+		void record_block ( BlockProfile& block, uint64_t instructions, uint64_t cycles ) {
+			++block.executions;
+			block.instructions += instructions;
+			block.cycles += cycles;
+		}
+
+		const MnemonicProfile& mnemonic ( Mnemonic mnemonic ) const {
+			return mnemonics [ static_cast< std::size_t >( mnemonic ) ];
+		}
+
+		const std::unordered_map<uint64_t, BlockProfile>& block_profiles ( ) const noexcept {
+			return blocks;
+		}
+
+		// Mnemonics and the top blocks sorted by host cycles, as a plain table
+		std::string report ( std::size_t top_blocks = 20 ) const;
+
+		// Folded stacks of block;mnemonic with host cycles as the value, the input format of flamegraph.pl and similar tools.
+		// Dispatch overhead of a block shows up as its own frame.
+		bool write_folded ( const std::filesystem::path& path ) const;
+
+		void reset ( );
+
+	private:
+		void name_mnemonic ( const iced::Instruction& instr );
+
+		std::array<MnemonicProfile, static_cast< std::size_t >( Mnemonic::COUNT )> mnemonics { };
+		// Cycles of instructions run outside the block cache, e.g. through KUBERA::execute
+		std::array<uint64_t, static_cast< std::size_t >( Mnemonic::COUNT )> unblocked_cycles { };
+		// Taken from the disassembly of the first instruction seen with each mnemonic
+		std::array<std::string, static_cast< std::size_t >( Mnemonic::COUNT )> names { };
+		std::unordered_map<uint64_t, BlockProfile> blocks;
+	};
+};
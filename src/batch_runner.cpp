@@ -0,0 +1,156 @@
+#include "../batch_runner.hpp"
+
+using namespace kubera;
+
+BatchRunner::BatchRunner ( std::size_t worker_count, std::size_t default_budget, std::chrono::nanoseconds default_timeout )
+	: default_budget ( default_budget ), default_timeout ( default_timeout ) {
+	worker_count = std::max<std::size_t> ( worker_count, 1 );
+	workers.reserve ( worker_count );
+	for ( std::size_t i = 0; i < worker_count; ++i ) {
+		auto worker = std::make_unique<Worker> ( );
+		// Never executed, it only has to be executable so the final RET is allowed to land on it
+		worker->return_address = worker->context.alloc_memory ( 0x1000, PageProtection::READ | PageProtection::EXEC );
+		workers.push_back ( std::move ( worker ) );
+	}
+
+	for ( auto& worker : workers ) {
+		worker->thread = std::thread ( &BatchRunner::worker_loop, this, std::ref ( *worker ) );
+	}
+}
+
+BatchRunner::~BatchRunner ( ) {
+	{
+		std::lock_guard lock ( mutex );
+		stopping = true;
+	}
+	start_cv.notify_all ( );
+	for ( auto& worker : workers ) {
+		worker->thread.join ( );
+	}
+}
+
+void BatchRunner::run ( const std::vector<BatchJob>& batch, const Callback& on_result ) {
+	if ( batch.empty ( ) ) {
+		return;
+	}
+
+	std::unique_lock lock ( mutex );
+	jobs = &batch;
+	callback = &on_result;
+	next_job.store ( 0, std::memory_order_relaxed );
+	active_workers = workers.size ( );
+	++generation;
+	start_cv.notify_all ( );
+
+	done_cv.wait ( lock, [ this ] { return active_workers == 0; } );
+	jobs = nullptr;
+	callback = nullptr;
+}
+
+void BatchRunner::worker_loop ( Worker& worker ) {
+	uint64_t seen_generation = 0;
+	while ( true ) {
+		{
+			std::unique_lock lock ( mutex );
+			start_cv.wait ( lock, [ this, seen_generation ] { return stopping || generation != seen_generation; } );
+			if ( stopping ) {
+				return;
+			}
+			seen_generation = generation;
+		}
+
+		// Jobs are claimed one at a time from a shared cursor, so a worker stuck on a long
+		// job never holds back short ones queued behind it
+		for ( auto index = next_job.fetch_add ( 1, std::memory_order_relaxed ); index < jobs->size ( );
+				index = next_job.fetch_add ( 1, std::memory_order_relaxed ) ) {
+			run_job ( worker, index );
+		}
+
+		{
+			std::lock_guard lock ( mutex );
+			if ( --active_workers == 0 ) {
+				done_cv.notify_one ( );
+			}
+		}
+	}
+}
+
+void BatchRunner::load_code ( Worker& worker, const std::shared_ptr<const std::vector<uint8_t>>& code ) {
+	if ( worker.loaded_code == code ) {
+		return;
+	}
+
+	auto* memory = worker.context.get_virtual_memory ( );
+	const std::size_t size = code ? code->size ( ) : 0;
+	if ( size > worker.code_capacity ) {
+		if ( worker.code_capacity != 0 ) {
+			memory->free ( worker.code_base, worker.code_capacity );
+		}
+		worker.code_capacity = ( size + memory->page_size - 1 ) & ~( memory->page_size - 1 );
+		worker.code_base = memory->alloc ( worker.code_capacity, PageProtection::READ | PageProtection::WRITE );
+	}
+	else {
+		memory->protect ( worker.code_base, worker.code_capacity, PageProtection::READ | PageProtection::WRITE );
+	}
+
+	if ( size != 0 ) {
+		memory->write_bytes ( worker.code_base, code->data ( ), size );
+	}
+	memory->protect ( worker.code_base, worker.code_capacity, PageProtection::READ | PageProtection::EXEC );
+	worker.loaded_code = code;
+}
+
+void BatchRunner::run_job ( Worker& worker, std::size_t index ) {
+	const auto& job = ( *jobs ) [ index ];
+	auto& context = worker.context;
+
+	if ( worker.loaded_code != job.code ) {
+		// Dropped first, or rewriting the code region would copy every page the old baseline still shares
+		worker.baseline.reset ( );
+		load_code ( worker, job.code );
+		worker.baseline = context.snapshot ( );
+	}
+	else {
+		// Only the pages the previous job dirtied are rewound, decoded blocks on untouched code survive
+		context.restore ( *worker.baseline );
+	}
+	context.reset_cpu ( );
+	for ( const auto& [reg, value] : job.registers ) {
+		context.set_reg ( reg, value, 8 );
+	}
+
+	// Enter like a call, leaving the 32 bytes of home space the Windows x64 ABI expects above the return address
+	const uint64_t rsp = context.stack_limit ( ) - 0x28;
+	context.set_reg ( Register::RSP, rsp, 8 );
+	context.set_stack<uint64_t> ( rsp, worker.return_address );
+	context.rip ( ) = worker.code_base + job.entry_offset;
+
+	RunOptions options;
+	options.budget = job.instruction_budget ? job.instruction_budget : default_budget;
+	options.stop_rip = worker.return_address;
+	const auto timeout = job.timeout.count ( ) ? job.timeout : default_timeout;
+	if ( timeout.count ( ) ) {
+		options.deadline = std::chrono::steady_clock::now ( ) + timeout;
+	}
+
+	BatchResult result;
+	result.job_index = index;
+	result.context = &context;
+	const auto run = context.run ( options );
+	result.instructions = run.instructions;
+
+	if ( context.rip ( ) == worker.return_address ) {
+		result.status = BatchStatus::Returned;
+	}
+	else if ( run.reason == StopReason::Budget ) {
+		result.status = BatchStatus::BudgetExhausted;
+	}
+	else if ( run.reason == StopReason::Timeout ) {
+		result.status = BatchStatus::TimedOut;
+	}
+	else {
+		result.status = BatchStatus::Faulted;
+	}
+
+	( *callback ) ( result );
+}
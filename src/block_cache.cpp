@@ -0,0 +1,331 @@
+#include "../KUBERA.hpp"
+
+using namespace kubera;
+
+BasicBlock* KUBERA::build_block ( uint64_t address ) {
+	constexpr std::size_t max_bytes = BlockCache::max_block_instructions * 15;
+	// The decoder always reads 16 bytes, keep a zeroed tail behind the fetched code
+	uint8_t buffer [ max_bytes + 16 ] = { 0 };
+
+	std::size_t fetched = 0;
+	uint64_t current = address;
+	while ( fetched < max_bytes ) {
+		void* src = memory->translate ( current, PageProtection::EXEC | PageProtection::READ, fetched != 0 );
+		if ( !src ) {
+			break;
+		}
+		std::size_t offset = current % memory->page_size;
+		std::size_t to_copy = std::min ( max_bytes - fetched, memory->page_size - offset );
+		std::memcpy ( buffer + fetched, src, to_copy );
+		fetched += to_copy;
+		current += to_copy;
+	}
+
+	if ( fetched == 0 ) {
+		return nullptr;
+	}
+
+	auto block = std::make_unique<BasicBlock> ( );
+	block->start = address;
+	block->instructions.reserve ( 16 );
+
+	decoder->reconfigure ( buffer, fetched, address );
+	std::size_t offset = 0;
+	while ( block->instructions.size ( ) < BlockCache::max_block_instructions && offset < fetched ) {
+		auto& instr = decoder->decode ( );
+		// Instruction runs into a page we could not fetch, leave it for the next block
+		if ( offset + instr.length ( ) > fetched ) {
+			break;
+		}
+
+		const auto handler = ( *dispatch ) [ static_cast< size_t >( instr.mnemonic ( ) ) ];
+		block->instructions.push_back ( { instr, handler } );
+		offset += instr.length ( );
+
+		// HLT can end a run, which only happens between blocks
+		if ( instr.length ( ) == 0 || instr.flow_control ( ) != FlowControl::Next || instr.mnemonic ( ) == Mnemonic::Hlt ) {
+			break;
+		}
+	}
+
+	if ( block->instructions.empty ( ) ) {
+		return nullptr;
+	}
+
+	// Element addresses are final now that the block is complete
+	for ( auto& entry : block->instructions ) {
+		entry.operands = lower_operands ( entry.instr );
+		entry.operands.source = &entry.instr;
+		entry.handler = specialized_handler ( entry.instr, entry.handler );
+		entry.exec_hook = memory->has_hook ( entry.instr.ip, entry.instr.length ( ), PageProtection::EXEC );
+	}
+
+	// A flag-setting instruction directly before the terminating jcc runs fused with it, unless the jcc is hooked
+	if ( block->instructions.size ( ) >= 2 ) {
+		auto& first = block->instructions [ block->instructions.size ( ) - 2 ];
+		const auto& second = block->instructions.back ( );
+		if ( !second.exec_hook ) {
+			first.fused = fused_handler ( first.instr, second.instr );
+		}
+	}
+
+	block->end = address + offset;
+	block->fallthrough.address = block->end;
+	const auto& last = block->instructions.back ( ).instr;
+	switch ( last.flow_control ( ) ) {
+		case FlowControl::ConditionalBranch:
+		case FlowControl::UnconditionalBranch:
+		case FlowControl::Call:
+			if ( last.op0_kind ( ) == OpKindSimple::NearBranch ) {
+				block->taken.address = last.branch_target ( );
+			}
+			break;
+		case FlowControl::IndirectBranch:
+		case FlowControl::IndirectCall:
+		case FlowControl::Return:
+			block->indirect_exit = true;
+			break;
+		default:
+			break;
+	}
+
+	for ( uint64_t page = address & ~( memory->page_size - 1 ); page < block->end; page += memory->page_size ) {
+		memory->mark_code ( page );
+	}
+	return block_cache.insert ( std::move ( block ) );
+}
+
+void KUBERA::invalidate_modified_code ( ) {
+	const auto page_size = memory->page_size;
+	const bool complete = memory->for_each_code_write ( block_cache.synced_sequence, [ this, page_size ] ( uint64_t page )
+	{
+		block_cache.invalidate ( page, page + page_size );
+	} );
+
+	if ( !complete ) {
+		block_cache.flush ( );
+	}
+	block_cache.synced_sequence = memory->code_write_sequence ( );
+}
+
+BasicBlock* KUBERA::lookup_block ( uint64_t address ) {
+	if ( auto* block = block_cache.find ( address ) ) {
+		return block;
+	}
+	return build_block ( address );
+}
+
+BasicBlock* KUBERA::chain_block ( BasicBlock& from, uint64_t address ) {
+	if ( auto* linked = from.linked ( address, block_cache.generation, memory->protection_sequence ( ) ) ) {
+		return linked;
+	}
+	auto* target = lookup_block ( address );
+	if ( target ) {
+		// Read the generation after the lookup, which may have flushed the cache to make room
+		from.link ( *target, block_cache.generation, memory->protection_sequence ( ) );
+	}
+	return target;
+}
+
+DecodedInstruction* KUBERA::next_decoded_instruction ( uint64_t address ) {
+	auto* block = block_cache.cursor_block;
+	auto index = block_cache.cursor_index;
+	if ( !block || index >= block->instructions.size ( ) || block->instructions [ index ].instr.ip != address ) {
+		block = block ? chain_block ( *block, address ) : lookup_block ( address );
+		if ( !block ) {
+			return nullptr;
+		}
+		index = 0;
+		if ( coverage_map ) [[unlikely]] {
+			record_edge ( block->start );
+		}
+	}
+
+	block_cache.cursor_block = block;
+	block_cache.cursor_index = index + 1;
+	return &block->instructions [ index ];
+}
+
+template<bool Profiled>
+bool KUBERA::execute_entry ( DecodedInstruction& entry, uint64_t stop_rip, std::size_t budget, std::size_t& executed,
+	[[maybe_unused]] Profiler::BlockProfile* block_profile ) {
+	const auto current_rip = entry.instr.ip;
+	// A taken branch (or a switch to stop_rip) ends the block early
+	if ( rip ( ) != current_rip || current_rip == stop_rip || executed == budget ) {
+		return false;
+	}
+
+	if ( entry.exec_hook ) [[unlikely]] {
+		memory->dispatch_hooks ( current_rip, entry.instr.length ( ), PageProtection::EXEC );
+		// The hook redirected execution
+		if ( rip ( ) != current_rip ) {
+			return false;
+		}
+	}
+
+	// The pair runs as one superinstruction when both halves would have run here, traces keep them as two steps.
+	// Profiles time every handler on its own, so they run the pair unfused.
+	if constexpr ( !Profiled ) {
+		if ( entry.fused && executed + 2 <= budget && ( &entry + 1 )->instr.ip != stop_rip && !trace_stream ) {
+			current_operands = &entry.operands;
+			entry.fused ( entry, *( &entry + 1 ), *this );
+			increment_tsc ( );
+			increment_tsc ( );
+			executed += 2;
+			// Whatever follows is the jcc itself, which only runs again if it branched to itself
+			return true;
+		}
+	}
+
+	if ( trace_stream ) [[unlikely]] {
+		trace_stream->begin_step ( current_rip );
+	}
+	current_operands = &entry.operands;
+	if constexpr ( Profiled ) {
+		const uint64_t begin = READ_TSC ( );
+		entry.handler ( entry.instr, *this );
+		profiler->record_instruction ( entry.instr, READ_TSC ( ) - begin, block_profile );
+	}
+	else {
+		entry.handler ( entry.instr, *this );
+	}
+	if ( rip ( ) == current_rip ) {
+		rip ( ) += entry.instr.length ( );
+	}
+	increment_tsc ( );
+	++executed;
+	if ( trace_stream ) [[unlikely]] {
+		trace_end_step ( );
+	}
+
+	// The instruction wrote to a page holding decoded code, the rest of the block may be stale
+	return memory->code_write_sequence ( ) == block_cache.synced_sequence;
+}
+
+std::size_t KUBERA::execute_block ( BasicBlock& block, uint64_t stop_rip, std::size_t budget ) {
+	if ( coverage_map ) [[unlikely]] {
+		record_edge ( block.start );
+	}
+	if ( profiler ) [[unlikely]] {
+		return execute_block_profiled ( block, stop_rip, budget );
+	}
+
+	current_block = &block;
+	std::size_t executed = 0;
+	for ( auto& entry : block.instructions ) {
+		if ( !execute_entry<false> ( entry, stop_rip, budget, executed, nullptr ) ) {
+			break;
+		}
+	}
+	return executed;
+}
+
+std::size_t KUBERA::execute_block_profiled ( BasicBlock& block, uint64_t stop_rip, std::size_t budget ) {
+	auto& block_profile = profiler->block ( block.start, block.end );
+	const uint64_t block_begin = READ_TSC ( );
+
+	current_block = &block;
+	std::size_t executed = 0;
+	for ( auto& entry : block.instructions ) {
+		if ( !execute_entry<true> ( entry, stop_rip, budget, executed, &block_profile ) ) {
+			break;
+		}
+	}
+
+	profiler->record_block ( block_profile, executed, READ_TSC ( ) - block_begin );
+	return executed;
+}
+
+std::size_t KUBERA::run_block ( ) {
+	bind_fault_slot ( );
+	block_cache.collect ( );
+	sync_block_cache ( );
+	// A block that cannot be fetched leaves its EXEC fault in last_fault
+	auto* block = lookup_block ( rip ( ) );
+	if ( !block ) {
+		return 0;
+	}
+	return execute_block ( *block, UINT64_MAX, SIZE_MAX );
+}
+
+std::size_t KUBERA::run_until ( uint64_t end_rip, std::size_t max_instructions ) {
+	std::size_t executed = 0;
+	BasicBlock* previous = nullptr;
+	bind_fault_slot ( );
+	while ( rip ( ) != end_rip && executed < max_instructions ) {
+		sync_block_cache ( );
+		// Blocks retired by the sync stay alive until collect, previous can still be followed (its links are dead by then)
+		auto* block = previous ? chain_block ( *previous, rip ( ) ) : lookup_block ( rip ( ) );
+		block_cache.collect ( );
+		if ( !block ) {
+			break;
+		}
+
+		const auto count = execute_block ( *block, end_rip, max_instructions - executed );
+		if ( count == 0 ) {
+			// Nothing retired but a handler may still have redirected RIP, only a stuck RIP ends the run
+			if ( rip ( ) == block->start ) {
+				break;
+			}
+			previous = nullptr;
+			continue;
+		}
+		executed += count;
+		previous = block;
+	}
+	return executed;
+}
+
+RunResult KUBERA::run ( const RunOptions& options ) {
+	bind_fault_slot ( );
+	pending_stop = StopReason::None;
+	const bool timed = options.deadline != std::chrono::steady_clock::time_point::max ( );
+	const uint64_t faults = memory->fault_count ( );
+
+	RunResult result;
+	std::size_t next_deadline_check = deadline_interval;
+	BasicBlock* previous = nullptr;
+	while ( true ) {
+		if ( stop_requested.load ( std::memory_order_relaxed ) ) [[unlikely]] {
+			stop_requested.store ( false, std::memory_order_relaxed );
+			result.reason = StopReason::StopRequested;
+			break;
+		}
+		if ( rip ( ) == options.stop_rip ) {
+			result.reason = StopReason::Breakpoint;
+			break;
+		}
+		if ( result.instructions >= options.budget ) {
+			result.reason = StopReason::Budget;
+			break;
+		}
+		if ( timed && result.instructions >= next_deadline_check ) {
+			next_deadline_check = result.instructions + deadline_interval;
+			if ( std::chrono::steady_clock::now ( ) >= options.deadline ) {
+				result.reason = StopReason::Timeout;
+				break;
+			}
+		}
+
+		sync_block_cache ( );
+		auto* block = previous ? chain_block ( *previous, rip ( ) ) : lookup_block ( rip ( ) );
+		block_cache.collect ( );
+		if ( !block ) {
+			result.reason = StopReason::Fault;
+			break;
+		}
+
+		result.instructions += execute_block ( *block, options.stop_rip, options.budget - result.instructions );
+		previous = block;
+
+		if ( pending_stop != StopReason::None ) [[unlikely]] {
+			result.reason = std::exchange ( pending_stop, StopReason::None );
+			break;
+		}
+		if ( options.stop_on_fault && memory->fault_count ( ) != faults ) [[unlikely]] {
+			result.reason = StopReason::Fault;
+			break;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,414 @@
+#include "../checkpoint.hpp"
+#include "../KUBERA.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+
+#if KUBERA_TRACE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace kubera;
+
+namespace
+{
+	constexpr std::size_t header_size = 24;
+
+	void store_le ( uint8_t* out, uint64_t value, std::size_t bytes ) {
+		for ( std::size_t i = 0; i < bytes; ++i ) {
+			out [ i ] = static_cast< uint8_t >( value >> ( i * 8 ) );
+		}
+	}
+
+	uint64_t load_le ( const uint8_t* in, std::size_t bytes ) {
+		uint64_t value = 0;
+		for ( std::size_t i = 0; i < bytes; ++i ) {
+			value |= static_cast< uint64_t >( in [ i ] ) << ( i * 8 );
+		}
+		return value;
+	}
+
+	uint64_t base_fingerprint ( const Snapshot& base ) {
+		uint64_t hash = base.memory->fingerprint ( );
+		for ( const auto value : base.cpu.registers ) {
+			checkpoint::mix ( hash, value );
+		}
+		checkpoint::mix ( hash, base.cpu.stack_base );
+		checkpoint::mix ( hash, base.cpu.stack_size );
+		return hash;
+	}
+
+	// Only fields the base fingerprint covers are XOR-encoded, a base rebuilt elsewhere agrees on those but not on the rest
+	// (the TSC in particular comes from the host it was built on), which is stored as is
+	void write_cpu ( const CPU& cpu, const CPU& base, CheckpointWriter& out ) {
+		out.put ( static_cast< uint8_t >( checkpoint::RecordKind::Cpu ) );
+		for ( std::size_t i = 0; i < cpu.registers.size ( ); ++i ) {
+			out.put_varint ( cpu.registers [ i ] ^ base.registers [ i ] );
+		}
+		out.put_varint ( cpu.stack_base ^ base.stack_base );
+		out.put_varint ( cpu.stack_size ^ base.stack_size );
+		out.put_varint ( cpu.ssp );
+		out.put_varint ( cpu.rflags.value );
+
+		out.put ( static_cast< uint8_t >( cpu.lazy_flags.op ) );
+		out.put ( cpu.lazy_flags.size );
+		out.put_varint ( cpu.lazy_flags.src1 );
+		out.put_varint ( cpu.lazy_flags.src2 );
+		out.put_varint ( cpu.lazy_flags.result );
+
+		out.put_varint ( cpu.mxcsr.value );
+		out.put_varint ( cpu.timestamp_counter );
+		out.put ( cpu.current_privilege_level );
+
+		for ( const auto& value : cpu.fpu.fpu_stack ) {
+			const auto [mantissa, sign_exp] = fp80::to_ieee754_80 ( value );
+			out.put_varint ( mantissa );
+			out.put_varint ( sign_exp );
+		}
+		out.put_varint ( cpu.fpu.fpu_tag_word.value );
+		out.put_varint ( cpu.fpu.fpu_status_word.value );
+		out.put_varint ( cpu.fpu.fpu_control_word.value );
+		out.put ( cpu.fpu.fpu_top );
+
+		// Most code never touches the upper vector registers, only the non-zero ones are stored
+		uint32_t nonzero = 0;
+		for ( std::size_t i = 0; i < cpu.vector_registers.size ( ); ++i ) {
+			const auto& bytes = cpu.vector_registers [ i ].bytes;
+			if ( std::any_of ( std::begin ( bytes ), std::end ( bytes ), [ ] ( uint8_t byte ) { return byte != 0; } ) ) {
+				nonzero |= 1u << i;
+			}
+		}
+		out.put_varint ( nonzero );
+		for ( uint32_t mask = nonzero; mask != 0; mask &= mask - 1 ) {
+			out.put_bytes ( cpu.vector_registers [ std::countr_zero ( mask ) ].bytes, sizeof ( VectorRegister::bytes ) );
+		}
+
+		out.put_varint ( cpu.shadow_stack.size ( ) );
+		for ( const auto value : cpu.shadow_stack ) {
+			out.put_varint ( value );
+		}
+	}
+
+	// cpu starts out as the base CPU, the XOR-encoded fields are relative to it
+	bool read_cpu ( CheckpointReader& in, CPU& cpu ) {
+		uint64_t value = 0;
+		auto xor_into = [ &in, &value ] ( auto& field )
+		{
+			if ( !in.get_varint ( value ) ) {
+				return false;
+			}
+			field ^= static_cast< std::remove_reference_t<decltype( field )> >( value );
+			return true;
+		};
+		auto read_into = [ &in, &value ] ( auto& field )
+		{
+			if ( !in.get_varint ( value ) ) {
+				return false;
+			}
+			field = static_cast< std::remove_reference_t<decltype( field )> >( value );
+			return true;
+		};
+
+		for ( auto& reg : cpu.registers ) {
+			if ( !xor_into ( reg ) ) {
+				return false;
+			}
+		}
+		if ( !xor_into ( cpu.stack_base ) || !xor_into ( cpu.stack_size ) || !read_into ( cpu.ssp ) || !read_into ( cpu.rflags.value ) ) {
+			return false;
+		}
+
+		uint8_t op = 0;
+		if ( !in.get ( op ) || op > static_cast< uint8_t >( FlagOp::Dec ) || !in.get ( cpu.lazy_flags.size ) ) {
+			return false;
+		}
+		cpu.lazy_flags.op = static_cast< FlagOp >( op );
+		if ( !read_into ( cpu.lazy_flags.src1 ) || !read_into ( cpu.lazy_flags.src2 ) || !read_into ( cpu.lazy_flags.result ) ) {
+			return false;
+		}
+
+		if ( !read_into ( cpu.mxcsr.value ) || !read_into ( cpu.timestamp_counter ) || !in.get ( cpu.current_privilege_level ) ) {
+			return false;
+		}
+
+		for ( auto& st : cpu.fpu.fpu_stack ) {
+			uint64_t mantissa = 0;
+			uint16_t sign_exp = 0;
+			if ( !read_into ( mantissa ) || !read_into ( sign_exp ) ) {
+				return false;
+			}
+			st = fp80::from_ieee754_80 ( { mantissa, sign_exp } );
+		}
+		if ( !read_into ( cpu.fpu.fpu_tag_word.value ) || !read_into ( cpu.fpu.fpu_status_word.value ) ||
+			!read_into ( cpu.fpu.fpu_control_word.value ) || !in.get ( cpu.fpu.fpu_top ) ) {
+			return false;
+		}
+
+		uint32_t nonzero = 0;
+		if ( !read_into ( nonzero ) ) {
+			return false;
+		}
+		for ( auto& reg : cpu.vector_registers ) {
+			reg = { };
+		}
+		for ( uint32_t mask = nonzero; mask != 0; mask &= mask - 1 ) {
+			if ( !in.get_bytes ( cpu.vector_registers [ std::countr_zero ( mask ) ].bytes, sizeof ( VectorRegister::bytes ) ) ) {
+				return false;
+			}
+		}
+
+		uint64_t depth = 0;
+		if ( !in.get_varint ( depth ) ) {
+			return false;
+		}
+		cpu.shadow_stack.clear ( );
+		for ( uint64_t i = 0; i < depth; ++i ) {
+			if ( !in.get_varint ( value ) ) {
+				return false;
+			}
+			cpu.shadow_stack.push_back ( value );
+		}
+		return true;
+	}
+};
+
+CheckpointWriter::CheckpointWriter ( CheckpointSink sink, trace::Compression compression, uint64_t base_fingerprint, uint32_t page_size )
+	: sink ( std::move ( sink ) ) {
+#if KUBERA_TRACE_ZSTD
+	if ( compression == trace::Compression::Zstd ) {
+		zstd_context = ZSTD_createCCtx ( );
+		compressed.resize ( ZSTD_CStreamOutSize ( ) );
+	}
+#endif
+	if ( !zstd_context ) {
+		compression = trace::Compression::None;
+	}
+
+	uint8_t header [ header_size ] = { };
+	std::memcpy ( header, checkpoint::magic.data ( ), checkpoint::magic.size ( ) );
+	store_le ( header + 8, checkpoint::format_version, 2 );
+	header [ 10 ] = static_cast< uint8_t >( compression );
+	store_le ( header + 12, base_fingerprint, 8 );
+	store_le ( header + 20, page_size, 4 );
+	write_out ( header, sizeof ( header ) );
+	buffer.reserve ( flush_threshold );
+}
+
+CheckpointWriter::~CheckpointWriter ( ) {
+#if KUBERA_TRACE_ZSTD
+	ZSTD_freeCCtx ( static_cast< ZSTD_CCtx* >( zstd_context ) );
+#endif
+}
+
+void CheckpointWriter::put_varint ( uint64_t value ) {
+	while ( value >= 0x80 ) {
+		put ( static_cast< uint8_t >( value | 0x80 ) );
+		value >>= 7;
+	}
+	put ( static_cast< uint8_t >( value ) );
+}
+
+void CheckpointWriter::put_bytes ( const void* data, std::size_t size ) {
+	const auto* bytes = static_cast< const uint8_t* >( data );
+	buffer.insert ( buffer.end ( ), bytes, bytes + size );
+	if ( buffer.size ( ) >= flush_threshold ) {
+		flush ( false );
+	}
+}
+
+bool CheckpointWriter::finish ( ) {
+	flush ( true );
+	return ok;
+}
+
+void CheckpointWriter::flush ( bool end ) {
+#if KUBERA_TRACE_ZSTD
+	if ( zstd_context ) {
+		auto* context = static_cast< ZSTD_CCtx* >( zstd_context );
+		ZSTD_inBuffer in { buffer.data ( ), buffer.size ( ), 0 };
+		while ( ok ) {
+			ZSTD_outBuffer out { compressed.data ( ), compressed.size ( ), 0 };
+			const auto remaining = ZSTD_compressStream2 ( context, &out, &in, end ? ZSTD_e_end : ZSTD_e_continue );
+			if ( ZSTD_isError ( remaining ) ) {
+				ok = false;
+				break;
+			}
+			write_out ( compressed.data ( ), out.pos );
+			if ( end ? remaining == 0 : in.pos == in.size ) {
+				break;
+			}
+		}
+		buffer.clear ( );
+		return;
+	}
+#endif
+	// Uncompressed output has no frame to end
+	( void ) end;
+	write_out ( buffer.data ( ), buffer.size ( ) );
+	buffer.clear ( );
+}
+
+void CheckpointWriter::write_out ( const void* data, std::size_t size ) {
+	if ( ok && size != 0 ) {
+		ok = sink ( data, size );
+	}
+}
+
+CheckpointReader::CheckpointReader ( CheckpointSource source ) : source ( std::move ( source ) ) {
+	uint8_t header [ header_size ];
+	for ( std::size_t got = 0; got < sizeof ( header ); ) {
+		const std::size_t read = this->source ( header + got, sizeof ( header ) - got );
+		if ( read == 0 ) {
+			return;
+		}
+		got += read;
+	}
+	if ( std::memcmp ( header, checkpoint::magic.data ( ), checkpoint::magic.size ( ) ) != 0 ||
+		load_le ( header + 8, 2 ) != checkpoint::format_version ) {
+		return;
+	}
+
+	const auto compression = static_cast< trace::Compression >( header [ 10 ] );
+	bool supported = compression == trace::Compression::None;
+#if KUBERA_TRACE_ZSTD
+	if ( compression == trace::Compression::Zstd ) {
+		zstd_context = ZSTD_createDCtx ( );
+		raw.resize ( ZSTD_DStreamInSize ( ) );
+		supported = true;
+	}
+#endif
+	if ( !supported ) {
+		return;
+	}
+	fingerprint = load_le ( header + 12, 8 );
+	checkpoint_page_size = static_cast< uint32_t >( load_le ( header + 20, 4 ) );
+	input.resize ( 0x10000 );
+	open = true;
+}
+
+CheckpointReader::~CheckpointReader ( ) {
+#if KUBERA_TRACE_ZSTD
+	ZSTD_freeDCtx ( static_cast< ZSTD_DCtx* >( zstd_context ) );
+#endif
+}
+
+bool CheckpointReader::refill ( ) {
+	input_pos = 0;
+	input_size = 0;
+	if ( !open ) {
+		return false;
+	}
+#if KUBERA_TRACE_ZSTD
+	if ( zstd_context ) {
+		while ( input_size == 0 ) {
+			if ( raw_pos == raw_size ) {
+				raw_size = source ( raw.data ( ), raw.size ( ) );
+				raw_pos = 0;
+				if ( raw_size == 0 ) {
+					return false;
+				}
+			}
+			ZSTD_inBuffer in { raw.data ( ), raw_size, raw_pos };
+			ZSTD_outBuffer out { input.data ( ), input.size ( ), 0 };
+			if ( ZSTD_isError ( ZSTD_decompressStream ( static_cast< ZSTD_DCtx* >( zstd_context ), &out, &in ) ) ) {
+				return false;
+			}
+			raw_pos = in.pos;
+			input_size = out.pos;
+		}
+		return true;
+	}
+#endif
+	input_size = source ( input.data ( ), input.size ( ) );
+	return input_size != 0;
+}
+
+bool CheckpointReader::get ( uint8_t& byte ) {
+	if ( input_pos == input_size && !refill ( ) ) [[unlikely]] {
+		return false;
+	}
+	byte = input [ input_pos++ ];
+	return true;
+}
+
+bool CheckpointReader::get_varint ( uint64_t& value ) {
+	value = 0;
+	for ( unsigned shift = 0; shift < 64; shift += 7 ) {
+		uint8_t byte = 0;
+		if ( !get ( byte ) ) {
+			return false;
+		}
+		value |= static_cast< uint64_t >( byte & 0x7F ) << shift;
+		if ( ( byte & 0x80 ) == 0 ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CheckpointReader::get_bytes ( void* data, std::size_t size ) {
+	auto* out = static_cast< uint8_t* >( data );
+	while ( size > 0 ) {
+		if ( input_pos == input_size && !refill ( ) ) {
+			return false;
+		}
+		const std::size_t to_copy = std::min ( size, input_size - input_pos );
+		std::memcpy ( out, input.data ( ) + input_pos, to_copy );
+		input_pos += to_copy;
+		out += to_copy;
+		size -= to_copy;
+	}
+	return true;
+}
+
+bool KUBERA::serialize_checkpoint ( const Snapshot& base, CheckpointSink sink, trace::Compression compression ) {
+	CheckpointWriter out ( std::move ( sink ), compression, base_fingerprint ( base ), static_cast< uint32_t >( memory->page_size ) );
+	write_cpu ( *cpu, base.cpu, out );
+	memory->write_checkpoint ( *base.memory, out );
+	out.put ( static_cast< uint8_t >( checkpoint::RecordKind::End ) );
+	return out.finish ( );
+}
+
+bool KUBERA::serialize_checkpoint ( const Snapshot& base, const std::filesystem::path& path, trace::Compression compression ) {
+	auto* file = std::fopen ( path.string ( ).c_str ( ), "wb" );
+	if ( !file ) {
+		return false;
+	}
+	const bool written = serialize_checkpoint ( base, [ file ] ( const void* data, std::size_t size )
+	{
+		return std::fwrite ( data, 1, size, file ) == size;
+	}, compression );
+	return std::fclose ( file ) == 0 && written;
+}
+
+bool KUBERA::load_checkpoint ( const Snapshot& base, CheckpointSource source ) {
+	CheckpointReader in ( std::move ( source ) );
+	if ( !in.is_open ( ) || in.base_fingerprint ( ) != base_fingerprint ( base ) || in.page_size ( ) != memory->page_size ) {
+		return false;
+	}
+
+	// Decoded up front so a checkpoint that is bad from the start leaves the instance alone
+	CPU loaded = base.cpu;
+	uint8_t kind = 0;
+	if ( !in.get ( kind ) || kind != static_cast< uint8_t >( checkpoint::RecordKind::Cpu ) || !read_cpu ( in, loaded ) ) {
+		return false;
+	}
+
+	restore ( base );
+	*cpu = std::move ( loaded );
+	return memory->load_checkpoint ( *base.memory, in );
+}
+
+bool KUBERA::load_checkpoint ( const Snapshot& base, const std::filesystem::path& path ) {
+	auto* file = std::fopen ( path.string ( ).c_str ( ), "rb" );
+	if ( !file ) {
+		return false;
+	}
+	const bool loaded = load_checkpoint ( base, [ file ] ( void* data, std::size_t size )
+	{
+		return std::fread ( data, 1, size, file );
+	} );
+	std::fclose ( file );
+	return loaded;
+}
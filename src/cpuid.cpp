@@ -0,0 +1,235 @@
+#include "../cpuid.hpp"
+#include <array>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+#include <intrin.h>
+#endif
+
+using namespace kubera;
+
+namespace
+{
+	// Subleaves captured of each indexed host leaf, more than any current part enumerates
+	constexpr uint32_t host_subleaf_limit = 64;
+
+	constexpr uint32_t range_base ( uint32_t leaf ) noexcept {
+		return leaf & 0xC0000000;
+	}
+
+	constexpr bool is_indexed ( uint32_t leaf ) noexcept {
+		switch ( leaf ) {
+			case 0x4: case 0x7: case 0xB: case 0xD: case 0xF: case 0x10: case 0x12: case 0x14: case 0x17: case 0x18:
+			case 0x1A: case 0x1B: case 0x1D: case 0x1E: case 0x1F: case 0x20: case 0x23: case 0x24:
+			case 0x8000001D: case 0x80000020: case 0x80000026:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	// Packs 12 characters in the ebx, edx, ecx order of leaf 0
+	void set_vendor_string ( CpuidLeaf& leaf, std::string_view vendor ) {
+		std::memcpy ( &leaf.ebx, vendor.data ( ), 4 );
+		std::memcpy ( &leaf.edx, vendor.data ( ) + 4, 4 );
+		std::memcpy ( &leaf.ecx, vendor.data ( ) + 8, 4 );
+	}
+
+	constexpr uint32_t bits ( std::initializer_list<uint8_t> positions ) noexcept {
+		uint32_t value = 0;
+		for ( const auto bit : positions ) {
+			value |= 1u << bit;
+		}
+		return value;
+	}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	CpuidLeaf host_cpuid ( uint32_t leaf, uint32_t subleaf ) {
+		CpuidLeaf out { };
+#ifdef _MSC_VER
+		std::array<int, 4> cpu_info;
+		__cpuidex ( cpu_info.data ( ), static_cast< int >( leaf ), static_cast< int >( subleaf ) );
+		std::memcpy ( &out, cpu_info.data ( ), sizeof ( out ) );
+#else
+		__asm__ __volatile__ (
+				"cpuid"
+				: "=a"( out.eax ), "=b"( out.ebx ), "=c"( out.ecx ), "=d"( out.edx )
+				: "a"( leaf ), "c"( subleaf )
+		);
+#endif
+		return out;
+	}
+
+	CpuidTable capture_host ( ) {
+		CpuidTable table;
+		auto capture_range = [ &table ] ( uint32_t base )
+		{
+			const uint32_t max = host_cpuid ( base, 0 ).eax;
+			if ( max < base || max - base > 0xFF ) {
+				return;
+			}
+			for ( uint32_t leaf = base; leaf <= max; ++leaf ) {
+				if ( !is_indexed ( leaf ) ) {
+					table.set ( leaf, 0, host_cpuid ( leaf, 0 ) );
+					continue;
+				}
+				for ( uint32_t subleaf = 0; subleaf < host_subleaf_limit; ++subleaf ) {
+					table.set ( leaf, subleaf, host_cpuid ( leaf, subleaf ), true );
+				}
+			}
+		};
+
+		capture_range ( 0 );
+		// Hypervisor leaves only exist when leaf 1 says so
+		if ( host_cpuid ( 1, 0 ).ecx & ( 1u << 31 ) ) {
+			capture_range ( 0x40000000 );
+		}
+		capture_range ( 0x80000000 );
+		return table;
+	}
+#endif
+};
+
+std::shared_ptr<const CpuidTable> CpuidTable::host ( ) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	static const auto table = std::make_shared<const CpuidTable> ( capture_host ( ) );
+#else
+	static const auto table = std::make_shared<const CpuidTable> ( profile ( VendorType::INTEL ) );
+#endif
+	return table;
+}
+
+CpuidTable CpuidTable::profile ( VendorType vendor ) {
+	CpuidTable table;
+	const bool amd = vendor == VendorType::AMD;
+
+	CpuidLeaf leaf0 { .eax = 0xD };
+	set_vendor_string ( leaf0, amd ? "AuthenticAMD" : "GenuineIntel" );
+	table.set ( 0, 0, leaf0 );
+
+	// Family 6 model 0x8F (Sapphire Rapids) and family 0x19 model 0x11 (Zen 4), one logical processor
+	table.set ( 1, 0, {
+		.eax = amd ? 0x00A10F11u : 0x000806F8u,
+		.ebx = 0x00010800,
+		// SSE3, SSSE3, CX16, SSE4.1, SSE4.2, POPCNT, XSAVE, OSXSAVE, AVX
+		.ecx = bits ( { 0, 9, 13, 19, 20, 23, 26, 27, 28 } ),
+		// FPU, TSC, CX8, CMOV, FXSR, SSE, SSE2
+		.edx = bits ( { 0, 4, 8, 15, 24, 25, 26 } ),
+	} );
+
+	table.set ( 7, 0, {
+		.eax = 1,
+		// BMI1, AVX2, BMI2, ERMS, AVX512F, AVX512DQ, AVX512CD, AVX512BW, AVX512VL
+		.ebx = bits ( { 3, 5, 8, 9, 16, 17, 28, 30, 31 } ),
+	}, true );
+	// APX_F
+	table.set ( 7, 1, { .edx = bits ( { 21 } ) }, true );
+
+	// XCR0 components x87, SSE, AVX, the three AVX-512 states and APX, sized for the standard format
+	table.set ( 0xD, 0, { .eax = 0x000800E7, .ebx = 2688, .ecx = 2688 }, true );
+	// XSAVEOPT
+	table.set ( 0xD, 1, { .eax = 1 }, true );
+	table.set ( 0xD, 2, { .eax = 256, .ebx = 576 }, true );
+	table.set ( 0xD, 5, { .eax = 64, .ebx = 1088 }, true );
+	table.set ( 0xD, 6, { .eax = 512, .ebx = 1152 }, true );
+	table.set ( 0xD, 7, { .eax = 1024, .ebx = 1664 }, true );
+	table.set ( 0xD, 19, { .eax = 128, .ebx = 960 }, true );
+
+	table.set ( 0x80000000, 0, { .eax = 0x80000008 } );
+	table.set ( 0x80000001, 0, {
+		// LAHF/SAHF, LZCNT, PREFETCHW
+		.ecx = bits ( { 0, 5, 8 } ),
+		// SYSCALL, NX, LM
+		.edx = bits ( { 11, 20, 29 } ),
+	} );
+
+	// Brand string, 48 bytes across 0x80000002-0x80000004
+	std::array<char, 48> brand { };
+	constexpr std::string_view brand_name = "KUBERA Virtual CPU";
+	std::memcpy ( brand.data ( ), brand_name.data ( ), brand_name.size ( ) );
+	for ( uint32_t i = 0; i < 3; ++i ) {
+		CpuidLeaf part;
+		std::memcpy ( &part, brand.data ( ) + i * sizeof ( part ), sizeof ( part ) );
+		table.set ( 0x80000002 + i, 0, part );
+	}
+
+	// 48 physical and 48 linear address bits
+	table.set ( 0x80000008, 0, { .eax = 0x3030 } );
+	return table;
+}
+
+CpuidLeaf CpuidTable::query ( uint32_t leaf, uint32_t subleaf ) const {
+	if ( const auto it = leaves.find ( leaf ); it != leaves.end ( ) ) {
+		const auto& entry = it->second;
+		if ( !entry.indexed ) {
+			return entry.subleaves.front ( );
+		}
+		return subleaf < entry.subleaves.size ( ) ? entry.subleaves [ subleaf ] : CpuidLeaf { };
+	}
+
+	// Inside its range, a leaf the CPU does not define reads as zeros
+	const auto base = leaves.find ( range_base ( leaf ) );
+	if ( base != leaves.end ( ) && leaf <= base->second.subleaves.front ( ).eax ) {
+		return { };
+	}
+
+	if ( vendor_type == VendorType::INTEL ) {
+		const auto basic = leaves.find ( 0 );
+		if ( basic != leaves.end ( ) ) {
+			const uint32_t max_basic = basic->second.subleaves.front ( ).eax;
+			if ( leaves.contains ( max_basic ) ) {
+				return query ( max_basic, subleaf );
+			}
+		}
+	}
+	return { };
+}
+
+void CpuidTable::set ( uint32_t leaf, uint32_t subleaf, const CpuidLeaf& value, bool indexed ) {
+	if ( leaf == 0 ) {
+		std::array<char, 12> vendor_string;
+		std::memcpy ( vendor_string.data ( ), &value.ebx, 4 );
+		std::memcpy ( vendor_string.data ( ) + 4, &value.edx, 4 );
+		std::memcpy ( vendor_string.data ( ) + 8, &value.ecx, 4 );
+		const std::string_view name ( vendor_string.data ( ), vendor_string.size ( ) );
+		vendor_type = name == "AuthenticAMD" || name == "HygonGenuine" ? VendorType::AMD : VendorType::INTEL;
+	}
+
+	auto& entry = leaves [ leaf ];
+	entry.indexed = indexed;
+	const std::size_t index = indexed ? subleaf : 0;
+	if ( entry.subleaves.size ( ) <= index ) {
+		entry.subleaves.resize ( index + 1 );
+	}
+	entry.subleaves [ index ] = value;
+}
+
+void CpuidTable::set_feature ( uint32_t leaf, uint32_t subleaf, CpuidRegister reg, uint8_t bit, bool enabled ) {
+	// Starts from the stored value, not what query would fall back to for a missing leaf
+	const auto it = leaves.find ( leaf );
+	const bool indexed = it != leaves.end ( ) ? it->second.indexed : is_indexed ( leaf );
+	CpuidLeaf value { };
+	if ( it != leaves.end ( ) ) {
+		const std::size_t index = indexed ? subleaf : 0;
+		if ( index < it->second.subleaves.size ( ) ) {
+			value = it->second.subleaves [ index ];
+		}
+	}
+
+	uint32_t* target = nullptr;
+	switch ( reg ) {
+		case CpuidRegister::EAX: target = &value.eax; break;
+		case CpuidRegister::EBX: target = &value.ebx; break;
+		case CpuidRegister::ECX: target = &value.ecx; break;
+		case CpuidRegister::EDX: target = &value.edx; break;
+	}
+	*target = enabled ? *target | ( 1u << bit ) : *target & ~( 1u << bit );
+	set ( leaf, subleaf, value, indexed );
+}
+
+uint64_t CpuidTable::xcr0 ( ) const {
+	const auto state = query ( 0xD, 0 );
+	return ( static_cast< uint64_t >( state.edx ) << 32 ) | state.eax;
+}
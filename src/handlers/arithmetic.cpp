@@ -14,17 +14,7 @@ void handlers::add ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t ub = b & mask;
 	const uint64_t res = ( ua + ub ) & mask;
 
-	const int64_t sa = SIGN_EXTEND ( ua, op_size );
-	const int64_t sb = SIGN_EXTEND ( ub, op_size );
-	const int64_t sres = SIGN_EXTEND ( res, op_size );
-
-	auto& flags = context.get_flags ( );
-	flags.CF = res < ua;
-	flags.ZF = res == 0;
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.AF = ( ( ua & 0xF ) + ( ub & 0xF ) ) > 0xF; // Carry from bit 3 to 4
-	flags.SF = ( res >> ( op_size * 8 - 1 ) ) & 1;
-	flags.OF = ( sa > 0 && sb > 0 && sres < 0 ) || ( sa < 0 && sb < 0 && sres > 0 );
+	context.set_lazy_flags ( FlagOp::Add, op_size, ua, ub, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -39,17 +29,7 @@ void handlers::sub ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t ub = b & mask;
 	const uint64_t res = ( ua - ub ) & mask;
 
-	const int64_t sa = SIGN_EXTEND ( ua, op_size );
-	const int64_t sb = SIGN_EXTEND ( ub, op_size );
-	const int64_t sres = SIGN_EXTEND ( res, op_size );
-
-	auto& flags = context.get_flags ( );
-	flags.CF = ua < ub;
-	flags.ZF = res == 0;
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0; // Even parity for low 8 bits
-	flags.AF = ( ( ua ^ ub ^ res ) & 0x10 ) != 0; // Borrow from bit 3 to 4
-	flags.SF = sres < 0;
-	flags.OF = ( sa >= 0 && sb < 0 && sres < 0 ) || ( sa < 0 && sb >= 0 && sres >= 0 );
+	context.set_lazy_flags ( FlagOp::Sub, op_size, ua, ub, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -62,15 +42,7 @@ void handlers::inc ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t ua = a & mask;
 	const uint64_t res = ( ua + 1 ) & mask;
 
-	const int64_t sa = SIGN_EXTEND ( ua, op_size );
-	const int64_t sres = SIGN_EXTEND ( res, op_size );
-
-	auto& flags = context.get_flags ( );
-	flags.OF = ( sa >= 0 && sres < 0 );
-	flags.SF = ( res >> ( op_size * 8 - 1 ) ) & 1;
-	flags.ZF = ( res == 0 );
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.AF = ( ( ua & 0xF ) + 1 ) > 0xF;
+	context.set_lazy_flags ( FlagOp::Inc, op_size, ua, 1, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -83,15 +55,7 @@ void handlers::dec ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t ua = a & mask;
 	const uint64_t res = ( ua - 1 ) & mask;
 
-	const int64_t sa = SIGN_EXTEND ( ua, op_size );
-	const int64_t sres = SIGN_EXTEND ( res, op_size );
-
-	auto& flags = context.get_flags ( );
-	flags.OF = ( sa < 0 && sres >= 0 );
-	flags.SF = ( res >> ( op_size * 8 - 1 ) ) & 1;
-	flags.ZF = ( res == 0 );
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.AF = ( ua & 0xF ) == 0;
+	context.set_lazy_flags ( FlagOp::Dec, op_size, ua, 1, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -127,15 +127,8 @@ void handlers::and_ ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t mask = GET_OPERAND_MASK ( op_size );
 
 	const uint64_t res = ( a & b ) & mask;
-	const int64_t sres = static_cast< int64_t >( res << ( 64 - op_size * 8 ) ) >> ( 64 - op_size * 8 );
 
-	auto& flags = context.get_flags ( );
-	flags.SF = sres < 0;
-	flags.ZF = ( res == 0 );
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.CF = 0;
-	flags.OF = 0;
-	flags.AF = 0;
+	context.set_lazy_flags ( FlagOp::Logic, op_size, a & mask, b & mask, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -149,15 +142,8 @@ void handlers::or_ ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t mask = GET_OPERAND_MASK ( op_size );
 
 	const uint64_t res = ( a | b ) & mask;
-	const int64_t sres = static_cast< int64_t >( res << ( 64 - op_size * 8 ) ) >> ( 64 - op_size * 8 );
 
-	auto& flags = context.get_flags ( );
-	flags.SF = sres < 0;
-	flags.ZF = ( res == 0 );
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.CF = 0;
-	flags.OF = 0;
-	flags.AF = 0;
+	context.set_lazy_flags ( FlagOp::Logic, op_size, a & mask, b & mask, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
@@ -172,13 +158,7 @@ void handlers::xor_ ( const iced::Instruction& instr, KUBERA& context ) {
 
 	const uint64_t res = ( a ^ b ) & mask;
 
-	auto& flags = context.get_flags ( );
-	flags.SF = ( res >> ( op_size * 8 - 1 ) ) & 1;
-	flags.ZF = ( res == 0 );
-	flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-	flags.CF = 0;
-	flags.OF = 0;
-	flags.AF = 0;
+	context.set_lazy_flags ( FlagOp::Logic, op_size, a & mask, b & mask, res );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, res, context );
 }
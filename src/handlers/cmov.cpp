@@ -15,95 +15,95 @@ void cmovcc ( const iced::Instruction& instr, KUBERA& context, Func condition )
 /// CMOVO-Conditional Move if Overflow
 /// Moves the source operand to the destination if OF is set.
 void handlers::cmovo ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).OF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_of ( ); } );
 }
 
 /// CMOVNL-Conditional Move if Not Less
 /// Moves the source operand to the destination if SF equals OF.
 void handlers::cmovnl ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF == context.get_flags ( ).OF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ) == context.flag_of ( ); } );
 }
 
 /// CMOVBE-Conditional Move if Below or Equal
 /// Moves the source operand to the destination if CF or ZF is set.
 void handlers::cmovbe ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).CF || context.get_flags ( ).ZF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_cf ( ) || context.flag_zf ( ); } );
 }
 
 /// CMOVZ-Conditional Move if Zero
 /// Moves the source operand to the destination if ZF is set.
 void handlers::cmovz ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).ZF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_zf ( ); } );
 }
 
 /// CMOVLE-Conditional Move if Less or Equal
 /// Moves the source operand to the destination if ZF is set or SF differs from OF.
 void handlers::cmovle ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).ZF || ( context.get_flags ( ).SF != context.get_flags ( ).OF ); } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_zf ( ) || ( context.flag_sf ( ) != context.flag_of ( ) ); } );
 }
 
 /// CMOVL-Conditional Move if Less
 /// Moves the source operand to the destination if SF differs from OF.
 void handlers::cmovl ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF != context.get_flags ( ).OF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ) != context.flag_of ( ); } );
 }
 
 /// CMOVNP-Conditional Move if Not Parity
 /// Moves the source operand to the destination if PF is clear.
 void handlers::cmovnp ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).PF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_pf ( ); } );
 }
 
 /// CMOVNS-Conditional Move if Not Sign
 /// Moves the source operand to the destination if SF is clear.
 void handlers::cmovns ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).SF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_sf ( ); } );
 }
 
 /// CMOVP-Conditional Move if Parity
 /// Moves the source operand to the destination if PF is set.
 void handlers::cmovp ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).PF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_pf ( ); } );
 }
 
 /// CMOVNB-Conditional Move if Not Below
 /// Moves the source operand to the destination if CF is clear.
 void handlers::cmovnb ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).CF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_cf ( ); } );
 }
 
 /// CMOVNO-Conditional Move if Not Overflow
 /// Moves the source operand to the destination if OF is clear.
 void handlers::cmovno ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).OF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_of ( ); } );
 }
 
 /// CMOVS-Conditional Move if Sign
 /// Moves the source operand to the destination if SF is set.
 void handlers::cmovs ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ); } );
 }
 
 /// CMOVNZ-Conditional Move if Not Zero
 /// Moves the source operand to the destination if ZF is clear.
 void handlers::cmovnz ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).ZF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_zf ( ); } );
 }
 
 /// CMOVNBE-Conditional Move if Not Below or Equal
 /// Moves the source operand to the destination if CF and ZF are clear.
 void handlers::cmovnbe ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).ZF && !context.get_flags ( ).CF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_zf ( ) && !context.flag_cf ( ); } );
 }
 
 /// CMOVB-Conditional Move if Below
 /// Moves the source operand to the destination if CF is set.
 void handlers::cmovb ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).CF; } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_cf ( ); } );
 }
 
 /// CMOVNLE-Conditional Move if Not Less or Equal
 /// Moves the source operand to the destination if ZF is clear and SF equals OF.
 void handlers::cmovnle ( const iced::Instruction& instr, KUBERA& context ) {
-  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).ZF && ( context.get_flags ( ).SF == context.get_flags ( ).OF ); } );
+  cmovcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_zf ( ) && ( context.flag_sf ( ) == context.flag_of ( ) ); } );
 }
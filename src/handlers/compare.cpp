@@ -16,17 +16,7 @@ void handlers::cmp ( const iced::Instruction& instr, KUBERA& context ) {
   const uint64_t ub = src2 & mask;
   const uint64_t res = ( ua - ub ) & mask;
 
-  const int64_t sa = SIGN_EXTEND ( ua, op_size );
-  const int64_t sb = SIGN_EXTEND ( ub, op_size );
-  const int64_t sres = SIGN_EXTEND ( res, op_size );
-
-  auto& flags = context.get_flags ( );
-  flags.CF = ( ua < ub );
-  flags.ZF = ( res == 0 );
-  flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-  flags.AF = ( ( ua ^ ub ^ res ) & 0x10 ) != 0;
-  flags.SF = ( sres < 0 );
-  flags.OF = ( sa >= 0 && sb < 0 && sres < 0 ) || ( sa < 0 && sb >= 0 && sres >= 0 );
+  context.set_lazy_flags ( FlagOp::Sub, op_size, ua, ub, res );
 }
 
 /// TEST-Logical Compare
@@ -39,13 +29,7 @@ void handlers::test ( const iced::Instruction& instr, KUBERA& context ) {
 
   const uint64_t res = ( src1 & src2 ) & mask;
 
-  auto& flags = context.get_flags ( );
-  flags.SF = ( res >> ( op_size * 8 - 1 ) ) & 1;
-  flags.ZF = ( res == 0 );
-  flags.PF = std::popcount ( res & 0xFF ) % 2 == 0;
-  flags.CF = 0;
-  flags.OF = 0;
-  flags.AF = 0;
+  context.set_lazy_flags ( FlagOp::Logic, op_size, src1 & mask, src2 & mask, res );
 }
 
 /// CMPXCHG-Compare and Exchange
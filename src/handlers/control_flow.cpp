@@ -13,7 +13,7 @@ void handlers::jmp ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNE - Jump if Not Equal
 /// Jumps to the target address if the zero flag (ZF) is 0, without affecting flags.
 void handlers::jne ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).ZF ) {
+	if ( !context.flag_zf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -21,7 +21,7 @@ void handlers::jne ( const iced::Instruction& instr, KUBERA& context ) {
 /// JE - Jump if Equal
 /// Jumps to the target address if the zero flag (ZF) is 1, without affecting flags.
 void handlers::je ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( context.get_flags ( ).ZF ) {
+	if ( context.flag_zf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -29,8 +29,7 @@ void handlers::je ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNBE - Jump if Not Below or Equal
 /// Jumps to the target address if the carry flag (CF) is 0 and the zero flag (ZF) is 0, without affecting flags.
 void handlers::jnbe ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( !flags.CF && !flags.ZF ) {
+	if ( !context.flag_cf ( ) && !context.flag_zf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -38,8 +37,7 @@ void handlers::jnbe ( const iced::Instruction& instr, KUBERA& context ) {
 /// JG - Jump if Greater
 /// Jumps to the target address if the zero flag (ZF) is 0 and the sign flag (SF) equals the overflow flag (OF), without affecting flags.
 void handlers::jg ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( !flags.ZF && flags.SF == flags.OF ) {
+	if ( !context.flag_zf ( ) && context.flag_sf ( ) == context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -47,8 +45,7 @@ void handlers::jg ( const iced::Instruction& instr, KUBERA& context ) {
 /// JL - Jump if Less
 /// Jumps to the target address if the sign flag (SF) does not equal the overflow flag (OF), without affecting flags.
 void handlers::jl ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( flags.SF != flags.OF ) {
+	if ( context.flag_sf ( ) != context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -56,7 +53,7 @@ void handlers::jl ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNB - Jump if Not Below
 /// Jumps to the target address if the carry flag (CF) is 0, without affecting flags.
 void handlers::jnb ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).CF ) {
+	if ( !context.flag_cf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -64,7 +61,7 @@ void handlers::jnb ( const iced::Instruction& instr, KUBERA& context ) {
 /// JB - Jump if Below
 /// Jumps to the target address if the carry flag (CF) is 1, without affecting flags.
 void handlers::jb ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( context.get_flags ( ).CF ) {
+	if ( context.flag_cf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -72,7 +69,7 @@ void handlers::jb ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNS - Jump if Not Sign
 /// Jumps to the target address if the sign flag (SF) is 0, without affecting flags.
 void handlers::jns ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).SF ) {
+	if ( !context.flag_sf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -80,8 +77,7 @@ void handlers::jns ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNL - Jump if Not Less
 /// Jumps to the target address if the sign flag (SF) equals the overflow flag (OF), without affecting flags.
 void handlers::jnl ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( flags.SF == flags.OF ) {
+	if ( context.flag_sf ( ) == context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -89,7 +85,7 @@ void handlers::jnl ( const iced::Instruction& instr, KUBERA& context ) {
 /// JO - Jump if Overflow
 /// Jumps to the target address if the overflow flag (OF) is 1, without affecting flags.
 void handlers::jo ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( context.get_flags ( ).OF ) {
+	if ( context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -97,7 +93,7 @@ void handlers::jo ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNO - Jump if Not Overflow
 /// Jumps to the target address if the overflow flag (OF) is 0, without affecting flags.
 void handlers::jno ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).OF ) {
+	if ( !context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -105,8 +101,7 @@ void handlers::jno ( const iced::Instruction& instr, KUBERA& context ) {
 /// JBE - Jump if Below or Equal
 /// Jumps to the target address if the carry flag (CF) is 1 or the zero flag (ZF) is 1, without affecting flags.
 void handlers::jbe ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( flags.CF || flags.ZF ) {
+	if ( context.flag_cf ( ) || context.flag_zf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -114,7 +109,7 @@ void handlers::jbe ( const iced::Instruction& instr, KUBERA& context ) {
 /// JS - Jump if Sign
 /// Jumps to the target address if the sign flag (SF) is 1, without affecting flags.
 void handlers::js ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( context.get_flags ( ).SF ) {
+	if ( context.flag_sf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -122,8 +117,7 @@ void handlers::js ( const iced::Instruction& instr, KUBERA& context ) {
 /// JA - Jump if Above
 /// Jumps to the target address if the carry flag (CF) is 0 and the zero flag (ZF) is 0, without affecting flags.
 void handlers::ja ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( !flags.CF && !flags.ZF ) {
+	if ( !context.flag_cf ( ) && !context.flag_zf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -131,7 +125,7 @@ void handlers::ja ( const iced::Instruction& instr, KUBERA& context ) {
 /// JAE - Jump if Above or Equal
 /// Jumps to the target address if the carry flag (CF) is 0, without affecting flags.
 void handlers::jae ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).CF ) {
+	if ( !context.flag_cf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -139,8 +133,7 @@ void handlers::jae ( const iced::Instruction& instr, KUBERA& context ) {
 /// JGE - Jump if Greater or Equal
 /// Jumps to the target address if the sign flag (SF) equals the overflow flag (OF), without affecting flags.
 void handlers::jge ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( flags.SF == flags.OF ) {
+	if ( context.flag_sf ( ) == context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -148,8 +141,7 @@ void handlers::jge ( const iced::Instruction& instr, KUBERA& context ) {
 /// JLE - Jump if Less or Equal
 /// Jumps to the target address if the zero flag (ZF) is 1 or the sign flag (SF) does not equal the overflow flag (OF), without affecting flags.
 void handlers::jle ( const iced::Instruction& instr, KUBERA& context ) {
-	const auto& flags = context.get_flags ( );
-	if ( flags.ZF || flags.SF != flags.OF ) {
+	if ( context.flag_zf ( ) || context.flag_sf ( ) != context.flag_of ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -157,7 +149,7 @@ void handlers::jle ( const iced::Instruction& instr, KUBERA& context ) {
 /// JP - Jump if Parity
 /// Jumps to the target address if the parity flag (PF) is 1, without affecting flags.
 void handlers::jp ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( context.get_flags ( ).PF ) {
+	if ( context.flag_pf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -165,7 +157,7 @@ void handlers::jp ( const iced::Instruction& instr, KUBERA& context ) {
 /// JNP - Jump if Not Parity
 /// Jumps to the target address if the parity flag (PF) is 0, without affecting flags.
 void handlers::jnp ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( !context.get_flags ( ).PF ) {
+	if ( !context.flag_pf ( ) ) {
 		handlers::jmp ( instr, context );
 	}
 }
@@ -200,14 +192,17 @@ void handlers::jrcxz ( const iced::Instruction& instr, KUBERA& context ) {
 /// RET - Return from Procedure
 /// Pops the return address from the stack, adjusts RSP (optionally by an immediate value), and jumps to the return address, without affecting flags.
 void handlers::ret ( const iced::Instruction& instr, KUBERA& context ) {
-	const size_t op_size = 8;
 	const uint64_t imm = ( instr.op_count ( ) > 0 && instr.op0_kind ( ) == OpKindSimple::Immediate ) ?
 		instr.immediate ( ) : 0;
-	const uint64_t pop_size = op_size + imm;
-	const uint64_t old_rsp = context.get_reg ( Register::RSP, op_size );
 
-	const uint64_t return_ip = context.get_stack<uint64_t> ( old_rsp );
-	context.set_reg ( Register::RSP, old_rsp + pop_size, op_size );
+	uint64_t return_ip;
+	if ( !context.pop_stack ( return_ip ) ) {
+		// !TODO(exception)
+		return;
+	}
+	if ( imm != 0 ) {
+		context.set_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( context.get_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( ) + imm );
+	}
 	context.handle_ip_switch ( return_ip );
 }
 
@@ -216,11 +211,10 @@ void handlers::ret ( const iced::Instruction& instr, KUBERA& context ) {
 void handlers::call ( const iced::Instruction& instr, KUBERA& context ) {
 	const size_t op_size = 8;
 	const uint64_t return_ip = context.get_reg ( Register::RIP, op_size ) + instr.length ( );
-	const uint64_t old_rsp = context.get_reg ( Register::RSP, op_size );
-	const uint64_t new_rsp = old_rsp - op_size;
-
-	context.set_stack<uint64_t> ( new_rsp, return_ip );
-	context.set_reg ( Register::RSP, new_rsp, op_size );
+	if ( !context.push_stack ( return_ip ) ) {
+		// !TODO(exception)
+		return;
+	}
 	handlers::jmp ( instr, context );
 }
 
@@ -56,10 +56,10 @@ void handlers::fld ( const iced::Instruction& instr, KUBERA& context ) {
 			return;
 		}
 		if ( fpu.classify_fpu_operand ( value ) == x86::FPU_TAG_SPECIAL ) {
-			if ( boost::multiprecision::fpclassify ( value ) == FP_SUBNORMAL ) {
+			if ( fp80::classify ( value ) == FP_SUBNORMAL ) {
 				fsw_flags |= x86::FSW_DE;
 			}
-			else if ( boost::multiprecision::isnan ( value ) ) {
+			else if ( fp80::is_nan ( value ) ) {
 				fsw_flags |= x86::FSW_IE;
 			}
 		}
@@ -106,8 +106,8 @@ void handlers::fprem ( const iced::Instruction& instr, KUBERA& context ) {
 	const float80_t st0_val = fpu.fpu_stack [ st0_phys_idx ];
 	const float80_t st1_val = fpu.fpu_stack [ st1_phys_idx ];
 
-	if ( boost::multiprecision::isnan ( st0_val ) || boost::multiprecision::isnan ( st1_val ) ||
-			boost::multiprecision::isinf ( st0_val ) || boost::multiprecision::isinf ( st1_val ) ||
+	if ( fp80::is_nan ( st0_val ) || fp80::is_nan ( st1_val ) ||
+			fp80::is_inf ( st0_val ) || fp80::is_inf ( st1_val ) ||
 			st1_val == 0 ) {
 		fsw_flags |= x86::FSW_IE;
 		fpu.fpu_status_word.C2 = 1;
@@ -115,22 +115,22 @@ void handlers::fprem ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	if ( boost::multiprecision::fpclassify ( st0_val ) == FP_SUBNORMAL ||
-			boost::multiprecision::fpclassify ( st1_val ) == FP_SUBNORMAL ) {
+	if ( fp80::classify ( st0_val ) == FP_SUBNORMAL ||
+			fp80::classify ( st1_val ) == FP_SUBNORMAL ) {
 		fsw_flags |= x86::FSW_DE;
 	}
 
-	float80_t result = boost::multiprecision::remainder ( st0_val, st1_val );
+	float80_t result = fp80::remainder ( st0_val, st1_val );
 	if ( result == 0 && st0_val != 0 ) {
 		result = st0_val;
 	}
 
-	if ( boost::multiprecision::fpclassify ( result ) == FP_SUBNORMAL && result != 0 ) {
+	if ( fp80::classify ( result ) == FP_SUBNORMAL && result != 0 ) {
 		fsw_flags |= ( x86::FSW_UE | x86::FSW_DE );
 	}
 
-	const int exp0 = st0_val.backend ( ).exponent ( );
-	const int exp1 = st1_val.backend ( ).exponent ( );
+	const int exp0 = fp80::exponent ( st0_val );
+	const int exp1 = fp80::exponent ( st1_val );
 	if ( exp0 - exp1 >= 64 ) {
 		fpu.fpu_status_word.C2 = 1;
 		fpu.fpu_status_word.C0 = 0;
@@ -164,35 +164,35 @@ void handlers::fstp ( const iced::Instruction& instr, KUBERA& context ) {
 	}
 
 	const float80_t value = fpu.fpu_stack [ st0_phys_idx ];
-	if ( boost::multiprecision::isnan ( value ) ) {
+	if ( fp80::is_nan ( value ) ) {
 		fsw_flags |= x86::FSW_IE;
 	}
-	if ( boost::multiprecision::fpclassify ( value ) == FP_SUBNORMAL ) {
+	if ( fp80::classify ( value ) == FP_SUBNORMAL ) {
 		fsw_flags |= x86::FSW_DE;
 	}
 
 	if ( instr.op0_kind ( ) == OpKindSimple::Memory ) {
 		const uint64_t addr = helpers::get_operand_value<uint64_t> ( instr, 0u, context );
 		if ( op_size == 4 ) {
-			const float f_val = value.convert_to<float> ( );
+			const float f_val = static_cast< float >( value );
 			const uint32_t f_bits = std::bit_cast< uint32_t >( f_val );
 			helpers::set_operand_value<uint32_t> ( instr, 0u, f_bits, context );
 			const float80_t check_back = f_val;
 			if ( f_val != 0 && value != 0 && check_back == 0 ) fsw_flags |= x86::FSW_UE;
-			if ( !boost::multiprecision::isinf ( check_back ) && boost::multiprecision::isinf ( value ) ) fsw_flags |= x86::FSW_OE;
+			if ( !fp80::is_inf ( check_back ) && fp80::is_inf ( value ) ) fsw_flags |= x86::FSW_OE;
 			if ( check_back != value ) fsw_flags |= x86::FSW_PE;
 		}
 		else if ( op_size == 8 ) {
-			const double d_val = value.convert_to<double> ( );
+			const double d_val = static_cast< double >( value );
 			const uint64_t d_bits = std::bit_cast< uint64_t >( d_val );
 			helpers::set_operand_value<uint64_t> ( instr, 0u, d_bits, context );
 			const float80_t check_back = d_val;
 			if ( d_val != 0 && value != 0 && check_back == 0 ) fsw_flags |= x86::FSW_UE;
-			if ( !boost::multiprecision::isinf ( check_back ) && boost::multiprecision::isinf ( value ) ) fsw_flags |= x86::FSW_OE;
+			if ( !fp80::is_inf ( check_back ) && fp80::is_inf ( value ) ) fsw_flags |= x86::FSW_OE;
 			if ( check_back != value ) fsw_flags |= x86::FSW_PE;
 		}
 		else if ( op_size == 10 ) {
-			context.write_type ( addr, value );
+			context.write_type_float80_t ( addr, value );
 		}
 		else {
 			// !TODO(exception)
@@ -319,7 +319,8 @@ void handlers::fmul ( const iced::Instruction& instr, KUBERA& context ) {
 		else if ( instr.op0_kind ( ) == OpKindSimple::Register && instr.op0_reg ( ) == Register::ST0 &&
 						instr.op1_kind ( ) == OpKindSimple::Register &&
 						instr.op1_reg ( ) >= Register::ST0 && instr.op1_reg ( ) <= Register::ST7 ) {
-			const int sti_phys_idx = fpu.get_fpu_phys_idx ( sti );
+			// The source is op1 in this form, sti names op0 which is ST(0)
+			const int sti_phys_idx = fpu.get_fpu_phys_idx ( static_cast< int >( instr.op1_reg ( ) ) - static_cast< int >( Register::ST0 ) );
 			if ( fpu.get_fpu_tag ( st0_phys_idx ) == x86::FPU_TAG_EMPTY ||
 					fpu.get_fpu_tag ( sti_phys_idx ) == x86::FPU_TAG_EMPTY ) {
 				fsw_flags |= ( x86::FSW_IE | x86::FSW_SF );
@@ -339,30 +340,30 @@ void handlers::fmul ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	if ( boost::multiprecision::fpclassify ( operand1 ) == FP_SUBNORMAL ||
-			boost::multiprecision::fpclassify ( operand2 ) == FP_SUBNORMAL ) {
+	if ( fp80::classify ( operand1 ) == FP_SUBNORMAL ||
+			fp80::classify ( operand2 ) == FP_SUBNORMAL ) {
 		fsw_flags |= x86::FSW_DE;
 	}
-	if ( boost::multiprecision::isnan ( operand1 ) || boost::multiprecision::isnan ( operand2 ) ||
-			( boost::multiprecision::fpclassify ( operand1 ) == FP_ZERO && boost::multiprecision::fpclassify ( operand2 ) == FP_INFINITE ) ||
-			( boost::multiprecision::fpclassify ( operand1 ) == FP_INFINITE && boost::multiprecision::fpclassify ( operand2 ) == FP_ZERO ) ) {
+	if ( fp80::is_nan ( operand1 ) || fp80::is_nan ( operand2 ) ||
+			( fp80::classify ( operand1 ) == FP_ZERO && fp80::classify ( operand2 ) == FP_INFINITE ) ||
+			( fp80::classify ( operand1 ) == FP_INFINITE && fp80::classify ( operand2 ) == FP_ZERO ) ) {
 		fsw_flags |= x86::FSW_IE;
 		check_fpu_exception ( fpu.fpu_status_word, fpu.fpu_control_word, fsw_flags );
 		return;
 	}
 
 	result = operand1 * operand2;
-	if ( boost::multiprecision::fpclassify ( result ) == FP_INFINITE ) {
+	if ( fp80::classify ( result ) == FP_INFINITE ) {
 		fsw_flags |= x86::FSW_OE;
 	}
-	if ( boost::multiprecision::fpclassify ( result ) == FP_SUBNORMAL ) {
+	if ( fp80::classify ( result ) == FP_SUBNORMAL ) {
 		fsw_flags |= x86::FSW_DE;
 	}
-	if ( ( boost::multiprecision::fpclassify ( result ) == FP_SUBNORMAL || boost::multiprecision::fpclassify ( result ) == FP_ZERO ) &&
-			boost::multiprecision::fpclassify ( operand1 ) == FP_NORMAL && boost::multiprecision::fpclassify ( operand2 ) == FP_NORMAL ) {
+	if ( ( fp80::classify ( result ) == FP_SUBNORMAL || fp80::classify ( result ) == FP_ZERO ) &&
+			fp80::classify ( operand1 ) == FP_NORMAL && fp80::classify ( operand2 ) == FP_NORMAL ) {
 		fsw_flags |= x86::FSW_UE;
 	}
-	if ( !( fsw_flags & ( x86::FSW_OE | x86::FSW_UE ) ) && boost::multiprecision::fpclassify ( result ) != FP_ZERO ) {
+	if ( !( fsw_flags & ( x86::FSW_OE | x86::FSW_UE ) ) && fp80::classify ( result ) != FP_ZERO ) {
 		fsw_flags |= x86::FSW_PE;
 	}
 
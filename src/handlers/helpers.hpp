@@ -5,7 +5,32 @@
 namespace helpers
 {
 	using namespace kubera;
+	FORCE_INLINE uint64_t calculate_mem_addr ( const LoweredOperands& lowered, const KUBERA& state ) {
+		uint64_t address = lowered.displacement;
+		switch ( lowered.mode ) {
+			case AddressMode::Base:
+				address += state.get_reg ( lowered.base );
+				break;
+			case AddressMode::Index:
+				address += state.get_reg ( lowered.index ) * lowered.scale;
+				break;
+			case AddressMode::BaseIndex:
+				address += state.get_reg ( lowered.base ) + state.get_reg ( lowered.index ) * lowered.scale;
+				break;
+			default:
+				break;
+		}
+		if ( lowered.has_segment ) {
+			address += state.get_reg ( lowered.segment );
+		}
+		return address;
+	}
+
 	FORCE_INLINE uint64_t calculate_mem_addr ( const iced::Instruction& instr, KUBERA& state ) {
+		if ( const auto* lowered = state.lowered_operands ( instr ) ) {
+			return calculate_mem_addr ( *lowered, state );
+		}
+
 		uint64_t address = 0;
 		if ( instr.mem_base ( ) == Register::RIP ) {
 			address += instr.ip + instr.length ( );
@@ -30,95 +55,166 @@ namespace helpers
 
 	template <typename Type>
 	Type get_operand_value ( const iced::Instruction& instr, size_t operand_index, KUBERA& state ) {
-		switch ( instr.op_kind_simple ( operand_index ) ) {
-			case OpKindSimple::Immediate:
-				return static_cast< Type >( instr.immediate ( ) );
-			case OpKindSimple::Register:
-			{
-				const auto reg = instr.op_reg ( operand_index );
-				if constexpr ( std::is_same_v<Type, float> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.get_xmm_float ( reg );
+		// Native vector operands, zero-extended to the full register width
+		if constexpr ( std::is_same_v<Type, VectorRegister> ) {
+			VectorRegister value { };
+			const auto size = instr.op_size ( operand_index );
+			switch ( instr.op_kind_simple ( operand_index ) ) {
+				case OpKindSimple::Register:
+					std::memcpy ( value.bytes, state.get_vector ( instr.op_reg ( operand_index ) ).bytes, size );
+					break;
+				case OpKindSimple::Memory:
+					state.get_virtual_memory ( )->read_bytes ( calculate_mem_addr ( instr, state ), value.bytes, size );
+					break;
+				default:
+					break;
+			}
+			return value;
+		}
+		else {
+			if constexpr ( std::is_integral_v<Type> ) {
+				const auto* lowered = state.lowered_operands ( instr );
+				if ( lowered && operand_index < LoweredOperands::max_operands ) {
+					const auto& op = lowered->operands [ operand_index ];
+					switch ( op.kind ) {
+						case OpKindSimple::Immediate:
+							return static_cast< Type >( instr.immediate ( ) );
+						case OpKindSimple::Register:
+							return static_cast< Type >( state.get_reg ( op.reg, sizeof ( Type ) ) );
+						case OpKindSimple::Memory:
+							return state.get_memory<Type> ( calculate_mem_addr ( instr, state ) );
+						case OpKindSimple::Invalid:
+							return Type {};
+						default:
+							return Type ( instr.branch_target ( ) );
 					}
 				}
-				else if constexpr ( std::is_same_v<Type, double> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.get_xmm_double ( reg );
+			}
+
+			switch ( instr.op_kind_simple ( operand_index ) ) {
+				case OpKindSimple::Immediate:
+					return static_cast< Type >( instr.immediate ( ) );
+				case OpKindSimple::Register:
+				{
+					const auto reg = instr.op_reg ( operand_index );
+					if constexpr ( std::is_same_v<Type, float> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.get_xmm_float ( reg );
+						}
 					}
-				}
-				else if constexpr ( std::is_same_v<Type, uint128_t> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.get_xmm_raw ( reg );
+					else if constexpr ( std::is_same_v<Type, double> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.get_xmm_double ( reg );
+						}
 					}
-				}
-				else if constexpr ( std::is_same_v<Type, uint256_t> ) {
-					if ( reg >= Register::YMM0 && reg <= Register::YMM31 ) {
-						return state.get_ymm_raw ( reg );
+					else if constexpr ( std::is_same_v<Type, uint128_t> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.get_xmm_raw ( reg );
+						}
 					}
-				}
-				else if constexpr ( std::is_same_v<Type, uint512_t> ) {
-					if ( reg >= Register::ZMM0 && reg <= Register::ZMM31 ) {
-						return state.get_zmm_raw ( reg );
+					else if constexpr ( std::is_same_v<Type, uint256_t> ) {
+						if ( reg >= Register::YMM0 && reg <= Register::YMM31 ) {
+							return state.get_ymm_raw ( reg );
+						}
+					}
+					else if constexpr ( std::is_same_v<Type, uint512_t> ) {
+						if ( reg >= Register::ZMM0 && reg <= Register::ZMM31 ) {
+							return state.get_zmm_raw ( reg );
+						}
+					}
+					else {
+						return static_cast< Type >( state.get_reg ( reg, sizeof ( Type ) ) );
 					}
 				}
-				else {
-					return static_cast< Type >( state.get_reg ( reg, sizeof ( Type ) ) );
+				case OpKindSimple::Memory:
+				{
+					uint64_t address = calculate_mem_addr ( instr, state );
+					return state.get_memory<Type> ( address );
 				}
+				case OpKindSimple::Invalid:
+					break;
+				default:
+					return Type ( instr.branch_target ( ) );
 			}
-			case OpKindSimple::Memory:
-			{
-				uint64_t address = calculate_mem_addr ( instr, state );
-				return state.get_memory<Type> ( address );
-			}
-			case OpKindSimple::Invalid:
-				break;
-			default:
-				return Type ( instr.branch_target ( ) );
+			return Type {};
 		}
-		return Type {};
 	}
 	template <typename Type>
 	void set_operand_value ( const iced::Instruction& instr, size_t operand_index, Type value, KUBERA& state ) {
-		switch ( instr.op_kind_simple ( operand_index ) ) {
-			case OpKindSimple::Register:
-			{
-				const auto reg = instr.op_reg ( operand_index );
-				if constexpr ( std::is_same_v<Type, float> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.set_xmm_float ( reg, value );
-					}
+		// Register destinations are zero-extended to the full register width
+		if constexpr ( std::is_same_v<Type, VectorRegister> ) {
+			const auto size = instr.op_size ( operand_index );
+			switch ( instr.op_kind_simple ( operand_index ) ) {
+				case OpKindSimple::Register:
+				{
+					auto& dst = state.get_vector ( instr.op_reg ( operand_index ) );
+					std::memcpy ( dst.bytes, value.bytes, size );
+					dst.zero_upper ( size );
+					break;
 				}
-				else if constexpr ( std::is_same_v<Type, double> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.set_xmm_double ( reg, value );
+				case OpKindSimple::Memory:
+					state.get_virtual_memory ( )->write_bytes ( calculate_mem_addr ( instr, state ), value.bytes, size );
+					break;
+				default:
+					break;
+			}
+		}
+		else {
+			if constexpr ( std::is_integral_v<Type> ) {
+				const auto* lowered = state.lowered_operands ( instr );
+				if ( lowered && operand_index < LoweredOperands::max_operands ) {
+					const auto& op = lowered->operands [ operand_index ];
+					if ( op.kind == OpKindSimple::Register ) {
+						return state.set_reg ( op.reg, static_cast< uint64_t >( value ), sizeof ( Type ) );
 					}
-				}
-				else if constexpr ( std::is_same_v<Type, uint128_t> ) {
-					if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
-						return state.set_xmm_raw ( reg, value );
+					if ( op.kind == OpKindSimple::Memory ) {
+						return state.set_memory<Type> ( calculate_mem_addr ( instr, state ), value );
 					}
+					return;
 				}
-				else if constexpr ( std::is_same_v<Type, uint256_t> ) {
-					if ( reg >= Register::YMM0 && reg <= Register::YMM31 ) {
-						return state.set_ymm_raw ( reg, value );
+			}
+
+			switch ( instr.op_kind_simple ( operand_index ) ) {
+				case OpKindSimple::Register:
+				{
+					const auto reg = instr.op_reg ( operand_index );
+					if constexpr ( std::is_same_v<Type, float> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.set_xmm_float ( reg, value );
+						}
 					}
-				}
-				else if constexpr ( std::is_same_v<Type, uint512_t> ) {
-					if ( reg >= Register::ZMM0 && reg <= Register::ZMM31 ) {
-						return state.set_zmm_raw ( reg, value );
+					else if constexpr ( std::is_same_v<Type, double> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.set_xmm_double ( reg, value );
+						}
+					}
+					else if constexpr ( std::is_same_v<Type, uint128_t> ) {
+						if ( reg >= Register::XMM0 && reg <= Register::XMM31 ) {
+							return state.set_xmm_raw ( reg, value );
+						}
+					}
+					else if constexpr ( std::is_same_v<Type, uint256_t> ) {
+						if ( reg >= Register::YMM0 && reg <= Register::YMM31 ) {
+							return state.set_ymm_raw ( reg, value );
+						}
+					}
+					else if constexpr ( std::is_same_v<Type, uint512_t> ) {
+						if ( reg >= Register::ZMM0 && reg <= Register::ZMM31 ) {
+							return state.set_zmm_raw ( reg, value );
+						}
+					}
+					else {
+						return state.set_reg ( reg, value, sizeof ( Type ) );
 					}
 				}
-				else {
-					return state.set_reg ( reg, value, sizeof ( Type ) );
+				case OpKindSimple::Memory:
+				{
+					uint64_t address = calculate_mem_addr ( instr, state );
+					return state.set_memory<Type> ( address, value );
 				}
+				default:
+					break;
 			}
-			case OpKindSimple::Memory:
-			{
-				uint64_t address = calculate_mem_addr ( instr, state );
-				return state.set_memory<Type> ( address, value );
-			}
-			default:
-				break;
 		}
 	}
 };
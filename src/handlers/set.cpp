@@ -14,95 +14,95 @@ void setcc ( const iced::Instruction& instr, KUBERA& context, Func condition ) {
 /// SETB-Set Byte if Below
 /// Sets the destination byte to 1 if CF is set, otherwise to 0.
 void handlers::setb ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).CF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_cf ( ); } );
 }
 
 /// SETNP-Set Byte if Not Parity
 /// Sets the destination byte to 1 if PF is clear, otherwise to 0.
 void handlers::setnp ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).PF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_pf ( ); } );
 }
 
 /// SETS-Set Byte if Sign
 /// Sets the destination byte to 1 if SF is set, otherwise to 0.
 void handlers::sets ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ); } );
 }
 
 /// SETNL-Set Byte if Not Less
 /// Sets the destination byte to 1 if SF equals OF, otherwise to 0.
 void handlers::setnl ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF == context.get_flags ( ).OF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ) == context.flag_of ( ); } );
 }
 
 /// SETO-Set Byte if Overflow
 /// Sets the destination byte to 1 if OF is set, otherwise to 0.
 void handlers::seto ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).OF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_of ( ); } );
 }
 
 /// SETBE-Set Byte if Below or Equal
 /// Sets the destination byte to 1 if CF or ZF is set, otherwise to 0.
 void handlers::setbe ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).CF | context.get_flags ( ).ZF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_cf ( ) | context.flag_zf ( ); } );
 }
 
 /// SETZ-Set Byte if Zero
 /// Sets the destination byte to 1 if ZF is set, otherwise to 0.
 void handlers::setz ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).ZF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_zf ( ); } );
 }
 
 /// SETNB-Set Byte if Not Below
 /// Sets the destination byte to 1 if CF is clear, otherwise to 0.
 void handlers::setnb ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).CF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_cf ( ); } );
 }
 
 /// SETNO-Set Byte if Not Overflow
 /// Sets the destination byte to 1 if OF is clear, otherwise to 0.
 void handlers::setno ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).OF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_of ( ); } );
 }
 
 /// SETP-Set Byte if Parity
 /// Sets the destination byte to 1 if PF is set, otherwise to 0.
 void handlers::setp ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).PF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_pf ( ); } );
 }
 
 /// SETLE-Set Byte if Less or Equal
 /// Sets the destination byte to 1 if ZF is set or SF differs from OF, otherwise to 0.
 void handlers::setle ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).ZF | ( context.get_flags ( ).SF ^ context.get_flags ( ).OF ); } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_zf ( ) | ( context.flag_sf ( ) ^ context.flag_of ( ) ); } );
 }
 
 /// SETNLE-Set Byte if Not Less or Equal
 /// Sets the destination byte to 1 if ZF is clear and SF equals OF, otherwise to 0.
 void handlers::setnle ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).ZF && ( context.get_flags ( ).SF == context.get_flags ( ).OF ); } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_zf ( ) && ( context.flag_sf ( ) == context.flag_of ( ) ); } );
 }
 
 /// SETNS-Set Byte if Not Sign
 /// Sets the destination byte to 1 if SF is clear, otherwise to 0.
 void handlers::setns ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).SF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_sf ( ); } );
 }
 
 /// SETL-Set Byte if Less
 /// Sets the destination byte to 1 if SF differs from OF, otherwise to 0.
 void handlers::setl ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.get_flags ( ).SF != context.get_flags ( ).OF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return context.flag_sf ( ) != context.flag_of ( ); } );
 }
 
 /// SETNBE-Set Byte if Not Below or Equal
 /// Sets the destination byte to 1 if CF and ZF are clear, otherwise to 0.
 void handlers::setnbe ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).CF && !context.get_flags ( ).ZF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_cf ( ) && !context.flag_zf ( ); } );
 }
 
 /// SETNZ-Set Byte if Not Zero
 /// Sets the destination byte to 1 if ZF is clear, otherwise to 0.
 void handlers::setnz ( const iced::Instruction& instr, KUBERA& context ) {
-  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.get_flags ( ).ZF; } );
+  setcc ( instr, context, [ ] ( KUBERA& context ) { return !context.flag_zf ( ); } );
 }
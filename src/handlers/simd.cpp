@@ -1,49 +1,134 @@
 #include "../../emulator.hpp"
 #include <bit>
 #include <cfenv>
+#include <cmath>
+#include <cstring>
 #include "helpers.hpp"
+#include "vector_kernels.hpp"
 
 using namespace kubera;
 
-/// VPXOR - Vector Packed XOR
-/// Performs a bitwise XOR of two source XMM/YMM/ZMM registers or a register and memory, storing the result in the destination register, without affecting flags.
-void handlers::vpxor ( const iced::Instruction& instr, KUBERA& context ) {
+// Legacy SSE form, XMM destination = op ( destination, source )
+static void packed_sse ( const iced::Instruction& instr, KUBERA& context, vector_kernels::KernelTable::BinaryOp op ) {
+	if ( instr.op0_kind ( ) != OpKindSimple::Register ||
+			instr.op0_size ( ) != 16 ||
+			( instr.op1_kind ( ) != OpKindSimple::Register && instr.op1_kind ( ) != OpKindSimple::Memory ) ) {
+		// !TODO(exception)
+		return;
+	}
+
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const auto src_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	op ( dst.bytes, dst.bytes, src_val.bytes, 16 );
+	dst.zero_upper ( 16 );
+}
+
+// VEX/EVEX form, destination = op ( source1, source2 ) over the full operand width
+static void packed_vex ( const iced::Instruction& instr, KUBERA& context, vector_kernels::KernelTable::BinaryOp op ) {
 	const size_t op_size = instr.op0_size ( );
 	if ( op_size != 16 && op_size != 32 && op_size != 64 ) {
 		// !TODO(exception)
 		return;
 	}
 
-	const uint512_t src1_val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	const uint512_t src2_val = helpers::get_operand_value<uint512_t> ( instr, 2u, context );
-	const uint512_t result = src1_val ^ src2_val;
+	const auto src1_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	const auto src2_val = helpers::get_operand_value<VectorRegister> ( instr, 2u, context );
+	VectorRegister result;
+	op ( result.bytes, src1_val.bytes, src2_val.bytes, op_size );
 
-	helpers::set_operand_value<uint512_t> ( instr, 0u, result, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, result, context );
 }
 
-/// VPCMPEQW - Vector Packed Compare Equal Word
-/// Compares 16-bit words in two source XMM/YMM/ZMM registers or a register and memory, setting each word in the destination to 0xFFFF if equal or 0 if not equal, without affecting flags.
-void handlers::vpcmpeqw ( const iced::Instruction& instr, KUBERA& context ) {
+// Host rounding modes in MXCSR.RC order
+static constexpr int host_rounding [ ] = { FE_TONEAREST, FE_DOWNWARD, FE_UPWARD, FE_TOWARDZERO };
+
+static bool has_subnormal_float ( const uint8_t* data, size_t size ) {
+	for ( size_t offset = 0; offset < size; offset += sizeof ( float ) ) {
+		float lane;
+		std::memcpy ( &lane, data + offset, sizeof ( lane ) );
+		if ( std::fpclassify ( lane ) == FP_SUBNORMAL ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Runs a packed single-precision kernel under the guest rounding mode and raises the MXCSR flags of all its lanes, read back
+// from the host environment. False when one of the raised exceptions is unmasked, the destination then keeps its old value.
+static bool packed_ps ( KUBERA& context, vector_kernels::KernelTable::BinaryOp op, uint8_t* out, const uint8_t* src1, const uint8_t* src2, size_t size ) {
+	auto& mxcsr = context.get_mxcsr ( );
+	std::fenv_t host_env;
+	std::feholdexcept ( &host_env );
+	std::fesetround ( host_rounding [ mxcsr.RC ] );
+	op ( out, src1, src2, size );
+	const int excepts = std::fetestexcept ( FE_ALL_EXCEPT );
+	std::fesetenv ( &host_env );
+
+	// Bits in MXCSR flag order, IE DE ZE OE UE PE
+	uint32_t raised = 0;
+	raised |= ( excepts & FE_INVALID ) ? 0x01 : 0;
+	raised |= ( has_subnormal_float ( src1, size ) || has_subnormal_float ( src2, size ) ) ? 0x02 : 0;
+	raised |= ( excepts & FE_DIVBYZERO ) ? 0x04 : 0;
+	raised |= ( excepts & FE_OVERFLOW ) ? 0x08 : 0;
+	raised |= ( excepts & FE_UNDERFLOW ) ? 0x10 : 0;
+	raised |= ( excepts & FE_INEXACT ) ? 0x20 : 0;
+	mxcsr.value |= raised;
+
+	// The masks sit 7 bits above their flags
+	if ( raised & ~( mxcsr.value >> 7 ) & 0x3F ) {
+		// !TODO(exception)
+		return false;
+	}
+	return true;
+}
+
+// packed_sse for single-precision arithmetic, see packed_ps
+static void packed_ps_sse ( const iced::Instruction& instr, KUBERA& context, vector_kernels::KernelTable::BinaryOp op ) {
+	if ( instr.op0_kind ( ) != OpKindSimple::Register ||
+			instr.op0_size ( ) != 16 ||
+			( instr.op1_kind ( ) != OpKindSimple::Register && instr.op1_kind ( ) != OpKindSimple::Memory ) ) {
+		// !TODO(exception)
+		return;
+	}
+
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const auto src_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	VectorRegister result;
+	if ( !packed_ps ( context, op, result.bytes, dst.bytes, src_val.bytes, 16 ) ) {
+		return;
+	}
+	std::memcpy ( dst.bytes, result.bytes, 16 );
+	dst.zero_upper ( 16 );
+}
+
+// packed_vex for single-precision arithmetic, see packed_ps
+static void packed_ps_vex ( const iced::Instruction& instr, KUBERA& context, vector_kernels::KernelTable::BinaryOp op ) {
 	const size_t op_size = instr.op0_size ( );
 	if ( op_size != 16 && op_size != 32 && op_size != 64 ) {
 		// !TODO(exception)
 		return;
 	}
 
-	const int num_elements = static_cast< int >( op_size / sizeof ( uint16_t ) );
-	const uint512_t src1_val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	const uint512_t src2_val = helpers::get_operand_value<uint512_t> ( instr, 2u, context );
-	uint512_t result = 0;
-
-	for ( int i = 0; i < num_elements; ++i ) {
-		const uint16_t element1 = static_cast< uint16_t > ( ( src1_val >> ( i * 16 ) ) & 0xFFFF );
-		const uint16_t element2 = static_cast< uint16_t > ( ( src2_val >> ( i * 16 ) ) & 0xFFFF );
-		if ( element1 == element2 ) {
-			result |= ( uint512_t ( 0xFFFF ) << ( i * 16 ) );
-		}
+	const auto src1_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	const auto src2_val = helpers::get_operand_value<VectorRegister> ( instr, 2u, context );
+	VectorRegister result;
+	if ( !packed_ps ( context, op, result.bytes, src1_val.bytes, src2_val.bytes, op_size ) ) {
+		return;
 	}
 
-	helpers::set_operand_value<uint512_t> ( instr, 0u, result, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, result, context );
+}
+
+/// VPXOR - Vector Packed XOR
+/// Performs a bitwise XOR of two source XMM/YMM/ZMM registers or a register and memory, storing the result in the destination register, without affecting flags.
+void handlers::vpxor ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).bitwise_xor );
+}
+
+/// VPCMPEQW - Vector Packed Compare Equal Word
+/// Compares 16-bit words in two source XMM/YMM/ZMM registers or a register and memory, setting each word in the destination to 0xFFFF if equal or 0 if not equal, without affecting flags.
+void handlers::vpcmpeqw ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).cmpeq16 );
 }
 
 /// VPMOVMSKB - Vector Move Mask Byte
@@ -59,16 +144,8 @@ void handlers::vpmovmskb ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint512_t src_val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	const int num_bytes = static_cast< int >( src_size );
-	uint64_t result = 0;
-
-	for ( int i = 0; i < num_bytes; ++i ) {
-		const uint8_t byte_val = static_cast< uint8_t > ( ( src_val >> ( i * 8 ) ) & 0xFF );
-		if ( byte_val >> 7 ) {
-			result |= ( 1ULL << i );
-		}
-	}
+	const auto& src_val = context.get_vector ( instr.op1_reg ( ) );
+	const uint64_t result = vector_kernels::kernels ( ).movemask8 ( src_val.bytes, src_size );
 
 	helpers::set_operand_value<uint64_t> ( instr, 0u, result, context );
 }
@@ -78,9 +155,7 @@ void handlers::vpmovmskb ( const iced::Instruction& instr, KUBERA& context ) {
 void handlers::vzeroupper ( const iced::Instruction& instr, KUBERA& context ) {
 	for ( int i = 0; i < 16; ++i ) {
 		const Register ymm_reg = static_cast< Register > ( static_cast< int > ( Register::YMM0 ) + i );
-		const uint256_t ymm_val = context.get_ymm_raw ( ymm_reg );
-		const uint128_t lower_val = static_cast< uint128_t > ( ymm_val & uint256_t ( "0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF" ) );
-		context.set_ymm_raw ( ymm_reg, lower_val );
+		context.get_vector ( ymm_reg ).zero_upper ( 16 );
 	}
 }
 
@@ -97,19 +172,14 @@ void handlers::vinsertf128 ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint256_t src1_val = helpers::get_operand_value<uint256_t> ( instr, 1u, context );
-	const uint128_t src2_val = helpers::get_operand_value<uint128_t> ( instr, 2u, context );
+	auto result = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	const auto src2_val = helpers::get_operand_value<VectorRegister> ( instr, 2u, context );
 	const uint8_t imm = static_cast< uint8_t >( instr.immediate ( ) );
-	uint256_t result;
 
-	if ( ( imm & 0x01 ) == 0 ) { // Insert into lower 128 bits
-		result = ( src1_val & uint256_t ( "0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF" ) ) | static_cast< uint256_t >( src2_val );
-	}
-	else { // Insert into upper 128 bits
-		result = ( static_cast< uint256_t >( src2_val ) << 128 ) | ( src1_val & uint256_t ( "0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF" ) );
-	}
+	// Bit 0 of the immediate selects the lower or upper 128 bits
+	std::memcpy ( result.bytes + ( imm & 0x01 ) * 16, src2_val.bytes, 16 );
 
-	helpers::set_operand_value<uint256_t> ( instr, 0u, result, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, result, context );
 }
 
 /// VMOVUPS - Vector Move Unaligned Packed Single-Precision
@@ -121,8 +191,8 @@ void handlers::vmovups ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint512_t val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	helpers::set_operand_value<uint512_t> ( instr, 0u, val, context );
+	const auto val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, val, context );
 }
 
 /// VMOVAPS - Vector Move Aligned Packed Single-Precision
@@ -149,8 +219,8 @@ void handlers::vmovaps ( const iced::Instruction& instr, KUBERA& context ) {
 		}
 	}
 
-	const uint512_t val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	helpers::set_operand_value<uint512_t> ( instr, 0u, val, context );
+	const auto val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, val, context );
 }
 
 /// VMOVDQU - Vector Move Unaligned Double Quadword
@@ -162,8 +232,8 @@ void handlers::vmovdqu ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint512_t val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	helpers::set_operand_value<uint512_t> ( instr, 0u, val, context );
+	const auto val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, val, context );
 }
 
 /// MOVDQU - Move Unaligned Double Quadword
@@ -175,8 +245,8 @@ void handlers::movdqu ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint512_t val = helpers::get_operand_value<uint512_t> ( instr, 1u, context );
-	helpers::set_operand_value<uint512_t> ( instr, 0u, val, context );
+	const auto val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, val, context );
 }
 
 /// PUNPCKLQDQ - Unpack Low Quadwords
@@ -191,13 +261,10 @@ void handlers::punpcklqdq ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint128_t v1 = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t v2 = context.get_xmm_raw ( instr.op1_reg ( ) );
-	const uint64_t lo1 = static_cast< uint64_t >( v1 );
-	const uint64_t lo2 = static_cast< uint64_t >( v2 );
-	const uint128_t result = ( static_cast< uint128_t >( lo2 ) << 64 ) | lo1;
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const uint64_t lo2 = context.get_vector_lane<uint64_t> ( instr.op1_reg ( ), 0 );
+	dst.set_lane<uint64_t> ( 1, lo2 );
+	dst.zero_upper ( 16 );
 }
 
 /// MOVLHPS - Move Low to High Packed Single-Precision
@@ -212,13 +279,10 @@ void handlers::movlhps ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = context.get_xmm_raw ( instr.op1_reg ( ) );
-	const uint64_t dst_low = static_cast< uint64_t >( dst_val );
-	const uint64_t src_low = static_cast< uint64_t >( src_val );
-	const uint128_t result = ( static_cast< uint128_t >( src_low ) << 64 ) | ( dst_low & 0xFFFFFFFFFFFFFFFF );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const uint64_t src_low = context.get_vector_lane<uint64_t> ( instr.op1_reg ( ), 0 );
+	dst.set_lane<uint64_t> ( 1, src_low );
+	dst.zero_upper ( 16 );
 }
 
 /// PSRLDQ - Shift Right Logical Double Quadword
@@ -233,10 +297,11 @@ void handlers::psrldq ( const iced::Instruction& instr, KUBERA& context ) {
 	}
 
 	const uint8_t shift_amount = static_cast< uint8_t >( instr.immediate ( ) );
-	const uint128_t val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t result = ( shift_amount > 15 ) ? 0 : ( val >> ( shift_amount * 8 ) );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const size_t shift = std::min<size_t> ( shift_amount, 16 );
 
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	std::memmove ( dst.bytes, dst.bytes + shift, 16 - shift );
+	dst.zero_upper ( 16 - shift );
 }
 
 /// MOVHLPS - Move High to Low Packed Single-Precision
@@ -251,11 +316,10 @@ void handlers::movhlps ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = context.get_xmm_raw ( instr.op1_reg ( ) );
-	const uint128_t result = ( dst_val & ( uint128_t ( 0xFFFFFFFFFFFFFFFF ) << 64 ) ) | static_cast< uint128_t >( src_val >> 64 );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const uint64_t src_high = context.get_vector_lane<uint64_t> ( instr.op1_reg ( ), 1 );
+	dst.set_lane<uint64_t> ( 0, src_high );
+	dst.zero_upper ( 16 );
 }
 
 /// UNPCKLPS - Unpack Low Packed Single-Precision
@@ -269,18 +333,14 @@ void handlers::unpcklps ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = helpers::get_operand_value<uint128_t> ( instr, 1u, context );
-	const uint32_t dst0 = static_cast< uint32_t >( dst_val );
-	const uint32_t dst1 = static_cast< uint32_t >( dst_val >> 32 );
-	const uint32_t src0 = static_cast< uint32_t >( src_val );
-	const uint32_t src1 = static_cast< uint32_t >( src_val >> 32 );
-	const uint128_t result = static_cast< uint128_t >( dst0 ) |
-		( static_cast< uint128_t >( src0 ) << 32 ) |
-		( static_cast< uint128_t >( dst1 ) << 64 ) |
-		( static_cast< uint128_t >( src1 ) << 96 );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	const auto src_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	const uint32_t dst1 = dst.lane<uint32_t> ( 1 );
 
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	dst.set_lane<uint32_t> ( 1, src_val.lane<uint32_t> ( 0 ) );
+	dst.set_lane<uint32_t> ( 2, dst1 );
+	dst.set_lane<uint32_t> ( 3, src_val.lane<uint32_t> ( 1 ) );
+	dst.zero_upper ( 16 );
 }
 
 /// MINSS - Minimum Scalar Single-Precision
@@ -350,56 +410,19 @@ void handlers::maxss ( const iced::Instruction& instr, KUBERA& context ) {
 /// ANDPS - Bitwise AND Packed Single-Precision
 /// Performs a bitwise AND on 128-bit XMM registers or a register and memory, storing the result in the destination XMM register, without affecting flags.
 void handlers::andps ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( instr.op0_kind ( ) != OpKindSimple::Register ||
-			instr.op0_size ( ) != 16 ||
-			instr.op0_reg ( ) < Register::XMM0 || instr.op0_reg ( ) > Register::XMM31 ||
-			( instr.op1_kind ( ) != OpKindSimple::Register && instr.op1_kind ( ) != OpKindSimple::Memory ) ) {
-		// !TODO(exception)
-		return;
-	}
-
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = helpers::get_operand_value<uint128_t> ( instr, 1u, context );
-	const uint128_t result = dst_val & src_val;
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_and );
 }
 
 /// ORPS - Bitwise OR Packed Single-Precision
 /// Performs a bitwise OR on 128-bit XMM registers or a register and memory, storing the result in the destination XMM register, without affecting flags.
 void handlers::orps ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( instr.op0_kind ( ) != OpKindSimple::Register ||
-			instr.op0_size ( ) != 16 ||
-			instr.op0_reg ( ) < Register::XMM0 || instr.op0_reg ( ) > Register::XMM31 ||
-			( instr.op1_kind ( ) != OpKindSimple::Register && instr.op1_kind ( ) != OpKindSimple::Memory ) ) {
-		// !TODO(exception)
-		return;
-	}
-
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = helpers::get_operand_value<uint128_t> ( instr, 1u, context );
-	const uint128_t result = dst_val | src_val;
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_or );
 }
 
 /// XORPS - Bitwise XOR Packed Single-Precision
 /// Performs a bitwise XOR on 128-bit XMM registers or a register and memory, storing the result in the destination XMM register, zeroing if source equals destination, without affecting flags.
 void handlers::xorps ( const iced::Instruction& instr, KUBERA& context ) {
-	if ( instr.op0_kind ( ) != OpKindSimple::Register ||
-			instr.op0_size ( ) != 16 ||
-			instr.op0_reg ( ) < Register::XMM0 || instr.op0_reg ( ) > Register::XMM31 ||
-			( instr.op1_kind ( ) != OpKindSimple::Register && instr.op1_kind ( ) != OpKindSimple::Memory ) ) {
-		// !TODO(exception)
-		return;
-	}
-
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = helpers::get_operand_value<uint128_t> ( instr, 1u, context );
-	const uint128_t result = ( instr.op1_kind ( ) == OpKindSimple::Register &&
-													 instr.op1_reg ( ) == instr.op0_reg ( ) ) ? 0 : ( dst_val ^ src_val );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_xor );
 }
 
 /// COMISD - Compare Scalar Double-Precision Ordered
@@ -616,12 +639,9 @@ void handlers::pinsrb ( const iced::Instruction& instr, KUBERA& context ) {
 	}
 
 	const uint32_t src_val = helpers::get_operand_value<uint32_t> ( instr, 1u, context );
-	const uint8_t byte_val = static_cast< uint8_t >( src_val );
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t mask = ~( uint128_t ( 0xFF ) << ( imm * 8 ) );
-	const uint128_t result = ( dst_val & mask ) | ( static_cast< uint128_t >( byte_val ) << ( imm * 8 ) );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	dst.set_lane<uint8_t> ( imm, static_cast< uint8_t >( src_val ) );
+	dst.zero_upper ( 16 );
 }
 
 /// PINSRD - Insert Doubleword
@@ -634,11 +654,9 @@ void handlers::pinsrd ( const iced::Instruction& instr, KUBERA& context ) {
 	}
 
 	const uint32_t src_val = helpers::get_operand_value<uint32_t> ( instr, 1u, context );
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t mask = ~( uint128_t ( 0xFFFFFFFF ) << ( imm * 32 ) );
-	const uint128_t result = ( dst_val & mask ) | ( static_cast< uint128_t >( src_val ) << ( imm * 32 ) );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	dst.set_lane<uint32_t> ( imm, src_val );
+	dst.zero_upper ( 16 );
 }
 
 /// PINSRQ - Insert Quadword
@@ -651,51 +669,229 @@ void handlers::pinsrq ( const iced::Instruction& instr, KUBERA& context ) {
 	}
 
 	const uint64_t src_val = helpers::get_operand_value<uint64_t> ( instr, 1u, context );
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t mask = ~( uint128_t ( 0xFFFFFFFFFFFFFFFF ) << ( imm * 64 ) );
-	const uint128_t result = ( dst_val & mask ) | ( static_cast< uint128_t >( src_val ) << ( imm * 64 ) );
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
-}
-
-// Helper function for packed addition
-template<typename T>
-static void padd ( const iced::Instruction& instr, KUBERA& context, size_t elem_size ) {
-	const uint128_t dst_val = context.get_xmm_raw ( instr.op0_reg ( ) );
-	const uint128_t src_val = helpers::get_operand_value<uint128_t> ( instr, 1u, context );
-	const int num_elements = static_cast< int >( 16 / elem_size );
-	uint128_t result = 0;
-
-	for ( int i = 0; i < num_elements; ++i ) {
-		const T dst_elem = static_cast< T > ( ( dst_val >> ( i * elem_size * 8 ) ) & ( ( 1ULL << ( elem_size * 8 ) ) - 1 ) );
-		const T src_elem = static_cast< T > ( ( src_val >> ( i * elem_size * 8 ) ) & ( ( 1ULL << ( elem_size * 8 ) ) - 1 ) );
-		const T sum = dst_elem + src_elem;
-		result |= static_cast< uint128_t > ( sum ) << ( i * elem_size * 8 );
-	}
-
-	context.set_xmm_raw ( instr.op0_reg ( ), result );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	dst.set_lane<uint64_t> ( imm, src_val );
+	dst.zero_upper ( 16 );
 }
 
 /// PADDB - Packed Add Bytes
 /// Adds 16 packed 8-bit integers from the source (XMM or memory) to the destination XMM register, storing the result in the destination, without affecting flags.
 void handlers::paddb ( const iced::Instruction& instr, KUBERA& context ) {
-	padd<uint8_t> ( instr, context, 1 );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).add8 );
 }
 
 /// PADDW - Packed Add Words
 /// Adds 8 packed 16-bit integers from the source (XMM or memory) to the destination XMM register, storing the result in the destination, without affecting flags.
 void handlers::paddw ( const iced::Instruction& instr, KUBERA& context ) {
-	padd<uint16_t> ( instr, context, 2 );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).add16 );
 }
 
 /// PADDD - Packed Add Doublewords
 /// Adds 4 packed 32-bit integers from the source (XMM or memory) to the destination XMM register, storing the result in the destination, without affecting flags.
 void handlers::paddd ( const iced::Instruction& instr, KUBERA& context ) {
-	padd<uint32_t> ( instr, context, 4 );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).add32 );
 }
 
 /// PADDQ - Packed Add Quadwords
 /// Adds 2 packed 64-bit integers from the source (XMM or memory) to the destination XMM register, storing the result in the destination, without affecting flags.
 void handlers::paddq ( const iced::Instruction& instr, KUBERA& context ) {
-	padd<uint64_t> ( instr, context, 8 );
+	packed_sse ( instr, context, vector_kernels::kernels ( ).add64 );
+}
+
+/// PXOR - Packed Logical XOR
+/// Performs a bitwise XOR of the source (XMM or memory) into the destination XMM register, without affecting flags.
+void handlers::pxor ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_xor );
+}
+
+/// PAND - Packed Logical AND
+/// Performs a bitwise AND of the source (XMM or memory) into the destination XMM register, without affecting flags.
+void handlers::pand ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_and );
+}
+
+/// PANDN - Packed Logical AND NOT
+/// Inverts the destination XMM register and ANDs it with the source (XMM or memory), without affecting flags.
+void handlers::pandn ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_andn );
+}
+
+/// POR - Packed Logical OR
+/// Performs a bitwise OR of the source (XMM or memory) into the destination XMM register, without affecting flags.
+void handlers::por ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).bitwise_or );
+}
+
+/// PCMPEQB - Packed Compare Equal Bytes
+/// Compares 16 packed bytes of the destination XMM register and source, setting each byte to 0xFF if equal or 0 if not, without affecting flags.
+void handlers::pcmpeqb ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).cmpeq8 );
+}
+
+/// PCMPEQW - Packed Compare Equal Words
+/// Compares 8 packed words of the destination XMM register and source, setting each word to 0xFFFF if equal or 0 if not, without affecting flags.
+void handlers::pcmpeqw ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).cmpeq16 );
+}
+
+/// PCMPEQD - Packed Compare Equal Doublewords
+/// Compares 4 packed doublewords of the destination XMM register and source, setting each doubleword to all ones if equal or 0 if not, without affecting flags.
+void handlers::pcmpeqd ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_sse ( instr, context, vector_kernels::kernels ( ).cmpeq32 );
+}
+
+/// VPAND - Vector Packed Logical AND
+/// Performs a bitwise AND of two XMM/YMM/ZMM sources, storing the result in the destination register, without affecting flags.
+void handlers::vpand ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).bitwise_and );
+}
+
+/// VPANDN - Vector Packed Logical AND NOT
+/// Inverts the first XMM/YMM/ZMM source and ANDs it with the second, storing the result in the destination register, without affecting flags.
+void handlers::vpandn ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).bitwise_andn );
+}
+
+/// VPOR - Vector Packed Logical OR
+/// Performs a bitwise OR of two XMM/YMM/ZMM sources, storing the result in the destination register, without affecting flags.
+void handlers::vpor ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).bitwise_or );
+}
+
+/// VPCMPEQB - Vector Packed Compare Equal Bytes
+/// Compares bytes of two XMM/YMM/ZMM sources, setting each destination byte to 0xFF if equal or 0 if not, without affecting flags.
+void handlers::vpcmpeqb ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).cmpeq8 );
+}
+
+/// VPCMPEQD - Vector Packed Compare Equal Doublewords
+/// Compares doublewords of two XMM/YMM/ZMM sources, setting each destination doubleword to all ones if equal or 0 if not, without affecting flags.
+void handlers::vpcmpeqd ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_vex ( instr, context, vector_kernels::kernels ( ).cmpeq32 );
+}
+
+/// ADDPS - Add Packed Single-Precision
+/// Adds 4 packed single-precision floats from the source (XMM or memory) to the destination XMM register, modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::addps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_sse ( instr, context, vector_kernels::kernels ( ).add_f32 );
+}
+
+/// SUBPS - Subtract Packed Single-Precision
+/// Subtracts 4 packed single-precision floats of the source (XMM or memory) from the destination XMM register, modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::subps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_sse ( instr, context, vector_kernels::kernels ( ).sub_f32 );
+}
+
+/// MULPS - Multiply Packed Single-Precision
+/// Multiplies 4 packed single-precision floats of the destination XMM register by the source (XMM or memory), modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::mulps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_sse ( instr, context, vector_kernels::kernels ( ).mul_f32 );
+}
+
+/// VADDPS - Vector Add Packed Single-Precision
+/// Adds packed single-precision floats of two XMM/YMM/ZMM sources, storing the result in the destination register, modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::vaddps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_vex ( instr, context, vector_kernels::kernels ( ).add_f32 );
+}
+
+/// VSUBPS - Vector Subtract Packed Single-Precision
+/// Subtracts packed single-precision floats of the second source from the first, storing the result in the destination register, modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::vsubps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_vex ( instr, context, vector_kernels::kernels ( ).sub_f32 );
+}
+
+/// VMULPS - Vector Multiply Packed Single-Precision
+/// Multiplies packed single-precision floats of two XMM/YMM/ZMM sources, storing the result in the destination register, modifying MXCSR flags (IE, DE, OE, UE, PE).
+void handlers::vmulps ( const iced::Instruction& instr, KUBERA& context ) {
+	packed_ps_vex ( instr, context, vector_kernels::kernels ( ).mul_f32 );
+}
+
+// Shuffles the doublewords of each 128-bit lane of src by the 2-bit selectors in imm
+static void shuffle_dwords ( VectorRegister& dst, const VectorRegister& src, uint8_t imm, size_t op_size ) {
+	for ( size_t lane = 0; lane < op_size / 16; ++lane ) {
+		for ( size_t i = 0; i < 4; ++i ) {
+			const size_t select = ( imm >> ( i * 2 ) ) & 0x3;
+			dst.set_lane<uint32_t> ( lane * 4 + i, src.lane<uint32_t> ( lane * 4 + select ) );
+		}
+	}
+}
+
+/// PSHUFD - Shuffle Packed Doublewords
+/// Copies doublewords from the source (XMM or memory) into the destination XMM register in the order selected by the immediate, without affecting flags.
+void handlers::pshufd ( const iced::Instruction& instr, KUBERA& context ) {
+	if ( instr.op0_kind ( ) != OpKindSimple::Register || instr.op0_size ( ) != 16 ) {
+		// !TODO(exception)
+		return;
+	}
+
+	const auto src_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	auto& dst = context.get_vector ( instr.op0_reg ( ) );
+	shuffle_dwords ( dst, src_val, static_cast< uint8_t >( instr.immediate ( ) ), 16 );
+	dst.zero_upper ( 16 );
+}
+
+/// VPSHUFD - Vector Shuffle Packed Doublewords
+/// Copies doublewords within each 128-bit lane of the XMM/YMM/ZMM source in the order selected by the immediate, without affecting flags.
+void handlers::vpshufd ( const iced::Instruction& instr, KUBERA& context ) {
+	const size_t op_size = instr.op0_size ( );
+	if ( op_size != 16 && op_size != 32 && op_size != 64 ) {
+		// !TODO(exception)
+		return;
+	}
+
+	const auto src_val = helpers::get_operand_value<VectorRegister> ( instr, 1u, context );
+	VectorRegister result;
+	shuffle_dwords ( result, src_val, static_cast< uint8_t >( instr.immediate ( ) ), op_size );
+
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, result, context );
+}
+
+// Helper function for the VPBROADCAST family, the source is the low element of an XMM register, memory or a GPR
+template<typename T>
+static void broadcast ( const iced::Instruction& instr, KUBERA& context ) {
+	const size_t op_size = instr.op0_size ( );
+	if ( op_size != 16 && op_size != 32 && op_size != 64 ) {
+		// !TODO(exception)
+		return;
+	}
+
+	T element;
+	const auto src_reg = instr.op1_reg ( );
+	if ( instr.op1_kind ( ) == OpKindSimple::Register && ( src_reg < Register::XMM0 || src_reg > Register::ZMM31 ) ) {
+		element = static_cast< T >( helpers::get_operand_value<uint64_t> ( instr, 1u, context ) );
+	}
+	else {
+		element = helpers::get_operand_value<VectorRegister> ( instr, 1u, context ).lane<T> ( 0 );
+	}
+
+	VectorRegister result;
+	for ( size_t i = 0; i < op_size / sizeof ( T ); ++i ) {
+		result.set_lane<T> ( i, element );
+	}
+
+	helpers::set_operand_value<VectorRegister> ( instr, 0u, result, context );
+}
+
+/// VPBROADCASTB - Broadcast Byte
+/// Replicates the low byte of the source into every byte of the destination XMM/YMM/ZMM register, without affecting flags.
+void handlers::vpbroadcastb ( const iced::Instruction& instr, KUBERA& context ) {
+	broadcast<uint8_t> ( instr, context );
+}
+
+/// VPBROADCASTW - Broadcast Word
+/// Replicates the low word of the source into every word of the destination XMM/YMM/ZMM register, without affecting flags.
+void handlers::vpbroadcastw ( const iced::Instruction& instr, KUBERA& context ) {
+	broadcast<uint16_t> ( instr, context );
+}
+
+/// VPBROADCASTD - Broadcast Doubleword
+/// Replicates the low doubleword of the source into every doubleword of the destination XMM/YMM/ZMM register, without affecting flags.
+void handlers::vpbroadcastd ( const iced::Instruction& instr, KUBERA& context ) {
+	broadcast<uint32_t> ( instr, context );
+}
+
+/// VPBROADCASTQ - Broadcast Quadword
+/// Replicates the low quadword of the source into every quadword of the destination XMM/YMM/ZMM register, without affecting flags.
+void handlers::vpbroadcastq ( const iced::Instruction& instr, KUBERA& context ) {
+	broadcast<uint64_t> ( instr, context );
 }
@@ -0,0 +1,557 @@
+#include "../../emulator.hpp"
+#include "helpers.hpp"
+
+using namespace kubera;
+
+// Variants of the hottest integer handlers instantiated per operand size and operand form.
+// build_block swaps them in for the generic handler, so operand kinds, widths and masks are
+// fixed at compile time and the operands come straight from the lowered descriptors.
+namespace
+{
+	enum class Form : uint8_t {
+		RegReg,
+		RegImm,
+		RegMem,
+		MemReg,
+		MemImm,
+	};
+
+	enum class AluOp : uint8_t {
+		Add,
+		Sub,
+		And,
+		Or,
+		Xor,
+		Cmp,
+		Test,
+		// Only fused with a following jcc
+		Inc,
+		Dec,
+	};
+
+	enum class Condition : uint8_t {
+		O, NO, B, NB, Z, NZ, BE, NBE, S, NS, P, NP, L, NL, LE, NLE,
+	};
+
+	template <std::size_t size>
+	using sized_uint = std::conditional_t<size == 1, uint8_t,
+		std::conditional_t<size == 2, uint16_t,
+		std::conditional_t<size == 4, uint32_t, uint64_t>>>;
+
+	template <Form form>
+	constexpr bool memory_destination = form == Form::MemReg || form == Form::MemImm;
+
+	template <std::size_t size, Form form>
+	FORCE_INLINE uint64_t read_destination ( const LoweredOperands& ops, KUBERA& context, uint64_t address ) {
+		if constexpr ( memory_destination<form> ) {
+			return context.get_memory<sized_uint<size>> ( address );
+		}
+		else {
+			return context.get_reg ( ops.operands [ 0 ].reg, size );
+		}
+	}
+
+	template <std::size_t size, Form form>
+	FORCE_INLINE void write_destination ( const LoweredOperands& ops, KUBERA& context, uint64_t address, uint64_t value ) {
+		if constexpr ( memory_destination<form> ) {
+			context.set_memory<sized_uint<size>> ( address, static_cast< sized_uint<size> >( value ) );
+		}
+		else {
+			context.set_reg ( ops.operands [ 0 ].reg, value, size );
+		}
+	}
+
+	template <std::size_t size, Form form>
+	FORCE_INLINE uint64_t read_source ( const iced::Instruction& instr, const LoweredOperands& ops, KUBERA& context, uint64_t address ) {
+		if constexpr ( form == Form::RegImm || form == Form::MemImm ) {
+			return instr.immediate ( ) & GET_OPERAND_MASK ( size );
+		}
+		else if constexpr ( form == Form::RegMem ) {
+			return context.get_memory<sized_uint<size>> ( address );
+		}
+		else {
+			return context.get_reg ( ops.operands [ 1 ].reg, size );
+		}
+	}
+
+	template <Form form>
+	FORCE_INLINE uint64_t memory_address ( const LoweredOperands& ops, KUBERA& context ) {
+		if constexpr ( form == Form::RegReg || form == Form::RegImm ) {
+			return 0;
+		}
+		else {
+			return helpers::calculate_mem_addr ( ops, context );
+		}
+	}
+
+	// Specialized handlers are only installed on cached instructions, which always have descriptors.
+	// Anything that calls one directly still gets the generic behaviour.
+	FORCE_INLINE bool fall_back ( const LoweredOperands* ops, const iced::Instruction& instr, KUBERA& context ) {
+		if ( ops ) [[likely]] {
+			return false;
+		}
+		dispatch_table ( ) [ static_cast< size_t >( instr.mnemonic ( ) ) ] ( instr, context );
+		return true;
+	}
+
+	template <AluOp op, std::size_t size, Form form>
+	void alu ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		const uint64_t address = memory_address<form> ( *ops, context );
+		const uint64_t a = read_destination<size, form> ( *ops, context, address );
+		const uint64_t b = read_source<size, form> ( instr, *ops, context, address );
+		constexpr uint64_t mask = GET_OPERAND_MASK ( size );
+
+		if constexpr ( op == AluOp::Add ) {
+			const uint64_t res = ( a + b ) & mask;
+			context.set_lazy_flags ( FlagOp::Add, size, a, b, res );
+			write_destination<size, form> ( *ops, context, address, res );
+		}
+		else if constexpr ( op == AluOp::Sub || op == AluOp::Cmp ) {
+			const uint64_t res = ( a - b ) & mask;
+			context.set_lazy_flags ( FlagOp::Sub, size, a, b, res );
+			if constexpr ( op == AluOp::Sub ) {
+				write_destination<size, form> ( *ops, context, address, res );
+			}
+		}
+		else {
+			const uint64_t res = op == AluOp::Or ? ( a | b ) : op == AluOp::Xor ? ( a ^ b ) : ( a & b );
+			context.set_lazy_flags ( FlagOp::Logic, size, a, b, res );
+			if constexpr ( op != AluOp::Test ) {
+				write_destination<size, form> ( *ops, context, address, res );
+			}
+		}
+	}
+
+	template <std::size_t size, Form form>
+	void mov ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		const uint64_t address = memory_address<form> ( *ops, context );
+		write_destination<size, form> ( *ops, context, address, read_source<size, form> ( instr, *ops, context, address ) );
+	}
+
+	template <Condition cond>
+	FORCE_INLINE bool condition_holds ( const KUBERA& context ) {
+		switch ( cond ) {
+			case Condition::O: return context.flag_of ( );
+			case Condition::NO: return !context.flag_of ( );
+			case Condition::B: return context.flag_cf ( );
+			case Condition::NB: return !context.flag_cf ( );
+			case Condition::Z: return context.flag_zf ( );
+			case Condition::NZ: return !context.flag_zf ( );
+			case Condition::BE: return context.flag_cf ( ) || context.flag_zf ( );
+			case Condition::NBE: return !context.flag_zf ( ) && !context.flag_cf ( );
+			case Condition::S: return context.flag_sf ( );
+			case Condition::NS: return !context.flag_sf ( );
+			case Condition::P: return context.flag_pf ( );
+			case Condition::NP: return !context.flag_pf ( );
+			case Condition::L: return context.flag_sf ( ) != context.flag_of ( );
+			case Condition::NL: return context.flag_sf ( ) == context.flag_of ( );
+			case Condition::LE: return context.flag_zf ( ) || ( context.flag_sf ( ) != context.flag_of ( ) );
+			case Condition::NLE: return !context.flag_zf ( ) && ( context.flag_sf ( ) == context.flag_of ( ) );
+		}
+		UNREACHABLE ( );
+	}
+
+	template <Condition cond, std::size_t size, Form form>
+	void cmov ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		if ( condition_holds<cond> ( context ) ) {
+			const uint64_t address = memory_address<form> ( *ops, context );
+			context.set_reg ( ops->operands [ 0 ].reg, read_source<size, form> ( instr, *ops, context, address ), size );
+		}
+	}
+
+	// XOR r, r and SUB r, r: the result and the flags do not depend on the register's value
+	template <AluOp op, std::size_t size>
+	void zero_idiom ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		context.set_lazy_flags ( op == AluOp::Xor ? FlagOp::Logic : FlagOp::Sub, size, 0, 0, 0 );
+		context.set_reg ( ops->operands [ 0 ].reg, 0, size );
+	}
+
+	// Condition of the jcc after op, taken straight from the operands and result where that is cheaper than the flags.
+	// The rest (and O/P) read the lazy flags op just left.
+	template <AluOp op, Condition cond, std::size_t size>
+	FORCE_INLINE bool fused_condition ( uint64_t a, uint64_t b, uint64_t res, const KUBERA& context ) {
+		using signed_type = std::make_signed_t<sized_uint<size>>;
+		const bool negative = static_cast< signed_type >( static_cast< sized_uint<size> >( res ) ) < 0;
+		if constexpr ( cond == Condition::Z ) {
+			return res == 0;
+		}
+		else if constexpr ( cond == Condition::NZ ) {
+			return res != 0;
+		}
+		else if constexpr ( cond == Condition::S ) {
+			return negative;
+		}
+		else if constexpr ( cond == Condition::NS ) {
+			return !negative;
+		}
+		else if constexpr ( op == AluOp::Cmp || op == AluOp::Sub ) {
+			const auto sa = static_cast< signed_type >( static_cast< sized_uint<size> >( a ) );
+			const auto sb = static_cast< signed_type >( static_cast< sized_uint<size> >( b ) );
+			switch ( cond ) {
+				case Condition::B: return a < b;
+				case Condition::NB: return a >= b;
+				case Condition::BE: return a <= b;
+				case Condition::NBE: return a > b;
+				case Condition::L: return sa < sb;
+				case Condition::NL: return sa >= sb;
+				case Condition::LE: return sa <= sb;
+				case Condition::NLE: return sa > sb;
+				default: return condition_holds<cond> ( context );
+			}
+		}
+		else if constexpr ( op == AluOp::Test ) {
+			// CF and OF are clear
+			switch ( cond ) {
+				case Condition::B: return false;
+				case Condition::NB: return true;
+				case Condition::BE: return res == 0;
+				case Condition::NBE: return res != 0;
+				case Condition::L: return negative;
+				case Condition::NL: return !negative;
+				case Condition::LE: return res == 0 || negative;
+				case Condition::NLE: return res != 0 && !negative;
+				default: return condition_holds<cond> ( context );
+			}
+		}
+		else {
+			return condition_holds<cond> ( context );
+		}
+	}
+
+	// Leaves RIP where the jcc would: at its target when taken (and the target is executable), after it otherwise
+	FORCE_INLINE void fused_branch ( const DecodedInstruction& branch, bool taken, KUBERA& context ) {
+		context.rip ( ) = branch.instr.ip;
+		if ( taken ) {
+			context.handle_ip_switch ( branch.instr.branch_target ( ) );
+		}
+		if ( context.rip ( ) == branch.instr.ip ) {
+			context.rip ( ) += branch.instr.length ( );
+		}
+	}
+
+	// CMP, TEST or SUB + jcc. The flags are still recorded lazily, so anything reading them later sees the same values.
+	template <AluOp op, Condition cond, std::size_t size, Form form>
+	void alu_jcc ( const DecodedInstruction& first, const DecodedInstruction& branch, KUBERA& context ) {
+		const auto& ops = first.operands;
+		const uint64_t address = memory_address<form> ( ops, context );
+		const uint64_t a = read_destination<size, form> ( ops, context, address );
+		const uint64_t b = read_source<size, form> ( first.instr, ops, context, address );
+		constexpr uint64_t mask = GET_OPERAND_MASK ( size );
+
+		const uint64_t res = ( op == AluOp::Test ? ( a & b ) : ( a - b ) ) & mask;
+		context.set_lazy_flags ( op == AluOp::Test ? FlagOp::Logic : FlagOp::Sub, size, a, b, res );
+		if constexpr ( op == AluOp::Sub ) {
+			write_destination<size, form> ( ops, context, address, res );
+		}
+		fused_branch ( branch, fused_condition<op, cond, size> ( a, b, res, context ), context );
+	}
+
+	// INC r or DEC r + jcc, typically a loop counter
+	template <AluOp op, Condition cond, std::size_t size>
+	void step_jcc ( const DecodedInstruction& first, const DecodedInstruction& branch, KUBERA& context ) {
+		const auto reg = first.operands.operands [ 0 ].reg;
+		constexpr uint64_t mask = GET_OPERAND_MASK ( size );
+
+		const uint64_t a = context.get_reg ( reg, size );
+		const uint64_t res = ( op == AluOp::Inc ? a + 1 : a - 1 ) & mask;
+		context.set_lazy_flags ( op == AluOp::Inc ? FlagOp::Inc : FlagOp::Dec, size, a, 1, res );
+		context.set_reg ( reg, res, size );
+		fused_branch ( branch, fused_condition<op, cond, size> ( a, 1, res, context ), context );
+	}
+
+	// PUSH r64 and POP r64 through the stack window
+	void push_reg64 ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		if ( !context.push_stack ( context.get_reg ( ops->operands [ 0 ].reg, 8 ) ) ) {
+			// !TODO(exception)
+			return;
+		}
+	}
+
+	void pop_reg64 ( const iced::Instruction& instr, KUBERA& context ) {
+		const auto* ops = context.lowered_operands ( instr );
+		if ( fall_back ( ops, instr, context ) ) {
+			return;
+		}
+
+		// RSP is incremented before the destination is written, so POP RSP keeps the popped value
+		uint64_t value;
+		if ( !context.pop_stack ( value ) ) {
+			// !TODO(exception)
+			return;
+		}
+		context.set_reg ( ops->operands [ 0 ].reg, value, 8 );
+	}
+
+	constexpr bool is_gpr ( Register reg ) {
+		return reg >= Register::AL && reg <= Register::R15;
+	}
+
+	// Classifies a two-operand instruction, false for anything the variants do not cover
+	bool classify ( const iced::Instruction& instr, Form& form ) {
+		if ( instr.op_count ( ) != 2 ) {
+			return false;
+		}
+
+		const auto size = instr.op0_size ( );
+		const auto dst = instr.op_kind_simple ( 0 );
+		const auto src = instr.op_kind_simple ( 1 );
+		const bool dst_reg = dst == OpKindSimple::Register && is_gpr ( instr.op0_reg ( ) );
+		const bool src_reg = src == OpKindSimple::Register && is_gpr ( instr.op1_reg ( ) ) && instr.op1_size ( ) == size;
+
+		if ( dst_reg ) {
+			if ( src_reg ) {
+				form = Form::RegReg;
+			}
+			else if ( src == OpKindSimple::Immediate ) {
+				form = Form::RegImm;
+			}
+			else if ( src == OpKindSimple::Memory && instr.op1_size ( ) == size ) {
+				form = Form::RegMem;
+			}
+			else {
+				return false;
+			}
+		}
+		else if ( dst == OpKindSimple::Memory ) {
+			if ( src_reg ) {
+				form = Form::MemReg;
+			}
+			else if ( src == OpKindSimple::Immediate ) {
+				form = Form::MemImm;
+			}
+			else {
+				return false;
+			}
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	template <std::size_t size, typename Make>
+	auto pick_form ( Form form, Make make ) -> decltype( make.template operator() < size, Form::RegReg > ( ) ) {
+		switch ( form ) {
+			case Form::RegReg: return make.template operator() < size, Form::RegReg > ( );
+			case Form::RegImm: return make.template operator() < size, Form::RegImm > ( );
+			case Form::RegMem: return make.template operator() < size, Form::RegMem > ( );
+			case Form::MemReg: return make.template operator() < size, Form::MemReg > ( );
+			case Form::MemImm: return make.template operator() < size, Form::MemImm > ( );
+		}
+		return nullptr;
+	}
+
+	// Instantiates make<size, form> for the runtime size and form, make returns nullptr for combinations it does not support
+	template <typename Make>
+	auto pick ( std::size_t size, Form form, Make make ) -> decltype( make.template operator() < 1, Form::RegReg > ( ) ) {
+		switch ( size ) {
+			case 1: return pick_form<1> ( form, make );
+			case 2: return pick_form<2> ( form, make );
+			case 4: return pick_form<4> ( form, make );
+			case 8: return pick_form<8> ( form, make );
+			default: return nullptr;
+		}
+	}
+
+	template <AluOp op>
+	InstructionHandler pick_alu ( std::size_t size, Form form ) {
+		return pick ( size, form, [ ] <std::size_t sz, Form fm> ( ) -> InstructionHandler {
+			// TEST has no r, r/m encoding
+			if constexpr ( op == AluOp::Test && fm == Form::RegMem ) {
+				return nullptr;
+			}
+			else {
+				return &alu<op, sz, fm>;
+			}
+		} );
+	}
+
+	// Condition of a jcc, false for the ones that are never fused
+	bool branch_condition ( Mnemonic mnemonic, Condition& cond ) {
+		switch ( mnemonic ) {
+			case Mnemonic::Jb: cond = Condition::B; return true;
+			case Mnemonic::Jae: cond = Condition::NB; return true;
+			case Mnemonic::Je: cond = Condition::Z; return true;
+			case Mnemonic::Jne: cond = Condition::NZ; return true;
+			case Mnemonic::Jbe: cond = Condition::BE; return true;
+			case Mnemonic::Ja: cond = Condition::NBE; return true;
+			case Mnemonic::Js: cond = Condition::S; return true;
+			case Mnemonic::Jns: cond = Condition::NS; return true;
+			case Mnemonic::Jl: cond = Condition::L; return true;
+			case Mnemonic::Jge: cond = Condition::NL; return true;
+			case Mnemonic::Jle: cond = Condition::LE; return true;
+			case Mnemonic::Jg: cond = Condition::NLE; return true;
+			default: return false;
+		}
+	}
+
+	// Instantiates make<cond> for the runtime condition
+	template <typename Make>
+	FusedHandler pick_condition ( Condition cond, Make make ) {
+		switch ( cond ) {
+			case Condition::B: return make.template operator() < Condition::B > ( );
+			case Condition::NB: return make.template operator() < Condition::NB > ( );
+			case Condition::Z: return make.template operator() < Condition::Z > ( );
+			case Condition::NZ: return make.template operator() < Condition::NZ > ( );
+			case Condition::BE: return make.template operator() < Condition::BE > ( );
+			case Condition::NBE: return make.template operator() < Condition::NBE > ( );
+			case Condition::S: return make.template operator() < Condition::S > ( );
+			case Condition::NS: return make.template operator() < Condition::NS > ( );
+			case Condition::L: return make.template operator() < Condition::L > ( );
+			case Condition::NL: return make.template operator() < Condition::NL > ( );
+			case Condition::LE: return make.template operator() < Condition::LE > ( );
+			case Condition::NLE: return make.template operator() < Condition::NLE > ( );
+			default: return nullptr;
+		}
+	}
+
+	template <AluOp op>
+	FusedHandler pick_alu_jcc ( std::size_t size, Form form, Condition cond ) {
+		return pick_condition ( cond, [ size, form ] <Condition c> ( ) -> FusedHandler {
+			return pick ( size, form, [ ] <std::size_t sz, Form fm> ( ) -> FusedHandler {
+				// No r, r/m TEST, and a SUB writing memory could rewrite the jcc it is fused with
+				if constexpr ( ( op == AluOp::Test && fm == Form::RegMem ) || ( op == AluOp::Sub && memory_destination<fm> ) ) {
+					return nullptr;
+				}
+				else {
+					return &alu_jcc<op, c, sz, fm>;
+				}
+			} );
+		} );
+	}
+
+	template <AluOp op>
+	FusedHandler pick_step_jcc ( std::size_t size, Condition cond ) {
+		return pick_condition ( cond, [ size ] <Condition c> ( ) -> FusedHandler {
+			switch ( size ) {
+				case 1: return &step_jcc<op, c, 1>;
+				case 2: return &step_jcc<op, c, 2>;
+				case 4: return &step_jcc<op, c, 4>;
+				case 8: return &step_jcc<op, c, 8>;
+				default: return nullptr;
+			}
+		} );
+	}
+
+	template <Condition cond>
+	InstructionHandler pick_cmov ( std::size_t size, Form form ) {
+		return pick ( size, form, [ ] <std::size_t sz, Form fm> ( ) -> InstructionHandler {
+			if constexpr ( fm == Form::RegReg || fm == Form::RegMem ) {
+				return &cmov<cond, sz, fm>;
+			}
+			else {
+				return nullptr;
+			}
+		} );
+	}
+}
+
+InstructionHandler kubera::specialized_handler ( const iced::Instruction& instr, InstructionHandler generic ) {
+	const auto mnemonic = instr.mnemonic ( );
+	if ( mnemonic == Mnemonic::Push || mnemonic == Mnemonic::Pop ) {
+		if ( instr.op_count ( ) == 1 && instr.op_kind_simple ( 0 ) == OpKindSimple::Register &&
+				instr.op0_reg ( ) >= Register::RAX && instr.op0_reg ( ) <= Register::R15 ) {
+			return mnemonic == Mnemonic::Push ? &push_reg64 : &pop_reg64;
+		}
+		return generic;
+	}
+
+	Form form;
+	if ( !classify ( instr, form ) ) {
+		return generic;
+	}
+
+	const auto size = instr.op0_size ( );
+	if ( ( mnemonic == Mnemonic::Xor || mnemonic == Mnemonic::Sub ) && form == Form::RegReg && instr.op0_reg ( ) == instr.op1_reg ( ) ) {
+		switch ( size ) {
+			case 1: return mnemonic == Mnemonic::Xor ? &zero_idiom<AluOp::Xor, 1> : &zero_idiom<AluOp::Sub, 1>;
+			case 2: return mnemonic == Mnemonic::Xor ? &zero_idiom<AluOp::Xor, 2> : &zero_idiom<AluOp::Sub, 2>;
+			case 4: return mnemonic == Mnemonic::Xor ? &zero_idiom<AluOp::Xor, 4> : &zero_idiom<AluOp::Sub, 4>;
+			case 8: return mnemonic == Mnemonic::Xor ? &zero_idiom<AluOp::Xor, 8> : &zero_idiom<AluOp::Sub, 8>;
+			default: return generic;
+		}
+	}
+
+	InstructionHandler handler = nullptr;
+	switch ( mnemonic ) {
+		case Mnemonic::Add: handler = pick_alu<AluOp::Add> ( size, form ); break;
+		case Mnemonic::Sub: handler = pick_alu<AluOp::Sub> ( size, form ); break;
+		case Mnemonic::And: handler = pick_alu<AluOp::And> ( size, form ); break;
+		case Mnemonic::Or: handler = pick_alu<AluOp::Or> ( size, form ); break;
+		case Mnemonic::Xor: handler = pick_alu<AluOp::Xor> ( size, form ); break;
+		case Mnemonic::Cmp: handler = pick_alu<AluOp::Cmp> ( size, form ); break;
+		case Mnemonic::Test: handler = pick_alu<AluOp::Test> ( size, form ); break;
+		case Mnemonic::Mov:
+			handler = pick ( size, form, [ ] <std::size_t sz, Form fm> ( ) -> InstructionHandler { return &mov<sz, fm>; } );
+			break;
+		case Mnemonic::Cmovo: handler = pick_cmov<Condition::O> ( size, form ); break;
+		case Mnemonic::Cmovno: handler = pick_cmov<Condition::NO> ( size, form ); break;
+		case Mnemonic::Cmovb: handler = pick_cmov<Condition::B> ( size, form ); break;
+		case Mnemonic::Cmovae: handler = pick_cmov<Condition::NB> ( size, form ); break;
+		case Mnemonic::Cmove: handler = pick_cmov<Condition::Z> ( size, form ); break;
+		case Mnemonic::Cmovne: handler = pick_cmov<Condition::NZ> ( size, form ); break;
+		case Mnemonic::Cmovbe: handler = pick_cmov<Condition::BE> ( size, form ); break;
+		case Mnemonic::Cmova: handler = pick_cmov<Condition::NBE> ( size, form ); break;
+		case Mnemonic::Cmovs: handler = pick_cmov<Condition::S> ( size, form ); break;
+		case Mnemonic::Cmovns: handler = pick_cmov<Condition::NS> ( size, form ); break;
+		case Mnemonic::Cmovp: handler = pick_cmov<Condition::P> ( size, form ); break;
+		case Mnemonic::Cmovnp: handler = pick_cmov<Condition::NP> ( size, form ); break;
+		case Mnemonic::Cmovl: handler = pick_cmov<Condition::L> ( size, form ); break;
+		case Mnemonic::Cmovge: handler = pick_cmov<Condition::NL> ( size, form ); break;
+		case Mnemonic::Cmovle: handler = pick_cmov<Condition::LE> ( size, form ); break;
+		case Mnemonic::Cmovg: handler = pick_cmov<Condition::NLE> ( size, form ); break;
+		default: break;
+	}
+	return handler ? handler : generic;
+}
+
+FusedHandler kubera::fused_handler ( const iced::Instruction& first, const iced::Instruction& second ) {
+	Condition cond;
+	if ( !second.jcc ( ) || second.op0_kind ( ) != OpKindSimple::NearBranch || !branch_condition ( second.mnemonic ( ), cond ) ) {
+		return nullptr;
+	}
+
+	const auto mnemonic = first.mnemonic ( );
+	if ( mnemonic == Mnemonic::Inc || mnemonic == Mnemonic::Dec ) {
+		if ( first.op_count ( ) != 1 || first.op_kind_simple ( 0 ) != OpKindSimple::Register || !is_gpr ( first.op0_reg ( ) ) ) {
+			return nullptr;
+		}
+		return mnemonic == Mnemonic::Inc ? pick_step_jcc<AluOp::Inc> ( first.op0_size ( ), cond ) : pick_step_jcc<AluOp::Dec> ( first.op0_size ( ), cond );
+	}
+
+	Form form;
+	if ( !classify ( first, form ) ) {
+		return nullptr;
+	}
+	switch ( mnemonic ) {
+		case Mnemonic::Cmp: return pick_alu_jcc<AluOp::Cmp> ( first.op0_size ( ), form, cond );
+		case Mnemonic::Test: return pick_alu_jcc<AluOp::Test> ( first.op0_size ( ), form, cond );
+		case Mnemonic::Sub: return pick_alu_jcc<AluOp::Sub> ( first.op0_size ( ), form, cond );
+		default: return nullptr;
+	}
+}
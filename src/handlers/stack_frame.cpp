@@ -16,16 +16,13 @@ void handlers::enter ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
-	uint64_t current_rsp = context.get_reg ( Register::RSP, 8 );
-	const uint64_t current_rbp = context.get_reg ( Register::RBP, 8 );
-
-	current_rsp -= op_size;
-	if ( !context.is_within_stack_bounds ( current_rsp, op_size ) ) {
+	const uint64_t current_rbp = context.get_reg_internal<KubRegister::RBP, Register::RBP, uint64_t> ( );
+	if ( !context.push_stack ( current_rbp ) ) {
 		// !TODO(exception)
 		return;
 	}
-	context.set_stack<uint64_t> ( current_rsp, current_rbp );
-	context.set_reg ( Register::RBP, current_rsp, op_size );
+	uint64_t current_rsp = context.get_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( );
+	context.set_reg_internal<KubRegister::RBP, Register::RBP, uint64_t> ( current_rsp );
 
 	current_rsp -= size;
 	if ( !context.is_within_stack_bounds ( current_rsp, size ) ) {
@@ -38,51 +35,39 @@ void handlers::enter ( const iced::Instruction& instr, KUBERA& context ) {
 /// LEAVE - Leave Procedure
 /// Restores the stack frame by setting RSP to RBP, popping RBP from the stack, and adjusting RSP, without affecting flags.
 void handlers::leave ( const iced::Instruction& instr, KUBERA& context ) {
-	const size_t op_size = 8; // LEAVE uses 64-bit stack operations
-	const uint64_t current_rbp = context.get_reg ( Register::RBP, op_size );
-	const uint64_t saved_rbp = context.get_stack<uint64_t> ( current_rbp );
+	// LEAVE uses 64-bit stack operations
+	const uint64_t old_rsp = context.get_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( );
+	context.set_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( context.get_reg_internal<KubRegister::RBP, Register::RBP, uint64_t> ( ) );
 
-	if ( !context.is_within_stack_bounds ( current_rbp, op_size ) ) {
+	uint64_t saved_rbp;
+	if ( !context.pop_stack ( saved_rbp ) ) {
+		context.set_reg_internal<KubRegister::RSP, Register::RSP, uint64_t> ( old_rsp );
 		// !TODO(exception)
 		return;
 	}
-
-	context.set_reg ( Register::RSP, current_rbp, op_size );
-	context.set_reg ( Register::RBP, saved_rbp, op_size );
-	context.set_reg ( Register::RSP, current_rbp + op_size, op_size );
+	context.set_reg_internal<KubRegister::RBP, Register::RBP, uint64_t> ( saved_rbp );
 }
 
 /// PUSHFQ - Push Flags (Quadword)
 /// Pushes the 64-bit RFLAGS register onto the stack, without affecting flags.
 void handlers::pushfq ( const iced::Instruction& instr, KUBERA& context ) {
-	const size_t op_size = 8; // PUSHFQ pushes 64-bit RFLAGS
-	uint64_t current_rsp = context.get_reg ( Register::RSP, op_size );
-	current_rsp -= op_size;
-
-	if ( !context.is_within_stack_bounds ( current_rsp, op_size ) ) {
+	// PUSHFQ pushes 64-bit RFLAGS
+	if ( !context.push_stack ( context.get_rflags ( ) ) ) {
 		// !TODO(exception)
 		return;
 	}
-
-	const uint64_t rflags = context.get_rflags ( );
-	context.set_stack<uint64_t> ( current_rsp, rflags );
-	context.set_reg ( Register::RSP, current_rsp, op_size );
 }
 
 /// POPFQ - Pop Flags (Quadword)
 /// Pops a 64-bit value from the stack into the RFLAGS register, modifying CF, PF, AF, ZF, SF, TF, IF, DF, OF, IOPL, NT, RF, VM, AC, VIF, VIP, and ID flags.
 void handlers::popfq ( const iced::Instruction& instr, KUBERA& context ) {
-	const size_t op_size = 8; // POPFQ pops 64-bit RFLAGS
-	const uint64_t current_rsp = context.get_reg ( Register::RSP, op_size );
-
-	if ( !context.is_within_stack_bounds ( current_rsp, op_size ) ) {
+	// POPFQ pops 64-bit RFLAGS
+	uint64_t rflags;
+	if ( !context.pop_stack ( rflags ) ) {
 		// !TODO(exception)
 		return;
 	}
-
-	const uint64_t rflags = context.get_stack<uint64_t> ( current_rsp );
 	context.set_rflags ( rflags );
-	context.set_reg ( Register::RSP, current_rsp + op_size, op_size );
 }
 
 /// PUSH - Push onto Stack
@@ -93,30 +78,25 @@ void handlers::push ( const iced::Instruction& instr, KUBERA& context ) {
 	const uint64_t mask = GET_OPERAND_MASK ( op_size );
 	const uint64_t value = src_val & mask;
 
-	uint64_t current_rsp = context.get_reg ( Register::RSP, 8 );
-	current_rsp -= 8; // Stack operations are 8 bytes
-
-	if ( !context.is_within_stack_bounds ( current_rsp, 8 ) ) {
+	// Stack operations are 8 bytes
+	if ( !context.push_stack ( value ) ) {
 		// !TODO(exception)
 		return;
 	}
-
-	context.set_stack<uint64_t> ( current_rsp, value );
-	context.set_reg ( Register::RSP, current_rsp, 8 );
 }
 
 /// POP - Pop from Stack
 /// Pops a value from the stack into a register or memory, without affecting flags.
 void handlers::pop ( const iced::Instruction& instr, KUBERA& context ) {
 	const size_t op_size = instr.op0_size ( );
-	const uint64_t current_rsp = context.get_reg ( Register::RSP, 8 );
 
-	if ( !context.is_within_stack_bounds ( current_rsp, 8 ) ) {
+	// RSP is incremented before the destination is written, so POP RSP keeps the popped value
+	// and a memory destination based on RSP sees the incremented value
+	uint64_t value;
+	if ( !context.pop_stack ( value ) ) {
 		// !TODO(exception)
 		return;
 	}
-
-	const uint64_t value = context.get_stack<uint64_t> ( current_rsp );
 	const uint64_t mask = GET_OPERAND_MASK ( op_size );
 	const uint64_t masked_value = value & mask;
 
@@ -131,6 +111,4 @@ void handlers::pop ( const iced::Instruction& instr, KUBERA& context ) {
 		// !TODO(exception)
 		return;
 	}
-
-	context.set_reg ( Register::RSP, current_rsp + 8, 8 );
 }
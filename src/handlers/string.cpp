@@ -1,51 +1,210 @@
 #include "../../emulator.hpp"
+#include <algorithm>
 #include <bit>
+#include <cstring>
 #include "helpers.hpp"
 
 using namespace kubera;
 
+// REP string instructions run page span by page span: every run of whole elements that stays inside one
+// source and one destination page costs a single translation per side and a host memory operation.
+// A fault stops the instruction at the faulting element with RSI/RDI/RCX describing the remaining work.
+
+// Number of whole elements from address to the end of its page (or down to the start of it when
+// walking backwards), 0 if the element at address straddles a page boundary
+static uint64_t elements_in_page ( uint64_t address, uint64_t elem_size, bool backward, uint64_t page_size ) {
+	const uint64_t offset = address & ( page_size - 1 );
+	if ( offset + elem_size > page_size ) {
+		return 0;
+	}
+	return backward ? offset / elem_size + 1 : ( page_size - offset ) / elem_size;
+}
+
+// Lowest guest address of a span of count elements starting at address
+static uint64_t span_base ( uint64_t address, uint64_t count, uint64_t elem_size, bool backward ) {
+	return backward ? address - ( count - 1 ) * elem_size : address;
+}
+
+static uint64_t load_element ( const uint8_t* src, uint8_t elem_size ) {
+	uint64_t value = 0;
+	std::memcpy ( &value, src, elem_size );
+	return value;
+}
+
 void movs_handler ( const iced::Instruction& instr, KUBERA& context, uint8_t elem_size ) {
 	const bool rep = instr.rep_prefix ( );
 	const uint64_t count = rep ? context.get_reg ( Register::RCX, 8 ) : 1;
 	if ( count == 0 ) {
 		return;
 	}
+	if ( elem_size != 1 && elem_size != 2 && elem_size != 4 && elem_size != 8 ) {
+		// !TODO(exception)
+		return;
+	}
 
 	const bool df = context.get_flags ( ).DF;
 	const int64_t step = df ? -static_cast< int64_t >( elem_size ) : static_cast< int64_t >( elem_size );
+	auto* memory = context.get_virtual_memory ( );
+	const uint64_t page_size = memory->page_size;
 	uint64_t rsi = context.get_reg ( Register::RSI, 8 );
 	uint64_t rdi = context.get_reg ( Register::RDI, 8 );
+	uint64_t remaining = count;
 
-	for ( uint64_t i = 0; i < count; ++i ) {
-		const uint64_t src_addr = rsi + i * step;
-		const uint64_t dst_addr = rdi + i * step;
+	while ( remaining != 0 ) {
+		uint64_t n = std::min ( { remaining, elements_in_page ( rsi, elem_size, df, page_size ), elements_in_page ( rdi, elem_size, df, page_size ) } );
+		if ( n == 0 ) {
+			// One of the elements straddles a page boundary
+			uint8_t element [ 8 ];
+			if ( !memory->check ( rsi, elem_size, PageProtection::READ ) || !memory->check ( rdi, elem_size, PageProtection::WRITE ) ) {
+				// !TODO(exception)
+				break;
+			}
+			memory->read_bytes ( rsi, element, elem_size );
+			memory->write_bytes ( rdi, element, elem_size );
+			n = 1;
+		}
+		else {
+			// The copy is element by element in the direction of DF, so a destination trailing the source by less than
+			// the span re-reads what this instruction just wrote. Keep every span clear of that dependency.
+			const uint64_t distance = df ? rsi - rdi : rdi - rsi;
+			if ( distance != 0 && distance < n * elem_size ) {
+				n = std::max<uint64_t> ( distance / elem_size, 1 );
+			}
 
-		if ( elem_size == 1 ) {
-			const uint8_t val = context.get_memory<uint8_t> ( src_addr );
-			context.set_memory<uint8_t> ( dst_addr, val );
+			// Destination first, so a copy-on-write break is visible to the source translation of the same page
+			auto* dst = memory->translate ( span_base ( rdi, n, elem_size, df ), PageProtection::WRITE, false, n * elem_size );
+			if ( !dst ) {
+				// !TODO(exception)
+				break;
+			}
+			const auto* src = memory->translate ( span_base ( rsi, n, elem_size, df ), PageProtection::READ, false, n * elem_size );
+			if ( !src ) {
+				// !TODO(exception)
+				break;
+			}
+			std::memmove ( dst, src, n * elem_size );
 		}
-		else if ( elem_size == 2 ) {
-			const uint16_t val = context.get_memory<uint16_t> ( src_addr );
-			context.set_memory<uint16_t> ( dst_addr, val );
+
+		rsi += n * step;
+		rdi += n * step;
+		remaining -= n;
+	}
+
+	context.set_reg ( Register::RSI, rsi, 8 );
+	context.set_reg ( Register::RDI, rdi, 8 );
+	if ( rep ) {
+		context.set_reg ( Register::RCX, remaining, 8 );
+	}
+}
+
+// Shared by CMPS and SCAS. Compares elements until the count runs out or the REPE/REPNE condition fails,
+// then sets the flags of the last comparison like CMP. SCAS has no source string and compares the accumulator.
+static void compare_string ( const iced::Instruction& instr, KUBERA& context, uint8_t elem_size, bool scan ) {
+	const bool repe = instr.rep_prefix ( );
+	const bool repne = instr.repne_prefix ( );
+	const bool rep = repe || repne;
+	const uint64_t count = rep ? context.get_reg ( Register::RCX, 8 ) : 1;
+	if ( count == 0 ) {
+		return;
+	}
+
+	const bool df = context.get_flags ( ).DF;
+	const int64_t step = df ? -static_cast< int64_t >( elem_size ) : static_cast< int64_t >( elem_size );
+	auto* memory = context.get_virtual_memory ( );
+	const uint64_t page_size = memory->page_size;
+	const uint64_t accumulator = scan ? context.get_reg ( Register::RAX, 8 ) & GET_OPERAND_MASK ( elem_size ) : 0;
+	uint64_t rsi = context.get_reg ( Register::RSI, 8 );
+	uint64_t rdi = context.get_reg ( Register::RDI, 8 );
+	uint64_t remaining = count;
+
+	bool compared = false;
+	bool terminated = false;
+	uint64_t last_a = 0;
+	uint64_t last_b = 0;
+
+	while ( remaining != 0 && !terminated ) {
+		uint64_t n = std::min ( remaining, elements_in_page ( rdi, elem_size, df, page_size ) );
+		if ( !scan ) {
+			n = std::min ( n, elements_in_page ( rsi, elem_size, df, page_size ) );
 		}
-		else if ( elem_size == 4 ) {
-			const uint32_t val = context.get_memory<uint32_t> ( src_addr );
-			context.set_memory<uint32_t> ( dst_addr, val );
+		if ( !rep ) {
+			n = std::min<uint64_t> ( n, 1 );
 		}
-		else if ( elem_size == 8 ) {
-			const uint64_t val = context.get_memory<uint64_t> ( src_addr );
-			context.set_memory<uint64_t> ( dst_addr, val );
+
+		uint64_t done = 0;
+		if ( n == 0 ) {
+			// One of the elements straddles a page boundary
+			uint8_t element [ 8 ];
+			if ( ( !scan && !memory->check ( rsi, elem_size, PageProtection::READ ) ) || !memory->check ( rdi, elem_size, PageProtection::READ ) ) {
+				// !TODO(exception)
+				break;
+			}
+			memory->read_bytes ( rdi, element, elem_size );
+			last_b = load_element ( element, elem_size );
+			if ( scan ) {
+				last_a = accumulator;
+			}
+			else {
+				memory->read_bytes ( rsi, element, elem_size );
+				last_a = load_element ( element, elem_size );
+			}
+			done = 1;
+			terminated = repe ? last_a != last_b : repne && last_a == last_b;
 		}
 		else {
-			// !TODO(exception)
-			return;
+			const auto* dst = static_cast< const uint8_t* >( memory->translate ( span_base ( rdi, n, elem_size, df ), PageProtection::READ, false, n * elem_size ) );
+			if ( !dst ) {
+				// !TODO(exception)
+				break;
+			}
+			const uint8_t* src = nullptr;
+			if ( !scan ) {
+				src = static_cast< const uint8_t* >( memory->translate ( span_base ( rsi, n, elem_size, df ), PageProtection::READ, false, n * elem_size ) );
+				if ( !src ) {
+					// !TODO(exception)
+					break;
+				}
+			}
+
+			// Element i in execution order, the span pointers are at its lowest address
+			const auto offset = [ = ] ( uint64_t i ) { return ( df ? n - 1 - i : i ) * elem_size; };
+
+			// Common idioms: REPE CMPSB over equal memory and REPNE SCASB (strlen/memchr)
+			if ( !df && elem_size == 1 && repe && !scan && n > 1 && std::memcmp ( src, dst, n - 1 ) == 0 ) {
+				done = n - 1;
+			}
+			else if ( !df && elem_size == 1 && repne && scan && n > 1 ) {
+				const auto* hit = static_cast< const uint8_t* >( std::memchr ( dst, static_cast< int >( accumulator ), n - 1 ) );
+				done = hit ? static_cast< uint64_t >( hit - dst ) : n - 1;
+			}
+
+			for ( ; done < n; ) {
+				last_a = scan ? accumulator : load_element ( src + offset ( done ), elem_size );
+				last_b = load_element ( dst + offset ( done ), elem_size );
+				++done;
+				if ( repe ? last_a != last_b : repne && last_a == last_b ) {
+					terminated = true;
+					break;
+				}
+			}
 		}
+
+		compared = true;
+		rsi += done * step;
+		rdi += done * step;
+		remaining -= done;
 	}
 
-	context.set_reg ( Register::RSI, rsi + count * step, 8 );
-	context.set_reg ( Register::RDI, rdi + count * step, 8 );
+	if ( compared ) {
+		const uint64_t mask = GET_OPERAND_MASK ( elem_size );
+		context.set_lazy_flags ( FlagOp::Sub, elem_size, last_a, last_b, ( last_a - last_b ) & mask );
+	}
+	if ( !scan ) {
+		context.set_reg ( Register::RSI, rsi, 8 );
+	}
+	context.set_reg ( Register::RDI, rdi, 8 );
 	if ( rep ) {
-		context.set_reg ( Register::RCX, 0, 8 );
+		context.set_reg ( Register::RCX, remaining, 8 );
 	}
 }
 
@@ -93,36 +252,90 @@ void handlers::stos ( const iced::Instruction& instr, KUBERA& context ) {
 		return;
 	}
 
+	if ( elem_size != 1 && elem_size != 2 && elem_size != 4 && elem_size != 8 ) {
+		// !TODO(exception)
+		return;
+	}
+
 	const bool df = context.get_flags ( ).DF;
 	const int64_t step = df ? -static_cast< int64_t >( elem_size ) : static_cast< int64_t >( elem_size );
-	const uint64_t rdi = context.get_reg ( Register::RDI, 8 );
+	auto* memory = context.get_virtual_memory ( );
+	const uint64_t page_size = memory->page_size;
 	const uint64_t rax = context.get_reg ( Register::RAX, elem_size );
 	const uint64_t mask = GET_OPERAND_MASK ( elem_size );
 	const uint64_t value = rax & mask;
+	uint64_t rdi = context.get_reg ( Register::RDI, 8 );
+	uint64_t remaining = count;
 
-	for ( uint64_t i = 0; i < count; ++i ) {
-		const uint64_t dst_addr = rdi + i * step;
-
-		if ( elem_size == 1 ) {
-			context.set_memory<uint8_t> ( dst_addr, static_cast< uint8_t > ( value ) );
-		}
-		else if ( elem_size == 2 ) {
-			context.set_memory<uint16_t> ( dst_addr, static_cast< uint16_t >( value ) );
-		}
-		else if ( elem_size == 4 ) {
-			context.set_memory<uint32_t> ( dst_addr, static_cast< uint32_t >( value ) );
-		}
-		else if ( elem_size == 8 ) {
-			context.set_memory<uint64_t> ( dst_addr, value );
+	while ( remaining != 0 ) {
+		uint64_t n = std::min ( remaining, elements_in_page ( rdi, elem_size, df, page_size ) );
+		if ( n == 0 ) {
+			// The element straddles a page boundary
+			if ( !memory->check ( rdi, elem_size, PageProtection::WRITE ) ) {
+				// !TODO(exception)
+				break;
+			}
+			memory->write_bytes ( rdi, &value, elem_size );
+			n = 1;
 		}
 		else {
-			// !TODO(exception)
-			return;
+			auto* dst = static_cast< uint8_t* >( memory->translate ( span_base ( rdi, n, elem_size, df ), PageProtection::WRITE, false, n * elem_size ) );
+			if ( !dst ) {
+				// !TODO(exception)
+				break;
+			}
+			if ( elem_size == 1 ) {
+				std::memset ( dst, static_cast< int >( value ), n );
+			}
+			else {
+				for ( uint64_t i = 0; i < n; ++i ) {
+					std::memcpy ( dst + i * elem_size, &value, elem_size );
+				}
+			}
 		}
+
+		rdi += n * step;
+		remaining -= n;
 	}
 
-	context.set_reg ( Register::RDI, rdi + count * step, 8 );
+	context.set_reg ( Register::RDI, rdi, 8 );
 	if ( rep ) {
-		context.set_reg ( Register::RCX, 0, 8 );
+		context.set_reg ( Register::RCX, remaining, 8 );
+	}
+}
+
+/// CMPSB - Compare String Byte
+/// Compares the byte at RSI with the byte at RDI and sets the flags like CMP, updating RSI and RDI based on DF. With REPE/REPNE it repeats while RCX is non-zero and the elements are equal/unequal.
+void handlers::cmpsb ( const iced::Instruction& instr, KUBERA& context ) {
+	compare_string ( instr, context, 1, false );
+}
+
+/// CMPSW - Compare String Word
+/// Compares the word at RSI with the word at RDI and sets the flags like CMP, updating RSI and RDI based on DF, repeating under REPE/REPNE.
+void handlers::cmpsw ( const iced::Instruction& instr, KUBERA& context ) {
+	compare_string ( instr, context, 2, false );
+}
+
+/// CMPSD - Compare String Doubleword
+/// Compares the doubleword at RSI with the doubleword at RDI and sets the flags like CMP, updating RSI and RDI based on DF, repeating under REPE/REPNE.
+void handlers::cmpsd ( const iced::Instruction& instr, KUBERA& context ) {
+	// The mnemonic is shared with the SSE2 scalar double compare, which has a register destination
+	if ( instr.op0_kind ( ) != OpKindSimple::Memory ) {
+		handlers::unsupported_instruction ( instr, context );
+		return;
 	}
+	compare_string ( instr, context, 4, false );
+}
+
+/// CMPSQ - Compare String Quadword
+/// Compares the quadword at RSI with the quadword at RDI and sets the flags like CMP, updating RSI and RDI based on DF, repeating under REPE/REPNE.
+void handlers::cmpsq ( const iced::Instruction& instr, KUBERA& context ) {
+	compare_string ( instr, context, 8, false );
+}
+
+/// SCAS - Scan String
+/// Compares AL/AX/EAX/RAX with the element at RDI and sets the flags like CMP, updating RDI based on DF. With REPE/REPNE it repeats while RCX is non-zero and the elements are equal/unequal.
+void handlers::scas ( const iced::Instruction& instr, KUBERA& context ) {
+	const uint8_t elem_size = static_cast< uint8_t >( instr.op0_size ( ) );
+	compare_string ( instr, context, elem_size, true );
 }
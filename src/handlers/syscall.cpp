@@ -5,6 +5,35 @@
 using namespace kubera;
 
 /// SYSCALL-Fast System Call
+/// Saves the return RIP in RCX and RFLAGS in R11, then runs the platform handler registered for the number in EAX.
 void handlers::syscall ( const iced::Instruction& instr, KUBERA& context ) {
-	std::printf ( "[!!!] Syscall instruction executed without a platform hook!\n" );
+	const auto& table = context.syscall_table ( );
+	SyscallArgs args { .number = context.get_reg_internal<KubRegister::RAX, Register::EAX, uint32_t> ( ) };
+	const auto& entry = table.find ( args.number );
+	if ( !entry.handler ) [[unlikely]] {
+		std::printf ( "[!!!] Syscall instruction executed without a platform hook!\n" );
+		return;
+	}
+
+	context.set_reg_internal<KubRegister::RCX, Register::RCX, uint64_t> ( context.rip ( ) + instr.length ( ) );
+	context.set_reg_internal<KubRegister::R11, Register::R11, uint64_t> ( context.get_rflags ( ) );
+	if ( table.convention == SyscallConvention::Windows ) {
+		args.args = {
+			context.get_reg_internal<KubRegister::R10, Register::R10, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::RDX, Register::RDX, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::R8, Register::R8, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::R9, Register::R9, uint64_t> ( ),
+		};
+	}
+	else {
+		args.args = {
+			context.get_reg_internal<KubRegister::RDI, Register::RDI, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::RSI, Register::RSI, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::RDX, Register::RDX, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::R10, Register::R10, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::R8, Register::R8, uint64_t> ( ),
+			context.get_reg_internal<KubRegister::R9, Register::R9, uint64_t> ( ),
+		};
+	}
+	entry.handler ( context, args, entry.user );
 }
\ No newline at end of file
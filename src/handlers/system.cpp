@@ -129,6 +129,10 @@ void handlers::rdtsc ( const iced::Instruction& instr, KUBERA& context ) {
 /// INT1-Debug Trap
 /// Triggers a debug exception (#DB) for single-step debugging.
 void handlers::int1 ( const iced::Instruction& instr, KUBERA& context ) {
+	if ( const auto& entry = context.interrupt_table ( ).find ( 1 ); entry.handler ) {
+		entry.handler ( context, 1, entry.user );
+		return;
+	}
 	if ( context.get_cpl ( ) == 0 ) {
 		// !TODO(exception)
 	}
@@ -140,12 +144,23 @@ void handlers::int1 ( const iced::Instruction& instr, KUBERA& context ) {
 /// INT3-Breakpoint
 /// Triggers a breakpoint exception (#BP) for debugging.
 void handlers::int3 ( const iced::Instruction& instr, KUBERA& context ) {
+	if ( const auto& entry = context.interrupt_table ( ).find ( 3 ); entry.handler ) {
+		entry.handler ( context, 3, entry.user );
+		return;
+	}
 	// !TODO(exception)
+	// Until #BP is delivered to the guest, a run stops after it with RIP past the INT3
+	context.signal_stop ( StopReason::Breakpoint );
 }
 
 /// INT-Software Interrupt
 /// Triggers a software interrupt with the specified vector number (generic handler for all interrupts).
 void handlers::int_ ( const iced::Instruction& instr, KUBERA& context ) {
+	const auto vector = static_cast< uint8_t >( instr.immediate ( ) );
+	if ( const auto& entry = context.interrupt_table ( ).find ( vector ); entry.handler ) {
+		entry.handler ( context, vector, entry.user );
+		return;
+	}
 	if ( context.get_cpl ( ) == 0 ) {
 		// !TODO(exception)
 	}
@@ -187,7 +202,7 @@ void handlers::fxsave ( const iced::Instruction& instr, KUBERA& context ) {
 		int phys_idx = fpu.get_fpu_phys_idx ( i );
 		const float80_t& st_val = fpu.fpu_stack [ phys_idx ];
 		uint64_t current_reg_addr = base_addr + 32 + ( i * 16 );
-		context.write_type<float80_t> ( current_reg_addr, st_val );
+		context.write_type_float80_t ( current_reg_addr, st_val );
 		for ( int j = 10; j < 16; ++j ) {
 			context.set_memory<uint8_t> ( current_reg_addr + j, 0 );
 		}
@@ -252,7 +267,8 @@ void handlers::fxrstor ( const iced::Instruction& instr, KUBERA& context ) {
 /// Halts the processor until the next interrupt or reset.
 void handlers::hlt ( const iced::Instruction& instr, KUBERA& context ) {
 	if ( context.get_cpl ( ) == 0 ) {
-		// !TODO(halt)
+		// Nothing raises interrupts yet, so halting ends the run with RIP past the HLT
+		context.signal_stop ( StopReason::Halt );
 	}
 	else {
 		// !TODO(exception)
@@ -291,41 +307,29 @@ void handlers::ldmxcsr ( const iced::Instruction& instr, KUBERA& context ) {
 /// XGETBV-Get Value of Extended Control Register
 /// Reads the specified extended control register (XCR) into EDX:EAX (high:low 32 bits).
 void handlers::xgetbv ( const iced::Instruction& instr, KUBERA& context ) {
-	// !TODO(implement)
-	throw std::runtime_error ( "xgetbv not implemented!" );
-	//const uint32_t ecx_in = context.get_reg_internal<KubRegister::RCX, Register::ECX, uint32_t> ( );
-	//const uint64_t xcr_val = _xgetbv ( ecx_in );
-	//const uint32_t eax_out = static_cast< uint32_t >( xcr_val & 0xFFFFFFFF );
-	//const uint32_t edx_out = static_cast< uint32_t >( xcr_val >> 32 );
-	//context.set_reg_internal<KubRegister::RAX, Register::EAX> ( eax_out );
-	//context.set_reg_internal<KubRegister::RDX, Register::EDX> ( edx_out );
+	const uint32_t ecx_in = context.get_reg_internal<KubRegister::RCX, Register::ECX, uint32_t> ( );
+	const auto& table = context.get_cpuid_table ( );
+	// XCR0, or XINUSE when supported, which may report components still in their initial state as in use
+	const bool xinuse = ecx_in == 1 && ( table.query ( 0xD, 1 ).eax & ( 1u << 2 ) );
+	if ( ecx_in != 0 && !xinuse ) {
+		// !TODO(exception)
+		return;
+	}
+	const uint64_t xcr_val = table.xcr0 ( );
+	context.set_reg_internal<KubRegister::RAX, Register::EAX, uint32_t> ( static_cast< uint32_t >( xcr_val ) );
+	context.set_reg_internal<KubRegister::RDX, Register::EDX, uint32_t> ( static_cast< uint32_t >( xcr_val >> 32 ) );
 }
 
 /// CPUID-CPU Identification
 /// Returns processor identification and feature information in RAX, RBX, RCX, and RDX based on the input in RAX and RCX.
 void handlers::cpuid ( const iced::Instruction& instr, KUBERA& context ) {
-	const uint32_t eax_in = context.get_reg_internal<KubRegister::RAX, Register::RAX, uint32_t> ( );
-	const uint32_t ecx_in = context.get_reg_internal<KubRegister::RCX, Register::RCX, uint32_t> ( );
-
-	// !TODO(isolation)
-	// !TODO(PRIORITY)
-	std::array<int, 4> cpu_info;
-#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
-#ifdef _MSC_VER
-	__cpuidex ( cpu_info.data ( ), eax_in, ecx_in );
-#else
-	__asm__ __volatile__ (
-			"cpuid"
-			: "=a"( cpu_info [ 0 ] ), "=b"( cpu_info [ 1 ] ), "=c"( cpu_info [ 2 ] ), "=d"( cpu_info [ 3 ] )
-			: "a"( eax_in ), "c"( ecx_in )
-	);
-#endif
-#else
-	throw std::runtime_error ( "CPUID emulation not available for non-x86 platforms" );
-#endif
-
-	context.set_reg_internal<KubRegister::RAX, Register::RAX> ( cpu_info [ 0 ] );
-	context.set_reg_internal<KubRegister::RBX, Register::RBX> ( cpu_info [ 1 ] );
-	context.set_reg_internal<KubRegister::RCX, Register::RCX> ( cpu_info [ 2 ] );
-	context.set_reg_internal<KubRegister::RDX, Register::RDX> ( cpu_info [ 3 ] );
+	const uint32_t eax_in = context.get_reg_internal<KubRegister::RAX, Register::EAX, uint32_t> ( );
+	const uint32_t ecx_in = context.get_reg_internal<KubRegister::RCX, Register::ECX, uint32_t> ( );
+
+	// Served from the instance's table, the host CPU is only queried once when the process captures it
+	const auto leaf = context.get_cpuid_table ( ).query ( eax_in, ecx_in );
+	context.set_reg_internal<KubRegister::RAX, Register::EAX, uint32_t> ( leaf.eax );
+	context.set_reg_internal<KubRegister::RBX, Register::EBX, uint32_t> ( leaf.ebx );
+	context.set_reg_internal<KubRegister::RCX, Register::ECX, uint32_t> ( leaf.ecx );
+	context.set_reg_internal<KubRegister::RDX, Register::EDX, uint32_t> ( leaf.edx );
 }
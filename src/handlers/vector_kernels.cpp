@@ -0,0 +1,282 @@
+#include "vector_kernels.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KUBERA_X86_HOST 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KUBERA_TARGET(x)
+#else
+#define KUBERA_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+using namespace kubera::vector_kernels;
+
+namespace
+{
+	// Portable fallback, one element at a time
+	template <typename T, typename Op>
+	void scalar_loop ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size, Op op ) {
+		for ( std::size_t i = 0; i < size; i += sizeof ( T ) ) {
+			T lhs, rhs;
+			std::memcpy ( &lhs, a + i, sizeof ( T ) );
+			std::memcpy ( &rhs, b + i, sizeof ( T ) );
+			const T result = op ( lhs, rhs );
+			std::memcpy ( dst + i, &result, sizeof ( T ) );
+		}
+	}
+
+#define SCALAR_KERNEL(name, type, expr) \
+	void scalar_##name ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size ) { \
+		scalar_loop<type> ( dst, a, b, size, [ ] ( type x, type y ) { return static_cast< type >( expr ); } ); \
+	}
+
+	SCALAR_KERNEL ( pand, uint64_t, x & y )
+	SCALAR_KERNEL ( pandn, uint64_t, ~x & y )
+	SCALAR_KERNEL ( por, uint64_t, x | y )
+	SCALAR_KERNEL ( pxor, uint64_t, x ^ y )
+	SCALAR_KERNEL ( cmpeq8, uint8_t, x == y ? 0xFF : 0 )
+	SCALAR_KERNEL ( cmpeq16, uint16_t, x == y ? 0xFFFF : 0 )
+	SCALAR_KERNEL ( cmpeq32, uint32_t, x == y ? 0xFFFFFFFF : 0 )
+	SCALAR_KERNEL ( add8, uint8_t, x + y )
+	SCALAR_KERNEL ( add16, uint16_t, x + y )
+	SCALAR_KERNEL ( add32, uint32_t, x + y )
+	SCALAR_KERNEL ( add64, uint64_t, x + y )
+	SCALAR_KERNEL ( add_f32, float, x + y )
+	SCALAR_KERNEL ( sub_f32, float, x - y )
+	SCALAR_KERNEL ( mul_f32, float, x * y )
+
+#undef SCALAR_KERNEL
+
+	uint64_t scalar_movemask8 ( const uint8_t* src, std::size_t size ) {
+		uint64_t mask = 0;
+		for ( std::size_t i = 0; i < size; ++i ) {
+			mask |= static_cast< uint64_t >( src [ i ] >> 7 ) << i;
+		}
+		return mask;
+	}
+
+	constexpr KernelTable scalar_table {
+		.level = KernelLevel::Scalar,
+		.bitwise_and = scalar_pand,
+		.bitwise_andn = scalar_pandn,
+		.bitwise_or = scalar_por,
+		.bitwise_xor = scalar_pxor,
+		.cmpeq8 = scalar_cmpeq8,
+		.cmpeq16 = scalar_cmpeq16,
+		.cmpeq32 = scalar_cmpeq32,
+		.add8 = scalar_add8,
+		.add16 = scalar_add16,
+		.add32 = scalar_add32,
+		.add64 = scalar_add64,
+		.add_f32 = scalar_add_f32,
+		.sub_f32 = scalar_sub_f32,
+		.mul_f32 = scalar_mul_f32,
+		.movemask8 = scalar_movemask8,
+	};
+
+#ifdef KUBERA_X86_HOST
+	// 128 bits per host op, a ZMM operand takes four iterations
+#define SSE2_INT_KERNEL(name, op) \
+	KUBERA_TARGET ( "sse2" ) void sse2_##name ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size ) { \
+		for ( std::size_t i = 0; i < size; i += 16 ) { \
+			const __m128i lhs = _mm_loadu_si128 ( reinterpret_cast< const __m128i* >( a + i ) ); \
+			const __m128i rhs = _mm_loadu_si128 ( reinterpret_cast< const __m128i* >( b + i ) ); \
+			_mm_storeu_si128 ( reinterpret_cast< __m128i* >( dst + i ), op ( lhs, rhs ) ); \
+		} \
+	}
+
+#define SSE2_F32_KERNEL(name, op) \
+	KUBERA_TARGET ( "sse2" ) void sse2_##name ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size ) { \
+		for ( std::size_t i = 0; i < size; i += 16 ) { \
+			const __m128 lhs = _mm_loadu_ps ( reinterpret_cast< const float* >( a + i ) ); \
+			const __m128 rhs = _mm_loadu_ps ( reinterpret_cast< const float* >( b + i ) ); \
+			_mm_storeu_ps ( reinterpret_cast< float* >( dst + i ), op ( lhs, rhs ) ); \
+		} \
+	}
+
+	SSE2_INT_KERNEL ( pand, _mm_and_si128 )
+	SSE2_INT_KERNEL ( pandn, _mm_andnot_si128 )
+	SSE2_INT_KERNEL ( por, _mm_or_si128 )
+	SSE2_INT_KERNEL ( pxor, _mm_xor_si128 )
+	SSE2_INT_KERNEL ( cmpeq8, _mm_cmpeq_epi8 )
+	SSE2_INT_KERNEL ( cmpeq16, _mm_cmpeq_epi16 )
+	SSE2_INT_KERNEL ( cmpeq32, _mm_cmpeq_epi32 )
+	SSE2_INT_KERNEL ( add8, _mm_add_epi8 )
+	SSE2_INT_KERNEL ( add16, _mm_add_epi16 )
+	SSE2_INT_KERNEL ( add32, _mm_add_epi32 )
+	SSE2_INT_KERNEL ( add64, _mm_add_epi64 )
+	SSE2_F32_KERNEL ( add_f32, _mm_add_ps )
+	SSE2_F32_KERNEL ( sub_f32, _mm_sub_ps )
+	SSE2_F32_KERNEL ( mul_f32, _mm_mul_ps )
+
+	KUBERA_TARGET ( "sse2" ) uint64_t sse2_movemask8 ( const uint8_t* src, std::size_t size ) {
+		uint64_t mask = 0;
+		for ( std::size_t i = 0; i < size; i += 16 ) {
+			const __m128i value = _mm_loadu_si128 ( reinterpret_cast< const __m128i* >( src + i ) );
+			mask |= static_cast< uint64_t >( static_cast< uint32_t >( _mm_movemask_epi8 ( value ) ) ) << i;
+		}
+		return mask;
+	}
+
+	constexpr KernelTable sse2_table {
+		.level = KernelLevel::SSE2,
+		.bitwise_and = sse2_pand,
+		.bitwise_andn = sse2_pandn,
+		.bitwise_or = sse2_por,
+		.bitwise_xor = sse2_pxor,
+		.cmpeq8 = sse2_cmpeq8,
+		.cmpeq16 = sse2_cmpeq16,
+		.cmpeq32 = sse2_cmpeq32,
+		.add8 = sse2_add8,
+		.add16 = sse2_add16,
+		.add32 = sse2_add32,
+		.add64 = sse2_add64,
+		.add_f32 = sse2_add_f32,
+		.sub_f32 = sse2_sub_f32,
+		.mul_f32 = sse2_mul_f32,
+		.movemask8 = sse2_movemask8,
+	};
+
+#undef SSE2_INT_KERNEL
+#undef SSE2_F32_KERNEL
+
+	// 256 bits per host op, XMM operands fall back to the SSE2 kernels
+#define AVX2_INT_KERNEL(name, op) \
+	KUBERA_TARGET ( "avx2" ) void avx2_##name ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size ) { \
+		if ( size < 32 ) { \
+			return sse2_##name ( dst, a, b, size ); \
+		} \
+		for ( std::size_t i = 0; i < size; i += 32 ) { \
+			const __m256i lhs = _mm256_loadu_si256 ( reinterpret_cast< const __m256i* >( a + i ) ); \
+			const __m256i rhs = _mm256_loadu_si256 ( reinterpret_cast< const __m256i* >( b + i ) ); \
+			_mm256_storeu_si256 ( reinterpret_cast< __m256i* >( dst + i ), op ( lhs, rhs ) ); \
+		} \
+	}
+
+#define AVX2_F32_KERNEL(name, op) \
+	KUBERA_TARGET ( "avx2" ) void avx2_##name ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size ) { \
+		if ( size < 32 ) { \
+			return sse2_##name ( dst, a, b, size ); \
+		} \
+		for ( std::size_t i = 0; i < size; i += 32 ) { \
+			const __m256 lhs = _mm256_loadu_ps ( reinterpret_cast< const float* >( a + i ) ); \
+			const __m256 rhs = _mm256_loadu_ps ( reinterpret_cast< const float* >( b + i ) ); \
+			_mm256_storeu_ps ( reinterpret_cast< float* >( dst + i ), op ( lhs, rhs ) ); \
+		} \
+	}
+
+	AVX2_INT_KERNEL ( pand, _mm256_and_si256 )
+	AVX2_INT_KERNEL ( pandn, _mm256_andnot_si256 )
+	AVX2_INT_KERNEL ( por, _mm256_or_si256 )
+	AVX2_INT_KERNEL ( pxor, _mm256_xor_si256 )
+	AVX2_INT_KERNEL ( cmpeq8, _mm256_cmpeq_epi8 )
+	AVX2_INT_KERNEL ( cmpeq16, _mm256_cmpeq_epi16 )
+	AVX2_INT_KERNEL ( cmpeq32, _mm256_cmpeq_epi32 )
+	AVX2_INT_KERNEL ( add8, _mm256_add_epi8 )
+	AVX2_INT_KERNEL ( add16, _mm256_add_epi16 )
+	AVX2_INT_KERNEL ( add32, _mm256_add_epi32 )
+	AVX2_INT_KERNEL ( add64, _mm256_add_epi64 )
+	AVX2_F32_KERNEL ( add_f32, _mm256_add_ps )
+	AVX2_F32_KERNEL ( sub_f32, _mm256_sub_ps )
+	AVX2_F32_KERNEL ( mul_f32, _mm256_mul_ps )
+
+	KUBERA_TARGET ( "avx2" ) uint64_t avx2_movemask8 ( const uint8_t* src, std::size_t size ) {
+		if ( size < 32 ) {
+			return sse2_movemask8 ( src, size );
+		}
+		uint64_t mask = 0;
+		for ( std::size_t i = 0; i < size; i += 32 ) {
+			const __m256i value = _mm256_loadu_si256 ( reinterpret_cast< const __m256i* >( src + i ) );
+			mask |= static_cast< uint64_t >( static_cast< uint32_t >( _mm256_movemask_epi8 ( value ) ) ) << i;
+		}
+		return mask;
+	}
+
+	constexpr KernelTable avx2_table {
+		.level = KernelLevel::AVX2,
+		.bitwise_and = avx2_pand,
+		.bitwise_andn = avx2_pandn,
+		.bitwise_or = avx2_por,
+		.bitwise_xor = avx2_pxor,
+		.cmpeq8 = avx2_cmpeq8,
+		.cmpeq16 = avx2_cmpeq16,
+		.cmpeq32 = avx2_cmpeq32,
+		.add8 = avx2_add8,
+		.add16 = avx2_add16,
+		.add32 = avx2_add32,
+		.add64 = avx2_add64,
+		.add_f32 = avx2_add_f32,
+		.sub_f32 = avx2_sub_f32,
+		.mul_f32 = avx2_mul_f32,
+		.movemask8 = avx2_movemask8,
+	};
+
+#undef AVX2_INT_KERNEL
+#undef AVX2_F32_KERNEL
+#endif
+
+	KernelLevel detect_host_level ( ) {
+#if defined(KUBERA_X86_HOST) && defined(_MSC_VER)
+		int regs [ 4 ] = { 0 };
+		__cpuid ( regs, 0 );
+		const int max_leaf = regs [ 0 ];
+
+		__cpuid ( regs, 1 );
+		const bool sse2 = ( regs [ 3 ] & ( 1 << 26 ) ) != 0;
+		const bool osxsave = ( regs [ 2 ] & ( 1 << 27 ) ) != 0;
+		const bool avx = ( regs [ 2 ] & ( 1 << 28 ) ) != 0;
+		// The OS has to save the YMM state for AVX2 to be usable
+		const bool ymm_state = osxsave && avx && ( _xgetbv ( 0 ) & 0x6 ) == 0x6;
+
+		bool avx2 = false;
+		if ( max_leaf >= 7 ) {
+			__cpuidex ( regs, 7, 0 );
+			avx2 = ( regs [ 1 ] & ( 1 << 5 ) ) != 0;
+		}
+
+		if ( avx2 && ymm_state ) {
+			return KernelLevel::AVX2;
+		}
+		return sse2 ? KernelLevel::SSE2 : KernelLevel::Scalar;
+#elif defined(KUBERA_X86_HOST)
+		__builtin_cpu_init ( );
+		if ( __builtin_cpu_supports ( "avx2" ) ) {
+			return KernelLevel::AVX2;
+		}
+		return __builtin_cpu_supports ( "sse2" ) ? KernelLevel::SSE2 : KernelLevel::Scalar;
+#else
+		return KernelLevel::Scalar;
+#endif
+	}
+
+	const KernelTable* table_for ( KernelLevel level ) {
+		switch ( level ) {
+#ifdef KUBERA_X86_HOST
+			case KernelLevel::AVX2:
+				return &avx2_table;
+			case KernelLevel::SSE2:
+				return &sse2_table;
+#endif
+			default:
+				return &scalar_table;
+		}
+	}
+
+	const KernelLevel detected_level = detect_host_level ( );
+}
+
+const KernelTable* kubera::vector_kernels::active_kernels = table_for ( detected_level );
+
+KernelLevel kubera::vector_kernels::host_level ( ) {
+	return detected_level;
+}
+
+void kubera::vector_kernels::select ( KernelLevel level ) {
+	if ( level > detected_level ) {
+		level = detected_level;
+	}
+	active_kernels = table_for ( level );
+}
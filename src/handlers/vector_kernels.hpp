@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kubera::vector_kernels
+{
+	enum class KernelLevel : uint8_t {
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+
+	// Element-wise kernels over packed guest vectors. `size` is the operand size in
+	// bytes and is always a multiple of 16 (XMM, YMM or ZMM width).
+	struct KernelTable {
+		using BinaryOp = void ( * ) ( uint8_t* dst, const uint8_t* a, const uint8_t* b, std::size_t size );
+		using MaskOp = uint64_t ( * ) ( const uint8_t* src, std::size_t size );
+
+		KernelLevel level;
+
+		BinaryOp bitwise_and;
+		BinaryOp bitwise_andn; // ~a & b
+		BinaryOp bitwise_or;
+		BinaryOp bitwise_xor;
+
+		BinaryOp cmpeq8;
+		BinaryOp cmpeq16;
+		BinaryOp cmpeq32;
+
+		BinaryOp add8;
+		BinaryOp add16;
+		BinaryOp add32;
+		BinaryOp add64;
+
+		BinaryOp add_f32;
+		BinaryOp sub_f32;
+		BinaryOp mul_f32;
+
+		MaskOp movemask8;
+	};
+
+	// Active kernel set, points at the best table the host supports after static initialisation
+	extern const KernelTable* active_kernels;
+
+	inline const KernelTable& kernels ( ) {
+		return *active_kernels;
+	}
+
+	// Highest level the host supports
+	KernelLevel host_level ( );
+
+	// Overrides the active kernel set, clamped to what the host supports. Not thread safe
+	// with respect to running handlers, call it before emulation starts.
+	void select ( KernelLevel level );
+};
@@ -3,14 +3,154 @@
 #include <print>
 
 using namespace kubera;
-std::array<KubRegister, static_cast< std::size_t > ( Register::DontUse0 )> reg_map;
-std::array<int, static_cast< std::size_t > ( Register::DontUse0 )> avx_map {};
+// Maps every iced GPR/segment/control register alias onto the full register it lives in
+static constexpr auto reg_map = [ ] {
+	std::array<KubRegister, static_cast< std::size_t > ( Register::DontUse0 )> map { };
+	map [ ( size_t ) Register::RAX ] = KubRegister::RAX;
+	map [ ( size_t ) Register::EAX ] = KubRegister::RAX;
+	map [ ( size_t ) Register::AX ] = KubRegister::RAX;
+	map [ ( size_t ) Register::AH ] = KubRegister::RAX;
+	map [ ( size_t ) Register::AL ] = KubRegister::RAX;
+	map [ ( size_t ) Register::RBX ] = KubRegister::RBX;
+	map [ ( size_t ) Register::EBX ] = KubRegister::RBX;
+	map [ ( size_t ) Register::BX ] = KubRegister::RBX;
+	map [ ( size_t ) Register::BH ] = KubRegister::RBX;
+	map [ ( size_t ) Register::BL ] = KubRegister::RBX;
+	map [ ( size_t ) Register::RCX ] = KubRegister::RCX;
+	map [ ( size_t ) Register::ECX ] = KubRegister::RCX;
+	map [ ( size_t ) Register::CX ] = KubRegister::RCX;
+	map [ ( size_t ) Register::CH ] = KubRegister::RCX;
+	map [ ( size_t ) Register::CL ] = KubRegister::RCX;
+	map [ ( size_t ) Register::RDX ] = KubRegister::RDX;
+	map [ ( size_t ) Register::EDX ] = KubRegister::RDX;
+	map [ ( size_t ) Register::DX ] = KubRegister::RDX;
+	map [ ( size_t ) Register::DH ] = KubRegister::RDX;
+	map [ ( size_t ) Register::DL ] = KubRegister::RDX;
+	map [ ( size_t ) Register::RSI ] = KubRegister::RSI;
+	map [ ( size_t ) Register::ESI ] = KubRegister::RSI;
+	map [ ( size_t ) Register::SI ] = KubRegister::RSI;
+	map [ ( size_t ) Register::SIL ] = KubRegister::RSI;
+	map [ ( size_t ) Register::RDI ] = KubRegister::RDI;
+	map [ ( size_t ) Register::EDI ] = KubRegister::RDI;
+	map [ ( size_t ) Register::DI ] = KubRegister::RDI;
+	map [ ( size_t ) Register::DIL ] = KubRegister::RDI;
+	map [ ( size_t ) Register::RBP ] = KubRegister::RBP;
+	map [ ( size_t ) Register::EBP ] = KubRegister::RBP;
+	map [ ( size_t ) Register::BP ] = KubRegister::RBP;
+	map [ ( size_t ) Register::BPL ] = KubRegister::RBP;
+	map [ ( size_t ) Register::RSP ] = KubRegister::RSP;
+	map [ ( size_t ) Register::ESP ] = KubRegister::RSP;
+	map [ ( size_t ) Register::SP ] = KubRegister::RSP;
+	map [ ( size_t ) Register::SPL ] = KubRegister::RSP;
+	map [ ( size_t ) Register::R8 ] = KubRegister::R8;
+	map [ ( size_t ) Register::R8D ] = KubRegister::R8;
+	map [ ( size_t ) Register::R8W ] = KubRegister::R8;
+	map [ ( size_t ) Register::R8L ] = KubRegister::R8;
+	map [ ( size_t ) Register::R9 ] = KubRegister::R9;
+	map [ ( size_t ) Register::R9D ] = KubRegister::R9;
+	map [ ( size_t ) Register::R9W ] = KubRegister::R9;
+	map [ ( size_t ) Register::R9L ] = KubRegister::R9;
+	map [ ( size_t ) Register::R10 ] = KubRegister::R10;
+	map [ ( size_t ) Register::R10D ] = KubRegister::R10;
+	map [ ( size_t ) Register::R10W ] = KubRegister::R10;
+	map [ ( size_t ) Register::R10L ] = KubRegister::R10;
+	map [ ( size_t ) Register::R11 ] = KubRegister::R11;
+	map [ ( size_t ) Register::R11D ] = KubRegister::R11;
+	map [ ( size_t ) Register::R11W ] = KubRegister::R11;
+	map [ ( size_t ) Register::R11L ] = KubRegister::R11;
+	map [ ( size_t ) Register::R12 ] = KubRegister::R12;
+	map [ ( size_t ) Register::R12D ] = KubRegister::R12;
+	map [ ( size_t ) Register::R12W ] = KubRegister::R12;
+	map [ ( size_t ) Register::R12L ] = KubRegister::R12;
+	map [ ( size_t ) Register::R13 ] = KubRegister::R13;
+	map [ ( size_t ) Register::R13D ] = KubRegister::R13;
+	map [ ( size_t ) Register::R13W ] = KubRegister::R13;
+	map [ ( size_t ) Register::R13L ] = KubRegister::R13;
+	map [ ( size_t ) Register::R14 ] = KubRegister::R14;
+	map [ ( size_t ) Register::R14D ] = KubRegister::R14;
+	map [ ( size_t ) Register::R14W ] = KubRegister::R14;
+	map [ ( size_t ) Register::R14L ] = KubRegister::R14;
+	map [ ( size_t ) Register::R15 ] = KubRegister::R15;
+	map [ ( size_t ) Register::R15D ] = KubRegister::R15;
+	map [ ( size_t ) Register::R15W ] = KubRegister::R15;
+	map [ ( size_t ) Register::R15L ] = KubRegister::R15;
+	map [ ( size_t ) Register::RIP ] = KubRegister::RIP;
+	map [ ( size_t ) Register::EIP ] = KubRegister::RIP;
+	map [ ( size_t ) Register::DR0 ] = KubRegister::DR0;
+	map [ ( size_t ) Register::DR1 ] = KubRegister::DR1;
+	map [ ( size_t ) Register::DR2 ] = KubRegister::DR2;
+	map [ ( size_t ) Register::DR3 ] = KubRegister::DR3;
+	map [ ( size_t ) Register::DR4 ] = KubRegister::DR4;
+	map [ ( size_t ) Register::DR5 ] = KubRegister::DR5;
+	map [ ( size_t ) Register::DR6 ] = KubRegister::DR6;
+	map [ ( size_t ) Register::DR7 ] = KubRegister::DR7;
+	map [ ( size_t ) Register::CR0 ] = KubRegister::CR0;
+	map [ ( size_t ) Register::CR2 ] = KubRegister::CR2;
+	map [ ( size_t ) Register::CR3 ] = KubRegister::CR3;
+	map [ ( size_t ) Register::CR4 ] = KubRegister::CR4;
+	map [ ( size_t ) Register::CR8 ] = KubRegister::CR8;
+	map [ ( size_t ) Register::CS ] = KubRegister::CS;
+	map [ ( size_t ) Register::DS ] = KubRegister::DS;
+	map [ ( size_t ) Register::ES ] = KubRegister::ES;
+	map [ ( size_t ) Register::FS ] = KubRegister::FS;
+	map [ ( size_t ) Register::GS ] = KubRegister::GS;
+	map [ ( size_t ) Register::SS ] = KubRegister::SS;
+	return map;
+} ( );
 
 KubRegister map_register ( Register reg ) {
 	return reg_map [ static_cast< size_t >( reg ) ];
 }
 
+static LoweredRegister lower_register ( Register reg ) {
+	// Vector, x87 and mask registers have no slot in the GPR file
+	if ( static_cast< std::size_t >( reg ) >= reg_map.size ( ) ) {
+		return { };
+	}
+	const bool high_byte = reg == Register::AH || reg == Register::BH || reg == Register::CH || reg == Register::DH;
+	return { static_cast< uint8_t >( map_register ( reg ) ), static_cast< uint8_t >( high_byte ? 8 : 0 ) };
+}
+
+LoweredOperands kubera::lower_operands ( const iced::Instruction& instr ) {
+	LoweredOperands lowered { };
+	for ( std::size_t i = 0; i < LoweredOperands::max_operands; ++i ) {
+		auto& op = lowered.operands [ i ];
+		op.kind = instr.op_kind_simple ( i );
+		op.size = static_cast< uint8_t >( instr.op_size ( i ) );
+		if ( op.kind == OpKindSimple::Register ) {
+			op.reg = lower_register ( instr.op_reg ( i ) );
+		}
+	}
+
+	lowered.displacement = instr.displacement ( );
+	const bool has_base = instr.mem_base ( ) != Register::None && instr.mem_base ( ) != Register::RIP;
+	const bool has_index = instr.mem_index ( ) != Register::None;
+	if ( instr.mem_base ( ) == Register::RIP ) {
+		lowered.displacement += instr.ip + instr.length ( );
+	}
+	if ( has_base ) {
+		lowered.base = lower_register ( instr.mem_base ( ) );
+	}
+	if ( has_index ) {
+		lowered.index = lower_register ( instr.mem_index ( ) );
+		lowered.scale = static_cast< uint8_t >( instr.mem_scale ( ) );
+	}
+	lowered.mode = has_base ? ( has_index ? AddressMode::BaseIndex : AddressMode::Base )
+		: ( has_index ? AddressMode::Index : AddressMode::Displacement );
+
+	if ( instr.segment_prefix ( ) != Register::None ) {
+		lowered.has_segment = true;
+		lowered.segment = lower_register ( instr.segment_prefix ( ) );
+	}
+	return lowered;
+}
+
 void kubera::KUBERA::handle_ip_switch ( uint64_t target ) {
+	// A live link to target was made under the current page protections, so target is still executable
+	if ( current_block && current_block->linked ( target, block_cache.generation, memory->protection_sequence ( ) ) ) [[likely]] {
+		this->rip ( ) = target;
+		return;
+	}
 	if ( !memory->check ( target, 1, PageProtection::EXEC ) ) {
 		return;
 	}
@@ -55,7 +195,30 @@ uint8_t KUBERA::get_access_shift ( Register reg, size_t size ) const noexcept {
 }
 
 uint64_t KUBERA::get_rflags ( ) const noexcept {
-	return cpu->rflags.value;
+	return evaluated_flags ( ).value;
+}
+
+x86::Flags KUBERA::evaluated_flags ( ) const noexcept {
+	auto flags = cpu->rflags;
+	const auto& lazy = cpu->lazy_flags;
+	if ( lazy.op == FlagOp::None ) {
+		return flags;
+	}
+
+	if ( lazy.op != FlagOp::Inc && lazy.op != FlagOp::Dec ) {
+		flags.CF = lazy.cf ( );
+	}
+	flags.PF = lazy.pf ( );
+	flags.AF = lazy.af ( );
+	flags.ZF = lazy.zf ( );
+	flags.SF = lazy.sf ( );
+	flags.OF = lazy.of ( );
+	return flags;
+}
+
+void KUBERA::materialize_flags ( ) noexcept {
+	cpu->rflags = evaluated_flags ( );
+	cpu->lazy_flags.op = FlagOp::None;
 }
 
 uint64_t KUBERA::get_reg ( Register reg, size_t size ) const noexcept {
@@ -73,7 +236,7 @@ uint64_t KUBERA::get_reg ( Register reg, size_t size ) const noexcept {
 }
 
 void KUBERA::set_rflags ( uint64_t rflags ) noexcept {
-	auto& flags = cpu->rflags;
+	auto& flags = get_flags ( );
 	auto old_flags = flags.value;
 
 	flags.CF = ( rflags >> 0 ) & 1;
@@ -125,6 +288,45 @@ void KUBERA::set_reg(Register reg, uint64_t value_to_set, size_t size) {
     }
 }
 
+void KUBERA::reset_cpu ( ) {
+	const auto stack_base = cpu->stack_base;
+	const auto stack_size = cpu->stack_size;
+	*cpu = CPU ( stack_base, stack_size );
+	block_cache.cursor_block = nullptr;
+
+	set_reg_internal<KubRegister::RSP, Register::RSP> ( stack_base + stack_size );
+}
+
+std::shared_ptr<const Snapshot> KUBERA::snapshot ( ) {
+	return std::make_shared<const Snapshot> ( Snapshot { *cpu, memory->snapshot ( ) } );
+}
+
+void KUBERA::restore ( const Snapshot& snap ) {
+	*cpu = snap.cpu;
+	// Decoded blocks on pages that change are retired through the code write log on the next sync
+	memory->restore ( *snap.memory );
+	block_cache.cursor_block = nullptr;
+	coverage_prev = 0;
+}
+
+uint8_t* KUBERA::refill_stack_window ( uint64_t address ) {
+	stack_window_generation = UINT64_MAX;
+	const uint64_t page = address & ~( memory->page_size - 1 );
+	// Only whole stack pages are cached, so a hit needs no bounds check of its own
+	if ( address - page > memory->page_size - sizeof ( uint64_t ) || !is_within_stack_bounds ( page, memory->page_size ) ) {
+		return nullptr;
+	}
+	// Resolving for both kinds breaks copy-on-write up front, the stack is written soon after it is read anyway
+	auto* data = memory->direct_page ( page, PageProtection::READ | PageProtection::WRITE );
+	if ( !data ) {
+		return nullptr;
+	}
+	stack_window_page = page;
+	stack_window = data;
+	stack_window_generation = memory->tlb_generation ( );
+	return data + ( address - page );
+}
+
 bool KUBERA::is_within_stack_bounds ( uint64_t address, size_t size ) const noexcept {
 	const auto stack_base_addr = cpu->stack_base;
 	const auto stack_top = stack_base_addr + cpu->stack_size;
@@ -132,107 +334,39 @@ bool KUBERA::is_within_stack_bounds ( uint64_t address, size_t size ) const noex
 	return address >= stack_bot && address <= stack_top - size;
 }
 
-void map_gpr ( ) {
-	reg_map [ ( size_t ) Register::RAX ] = KubRegister::RAX;
-	reg_map [ ( size_t ) Register::EAX ] = KubRegister::RAX;
-	reg_map [ ( size_t ) Register::AX ] = KubRegister::RAX;
-	reg_map [ ( size_t ) Register::AH ] = KubRegister::RAX;
-	reg_map [ ( size_t ) Register::AL ] = KubRegister::RAX;
-	reg_map [ ( size_t ) Register::RBX ] = KubRegister::RBX;
-	reg_map [ ( size_t ) Register::EBX ] = KubRegister::RBX;
-	reg_map [ ( size_t ) Register::BX ] = KubRegister::RBX;
-	reg_map [ ( size_t ) Register::BH ] = KubRegister::RBX;
-	reg_map [ ( size_t ) Register::BL ] = KubRegister::RBX;
-	reg_map [ ( size_t ) Register::RCX ] = KubRegister::RCX;
-	reg_map [ ( size_t ) Register::ECX ] = KubRegister::RCX;
-	reg_map [ ( size_t ) Register::CX ] = KubRegister::RCX;
-	reg_map [ ( size_t ) Register::CH ] = KubRegister::RCX;
-	reg_map [ ( size_t ) Register::CL ] = KubRegister::RCX;
-	reg_map [ ( size_t ) Register::RDX ] = KubRegister::RDX;
-	reg_map [ ( size_t ) Register::EDX ] = KubRegister::RDX;
-	reg_map [ ( size_t ) Register::DX ] = KubRegister::RDX;
-	reg_map [ ( size_t ) Register::DH ] = KubRegister::RDX;
-	reg_map [ ( size_t ) Register::DL ] = KubRegister::RDX;
-	reg_map [ ( size_t ) Register::RSI ] = KubRegister::RSI;
-	reg_map [ ( size_t ) Register::ESI ] = KubRegister::RSI;
-	reg_map [ ( size_t ) Register::SI ] = KubRegister::RSI;
-	reg_map [ ( size_t ) Register::SIL ] = KubRegister::RSI;
-	reg_map [ ( size_t ) Register::RDI ] = KubRegister::RDI;
-	reg_map [ ( size_t ) Register::EDI ] = KubRegister::RDI;
-	reg_map [ ( size_t ) Register::DI ] = KubRegister::RDI;
-	reg_map [ ( size_t ) Register::DIL ] = KubRegister::RDI;
-	reg_map [ ( size_t ) Register::RBP ] = KubRegister::RBP;
-	reg_map [ ( size_t ) Register::EBP ] = KubRegister::RBP;
-	reg_map [ ( size_t ) Register::BP ] = KubRegister::RBP;
-	reg_map [ ( size_t ) Register::BPL ] = KubRegister::RBP;
-	reg_map [ ( size_t ) Register::RSP ] = KubRegister::RSP;
-	reg_map [ ( size_t ) Register::ESP ] = KubRegister::RSP;
-	reg_map [ ( size_t ) Register::SP ] = KubRegister::RSP;
-	reg_map [ ( size_t ) Register::SPL ] = KubRegister::RSP;
-	reg_map [ ( size_t ) Register::R8 ] = KubRegister::R8;
-	reg_map [ ( size_t ) Register::R8D ] = KubRegister::R8;
-	reg_map [ ( size_t ) Register::R8W ] = KubRegister::R8;
-	reg_map [ ( size_t ) Register::R8L ] = KubRegister::R8;
-	reg_map [ ( size_t ) Register::R9 ] = KubRegister::R9;
-	reg_map [ ( size_t ) Register::R9D ] = KubRegister::R9;
-	reg_map [ ( size_t ) Register::R9W ] = KubRegister::R9;
-	reg_map [ ( size_t ) Register::R9L ] = KubRegister::R9;
-	reg_map [ ( size_t ) Register::R10 ] = KubRegister::R10;
-	reg_map [ ( size_t ) Register::R10D ] = KubRegister::R10;
-	reg_map [ ( size_t ) Register::R10W ] = KubRegister::R10;
-	reg_map [ ( size_t ) Register::R10L ] = KubRegister::R10;
-	reg_map [ ( size_t ) Register::R11 ] = KubRegister::R11;
-	reg_map [ ( size_t ) Register::R11D ] = KubRegister::R11;
-	reg_map [ ( size_t ) Register::R11W ] = KubRegister::R11;
-	reg_map [ ( size_t ) Register::R11L ] = KubRegister::R11;
-	reg_map [ ( size_t ) Register::R12 ] = KubRegister::R12;
-	reg_map [ ( size_t ) Register::R12D ] = KubRegister::R12;
-	reg_map [ ( size_t ) Register::R12W ] = KubRegister::R12;
-	reg_map [ ( size_t ) Register::R12L ] = KubRegister::R12;
-	reg_map [ ( size_t ) Register::R13 ] = KubRegister::R13;
-	reg_map [ ( size_t ) Register::R13D ] = KubRegister::R13;
-	reg_map [ ( size_t ) Register::R13W ] = KubRegister::R13;
-	reg_map [ ( size_t ) Register::R13L ] = KubRegister::R13;
-	reg_map [ ( size_t ) Register::R14 ] = KubRegister::R14;
-	reg_map [ ( size_t ) Register::R14D ] = KubRegister::R14;
-	reg_map [ ( size_t ) Register::R14W ] = KubRegister::R14;
-	reg_map [ ( size_t ) Register::R14L ] = KubRegister::R14;
-	reg_map [ ( size_t ) Register::R15 ] = KubRegister::R15;
-	reg_map [ ( size_t ) Register::R15D ] = KubRegister::R15;
-	reg_map [ ( size_t ) Register::R15W ] = KubRegister::R15;
-	reg_map [ ( size_t ) Register::R15L ] = KubRegister::R15;
-	reg_map [ ( size_t ) Register::RIP ] = KubRegister::RIP;
-	reg_map [ ( size_t ) Register::EIP ] = KubRegister::RIP;
-	reg_map [ ( size_t ) Register::DR0 ] = KubRegister::DR0;
-	reg_map [ ( size_t ) Register::DR1 ] = KubRegister::DR1;
-	reg_map [ ( size_t ) Register::DR2 ] = KubRegister::DR2;
-	reg_map [ ( size_t ) Register::DR3 ] = KubRegister::DR3;
-	reg_map [ ( size_t ) Register::DR4 ] = KubRegister::DR4;
-	reg_map [ ( size_t ) Register::DR5 ] = KubRegister::DR5;
-	reg_map [ ( size_t ) Register::DR6 ] = KubRegister::DR6;
-	reg_map [ ( size_t ) Register::DR7 ] = KubRegister::DR7;
-	reg_map [ ( size_t ) Register::CR0 ] = KubRegister::CR0;
-	reg_map [ ( size_t ) Register::CR2 ] = KubRegister::CR2;
-	reg_map [ ( size_t ) Register::CR3 ] = KubRegister::CR3;
-	reg_map [ ( size_t ) Register::CR4 ] = KubRegister::CR4;
-	reg_map [ ( size_t ) Register::CR8 ] = KubRegister::CR8;
-	reg_map [ ( size_t ) Register::CS ] = KubRegister::CS;
-	reg_map [ ( size_t ) Register::DS ] = KubRegister::DS;
-	reg_map [ ( size_t ) Register::ES ] = KubRegister::ES;
-	reg_map [ ( size_t ) Register::FS ] = KubRegister::FS;
-	reg_map [ ( size_t ) Register::GS ] = KubRegister::GS;
-	reg_map [ ( size_t ) Register::SS ] = KubRegister::SS;
-}
-
-void map_avx ( ) {
-	std::array<Register, 3> bases { Register::XMM0, Register::YMM0, Register::ZMM0 };
-	for ( const auto base : bases ) {
-		for ( auto i = 0u; i < 31; ++i ) {
-			avx_map [ static_cast< size_t > ( base ) + i ] = i;
+
+#if defined(KUBERA_HOST_X87)
+float80_t fp80::from_ieee754_80 ( Bits bits ) {
+	const uint64_t mantissa = bits.first;
+	const uint16_t sign_exp = bits.second;
+	const uint16_t biased_exp = sign_exp & 0x7FFF;
+	const bool integer_bit = ( mantissa >> 63 ) != 0;
+
+	// Canonical encodings are already the host format
+	if ( biased_exp == 0x7FFF || integer_bit == ( biased_exp != 0 ) ) {
+		// Pseudo-infinities and pseudo-NaNs (I=0) are NaNs, as in the software backend
+		if ( biased_exp == 0x7FFF && !integer_bit ) {
+			return std::numeric_limits<float80_t>::quiet_NaN ( );
 		}
+		float80_t result = 0;
+		std::memcpy ( &result, &mantissa, 8 );
+		std::memcpy ( reinterpret_cast< uint8_t* >( &result ) + 8, &sign_exp, 2 );
+		return result;
 	}
-};
 
+	// Unnormals and pseudo-denormals keep their value, normalized
+	const int exponent = ( biased_exp == 0 ? 1 : biased_exp ) - 16383 - 63;
+	const float80_t magnitude = std::ldexp ( static_cast< float80_t >( mantissa ), exponent );
+	return ( sign_exp & 0x8000 ) ? -magnitude : magnitude;
+}
+
+fp80::Bits fp80::to_ieee754_80 ( const float80_t& value ) {
+	Bits bits { 0, 0 };
+	std::memcpy ( &bits.first, &value, 8 );
+	std::memcpy ( &bits.second, reinterpret_cast< const uint8_t* >( &value ) + 8, 2 );
+	return bits;
+}
+#else
 inline int countl_zero_u64 ( uint64_t val ) {
 	unsigned long leading_zero;
 #ifdef _MSC_VER
@@ -245,7 +379,7 @@ inline int countl_zero_u64 ( uint64_t val ) {
 #endif
 }
 
-float80_t from_ieee754_80 ( std::pair<uint64_t, uint16_t> bits ) {
+float80_t fp80::from_ieee754_80 ( Bits bits ) {
 	const uint64_t mantissa = bits.first;
 	const uint16_t sign_exp = bits.second;
 
@@ -316,93 +450,95 @@ float80_t from_ieee754_80 ( std::pair<uint64_t, uint16_t> bits ) {
 	return result;
 }
 
-float80_t from_ieee754_80_bytes ( const uint8_t bytes [ 10 ] ) {
-	// Safely construct integers from bytes (assumes little-endian source)
-	uint64_t mantissa = 0;
-	for ( int i = 7; i >= 0; --i ) {
-		mantissa = ( mantissa << 8 ) | bytes [ i ];
+fp80::Bits fp80::to_ieee754_80 ( const float80_t& value ) {
+	const uint16_t sign = value.backend ( ).sign ( ) ? 0x8000 : 0;
+	switch ( classify ( value ) ) {
+		case FP_ZERO:
+			return { 0, sign };
+		case FP_INFINITE:
+			return { 0x8000000000000000ULL, static_cast< uint16_t >( sign | 0x7FFF ) };
+		case FP_NAN:
+			// No payload is kept, stores the default NaN (real indefinite)
+			return { 0xC000000000000000ULL, 0xFFFF };
+		default:
+			break;
 	}
-	uint16_t sign_exp = ( static_cast< uint16_t >( bytes [ 9 ] ) << 8 ) | bytes [ 8 ];
 
-	return from_ieee754_80 ( { mantissa, sign_exp } );
+	int exp = 0;
+	const float80_t fraction = boost::multiprecision::frexp ( boost::multiprecision::abs ( value ), &exp );
+	// fraction is in [0.5, 1), scaling it by 2^64 gives the significand with the integer bit set
+	uint64_t mantissa = boost::multiprecision::ldexp ( fraction, 64 ).convert_to<uint64_t> ( );
+	int biased_exp = exp - 1 + 16383;
+	if ( biased_exp <= 0 ) {
+		mantissa >>= 1 - biased_exp;
+		biased_exp = 0;
+	}
+	return { mantissa, static_cast< uint16_t >( sign | biased_exp ) };
 }
+#endif
 
 float80_t KUBERA::read_type_float80_t ( uint64_t address ) const {
-	uint64_t p0 = memory->read<uint64_t> ( address + 0 );
-	uint16_t p1 = memory->read<uint16_t> ( address + 8 );
-
-	alignas( 16 ) uint8_t temp [ 10 ];
-	std::memcpy ( temp, &p0, 8 );
-	std::memcpy ( temp + 8, &p1, 2 );
+	const uint64_t mantissa = memory->read<uint64_t> ( address + 0 );
+	const uint16_t sign_exp = memory->read<uint16_t> ( address + 8 );
+	return fp80::from_ieee754_80 ( { mantissa, sign_exp } );
+}
 
-	return from_ieee754_80_bytes ( temp );
+void KUBERA::write_type_float80_t ( uint64_t address, const float80_t& value ) {
+	const auto [mantissa, sign_exp] = fp80::to_ieee754_80 ( value );
+	memory->write<uint64_t> ( address + 0, mantissa );
+	memory->write<uint16_t> ( address + 8, sign_exp );
 }
 
-uint128_t KUBERA::get_xmm_raw ( Register _reg ) const {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	uint512_t value = ( *cpu->sse_registers ) [ reg ];
-	return value.convert_to<uint128_t> ( );
+uint128_t KUBERA::get_xmm_raw ( Register reg ) const {
+	return vector_to_wide<uint128_t> ( get_vector ( reg ) );
 }
 
-void KUBERA::set_xmm_raw ( Register _reg, const uint128_t& value ) {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	( *cpu->sse_registers ) [ reg ] = value;
+void KUBERA::set_xmm_raw ( Register reg, const uint128_t& value ) {
+	wide_to_vector ( get_vector ( reg ), value );
 }
 
-uint256_t KUBERA::get_ymm_raw ( Register _reg ) const {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	uint512_t value = ( *cpu->sse_registers ) [ reg ];
-	return value.convert_to<uint256_t> ( );
+uint256_t KUBERA::get_ymm_raw ( Register reg ) const {
+	return vector_to_wide<uint256_t> ( get_vector ( reg ) );
 }
 
-void KUBERA::set_ymm_raw ( Register _reg, const uint256_t& value ) {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	( *cpu->sse_registers ) [ reg ] = value;
+void KUBERA::set_ymm_raw ( Register reg, const uint256_t& value ) {
+	wide_to_vector ( get_vector ( reg ), value );
 }
 
-uint512_t KUBERA::get_zmm_raw ( Register _reg ) const {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	uint512_t value = ( *cpu->sse_registers ) [ reg ];
-	return value;
+uint512_t KUBERA::get_zmm_raw ( Register reg ) const {
+	return vector_to_wide<uint512_t> ( get_vector ( reg ) );
 }
 
-void KUBERA::set_zmm_raw ( Register _reg, const uint512_t& value ) {
-	auto reg = avx_map [ static_cast< int >( _reg ) ];
-	( *cpu->sse_registers ) [ reg ] = value;
+void KUBERA::set_zmm_raw ( Register reg, const uint512_t& value ) {
+	wide_to_vector ( get_vector ( reg ), value );
 }
 
 float KUBERA::get_xmm_float ( Register reg ) const {
-	uint128_t raw = get_xmm_raw ( reg );
-	uint32_t low_bits = static_cast< uint32_t >( raw & 0xFFFFFFFF );
-	return std::bit_cast< float >( low_bits );
+	return get_vector ( reg ).lane<float> ( 0 );
 }
 
 void KUBERA::set_xmm_float ( Register reg, float value ) {
-	uint128_t current_raw = get_xmm_raw ( reg );
-	uint32_t new_low_bits = std::bit_cast< uint32_t >( value );
-	current_raw = ( current_raw & ~uint128_t ( 0xFFFFFFFF ) ) | uint128_t ( new_low_bits );
-	set_xmm_raw ( reg, current_raw );
+	auto& vec = get_vector ( reg );
+	vec.set_lane<float> ( 0, value );
+	vec.zero_upper ( 16 );
 }
 
 double KUBERA::get_xmm_double ( Register reg ) const {
-	uint128_t raw = get_xmm_raw ( reg );
-	uint64_t low_bits = static_cast< uint64_t >( raw & 0xFFFFFFFFFFFFFFFF );
-	return std::bit_cast< double >( low_bits );
+	return get_vector ( reg ).lane<double> ( 0 );
 }
 
 void KUBERA::set_xmm_double ( Register reg, double value ) {
-	uint128_t current_raw = get_xmm_raw ( reg );
-	uint64_t new_low_bits = std::bit_cast< uint64_t >( value );
-	current_raw = ( current_raw & ~uint128_t ( 0xFFFFFFFFFFFFFFFF ) ) | uint128_t ( new_low_bits );
-	set_xmm_raw ( reg, current_raw );
+	auto& vec = get_vector ( reg );
+	vec.set_lane<double> ( 0, value );
+	vec.zero_upper ( 16 );
 }
 
-void unsupported_instruction ( const iced::Instruction& instr, KUBERA& context ) {
+void handlers::unsupported_instruction ( const iced::Instruction& instr, KUBERA& context ) {
 	std::println ( "[KUBERA] Unsupported instruction {}, skipping.", instr.to_string ( ) );
 }
 
-#define SET_HANDLER(x, y) instruction_dispatch_table->at ( static_cast< size_t >( x) ) = y
-void map_handlers ( ) {
+#define SET_HANDLER(x, y) table.at ( static_cast< size_t >( x) ) = y
+static void map_handlers ( InstructionHandlerList& table ) {
 	SET_HANDLER ( Mnemonic::Add, handlers::add );
 	SET_HANDLER ( Mnemonic::Sub, handlers::sub );
 	SET_HANDLER ( Mnemonic::Inc, handlers::inc );
@@ -574,6 +710,14 @@ void map_handlers ( ) {
 	SET_HANDLER ( Mnemonic::Stosd, handlers::stos );
 	SET_HANDLER ( Mnemonic::Stosb, handlers::stos );
 	SET_HANDLER ( Mnemonic::Stosw, handlers::stos );
+	SET_HANDLER ( Mnemonic::Cmpsb, handlers::cmpsb );
+	SET_HANDLER ( Mnemonic::Cmpsw, handlers::cmpsw );
+	SET_HANDLER ( Mnemonic::Cmpsd, handlers::cmpsd );
+	SET_HANDLER ( Mnemonic::Cmpsq, handlers::cmpsq );
+	SET_HANDLER ( Mnemonic::Scasb, handlers::scas );
+	SET_HANDLER ( Mnemonic::Scasw, handlers::scas );
+	SET_HANDLER ( Mnemonic::Scasd, handlers::scas );
+	SET_HANDLER ( Mnemonic::Scasq, handlers::scas );
 
 	// SIMD Instructions
 	SET_HANDLER ( Mnemonic::Vpxor, handlers::vpxor );
@@ -598,6 +742,25 @@ void map_handlers ( ) {
 	SET_HANDLER ( Mnemonic::Paddw, handlers::paddw );
 	SET_HANDLER ( Mnemonic::Paddd, handlers::paddd );
 	SET_HANDLER ( Mnemonic::Paddq, handlers::paddq );
+	SET_HANDLER ( Mnemonic::Pxor, handlers::pxor );
+	SET_HANDLER ( Mnemonic::Pand, handlers::pand );
+	SET_HANDLER ( Mnemonic::Pandn, handlers::pandn );
+	SET_HANDLER ( Mnemonic::Por, handlers::por );
+	SET_HANDLER ( Mnemonic::Pcmpeqb, handlers::pcmpeqb );
+	SET_HANDLER ( Mnemonic::Pcmpeqw, handlers::pcmpeqw );
+	SET_HANDLER ( Mnemonic::Pcmpeqd, handlers::pcmpeqd );
+	SET_HANDLER ( Mnemonic::Pmovmskb, handlers::vpmovmskb );
+	SET_HANDLER ( Mnemonic::Vpand, handlers::vpand );
+	SET_HANDLER ( Mnemonic::Vpandn, handlers::vpandn );
+	SET_HANDLER ( Mnemonic::Vpor, handlers::vpor );
+	SET_HANDLER ( Mnemonic::Vpcmpeqb, handlers::vpcmpeqb );
+	SET_HANDLER ( Mnemonic::Vpcmpeqd, handlers::vpcmpeqd );
+	SET_HANDLER ( Mnemonic::Pshufd, handlers::pshufd );
+	SET_HANDLER ( Mnemonic::Vpshufd, handlers::vpshufd );
+	SET_HANDLER ( Mnemonic::Vpbroadcastb, handlers::vpbroadcastb );
+	SET_HANDLER ( Mnemonic::Vpbroadcastw, handlers::vpbroadcastw );
+	SET_HANDLER ( Mnemonic::Vpbroadcastd, handlers::vpbroadcastd );
+	SET_HANDLER ( Mnemonic::Vpbroadcastq, handlers::vpbroadcastq );
 
 	// Floating-Point Instructions
 	SET_HANDLER ( Mnemonic::Addss, handlers::addss );
@@ -609,6 +772,12 @@ void map_handlers ( ) {
 	SET_HANDLER ( Mnemonic::Andps, handlers::andps );
 	SET_HANDLER ( Mnemonic::Orps, handlers::orps );
 	SET_HANDLER ( Mnemonic::Xorps, handlers::xorps );
+	SET_HANDLER ( Mnemonic::Addps, handlers::addps );
+	SET_HANDLER ( Mnemonic::Subps, handlers::subps );
+	SET_HANDLER ( Mnemonic::Mulps, handlers::mulps );
+	SET_HANDLER ( Mnemonic::Vaddps, handlers::vaddps );
+	SET_HANDLER ( Mnemonic::Vsubps, handlers::vsubps );
+	SET_HANDLER ( Mnemonic::Vmulps, handlers::vmulps );
 	SET_HANDLER ( Mnemonic::Sqrtss, handlers::sqrtss );
 	SET_HANDLER ( Mnemonic::Sqrtsd, handlers::sqrtsd );
 	SET_HANDLER ( Mnemonic::Comiss, handlers::comiss );
@@ -640,93 +809,42 @@ void map_handlers ( ) {
 	SET_HANDLER ( Mnemonic::Nop, handlers::nop );
 }
 
-KUBERA::KUBERA ( ) {
-	if ( !memory ) {
-		memory = std::make_unique<VirtualMemory> ( );
-	}
+#undef SET_HANDLER
+
+const InstructionHandlerList& kubera::dispatch_table ( ) {
+	// Function-local static, so concurrent first calls still build it exactly once
+	static const InstructionHandlerList table = [ ] {
+		InstructionHandlerList handlers;
+		handlers.fill ( handlers::unsupported_instruction );
+		map_handlers ( handlers );
+		return handlers;
+	} ( );
+	return table;
+}
+
+KUBERA::KUBERA ( ) : KUBERA ( std::make_shared<VirtualMemory> ( ) ) {
+}
+
+KUBERA::KUBERA ( std::shared_ptr<VirtualMemory> shared_memory ) : memory ( std::move ( shared_memory ) ), dispatch ( &dispatch_table ( ) ) {
+	// alloc_at moves past the stacks of other instances sharing this address space
 	const uint64_t stack_addr = memory->alloc_at ( 0xDEADBEEF00000000, 0x200000, PageProtection::READ | PageProtection::WRITE );
 	cpu = std::make_unique<CPU> ( stack_addr, 0x200000 );
 	decoder = std::make_unique<iced::Decoder> ( );
-	instruction_dispatch_table = std::make_unique<InstructionHandlerList> ();
-	map_avx ( );
-	map_gpr ( );
-	instruction_dispatch_table->fill ( unsupported_instruction );
-	map_handlers ( );
+	block_cache.synced_sequence = memory->code_write_sequence ( );
+	cpuid_table = CpuidTable::host ( );
 
 	set_reg_internal<KubRegister::RSP, Register::RSP> ( stack_addr + cpu->stack_size );
 }
 
-
-std::vector<std::string> KUBERA::get_register_changes ( const std::array<std::uint64_t, KubRegister::COUNT>& old_registers ) const {
-	std::vector<std::string> changes;
-	for ( size_t i = 0; i < KubRegister::COUNT; ++i ) {
-		if ( cpu->registers [ i ] != old_registers [ i ] && static_cast< KubRegister > ( i ) != KubRegister::RIP ) {
-			std::stringstream ss;
-			ss << register_names [ i ] << " 0x" << std::hex << old_registers [ i ] << ";0x" << std::hex << cpu->registers [ i ];
-			changes.push_back ( ss.str ( ) );
-		}
-	}
-	return changes;
+KUBERA::~KUBERA ( ) {
+	stop_trace ( );
+	memory->release_fault_slot ( &fault );
 }
 
-std::vector<std::string> KUBERA::get_rflags_changes ( const x86::Flags& old_rflags ) const {
-	std::vector<std::string> changes;
-	auto add_change = [ &changes ] ( const std::string& name, uint64_t old_val, uint64_t new_val )
-	{
-		if ( old_val != new_val ) {
-			changes.push_back ( name + " " + std::to_string ( old_val ) + ";" + std::to_string ( new_val ) );
-		}
-	};
-	add_change ( "CF", old_rflags.CF, cpu->rflags.CF );
-	add_change ( "PF", old_rflags.PF, cpu->rflags.PF );
-	add_change ( "AF", old_rflags.AF, cpu->rflags.AF );
-	add_change ( "ZF", old_rflags.ZF, cpu->rflags.ZF );
-	add_change ( "SF", old_rflags.SF, cpu->rflags.SF );
-	add_change ( "TF", old_rflags.TF, cpu->rflags.TF );
-	add_change ( "IF", old_rflags.IF, cpu->rflags.IF );
-	add_change ( "DF", old_rflags.DF, cpu->rflags.DF );
-	add_change ( "OF", old_rflags.OF, cpu->rflags.OF );
-	add_change ( "IOPL", old_rflags.IOPL, cpu->rflags.IOPL );
-	add_change ( "NT", old_rflags.NT, cpu->rflags.NT );
-	add_change ( "RF", old_rflags.RF, cpu->rflags.RF );
-	add_change ( "VM", old_rflags.VM, cpu->rflags.VM );
-	add_change ( "AC", old_rflags.AC, cpu->rflags.AC );
-	add_change ( "VIF", old_rflags.VIF, cpu->rflags.VIF );
-	add_change ( "VIP", old_rflags.VIP, cpu->rflags.VIP );
-	add_change ( "ID", old_rflags.ID, cpu->rflags.ID );
-	return changes;
-}
-
-std::vector<std::string> KUBERA::get_mxcsr_changes ( const x86::Mxcsr& old_mxcsr ) const {
-	std::vector<std::string> changes;
-	auto add_change = [ &changes ] ( const std::string& name, unsigned int old_val, unsigned int new_val )
-	{
-		if ( old_val != new_val ) {
-			changes.push_back ( name + " " + std::to_string ( old_val ) + ";" + std::to_string ( new_val ) );
-		}
-	};
-	add_change ( "IE", old_mxcsr.IE, cpu->mxcsr.IE );
-	add_change ( "DE", old_mxcsr.DE, cpu->mxcsr.DE );
-	add_change ( "ZE", old_mxcsr.ZE, cpu->mxcsr.ZE );
-	add_change ( "OE", old_mxcsr.OE, cpu->mxcsr.OE );
-	add_change ( "UE", old_mxcsr.UE, cpu->mxcsr.UE );
-	add_change ( "PE", old_mxcsr.PE, cpu->mxcsr.PE );
-	add_change ( "DAZ", old_mxcsr.DAZ, cpu->mxcsr.DAZ );
-	add_change ( "IM", old_mxcsr.IM, cpu->mxcsr.IM );
-	add_change ( "DM", old_mxcsr.DM, cpu->mxcsr.DM );
-	add_change ( "ZM", old_mxcsr.ZM, cpu->mxcsr.ZM );
-	add_change ( "OM", old_mxcsr.OM, cpu->mxcsr.OM );
-	add_change ( "UM", old_mxcsr.UM, cpu->mxcsr.UM );
-	add_change ( "PM", old_mxcsr.PM, cpu->mxcsr.PM );
-	add_change ( "RC", old_mxcsr.RC, cpu->mxcsr.RC );
-	add_change ( "FTZ", old_mxcsr.FTZ, cpu->mxcsr.FTZ );
-	return changes;
-}
 
 template void KUBERA::write_type<uint512_t> ( uint64_t, uint512_t );
 template void KUBERA::write_type<uint256_t> ( uint64_t, uint256_t );
 template void KUBERA::write_type<uint128_t> ( uint64_t, uint128_t );
-template void KUBERA::write_type<float80_t> ( uint64_t, float80_t );
 template void KUBERA::write_type<uint64_t> ( uint64_t, uint64_t );
 template void KUBERA::write_type<uint32_t> ( uint64_t, uint32_t );
 template void KUBERA::write_type<uint16_t> ( uint64_t, uint16_t );
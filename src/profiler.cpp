@@ -0,0 +1,104 @@
+#include "../profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <string_view>
+
+using namespace kubera;
+
+void Profiler::name_mnemonic ( const iced::Instruction& instr ) {
+	std::string_view text = instr.to_string ( );
+	// Prefixes are not part of the mnemonic
+	for ( const std::string_view prefix : { "lock ", "rep ", "repe ", "repne ", "xacquire ", "xrelease ", "notrack " } ) {
+		if ( text.starts_with ( prefix ) ) {
+			text.remove_prefix ( prefix.size ( ) );
+		}
+	}
+	names [ static_cast< std::size_t >( instr.mnemonic ( ) ) ] = std::string ( text.substr ( 0, text.find ( ' ' ) ) );
+}
+
+std::string Profiler::report ( std::size_t top_blocks ) const {
+	std::vector<std::size_t> order;
+	uint64_t total_count = 0;
+	uint64_t total_cycles = 0;
+	for ( std::size_t i = 0; i < mnemonics.size ( ); ++i ) {
+		if ( mnemonics [ i ].count != 0 ) {
+			order.push_back ( i );
+			total_count += mnemonics [ i ].count;
+			total_cycles += mnemonics [ i ].cycles;
+		}
+	}
+	std::ranges::sort ( order, [ this ] ( std::size_t a, std::size_t b ) { return mnemonics [ a ].cycles > mnemonics [ b ].cycles; } );
+
+	auto share = [ ] ( uint64_t part, uint64_t whole )
+	{
+		return whole ? 100.0 * static_cast< double >( part ) / static_cast< double >( whole ) : 0.0;
+	};
+
+	std::string out = std::format ( "Mnemonics by host cycles ({} instructions, {} cycles)\n", total_count, total_cycles );
+	out += std::format ( "{:<16} {:>14} {:>16} {:>12} {:>8}\n", "mnemonic", "count", "cycles", "cycles/exec", "share" );
+	for ( const auto i : order ) {
+		const auto& profile = mnemonics [ i ];
+		out += std::format ( "{:<16} {:>14} {:>16} {:>12.1f} {:>7.2f}%\n", names [ i ], profile.count, profile.cycles,
+			static_cast< double >( profile.cycles ) / static_cast< double >( profile.count ), share ( profile.cycles, total_cycles ) );
+	}
+
+	std::vector<const BlockProfile*> sorted;
+	uint64_t block_cycles = 0;
+	for ( const auto& [start, profile] : blocks ) {
+		if ( profile.executions != 0 ) {
+			sorted.push_back ( &profile );
+			block_cycles += profile.cycles;
+		}
+	}
+	std::ranges::sort ( sorted, [ ] ( const BlockProfile* a, const BlockProfile* b ) { return a->cycles > b->cycles; } );
+	if ( sorted.size ( ) > top_blocks ) {
+		sorted.resize ( top_blocks );
+	}
+
+	out += std::format ( "\nBlocks by host cycles ({} blocks, {} cycles)\n", blocks.size ( ), block_cycles );
+	out += std::format ( "{:<18} {:<18} {:>12} {:>14} {:>16} {:>12} {:>8}\n", "start", "end", "executions", "instructions", "cycles",
+		"cycles/exec", "share" );
+	for ( const auto* profile : sorted ) {
+		out += std::format ( "{:<#18x} {:<#18x} {:>12} {:>14} {:>16} {:>12.1f} {:>7.2f}%\n", profile->start, profile->end, profile->executions,
+			profile->instructions, profile->cycles, static_cast< double >( profile->cycles ) / static_cast< double >( profile->executions ),
+			share ( profile->cycles, block_cycles ) );
+	}
+	return out;
+}
+
+bool Profiler::write_folded ( const std::filesystem::path& path ) const {
+	auto* file = std::fopen ( path.string ( ).c_str ( ), "w" );
+	if ( !file ) {
+		return false;
+	}
+
+	auto emit = [ file ] ( const std::string& stack, uint64_t cycles )
+	{
+		if ( cycles != 0 ) {
+			const auto line = std::format ( "{} {}\n", stack, cycles );
+			std::fwrite ( line.data ( ), 1, line.size ( ), file );
+		}
+	};
+
+	for ( const auto& [start, profile] : blocks ) {
+		const auto frame = std::format ( "{:#x}", start );
+		uint64_t handler_cycles = 0;
+		for ( const auto& [mnemonic, cycles] : profile.mnemonic_cycles ) {
+			emit ( frame + ";" + names [ static_cast< std::size_t >( mnemonic ) ], cycles );
+			handler_cycles += cycles;
+		}
+		emit ( frame + ";[dispatch]", profile.cycles > handler_cycles ? profile.cycles - handler_cycles : 0 );
+	}
+	for ( std::size_t i = 0; i < unblocked_cycles.size ( ); ++i ) {
+		emit ( "[unblocked];" + names [ i ], unblocked_cycles [ i ] );
+	}
+
+	return std::fclose ( file ) == 0;
+}
+
+void Profiler::reset ( ) {
+	mnemonics.fill ( { } );
+	unblocked_cycles.fill ( 0 );
+	blocks.clear ( );
+}
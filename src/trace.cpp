@@ -0,0 +1,586 @@
+#include "../trace.hpp"
+#include "../KUBERA.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+#if KUBERA_TRACE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace kubera;
+
+namespace
+{
+	void store_le32 ( uint8_t* out, uint32_t value ) {
+		for ( int i = 0; i < 4; ++i ) {
+			out [ i ] = static_cast< uint8_t >( value >> ( i * 8 ) );
+		}
+	}
+
+	uint32_t load_le32 ( const uint8_t* in ) {
+		uint32_t value = 0;
+		for ( int i = 0; i < 4; ++i ) {
+			value |= static_cast< uint32_t >( in [ i ] ) << ( i * 8 );
+		}
+		return value;
+	}
+
+	constexpr std::size_t header_size = 12;
+	constexpr std::size_t chunk_header_size = 8;
+}
+
+TraceStream::TraceStream ( TraceWriter& writer, uint32_t id, std::size_t block_size, std::size_t block_count )
+	: writer ( writer ), stream_id ( id ), block_size ( std::max ( block_size, trace::max_record_size * 4 ) ) {
+	blocks.resize ( std::max<std::size_t> ( block_count, 2 ) );
+	for ( auto& block : blocks ) {
+		block.data = std::make_unique<uint8_t[ ]> ( this->block_size );
+	}
+	cursor = blocks [ 0 ].data.get ( );
+}
+
+void TraceStream::put_varint ( uint64_t value ) {
+	while ( value >= 0x80 ) {
+		put ( static_cast< uint8_t >( value | 0x80 ) );
+		value >>= 7;
+	}
+	put ( static_cast< uint8_t >( value ) );
+}
+
+void TraceStream::reserve ( std::size_t bytes ) {
+	if ( fill + bytes > block_size ) {
+		publish ( );
+	}
+}
+
+void TraceStream::publish ( ) {
+	if ( fill == 0 ) {
+		return;
+	}
+
+	const auto index = produced.load ( std::memory_order_relaxed );
+	blocks [ index % blocks.size ( ) ].size = fill;
+	{
+		std::lock_guard lock ( writer.mutex );
+		produced.store ( index + 1, std::memory_order_release );
+	}
+	writer.work_cv.notify_one ( );
+
+	// Every block is queued, wait for the writer to hand one back
+	if ( index + 1 - consumed.load ( std::memory_order_acquire ) == blocks.size ( ) ) {
+		std::unique_lock lock ( writer.mutex );
+		writer.space_cv.wait ( lock, [ this ]
+		{
+			return produced.load ( std::memory_order_relaxed ) - consumed.load ( std::memory_order_acquire ) < blocks.size ( );
+		} );
+	}
+	cursor = blocks [ ( index + 1 ) % blocks.size ( ) ].data.get ( );
+	fill = 0;
+}
+
+void TraceStream::flush ( ) {
+	publish ( );
+	std::unique_lock lock ( writer.mutex );
+	writer.space_cv.wait ( lock, [ this ]
+	{
+		return consumed.load ( std::memory_order_acquire ) == produced.load ( std::memory_order_relaxed );
+	} );
+}
+
+void TraceStream::begin_step ( uint64_t rip ) {
+	reserve ( trace::max_record_size );
+	put ( static_cast< uint8_t >( trace::RecordKind::Step ) );
+	put_signed ( static_cast< int64_t >( rip - last_rip ) );
+	last_rip = rip;
+	in_step = true;
+}
+
+void TraceStream::put_access ( trace::RecordKind kind, uint64_t address, std::size_t size, const VirtualMemory& memory ) {
+	reserve ( trace::max_record_size );
+	put ( static_cast< uint8_t >( kind ) );
+	put_signed ( static_cast< int64_t >( address - last_address ) );
+	last_address = address;
+	put_varint ( size );
+
+	const std::size_t captured = std::min ( size, trace::max_value_bytes );
+	if ( !memory.peek ( address, cursor + fill, captured ) ) {
+		std::memset ( cursor + fill, 0, captured );
+	}
+	fill += captured;
+}
+
+void TraceStream::record_read ( uint64_t address, std::size_t size, const VirtualMemory& memory ) {
+	if ( in_step ) {
+		put_access ( trace::RecordKind::Read, address, size, memory );
+	}
+}
+
+void TraceStream::record_write ( uint64_t address, std::size_t size ) {
+	if ( in_step ) {
+		pending_writes.emplace_back ( address, size );
+	}
+}
+
+void TraceStream::end_step ( const std::array<uint64_t, KubRegister::COUNT>& registers, uint64_t rflags, uint32_t mxcsr, const VirtualMemory& memory ) {
+	// Written values are taken once the instruction has stored them
+	for ( const auto& [address, size] : pending_writes ) {
+		put_access ( trace::RecordKind::Write, address, size, memory );
+	}
+	pending_writes.clear ( );
+
+	for ( std::size_t i = 0; i < KubRegister::COUNT; ++i ) {
+		// RIP is implied by the step records
+		if ( registers [ i ] == last_registers [ i ] || i == KubRegister::RIP ) {
+			continue;
+		}
+		reserve ( 2 + 10 );
+		put ( static_cast< uint8_t >( trace::RecordKind::Register ) );
+		put ( static_cast< uint8_t >( i ) );
+		put_varint ( registers [ i ] ^ last_registers [ i ] );
+		last_registers [ i ] = registers [ i ];
+	}
+
+	if ( rflags != last_rflags ) {
+		reserve ( 1 + 10 );
+		put ( static_cast< uint8_t >( trace::RecordKind::Flags ) );
+		put_varint ( rflags ^ last_rflags );
+		last_rflags = rflags;
+	}
+	if ( mxcsr != last_mxcsr ) {
+		reserve ( 1 + 10 );
+		put ( static_cast< uint8_t >( trace::RecordKind::Mxcsr ) );
+		put_varint ( mxcsr ^ last_mxcsr );
+		last_mxcsr = mxcsr;
+	}
+	in_step = false;
+}
+
+TraceWriter::TraceWriter ( const std::filesystem::path& path, trace::Compression compression, std::size_t block_size, std::size_t blocks_per_stream )
+	: compression ( compression ), block_size ( block_size ), blocks_per_stream ( blocks_per_stream ) {
+	file = std::fopen ( path.string ( ).c_str ( ), "wb" );
+	if ( !file ) {
+		return;
+	}
+
+#if KUBERA_TRACE_ZSTD
+	if ( compression == trace::Compression::Zstd ) {
+		zstd_context = ZSTD_createCCtx ( );
+		compressed.resize ( ZSTD_CStreamOutSize ( ) );
+	}
+#endif
+	if ( !zstd_context ) {
+		this->compression = trace::Compression::None;
+	}
+
+	uint8_t header [ header_size ] = { };
+	std::memcpy ( header, trace::magic.data ( ), trace::magic.size ( ) );
+	header [ 8 ] = static_cast< uint8_t >( trace::format_version );
+	header [ 9 ] = static_cast< uint8_t >( trace::format_version >> 8 );
+	header [ 10 ] = static_cast< uint8_t >( this->compression );
+	std::fwrite ( header, 1, sizeof ( header ), file );
+
+	thread = std::thread ( &TraceWriter::drain_loop, this );
+}
+
+TraceWriter::~TraceWriter ( ) {
+	if ( !file ) {
+		return;
+	}
+
+	for ( auto& stream : streams ) {
+		stream->publish ( );
+	}
+	{
+		std::lock_guard lock ( mutex );
+		stopping = true;
+	}
+	work_cv.notify_one ( );
+	thread.join ( );
+
+	write_out ( nullptr, 0, true );
+#if KUBERA_TRACE_ZSTD
+	ZSTD_freeCCtx ( static_cast< ZSTD_CCtx* >( zstd_context ) );
+#endif
+	std::fclose ( file );
+}
+
+TraceStream& TraceWriter::open_stream ( ) {
+	std::lock_guard lock ( mutex );
+	const auto id = static_cast< uint32_t >( streams.size ( ) );
+	streams.push_back ( std::unique_ptr<TraceStream> ( new TraceStream ( *this, id, block_size, blocks_per_stream ) ) );
+	return *streams.back ( );
+}
+
+void TraceWriter::drain_loop ( ) {
+	std::unique_lock lock ( mutex );
+	while ( true ) {
+		work_cv.wait ( lock, [ this ]
+		{
+			return stopping || std::ranges::any_of ( streams, [ ] ( const auto& stream )
+			{
+				return stream->produced.load ( std::memory_order_relaxed ) != stream->consumed.load ( std::memory_order_relaxed );
+			} );
+		} );
+		const bool stop = stopping;
+
+		lock.unlock ( );
+		const bool wrote = drain ( );
+		lock.lock ( );
+
+		if ( stop && !wrote ) {
+			return;
+		}
+	}
+}
+
+bool TraceWriter::drain ( ) {
+	std::vector<TraceStream*> pending;
+	{
+		std::lock_guard lock ( mutex );
+		for ( auto& stream : streams ) {
+			pending.push_back ( stream.get ( ) );
+		}
+	}
+
+	bool wrote = false;
+	for ( auto* stream : pending ) {
+		const auto produced = stream->produced.load ( std::memory_order_acquire );
+		for ( auto index = stream->consumed.load ( std::memory_order_relaxed ); index < produced; ++index ) {
+			const auto& block = stream->blocks [ index % stream->blocks.size ( ) ];
+			write_chunk ( stream->stream_id, block.data.get ( ), block.size );
+			{
+				std::lock_guard lock ( mutex );
+				stream->consumed.store ( index + 1, std::memory_order_release );
+			}
+			space_cv.notify_all ( );
+			wrote = true;
+		}
+	}
+	return wrote;
+}
+
+void TraceWriter::write_chunk ( uint32_t stream, const uint8_t* data, std::size_t size ) {
+	uint8_t header [ chunk_header_size ];
+	store_le32 ( header, stream );
+	store_le32 ( header + 4, static_cast< uint32_t >( size ) );
+	write_out ( header, sizeof ( header ) );
+	write_out ( data, size );
+}
+
+void TraceWriter::write_out ( const void* data, std::size_t size, bool finish ) {
+#if KUBERA_TRACE_ZSTD
+	if ( zstd_context ) {
+		auto* context = static_cast< ZSTD_CCtx* >( zstd_context );
+		ZSTD_inBuffer in { data, size, 0 };
+		while ( true ) {
+			ZSTD_outBuffer out { compressed.data ( ), compressed.size ( ), 0 };
+			const auto remaining = ZSTD_compressStream2 ( context, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue );
+			if ( ZSTD_isError ( remaining ) ) {
+				return;
+			}
+			std::fwrite ( compressed.data ( ), 1, out.pos, file );
+			if ( finish ? remaining == 0 : in.pos == in.size ) {
+				return;
+			}
+		}
+	}
+#endif
+	// Uncompressed output has no frame to end
+	( void ) finish;
+	if ( size != 0 ) {
+		std::fwrite ( data, 1, size, file );
+	}
+}
+
+TraceReader::TraceReader ( const std::filesystem::path& path ) {
+	file = std::fopen ( path.string ( ).c_str ( ), "rb" );
+	if ( !file ) {
+		return;
+	}
+
+	uint8_t header [ header_size ];
+	const bool valid = std::fread ( header, 1, sizeof ( header ), file ) == sizeof ( header ) &&
+		std::memcmp ( header, trace::magic.data ( ), trace::magic.size ( ) ) == 0 &&
+		( header [ 8 ] | ( header [ 9 ] << 8 ) ) == trace::format_version;
+	compression = static_cast< trace::Compression >( header [ 10 ] );
+
+	bool supported = compression == trace::Compression::None;
+#if KUBERA_TRACE_ZSTD
+	if ( compression == trace::Compression::Zstd ) {
+		zstd_context = ZSTD_createDCtx ( );
+		raw.resize ( ZSTD_DStreamInSize ( ) );
+		supported = true;
+	}
+#endif
+	if ( !valid || !supported ) {
+		std::fclose ( file );
+		file = nullptr;
+		return;
+	}
+	input.resize ( 0x10000 );
+}
+
+TraceReader::~TraceReader ( ) {
+#if KUBERA_TRACE_ZSTD
+	ZSTD_freeDCtx ( static_cast< ZSTD_DCtx* >( zstd_context ) );
+#endif
+	if ( file ) {
+		std::fclose ( file );
+	}
+}
+
+bool TraceReader::refill ( ) {
+	input_pos = 0;
+	input_size = 0;
+#if KUBERA_TRACE_ZSTD
+	if ( zstd_context ) {
+		while ( input_size == 0 ) {
+			if ( raw_pos == raw_size ) {
+				raw_size = std::fread ( raw.data ( ), 1, raw.size ( ), file );
+				raw_pos = 0;
+				if ( raw_size == 0 ) {
+					return false;
+				}
+			}
+			ZSTD_inBuffer in { raw.data ( ), raw_size, raw_pos };
+			ZSTD_outBuffer out { input.data ( ), input.size ( ), 0 };
+			if ( ZSTD_isError ( ZSTD_decompressStream ( static_cast< ZSTD_DCtx* >( zstd_context ), &out, &in ) ) ) {
+				return false;
+			}
+			raw_pos = in.pos;
+			input_size = out.pos;
+		}
+		return true;
+	}
+#endif
+	input_size = std::fread ( input.data ( ), 1, input.size ( ), file );
+	return input_size != 0;
+}
+
+bool TraceReader::read_in ( void* data, std::size_t size ) {
+	auto* out = static_cast< uint8_t* >( data );
+	while ( size > 0 ) {
+		if ( input_pos == input_size && !refill ( ) ) {
+			return false;
+		}
+		const std::size_t to_copy = std::min ( size, input_size - input_pos );
+		std::memcpy ( out, input.data ( ) + input_pos, to_copy );
+		input_pos += to_copy;
+		out += to_copy;
+		size -= to_copy;
+	}
+	return true;
+}
+
+void TraceReader::finish ( ) {
+	for ( auto& [id, state] : streams ) {
+		if ( state.current ) {
+			ready.push_back ( std::move ( *state.current ) );
+			state.current.reset ( );
+		}
+	}
+	finished = true;
+}
+
+bool TraceReader::parse_chunk ( uint32_t stream, const std::vector<uint8_t>& data ) {
+	auto it = std::ranges::find_if ( streams, [ stream ] ( const auto& entry ) { return entry.first == stream; } );
+	if ( it == streams.end ( ) ) {
+		streams.emplace_back ( stream, StreamState { } );
+		it = std::prev ( streams.end ( ) );
+	}
+	auto& state = it->second;
+
+	std::size_t pos = 0;
+	auto varint = [ &data, &pos ] ( uint64_t& value )
+	{
+		value = 0;
+		for ( unsigned shift = 0; shift < 64; shift += 7 ) {
+			if ( pos >= data.size ( ) ) {
+				return false;
+			}
+			const uint8_t byte = data [ pos++ ];
+			value |= static_cast< uint64_t >( byte & 0x7F ) << shift;
+			if ( ( byte & 0x80 ) == 0 ) {
+				return true;
+			}
+		}
+		return false;
+	};
+	auto zigzag = [ ] ( uint64_t value )
+	{
+		return ( value >> 1 ) ^ ( ~( value & 1 ) + 1 );
+	};
+
+	while ( pos < data.size ( ) ) {
+		const auto kind = static_cast< trace::RecordKind >( data [ pos++ ] );
+		uint64_t value = 0;
+		if ( kind == trace::RecordKind::Step ) {
+			if ( !varint ( value ) ) {
+				return false;
+			}
+			if ( state.current ) {
+				ready.push_back ( std::move ( *state.current ) );
+			}
+			state.last_rip += zigzag ( value );
+			state.current.emplace ( );
+			state.current->stream = stream;
+			state.current->rip = state.last_rip;
+			continue;
+		}
+
+		// Everything else belongs to a step
+		if ( !state.current ) {
+			return false;
+		}
+		auto& step = *state.current;
+		switch ( kind ) {
+			case trace::RecordKind::Register:
+			{
+				if ( pos >= data.size ( ) ) {
+					return false;
+				}
+				const uint8_t index = data [ pos++ ];
+				if ( index >= KubRegister::COUNT || !varint ( value ) ) {
+					return false;
+				}
+				const uint64_t old_value = state.registers [ index ];
+				state.registers [ index ] ^= value;
+				step.registers.push_back ( { index, old_value, state.registers [ index ] } );
+				break;
+			}
+			case trace::RecordKind::Flags:
+			{
+				if ( !varint ( value ) ) {
+					return false;
+				}
+				step.rflags.emplace ( state.rflags, state.rflags ^ value );
+				state.rflags ^= value;
+				break;
+			}
+			case trace::RecordKind::Mxcsr:
+			{
+				if ( !varint ( value ) ) {
+					return false;
+				}
+				const auto delta = static_cast< uint32_t >( value );
+				step.mxcsr.emplace ( state.mxcsr, state.mxcsr ^ delta );
+				state.mxcsr ^= delta;
+				break;
+			}
+			case trace::RecordKind::Read:
+			case trace::RecordKind::Write:
+			{
+				TraceAccess access;
+				access.write = kind == trace::RecordKind::Write;
+				if ( !varint ( value ) || !varint ( access.size ) ) {
+					return false;
+				}
+				state.last_address += zigzag ( value );
+				access.address = state.last_address;
+				const std::size_t captured = std::min<uint64_t> ( access.size, trace::max_value_bytes );
+				if ( data.size ( ) - pos < captured ) {
+					return false;
+				}
+				std::memcpy ( access.value.data ( ), data.data ( ) + pos, captured );
+				pos += captured;
+				step.accesses.push_back ( access );
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+bool TraceReader::next ( TraceStep& step ) {
+	while ( ready_pos >= ready.size ( ) ) {
+		if ( finished || !file ) {
+			return false;
+		}
+		ready.clear ( );
+		ready_pos = 0;
+
+		uint8_t header [ chunk_header_size ];
+		if ( !read_in ( header, sizeof ( header ) ) ) {
+			finish ( );
+			continue;
+		}
+		chunk.resize ( load_le32 ( header + 4 ) );
+		// A truncated or corrupt tail ends the trace, the steps before it are still returned
+		if ( !read_in ( chunk.data ( ), chunk.size ( ) ) || !parse_chunk ( load_le32 ( header ), chunk ) ) {
+			finish ( );
+		}
+	}
+	step = std::move ( ready [ ready_pos++ ] );
+	return true;
+}
+
+std::string kubera::format_trace_step ( const TraceStep& step ) {
+	std::string line = std::format ( "[{}] {:#x}", step.stream, step.rip );
+	for ( const auto& change : step.registers ) {
+		line += std::format ( " {} {:#x};{:#x}", KUBERA::register_names [ change.index ], change.old_value, change.new_value );
+	}
+
+	if ( step.rflags ) {
+		static constexpr std::pair<const char*, unsigned> flag_bits [ ] = {
+			{ "CF", 0 }, { "PF", 2 }, { "AF", 4 }, { "ZF", 6 }, { "SF", 7 }, { "TF", 8 }, { "IF", 9 }, { "DF", 10 }, { "OF", 11 },
+			{ "NT", 14 }, { "RF", 16 }, { "VM", 17 }, { "AC", 18 }, { "VIF", 19 }, { "VIP", 20 }, { "ID", 21 },
+		};
+		const auto [old_flags, new_flags] = *step.rflags;
+		for ( const auto& [name, bit] : flag_bits ) {
+			if ( ( ( old_flags ^ new_flags ) >> bit ) & 1 ) {
+				line += std::format ( " {} {};{}", name, ( old_flags >> bit ) & 1, ( new_flags >> bit ) & 1 );
+			}
+		}
+		if ( ( ( old_flags ^ new_flags ) >> 12 ) & 3 ) {
+			line += std::format ( " IOPL {};{}", ( old_flags >> 12 ) & 3, ( new_flags >> 12 ) & 3 );
+		}
+	}
+
+	if ( step.mxcsr ) {
+		line += std::format ( " MXCSR {:#x};{:#x}", step.mxcsr->first, step.mxcsr->second );
+	}
+
+	for ( const auto& access : step.accesses ) {
+		line += std::format ( " {} [{:#x}:{}]", access.write ? "W" : "R", access.address, access.size );
+		const std::size_t captured = std::min<uint64_t> ( access.size, trace::max_value_bytes );
+		if ( captured != 0 ) {
+			line += " ";
+			// Little-endian value, most significant byte first
+			for ( std::size_t i = captured; i-- > 0; ) {
+				line += std::format ( "{:02x}", access.value [ i ] );
+			}
+		}
+	}
+	return line;
+}
+
+void KUBERA::start_trace ( TraceStream& stream ) {
+	stop_trace ( );
+	trace_stream = &stream;
+	trace_hook = memory->add_hook ( 0, SIZE_MAX, PageProtection::READ | PageProtection::WRITE,
+		[ this ] ( VirtualMemory* vm, uint64_t address, std::size_t size, uint8_t access )
+	{
+		if ( access & PageProtection::WRITE ) {
+			trace_stream->record_write ( address, size );
+		}
+		else {
+			trace_stream->record_read ( address, size, *vm );
+		}
+	} );
+}
+
+void KUBERA::stop_trace ( ) {
+	if ( !trace_stream ) {
+		return;
+	}
+	memory->remove_hook ( trace_hook );
+	trace_stream->flush ( );
+	trace_stream = nullptr;
+	trace_hook = 0;
+}
+
+void KUBERA::trace_end_step ( ) {
+	trace_stream->end_step ( cpu->registers, evaluated_flags ( ).value, cpu->mxcsr.value, *memory );
+}
@@ -1,75 +1,658 @@
 #include "../memory.hpp"
+#include "../checkpoint.hpp"
 #include <memory>
+#include <bit>
+#include <algorithm>
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 namespace kubera
 {
-	VirtualMemory::VirtualMemory ( std::size_t ps ) : page_size ( ps ) {
-		for ( auto& c : cache ) {
-			c.virt = UINT64_MAX;
-		}
-	}
+	namespace
+	{
+		// Host frames for 4 KiB guest pages, carved out of large address space reservations so committing
+		// a page is a pointer bump or a free list pop instead of an aligned heap allocation. Reserved memory
+		// only costs RSS once touched and comes back zeroed from the OS, so only frames reused straight off
+		// the free list need clearing. Shared by every VirtualMemory since frames outlive them in snapshots.
+		class FrameArena {
+		public:
+			static constexpr std::size_t frame_size = 0x1000;
+			static constexpr std::size_t chunk_size = 64ULL << 20;
+			// Batches at least this large are decommitted instead of being kept resident for reuse
+			static constexpr std::size_t decommit_threshold = 64;
 
-	VirtualMemory::~VirtualMemory ( ) {
-		for ( auto& [v, p] : pages ) {
-			if ( p->data ) {
+			static FrameArena& instance ( ) {
+				// Never destroyed, static VirtualMemory instances may release frames during exit
+				static auto* arena = new FrameArena ( );
+				return *arena;
+			}
+
+			uint8_t* allocate ( ) {
+				uint8_t* frame = nullptr;
+				bool needs_clear = false;
+				bool needs_commit = false;
+				{
+					std::lock_guard lock ( mutex );
+					if ( !resident.empty ( ) ) {
+						frame = resident.back ( );
+						resident.pop_back ( );
+						needs_clear = true;
+					}
+					else if ( !decommitted.empty ( ) ) {
+						frame = decommitted.back ( );
+						decommitted.pop_back ( );
+						needs_commit = true;
+					}
+					else {
+						if ( bump == bump_end && !reserve_chunk ( ) ) {
+							return nullptr;
+						}
+						frame = bump;
+						bump += frame_size;
+						needs_commit = true;
+					}
+				}
+
+				if ( needs_clear ) {
+					std::memset ( frame, 0, frame_size );
+				}
+				else if ( needs_commit && !os_commit ( frame, frame_size ) ) {
+					// Still uncommitted, the resident list would hand it out to be cleared
+					std::lock_guard lock ( mutex );
+					decommitted.push_back ( frame );
+					return nullptr;
+				}
+				return frame;
+			}
+
+			// False if frame was not allocated here
+			bool release ( uint8_t* frame ) {
+				std::lock_guard lock ( mutex );
+				if ( !owns ( frame ) ) {
+					return false;
+				}
+				resident.push_back ( frame );
+				return true;
+			}
+
+			// Releases the frames allocated here and leaves the others in frames
+			void release ( std::vector<uint8_t*>& frames ) {
+				std::lock_guard lock ( mutex );
+				auto foreign = std::partition ( frames.begin ( ), frames.end ( ), [ this ] ( uint8_t* frame ) { return owns ( frame ); } );
+				const auto owned = static_cast< std::size_t >( foreign - frames.begin ( ) );
+
+				if ( owned < decommit_threshold ) {
+					resident.insert ( resident.end ( ), frames.begin ( ), foreign );
+				}
+				else {
+					// Frames freed together are mostly adjacent, decommit them run by run
+					std::sort ( frames.begin ( ), foreign );
+					for ( auto run = frames.begin ( ); run != foreign; ) {
+						auto run_end = std::next ( run );
+						while ( run_end != foreign && *run_end == *std::prev ( run_end ) + frame_size ) {
+							++run_end;
+						}
+						os_decommit ( *run, static_cast< std::size_t >( run_end - run ) * frame_size );
+						run = run_end;
+					}
+					decommitted.insert ( decommitted.end ( ), frames.begin ( ), foreign );
+				}
+				frames.erase ( frames.begin ( ), foreign );
+			}
+
+		private:
+			std::mutex mutex;
+			// Reservation bases, sorted
+			std::vector<uint8_t*> chunks;
+			uint8_t* bump { nullptr };
+			uint8_t* bump_end { nullptr };
+			// Free frames that still hold their old contents
+			std::vector<uint8_t*> resident;
+			// Free frames returned to the OS, zeroed once committed again
+			std::vector<uint8_t*> decommitted;
+
+			bool owns ( const uint8_t* frame ) const {
+				auto it = std::upper_bound ( chunks.begin ( ), chunks.end ( ), frame, std::less<> { } );
+				return it != chunks.begin ( ) && frame < *std::prev ( it ) + chunk_size;
+			}
+
+			bool reserve_chunk ( ) {
+			#ifdef _MSC_VER
+				auto* base = static_cast< uint8_t* >( VirtualAlloc ( nullptr, chunk_size, MEM_RESERVE, PAGE_READWRITE ) );
+				if ( !base ) {
+					return false;
+				}
+			#else
+				int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+			#ifdef MAP_NORESERVE
+				flags |= MAP_NORESERVE;
+			#endif
+				void* mapping = mmap ( nullptr, chunk_size, PROT_READ | PROT_WRITE, flags, -1, 0 );
+				if ( mapping == MAP_FAILED ) {
+					return false;
+				}
+				auto* base = static_cast< uint8_t* >( mapping );
+			#endif
+				chunks.insert ( std::upper_bound ( chunks.begin ( ), chunks.end ( ), base, std::less<> { } ), base );
+				bump = base;
+				bump_end = base + chunk_size;
+				return true;
+			}
+
+			// Backs reserved or decommitted frames with memory, a no-op where the OS commits on first touch
+			static bool os_commit ( uint8_t* frame, std::size_t size ) {
+			#ifdef _MSC_VER
+				return VirtualAlloc ( frame, size, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+			#else
+				( void ) frame;
+				( void ) size;
+				return true;
+			#endif
+			}
+
+			static void os_decommit ( uint8_t* frames, std::size_t size ) {
 			#ifdef _MSC_VER
-				_aligned_free ( p->data );
+				VirtualFree ( frames, size, MEM_DECOMMIT );
 			#else
-				std::free ( p->data );
+				madvise ( frames, size, MADV_DONTNEED );
 			#endif
 			}
+		};
+
+		// Backing whose range holds frame
+		template<typename Backings>
+		auto find_host_backing ( Backings& backings, const uint8_t* frame ) {
+			auto it = backings.upper_bound ( frame );
+			if ( it == backings.begin ( ) || frame >= std::prev ( it )->second.end ) {
+				return backings.end ( );
+			}
+			return std::prev ( it );
+		}
+	};
+
+	void FrameRefs::share ( uint8_t* frame ) {
+		std::lock_guard lock ( mutex );
+		auto [it, inserted] = counts.try_emplace ( frame, 1 );
+		++it->second;
+	}
+
+	void FrameRefs::release ( uint8_t* frame ) {
+		{
+			std::lock_guard lock ( mutex );
+			auto it = counts.find ( frame );
+			if ( it != counts.end ( ) ) {
+				// The remaining owner becomes the only one and is no longer tracked
+				if ( --it->second == 1 ) {
+					counts.erase ( it );
+				}
+				return;
+			}
+		}
+		VirtualMemory::uncommit ( frame );
+	}
+
+	bool FrameRefs::is_shared ( uint8_t* frame ) {
+		std::lock_guard lock ( mutex );
+		return counts.contains ( frame );
+	}
+
+	MemorySnapshot::~MemorySnapshot ( ) {
+		for ( auto& [virt, page] : pages ) {
+			if ( page.present && ( page.flags & PageFlags::PAGE_FLAG_HOST ) == 0 ) {
+				frames->release ( page.data );
+			}
+		}
+	}
+
+	const Page* MemorySnapshot::find ( uint64_t virt_page ) const {
+		auto it = std::lower_bound ( pages.begin ( ), pages.end ( ), virt_page, [ ] ( const auto& entry, uint64_t virt )
+		{
+			return entry.first < virt;
+		} );
+		return it != pages.end ( ) && it->first == virt_page ? &it->second : nullptr;
+	}
+
+	VirtualMemory::VirtualMemory ( std::size_t ps ) : page_size ( ps ), page_shift ( std::countr_zero ( ps ) ) {
+	}
+
+	VirtualMemory::~VirtualMemory ( ) {
+		std::vector<uint8_t*> batch;
+		for ( auto& [key, pdpt] : page_map_root ) {
+			for ( auto& directory : pdpt->directories ) {
+				if ( !directory ) continue;
+				for ( auto& table : directory->tables ) {
+					if ( !table ) continue;
+					for ( auto& page : table->pages ) {
+						release_frame ( &page, &batch );
+					}
+				}
+			}
+		}
+		uncommit ( batch );
+	}
+
+	Page* VirtualMemory::lookup_page ( uint64_t virt_page ) const {
+		const uint64_t vpn = virt_page >> page_shift;
+		auto root_it = page_map_root.find ( vpn >> ( table_bits * 3 ) );
+		if ( root_it == page_map_root.end ( ) ) {
+			return nullptr;
+		}
+		const auto& directory = root_it->second->directories [ ( vpn >> ( table_bits * 2 ) ) & ( table_entries - 1 ) ];
+		if ( !directory ) {
+			return nullptr;
+		}
+		const auto& table = directory->tables [ ( vpn >> table_bits ) & ( table_entries - 1 ) ];
+		if ( !table ) {
+			return nullptr;
 		}
+		auto& page = table->pages [ vpn & ( table_entries - 1 ) ];
+		return page.mapped ? &page : nullptr;
+	}
+
+	Page* VirtualMemory::map_page ( uint64_t virt_page ) {
+		const uint64_t vpn = virt_page >> page_shift;
+		auto& pdpt = page_map_root [ vpn >> ( table_bits * 3 ) ];
+		if ( !pdpt ) {
+			pdpt = std::make_unique<PageDirectoryPointerTable> ( );
+		}
+		auto& directory = pdpt->directories [ ( vpn >> ( table_bits * 2 ) ) & ( table_entries - 1 ) ];
+		if ( !directory ) {
+			directory = std::make_unique<PageDirectory> ( );
+			++pdpt->used;
+		}
+		auto& table = directory->tables [ ( vpn >> table_bits ) & ( table_entries - 1 ) ];
+		if ( !table ) {
+			table = std::make_unique<PageTable> ( );
+			++directory->used;
+		}
+		auto& page = table->pages [ vpn & ( table_entries - 1 ) ];
+		if ( page.mapped ) {
+			return nullptr;
+		}
+		layout_changed = true;
+		page = Page { };
+		page.mapped = true;
+		if ( !hooks.empty ( ) ) {
+			page.flags = hook_flags ( virt_page );
+		}
+		++table->mapped;
+		return &page;
+	}
+
+	void VirtualMemory::unmap_page ( uint64_t virt_page, std::vector<uint8_t*>* batch ) {
+		unmap_range ( virt_page, virt_page + page_size, batch );
+	}
+
+	void VirtualMemory::unmap_range ( uint64_t start, uint64_t end, std::vector<uint8_t*>* batch ) {
+		uint64_t vpn = start >> page_shift;
+		const uint64_t end_vpn = end >> page_shift;
+		while ( vpn < end_vpn ) {
+			// Pages of the range covered by the table holding vpn, resolved once for all of them
+			const uint64_t table_end = std::min ( ( vpn | ( table_entries - 1 ) ) + 1, end_vpn );
+			auto root_it = page_map_root.find ( vpn >> ( table_bits * 3 ) );
+			if ( root_it == page_map_root.end ( ) ) {
+				vpn = table_end;
+				continue;
+			}
+			auto& pdpt = root_it->second;
+			auto& directory = pdpt->directories [ ( vpn >> ( table_bits * 2 ) ) & ( table_entries - 1 ) ];
+			if ( !directory ) {
+				vpn = table_end;
+				continue;
+			}
+			auto& table = directory->tables [ ( vpn >> table_bits ) & ( table_entries - 1 ) ];
+			if ( !table ) {
+				vpn = table_end;
+				continue;
+			}
+
+			for ( ; vpn < table_end; ++vpn ) {
+				auto& page = table->pages [ vpn & ( table_entries - 1 ) ];
+				if ( !page.mapped ) {
+					continue;
+				}
+				const uint64_t virt_page = vpn << page_shift;
+				if ( page.has_code ) {
+					log_code_write ( virt_page, &page );
+				}
+				flush_tlb ( virt_page );
+				release_frame ( &page, batch );
+				page = Page { };
+				layout_changed = true;
+				++protection_seq;
+				--table->mapped;
+			}
+
+			// Release intermediate tables once they no longer map anything
+			if ( table->mapped == 0 ) {
+				table.reset ( );
+				if ( --directory->used == 0 ) {
+					directory.reset ( );
+					if ( --pdpt->used == 0 ) {
+						page_map_root.erase ( root_it );
+					}
+				}
+			}
+		}
+	}
+
+	template<typename Fn>
+	void VirtualMemory::for_each_page_in_range ( uint64_t start, uint64_t end, Fn&& fn ) {
+		uint64_t vpn = start >> page_shift;
+		const uint64_t end_vpn = end >> page_shift;
+		while ( vpn < end_vpn ) {
+			const uint64_t table_end = std::min ( ( vpn | ( table_entries - 1 ) ) + 1, end_vpn );
+			PageTable* table = nullptr;
+			if ( auto root_it = page_map_root.find ( vpn >> ( table_bits * 3 ) ); root_it != page_map_root.end ( ) ) {
+				if ( auto& directory = root_it->second->directories [ ( vpn >> ( table_bits * 2 ) ) & ( table_entries - 1 ) ] ) {
+					table = directory->tables [ ( vpn >> table_bits ) & ( table_entries - 1 ) ].get ( );
+				}
+			}
+			if ( table ) {
+				for ( ; vpn < table_end; ++vpn ) {
+					auto& page = table->pages [ vpn & ( table_entries - 1 ) ];
+					if ( page.mapped ) {
+						fn ( vpn << page_shift, page );
+					}
+				}
+			}
+			vpn = table_end;
+		}
+	}
+
+	uint64_t VirtualMemory::add_hook ( uint64_t addr, std::size_t size, uint8_t access, MemoryHook hook ) {
+		access &= PageProtection::READ | PageProtection::WRITE | PageProtection::EXEC;
+		if ( size == 0 || access == PageProtection::NONE || !hook ) {
+			return 0;
+		}
+
+		const uint64_t id = next_hook_id++;
+		auto& entry = hooks.emplace ( id, HookEntry { addr, addr + size, access, false, std::move ( hook ) } ).first->second;
+		link_hook ( &entry );
+		refresh_hook_flags ( addr, addr + size );
+		return id;
+	}
+
+	bool VirtualMemory::remove_hook ( uint64_t id ) {
+		auto it = hooks.find ( id );
+		if ( it == hooks.end ( ) || it->second.removed ) {
+			return false;
+		}
+
+		const uint64_t start = it->second.start;
+		const uint64_t end = it->second.end;
+		if ( hook_dispatch_depth != 0 ) {
+			// A dispatch may be walking the buckets, hide the hook until it returns
+			it->second.removed = true;
+			removed_hooks.push_back ( id );
+		}
+		else {
+			erase_hook ( id );
+		}
+		refresh_hook_flags ( start, end );
+		return true;
+	}
+
+	void VirtualMemory::link_hook ( HookEntry* entry ) {
+		const uint64_t first = entry->start / page_size;
+		const uint64_t last = ( entry->end - 1 ) / page_size;
+		if ( last - first >= wide_hook_pages ) {
+			wide_hooks.push_back ( entry );
+			return;
+		}
+		for ( uint64_t page = first; page <= last; ++page ) {
+			hook_pages [ page ].push_back ( entry );
+		}
+	}
+
+	void VirtualMemory::erase_hook ( uint64_t id ) {
+		auto it = hooks.find ( id );
+		if ( it == hooks.end ( ) ) {
+			return;
+		}
+
+		auto* entry = &it->second;
+		const uint64_t first = entry->start / page_size;
+		const uint64_t last = ( entry->end - 1 ) / page_size;
+		if ( last - first >= wide_hook_pages ) {
+			std::erase ( wide_hooks, entry );
+		}
+		else {
+			for ( uint64_t page = first; page <= last; ++page ) {
+				auto bucket = hook_pages.find ( page );
+				std::erase ( bucket->second, entry );
+				if ( bucket->second.empty ( ) ) {
+					hook_pages.erase ( bucket );
+				}
+			}
+		}
+		hooks.erase ( it );
 	}
 
 	void VirtualMemory::set_read_hook ( uint64_t addr, std::function<void ( VirtualMemory* vm, uint64_t addr, std::size_t size )> hook ) {
-		auto* region = const_cast< Region* >( find_region ( addr ) );
-		if ( region ) {
-			region->read_hook = std::move ( hook );
+		if ( const auto* region = find_region ( addr ) ) {
+			add_hook ( region->base_address, region->size, PageProtection::READ, [ hook = std::move ( hook ) ] ( VirtualMemory* vm, uint64_t address, std::size_t size, uint8_t )
+			{
+				hook ( vm, address, size );
+			} );
+		}
+	}
+
+	template<typename Fn>
+	void VirtualMemory::for_each_hook ( uint64_t start, uint64_t end, Fn&& fn ) const {
+		// Lists are walked by index up to their size on entry, fn may add hooks and grow them
+		const std::size_t wide = wide_hooks.size ( );
+		for ( std::size_t i = 0; i < wide; ++i ) {
+			const auto* entry = wide_hooks [ i ];
+			if ( !entry->removed && entry->start < end && entry->end > start ) {
+				fn ( *entry );
+			}
+		}
+		if ( hook_pages.empty ( ) ) {
+			return;
+		}
+
+		const uint64_t first = start / page_size;
+		const uint64_t last = ( end - 1 ) / page_size;
+		for ( uint64_t page = first; page <= last; ++page ) {
+			const auto bucket = hook_pages.find ( page );
+			if ( bucket == hook_pages.end ( ) ) {
+				continue;
+			}
+			// Map values keep their address across rehashes, so this stays valid while fn adds hooks
+			const auto& entries = bucket->second;
+			const std::size_t count = entries.size ( );
+			const uint64_t page_start = page * page_size;
+			for ( std::size_t i = 0; i < count; ++i ) {
+				const auto* entry = entries [ i ];
+				if ( entry->removed || entry->start >= end || entry->end <= start ) {
+					continue;
+				}
+				// A hook starting before this page overlaps the range on the previous page too and was visited there
+				if ( page != first && entry->start < page_start ) {
+					continue;
+				}
+				fn ( *entry );
+			}
+		}
+	}
+
+	bool VirtualMemory::has_hook ( uint64_t addr, std::size_t size, uint8_t access ) const {
+		if ( hooks.empty ( ) ) {
+			return false;
+		}
+		bool found = false;
+		for_each_hook ( addr, addr + size, [ &found, access ] ( const HookEntry& entry )
+		{
+			found |= ( entry.access & access ) != 0;
+		} );
+		return found;
+	}
+
+	void VirtualMemory::dispatch_hooks ( uint64_t addr, std::size_t size, uint8_t access ) {
+		if ( hooks.empty ( ) ) {
+			return;
+		}
+
+		// Callbacks run straight off the buckets, the hooks they remove are only erased once the outermost dispatch is done
+		++hook_dispatch_depth;
+		for_each_hook ( addr, addr + size, [ this, addr, size, access ] ( const HookEntry& entry )
+		{
+			if ( ( entry.access & access ) != 0 ) {
+				entry.callback ( this, addr, size, access );
+			}
+		} );
+		if ( --hook_dispatch_depth == 0 && !removed_hooks.empty ( ) ) {
+			for ( const auto id : removed_hooks ) {
+				erase_hook ( id );
+			}
+			removed_hooks.clear ( );
+		}
+	}
+
+	uint8_t VirtualMemory::hook_flags ( uint64_t virt_page ) const {
+		uint8_t flags = PageFlags::PAGE_FLAG_NONE;
+		if ( !hooks.empty ( ) ) {
+			for_each_hook ( virt_page, virt_page + page_size, [ &flags ] ( const HookEntry& entry )
+			{
+				flags |= hook_flags_for ( entry.access );
+			} );
+		}
+		return flags;
+	}
+
+	void VirtualMemory::refresh_hook_flags ( uint64_t start, uint64_t end ) {
+		auto refresh = [ this ] ( uint64_t virt, Page& page )
+		{
+			const uint8_t flags = hook_flags ( virt );
+			const uint8_t previous = page.flags & hook_flag_mask;
+			if ( flags == previous ) {
+				return;
+			}
+			// Decoded blocks carry the exec hook state of their instructions, rebuild them
+			if ( page.has_code && ( ( flags ^ previous ) & PageFlags::PAGE_FLAG_EXEC_HOOK ) != 0 ) {
+				log_code_write ( virt, &page );
+			}
+			page.flags = ( page.flags & ~hook_flag_mask ) | flags;
+			flush_tlb ( virt );
+		};
+
+		const uint64_t first = start & ~( page_size - 1 );
+		// Ranges spanning more than a root entry, like a hook on the whole address space, visit the mapped pages instead
+		if ( end - first > ( uint64_t { page_size } << ( table_bits * 3 ) ) ) {
+			for_each_mapped_page ( [ &refresh, start, end, this ] ( uint64_t virt, Page& page )
+			{
+				if ( virt + page_size > start && virt < end ) {
+					refresh ( virt, page );
+				}
+			} );
+			return;
+		}
+		for_each_page_in_range ( first, ( end + page_size - 1 ) & ~( page_size - 1 ), refresh );
+	}
+
+	bool VirtualMemory::commit_page ( Page* page ) {
+		if ( page->present ) {
+			return true;
+		}
+		page->data = commit ( page_size );
+		if ( !page->data ) {
+			return false;
+		}
+		page->present = true;
+		return true;
+	}
+
+	void VirtualMemory::flush_tlb ( uint64_t virt_page ) {
+		++tlb_seq;
+		const auto index = tlb_index ( virt_page );
+		for ( auto& set : tlb ) {
+			if ( set [ index ].virt == virt_page ) {
+				set [ index ] = TlbEntry { };
+			}
+		}
+	}
+
+	void VirtualMemory::flush_tlb ( ) {
+		++tlb_seq;
+		for ( auto& set : tlb ) {
+			set.fill ( TlbEntry { } );
 		}
 	}
 
 	uint8_t* VirtualMemory::commit ( std::size_t size ) {
+		if ( size == FrameArena::frame_size ) {
+			return FrameArena::instance ( ).allocate ( );
+		}
+
+		// Other page sizes are rare enough to go through the heap
+		const std::size_t rounded = ( size + PAGE_ALIGN - 1 ) & ~static_cast< std::size_t >( PAGE_ALIGN - 1 );
 	#ifdef _MSC_VER
-		return reinterpret_cast< uint8_t* >( _aligned_malloc ( size, PAGE_ALIGN ) );
+		auto* data = reinterpret_cast< uint8_t* >( _aligned_malloc ( rounded, PAGE_ALIGN ) );
 	#else
-		return reinterpret_cast< uint8_t* >( std::aligned_alloc ( size, PAGE_ALIGN ) );
+		auto* data = reinterpret_cast< uint8_t* >( std::aligned_alloc ( PAGE_ALIGN, rounded ) );
+	#endif
+		if ( data ) {
+			std::memset ( data, 0, rounded );
+		}
+		return data;
+	}
+
+	static void free_heap_frame ( uint8_t* data ) {
+	#ifdef _MSC_VER
+		_aligned_free ( data );
+	#else
+		std::free ( data );
 	#endif
 	}
 
 	void VirtualMemory::uncommit ( uint8_t* data ) {
-		if ( data ) {
-		#ifdef _MSC_VER
-			_aligned_free ( data );
-		#else
-			std::free ( data );
-		#endif
+		if ( data && !FrameArena::instance ( ).release ( data ) ) {
+			free_heap_frame ( data );
+		}
+	}
+
+	void VirtualMemory::uncommit ( std::vector<uint8_t*>& frames ) {
+		FrameArena::instance ( ).release ( frames );
+		for ( auto* data : frames ) {
+			free_heap_frame ( data );
 		}
+		frames.clear ( );
 	}
 
 	uint64_t VirtualMemory::alloc ( std::size_t size, uint8_t prot, std::size_t alignment, bool commit_immediately ) {
 		uint64_t base = ( next_alloc + alignment - 1 ) & ~( alignment - 1 );
 		std::size_t pages_needed = ( size + page_size - 1 ) / page_size;
 		Region region { base, pages_needed * page_size, prot, prot };
+		region.allocation_base = base;
 		regions [ base ] = region;
 		for ( std::size_t i = 0; i < pages_needed; i++ ) {
 			uint64_t virt = base + i * page_size;
-			pages [ virt ] = std::make_unique<Page> ( );
-			pages [ virt ]->prot = prot;
-			pages [ virt ]->region_base = base;
-			if ( commit_immediately ) {
-				pages [ virt ]->data = commit ( page_size );
-				if ( !pages [ virt ]->data ) {
-					if constexpr ( verbose_memory ) {
-						std::println ( "Failed to commit memory for page at address {:#x}", virt );
-					}
+			auto* page = map_page ( virt );
+			if ( !page ) {
+				log_message ( "Warning: Page at address {:#x} already exists. Allocation failed.", virt );
+				for ( std::size_t j = 0; j < i; j++ ) {
+					unmap_page ( base + j * page_size );
+				}
+				regions.erase ( base );
+				return 0;
+			}
+			page->prot = prot;
+			if ( commit_immediately && !commit_page ( page ) ) {
+				log_message ( "Failed to commit memory for page at address {:#x}", virt );
 
-					for ( std::size_t j = 0; j <= i; j++ ) {
-						pages.erase ( base + j * page_size );
-					}
-					regions.erase ( base );
-					return 0;
+				for ( std::size_t j = 0; j <= i; j++ ) {
+					unmap_page ( base + j * page_size );
 				}
-				std::memset ( pages [ virt ]->data, 0, page_size );
-				pages [ virt ]->present = true;
+				regions.erase ( base );
+				return 0;
 			}
 		}
 		next_alloc = base + pages_needed * page_size;
@@ -87,10 +670,8 @@ namespace kubera
 			bool overlap = false;
 			while ( it != regions.end ( ) && it->first < region_end ) {
 				if ( it->first + it->second.size > base ) {
-					if constexpr ( verbose_memory ) {
-						std::println ( "Warning: Requested region at {:#x} overlaps with existing region at {:#x} (size {:#x}). Trying next available address.",
-												 base, it->first, it->second.size );
-					}
+					log_message ( "Warning: Requested region at {:#x} overlaps with existing region at {:#x} (size {:#x}). Trying next available address.",
+						base, it->first, it->second.size );
 					overlap = true;
 					base = ( it->first + it->second.size + alignment - 1 ) & ~( alignment - 1 );
 					region_end = base + pages_needed * page_size;
@@ -107,37 +688,28 @@ namespace kubera
 		}
 
 		Region region { base, pages_needed * page_size, prot, prot };
+		region.allocation_base = base;
 		regions [ base ] = region;
 
 		for ( std::size_t i = 0; i < pages_needed; i++ ) {
 			uint64_t virt = base + i * page_size;
-			if ( pages.find ( virt ) != pages.end ( ) ) {
-				if constexpr ( verbose_memory ) {
-					std::println ( "Warning: Page at address {:#x} already exists. Allocation failed.", virt );
-				}
+			auto* page = map_page ( virt );
+			if ( !page ) {
+				log_message ( "Warning: Page at address {:#x} already exists. Allocation failed.", virt );
 				regions.erase ( base );
 				for ( std::size_t j = 0; j < i; j++ ) {
-					pages.erase ( base + j * page_size );
+					unmap_page ( base + j * page_size );
 				}
 				return 0;
 			}
-			pages [ virt ] = std::make_unique<Page> ( );
-			pages [ virt ]->prot = prot;
-			pages [ virt ]->region_base = base;
-			if ( commit_immediately ) {
-				pages [ virt ]->data = commit ( page_size );
-				if ( !pages [ virt ]->data ) {
-					if constexpr ( verbose_memory ) {
-						std::println ( "Failed to commit memory for page at address {:#x}", virt );
-					}
-					for ( std::size_t j = 0; j <= i; j++ ) {
-						pages.erase ( base + j * page_size );
-					}
-					regions.erase ( base );
-					return 0;
+			page->prot = prot;
+			if ( commit_immediately && !commit_page ( page ) ) {
+				log_message ( "Failed to commit memory for page at address {:#x}", virt );
+				for ( std::size_t j = 0; j <= i; j++ ) {
+					unmap_page ( base + j * page_size );
 				}
-				std::memset ( pages [ virt ]->data, 0, page_size );
-				pages [ virt ]->present = true;
+				regions.erase ( base );
+				return 0;
 			}
 		}
 
@@ -146,36 +718,178 @@ namespace kubera
 
 	uint64_t VirtualMemory::load ( const void* data, std::size_t size, uint8_t prot, std::size_t alignment ) {
 		uint64_t addr = alloc ( size, prot, alignment );
-		write_bytes ( addr, data, size, PageProtection::WRITE );
+		if ( !addr ) {
+			return 0;
+		}
+
+		// Bypass the protection so read-only and executable images can be loaded too
+		const auto* src = static_cast< const uint8_t* >( data );
+		for ( std::size_t offset = 0; offset < size; offset += page_size ) {
+			auto* dest = translate_bypass ( addr + offset );
+			if ( !dest ) {
+				free ( addr, size );
+				return 0;
+			}
+			std::memcpy ( dest, src + offset, std::min ( page_size, size - offset ) );
+		}
 		return addr;
 	}
 
+	uint64_t VirtualMemory::map_host ( std::shared_ptr<const void> owner, const void* data, std::size_t size, uint8_t prot, std::size_t alignment ) {
+		const uint64_t base = alloc ( size, prot, alignment );
+		if ( !base ) {
+			return 0;
+		}
+
+		const auto* bytes = static_cast< const uint8_t* >( data );
+		const std::size_t full_pages = size / page_size;
+		// Only whole pages read the host memory, a buffer shorter than a page needs no owner
+		if ( full_pages != 0 ) {
+			add_host_backing ( bytes, HostBacking { bytes + full_pages * page_size, { std::move ( owner ) }, full_pages } );
+		}
+		for ( std::size_t i = 0; i < full_pages; ++i ) {
+			auto* page = lookup_page ( base + i * page_size );
+			// Never written through, the first guest write copies the page
+			page->data = const_cast< uint8_t* >( bytes + i * page_size );
+			page->present = true;
+			page->flags |= PageFlags::PAGE_FLAG_HOST | PageFlags::PAGE_FLAG_COW;
+		}
+
+		// A partial last page would let guest reads run past the end of the host buffer
+		if ( const std::size_t tail = size % page_size; tail != 0 ) {
+			auto* page = lookup_page ( base + full_pages * page_size );
+			if ( !commit_page ( page ) ) {
+				free ( base, size );
+				return 0;
+			}
+			std::memcpy ( page->data, bytes + full_pages * page_size, tail );
+		}
+		return base;
+	}
+
+	uint64_t VirtualMemory::map_file ( const std::filesystem::path& path, uint8_t prot, std::size_t alignment ) {
+	#ifdef _MSC_VER
+		HANDLE file = CreateFileW ( path.c_str ( ), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if ( file == INVALID_HANDLE_VALUE ) {
+			return 0;
+		}
+		LARGE_INTEGER file_size { };
+		if ( !GetFileSizeEx ( file, &file_size ) || file_size.QuadPart == 0 ) {
+			CloseHandle ( file );
+			return 0;
+		}
+		HANDLE mapping = CreateFileMappingW ( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		CloseHandle ( file );
+		if ( !mapping ) {
+			return 0;
+		}
+		void* view = MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+		CloseHandle ( mapping );
+		if ( !view ) {
+			return 0;
+		}
+		const auto size = static_cast< std::size_t >( file_size.QuadPart );
+		std::shared_ptr<const void> owner ( view, [ ] ( const void* p ) { UnmapViewOfFile ( p ); } );
+	#else
+		const int fd = open ( path.c_str ( ), O_RDONLY );
+		if ( fd < 0 ) {
+			return 0;
+		}
+		struct stat st { };
+		if ( fstat ( fd, &st ) != 0 || st.st_size == 0 ) {
+			close ( fd );
+			return 0;
+		}
+		const auto size = static_cast< std::size_t >( st.st_size );
+		void* view = mmap ( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		close ( fd );
+		if ( view == MAP_FAILED ) {
+			return 0;
+		}
+		std::shared_ptr<const void> owner ( view, [ size ] ( const void* p ) { munmap ( const_cast< void* >( p ), size ); } );
+	#endif
+		const void* data = owner.get ( );
+		return map_host ( std::move ( owner ), data, size, prot, alignment );
+	}
+
+	void VirtualMemory::share_frame ( Page& page ) {
+		// Host frames are never freed, so they need no reference
+		if ( ( page.flags & PageFlags::PAGE_FLAG_HOST ) == 0 ) {
+			frame_refs->share ( page.data );
+		}
+		page.flags |= PageFlags::PAGE_FLAG_COW;
+	}
+
+	void VirtualMemory::add_host_backing ( const uint8_t* begin, HostBacking backing ) {
+		auto it = host_backings.upper_bound ( begin );
+		if ( it != host_backings.begin ( ) && std::prev ( it )->second.end > begin ) {
+			--it;
+		}
+		while ( it != host_backings.end ( ) && it->first < backing.end ) {
+			begin = std::min ( begin, it->first );
+			backing.end = std::max ( backing.end, it->second.end );
+			backing.pages += it->second.pages;
+			backing.owners.insert ( backing.owners.end ( ), it->second.owners.begin ( ), it->second.owners.end ( ) );
+			it = host_backings.erase ( it );
+		}
+		host_backings.emplace ( begin, std::move ( backing ) );
+	}
+
+	void VirtualMemory::retain_host ( const uint8_t* frame, const HostBackings* saved ) {
+		auto it = find_host_backing ( host_backings, frame );
+		if ( it == host_backings.end ( ) ) {
+			const auto saved_it = saved ? find_host_backing ( *saved, frame ) : HostBackings::const_iterator { };
+			if ( !saved || saved_it == saved->end ( ) ) {
+				return;
+			}
+			add_host_backing ( saved_it->first, HostBacking { saved_it->second.end, saved_it->second.owners, 0 } );
+			it = find_host_backing ( host_backings, frame );
+		}
+		++it->second.pages;
+	}
+
+	void VirtualMemory::drop_host ( const uint8_t* frame ) {
+		auto it = find_host_backing ( host_backings, frame );
+		if ( it != host_backings.end ( ) && --it->second.pages == 0 ) {
+			host_backings.erase ( it );
+		}
+	}
+
 	void VirtualMemory::free ( uint64_t addr, std::size_t size ) {
 		uint64_t base = addr & ~( page_size - 1 );
 		std::size_t pages_needed = ( size + page_size - 1 ) / page_size;
 		uint64_t region_end = base + pages_needed * page_size;
 
+		// Regions straddling either end keep their part outside the range
 		auto it = regions.lower_bound ( base );
 		if ( it != regions.begin ( ) ) --it;
 		while ( it != regions.end ( ) && it->first < region_end ) {
-			if ( it->first + it->second.size > base ) {
-				auto next = std::next ( it );
-				regions.erase ( it );
-				it = next;
-			}
-			else {
+			auto& region = it->second;
+			const uint64_t end = region.base_address + region.size;
+			if ( end <= base ) {
 				++it;
+				continue;
 			}
-		}
 
-		for ( std::size_t i = 0; i < pages_needed; i++ ) {
-			uint64_t virt = base + i * page_size;
-			auto page_it = pages.find ( virt );
-			if ( page_it != pages.end ( ) ) {
-				uncommit ( page_it->second->data );
-				pages.erase ( page_it );
+			Region after = region;
+			if ( region.base_address < base ) {
+				region.size = static_cast< std::size_t >( base - region.base_address );
+				++it;
+			}
+			else {
+				it = regions.erase ( it );
+			}
+			if ( end > region_end ) {
+				after.base_address = region_end;
+				after.size = static_cast< std::size_t >( end - region_end );
+				regions [ region_end ] = std::move ( after );
+				break;
 			}
 		}
+
+		std::vector<uint8_t*> batch;
+		unmap_range ( base, region_end, &batch );
+		uncommit ( batch );
 	}
 
 	bool VirtualMemory::protect ( uint64_t addr, std::size_t size, uint8_t prot ) {
@@ -183,18 +897,37 @@ namespace kubera
 		std::size_t pages_needed = ( size + page_size - 1 ) / page_size;
 		uint64_t end = start + pages_needed * page_size;
 
-		auto* region = find_region ( addr );
-		if ( !region ) {
-			return false;
+		// Like VirtualProtect the whole range has to be allocated, it may span several regions
+		for ( uint64_t cursor = start; cursor < end; ) {
+			auto* region = find_region ( cursor );
+			if ( !region ) {
+				return false;
+			}
+			cursor = region->base_address + region->size;
 		}
 
-		split_region ( region->base_address, start, end, prot );
-		for ( std::size_t i = 0; i < pages_needed; i++ ) {
-			uint64_t virt = start + i * page_size;
-			auto it = pages.find ( virt );
-			if ( it == pages.end ( ) ) return false;
-			it->second->prot = prot;
+		for ( uint64_t cursor = start; cursor < end; ) {
+			const auto* region = find_region ( cursor );
+			const uint64_t region_end = region->base_address + region->size;
+			const uint64_t split_end = std::min ( end, region_end );
+			split_region ( region->base_address, cursor, split_end, prot );
+			cursor = split_end;
 		}
+		coalesce_regions ( start, end );
+
+		for_each_page_in_range ( start, end, [ this, prot ] ( uint64_t virt, Page& page )
+		{
+			if ( page.prot == prot ) {
+				return;
+			}
+			if ( page.has_code ) {
+				log_code_write ( virt, &page );
+			}
+			layout_changed = true;
+			++protection_seq;
+			page.prot = prot;
+			flush_tlb ( virt );
+		} );
 		return true;
 	}
 
@@ -214,155 +947,603 @@ namespace kubera
 		auto it = regions.find ( base );
 		if ( it == regions.end ( ) ) return;
 
-		Region old_region = it->second;
+		Region old_region = std::move ( it->second );
 		regions.erase ( it );
 
 		if ( split_start > base ) {
-			Region before { base, static_cast< std::size_t >( split_start - base ), old_region.allocation_protect, old_region.current_protect };
-			regions [ base ] = before;
+			Region before = old_region;
+			before.size = static_cast< std::size_t >( split_start - base );
+			regions [ base ] = std::move ( before );
 		}
 
-		Region modified { split_start, static_cast< std::size_t >( split_end - split_start ), old_region.allocation_protect, new_protect };
-		regions [ split_start ] = modified;
-
 		if ( split_end < base + old_region.size ) {
-			Region after { split_end, static_cast< std::size_t > ( base + old_region.size - split_end ), old_region.allocation_protect, old_region.current_protect };
-			regions [ split_end ] = after;
+			Region after = old_region;
+			after.base_address = split_end;
+			after.size = static_cast< std::size_t > ( base + old_region.size - split_end );
+			regions [ split_end ] = std::move ( after );
 		}
 
-		for ( auto& [virt, page] : pages ) {
-			if ( virt >= base && virt < base + old_region.size ) {
-				auto* new_region = find_region ( virt );
-				if ( new_region ) {
-					page->region_base = new_region->base_address;
-				}
+		old_region.base_address = split_start;
+		old_region.size = static_cast< std::size_t >( split_end - split_start );
+		old_region.current_protect = new_protect;
+		regions [ split_start ] = std::move ( old_region );
+	}
+
+	void VirtualMemory::coalesce_regions ( uint64_t start, uint64_t end ) {
+		// Start from the left neighbour of the region holding start
+		auto it = regions.upper_bound ( start );
+		for ( int i = 0; i < 2 && it != regions.begin ( ); ++i ) {
+			--it;
+		}
+
+		while ( it != regions.end ( ) && it->first <= end ) {
+			auto next = std::next ( it );
+			if ( next == regions.end ( ) ) {
+				break;
+			}
+			auto& a = it->second;
+			const auto& b = next->second;
+			if ( a.base_address + a.size == b.base_address && a.allocation_base == b.allocation_base &&
+					a.allocation_protect == b.allocation_protect && a.current_protect == b.current_protect ) {
+				a.size += b.size;
+				regions.erase ( next );
+			}
+			else {
+				it = next;
 			}
 		}
 	}
 
-	void* VirtualMemory::translate ( uint64_t addr, uint8_t access, bool silent ) {
+	void VirtualMemory::record_fault ( uint64_t addr, uint8_t access, FaultReason reason ) {
+		*fault_slot = { .address = addr, .rip = fault_rip ? *fault_rip : 0, .access = access, .reason = reason };
+		++fault_seq;
+		if ( fault_sink ) [[unlikely]] {
+			fault_sink ( *fault_slot );
+		}
+	}
+
+	void print_fault ( const MemoryFault& fault ) {
+		constexpr const char* reasons [ ] = { "none", "invalid address", "protection", "insufficient memory" };
+		std::println ( "Access violation at address {:#x} with access {:#x} ({}) at rip {:#x}", fault.address, fault.access,
+			reasons [ static_cast< std::size_t >( fault.reason ) ], fault.rip );
+	}
+
+	void print_memory_log ( std::string_view message ) {
+		std::println ( "{}", message );
+	}
+
+	Page* VirtualMemory::resolve_page ( uint64_t addr, uint8_t access, bool silent ) {
 		uint64_t virt_page = addr & ~( page_size - 1 );
-		for ( auto& e : cache ) {
-			if ( e.virt == virt_page ) {
-				if ( ( e.page->prot & access ) != access ) {
-					if constexpr ( verbose_memory ) {
-						if ( !silent )
-							std::println ( "Access violation at address {:#x} with access {:#x} (protection)", addr, access );
-					}
-					return nullptr;
-				}
-				if ( !e.page->present ) {
-					e.page->data = commit ( page_size );
-					if ( !e.page->data ) {
-						if constexpr ( verbose_memory ) {
-							if ( !silent )
-								std::println ( "Access violation at address {:#x} with access {:#x} (memory not committed)", addr, access );
-						}
-						return nullptr;
-					}
-					std::memset ( e.page->data, 0, page_size );
-					e.page->present = true;
-				}
-				if ( ( access & PageProtection::READ ) != 0 ) {
-					auto* region = find_region ( addr );
-					if ( region && region->read_hook ) {
-						( *region->read_hook )( this, addr, page_size - ( addr - virt_page ) );
-					}
-				}
-				return e.page->data + ( addr - virt_page );
+		Page* pg = lookup_page ( virt_page );
+		if ( !pg ) {
+			if ( !silent ) {
+				record_fault ( addr, access, FaultReason::Unmapped );
 			}
+			return nullptr;
 		}
-		auto it = pages.find ( virt_page );
-		if ( it == pages.end ( ) ) {
-			if constexpr ( verbose_memory ) {
-				if ( !silent )
-					std::println ( "Access violation at address {:#x} with access {:#x} (invalid address)", addr, access );
+		if ( ( pg->prot & access ) != access ) {
+			if ( !silent ) {
+				record_fault ( addr, access, FaultReason::Protection );
 			}
 			return nullptr;
 		}
-		Page* pg = it->second.get ( );
-		cache [ cache_pos ] = { virt_page, pg };
-		cache_pos = ( cache_pos + 1 ) % cache.size ( );
-		if ( ( pg->prot & access ) != access ) {
-			if constexpr ( verbose_memory ) {
-				if ( !silent )
-					std::println ( "Access violation at address {:#x} with access {:#x}", addr, access );
+		const bool was_present = pg->present;
+		if ( !commit_page ( pg ) ) {
+			if ( !silent ) {
+				record_fault ( addr, access, FaultReason::OutOfMemory );
 			}
 			return nullptr;
 		}
-		if ( !pg->present ) {
-			pg->data = commit ( page_size );
-			if ( !pg->data ) {
-				if constexpr ( verbose_memory ) {
-					if ( !silent )
-						std::println ( "Access violation at address {:#x} with access %u (insufficient memory)", addr, access );
+
+		if ( ( access & PageProtection::WRITE ) != 0 ) {
+			if ( pg->has_code ) {
+				log_code_write ( virt_page, pg );
+			}
+			if ( ( pg->flags & PageFlags::PAGE_FLAG_COW ) != 0 && !break_cow ( virt_page, pg ) ) {
+				if ( !silent ) {
+					record_fault ( addr, access, FaultReason::OutOfMemory );
 				}
 				return nullptr;
 			}
-			std::memset ( pg->data, 0, page_size );
-			pg->present = true;
+			mark_dirty ( virt_page, pg );
+		}
+		else if ( !was_present ) {
+			mark_dirty ( virt_page, pg );
 		}
 
-		auto* region = find_region ( addr );
-		if ( region && region->read_hook ) {
-			( *region->read_hook )( this, addr, page_size - ( addr - virt_page ) );
+		return pg;
+	}
+
+	void* VirtualMemory::translate_slow ( uint64_t addr, uint8_t access, bool silent, std::size_t size ) {
+		auto* pg = resolve_page ( addr, access, silent );
+		if ( !pg ) {
+			return nullptr;
+		}
+
+		const uint64_t virt_page = addr & ~( page_size - 1 );
+		const uint8_t hooked = hooked_access ( access );
+		// Pages hooked for this kind of access are never cached, so the hook keeps firing on every access
+		if ( ( pg->flags & hook_flags_for ( hooked ) ) != 0 ) {
+			const std::size_t rest = page_size - ( addr - virt_page );
+			dispatch_hooks ( addr, size == 0 ? rest : std::min ( size, rest ), hooked );
+			return pg->data + ( addr - virt_page );
 		}
 
+		tlb [ tlb_kind ( access ) ] [ tlb_index ( virt_page ) ] = { virt_page, pg->data, pg->prot };
 		return pg->data + ( addr - virt_page );
 	}
 
+	bool VirtualMemory::probe ( uint64_t addr, uint8_t access ) {
+		const uint64_t virt_page = addr & ~( page_size - 1 );
+		const auto& entry = tlb [ tlb_kind ( access ) ] [ tlb_index ( virt_page ) ];
+		if ( entry.virt == virt_page && ( entry.prot & access ) == access ) {
+			return true;
+		}
+
+		auto* pg = resolve_page ( addr, access, false );
+		if ( !pg ) {
+			return false;
+		}
+		if ( ( pg->flags & hook_flags_for ( hooked_access ( access ) ) ) == 0 ) {
+			tlb [ tlb_kind ( access ) ] [ tlb_index ( virt_page ) ] = { virt_page, pg->data, pg->prot };
+		}
+		return true;
+	}
+
+	uint8_t* VirtualMemory::direct_page ( uint64_t addr, uint8_t access ) {
+		auto* pg = resolve_page ( addr, access, true );
+		if ( !pg || ( pg->flags & hook_flags_for ( hooked_access ( access ) ) ) != 0 ) {
+			return nullptr;
+		}
+		const uint64_t virt_page = addr & ~( page_size - 1 );
+		tlb [ tlb_kind ( access ) ] [ tlb_index ( virt_page ) ] = { virt_page, pg->data, pg->prot };
+		return pg->data;
+	}
+
 	void* VirtualMemory::translate_bypass ( uint64_t addr, bool silent ) {
 		uint64_t virt_page = addr & ~( page_size - 1 );
-		for ( auto& e : cache ) {
-			if ( e.virt == virt_page ) {
-				if ( !e.page->present ) {
-					e.page->data = commit ( page_size );
-					if ( !e.page->data ) {
-						if constexpr ( verbose_memory ) {
-							if ( !silent )
-								std::println ( "Access violation at address {:#x} (insufficient memory)", addr );
-						}
-						return nullptr;
+		Page* pg = lookup_page ( virt_page );
+		if ( !pg ) {
+			if ( !silent ) {
+				record_fault ( addr, PageProtection::NONE, FaultReason::Unmapped );
+			}
+			return nullptr;
+		}
+
+		if ( !commit_page ( pg ) ) {
+			if ( !silent ) {
+				record_fault ( addr, PageProtection::NONE, FaultReason::OutOfMemory );
+			}
+			return nullptr;
+		}
+
+		// The caller may write through the returned pointer
+		if ( pg->has_code ) {
+			log_code_write ( virt_page, pg );
+		}
+		if ( ( pg->flags & PageFlags::PAGE_FLAG_COW ) != 0 && !break_cow ( virt_page, pg ) ) {
+			if ( !silent ) {
+				record_fault ( addr, PageProtection::NONE, FaultReason::OutOfMemory );
+			}
+			return nullptr;
+		}
+		mark_dirty ( virt_page, pg );
+
+		return pg->data + ( addr - virt_page );
+	}
+
+	bool VirtualMemory::break_cow ( uint64_t virt_page, Page* page ) {
+		const bool host = ( page->flags & PageFlags::PAGE_FLAG_HOST ) != 0;
+		if ( !host && !frame_refs->is_shared ( page->data ) ) {
+			page->flags &= ~PageFlags::PAGE_FLAG_COW;
+			return true;
+		}
+
+		auto* copy = commit ( page_size );
+		if ( !copy ) {
+			return false;
+		}
+		std::memcpy ( copy, page->data, page_size );
+		if ( host ) {
+			drop_host ( page->data );
+		}
+		else {
+			frame_refs->release ( page->data );
+		}
+		page->data = copy;
+		page->flags &= ~( PageFlags::PAGE_FLAG_COW | PageFlags::PAGE_FLAG_HOST );
+		// Read and exec entries still point at the shared frame
+		flush_tlb ( virt_page );
+		return true;
+	}
+
+	void VirtualMemory::release_frame ( Page* page, std::vector<uint8_t*>* batch ) {
+		if ( !page->data ) {
+			return;
+		}
+		if ( ( page->flags & PageFlags::PAGE_FLAG_HOST ) != 0 ) {
+			// Owned by the host mapping
+			drop_host ( page->data );
+		}
+		else if ( ( page->flags & PageFlags::PAGE_FLAG_COW ) != 0 ) {
+			frame_refs->release ( page->data );
+		}
+		else if ( batch ) {
+			batch->push_back ( page->data );
+		}
+		else {
+			uncommit ( page->data );
+		}
+		page->data = nullptr;
+	}
+
+	template<typename Fn>
+	void VirtualMemory::for_each_mapped_page ( Fn&& fn ) {
+		for ( auto& [key, pdpt] : page_map_root ) {
+			for ( std::size_t d = 0; d < table_entries; ++d ) {
+				auto& directory = pdpt->directories [ d ];
+				if ( !directory ) continue;
+				for ( std::size_t t = 0; t < table_entries; ++t ) {
+					auto& table = directory->tables [ t ];
+					if ( !table ) continue;
+					for ( std::size_t p = 0; p < table_entries; ++p ) {
+						auto& page = table->pages [ p ];
+						if ( !page.mapped ) continue;
+						const uint64_t vpn = ( key << ( table_bits * 3 ) ) | ( d << ( table_bits * 2 ) ) | ( t << table_bits ) | p;
+						fn ( vpn << page_shift, page );
 					}
-					std::memset ( e.page->data, 0, page_size );
-					e.page->present = true;
 				}
-				return e.page->data + ( addr - virt_page );
 			}
 		}
+	}
+
+	std::shared_ptr<const MemorySnapshot> VirtualMemory::snapshot ( ) {
+		auto snap = std::make_shared<MemorySnapshot> ( );
+		snap->id = next_snapshot_id++;
+		snap->frames = frame_refs;
+		snap->regions = regions;
+		snap->next_alloc = next_alloc;
+		snap->page_size = page_size;
+		snap->host_backings = host_backings;
 
-		auto it = pages.find ( virt_page );
-		if ( it == pages.end ( ) ) {
-			if constexpr ( verbose_memory ) {
-				if ( !silent )
-					std::println ( "Access violation at address {:#x} (invalid address)", addr );
+		for_each_mapped_page ( [ this, &snap ] ( uint64_t virt, Page& page )
+		{
+			page.flags &= ~PageFlags::PAGE_FLAG_DIRTY;
+			if ( page.present ) {
+				share_frame ( page );
+			}
+			Page saved = page;
+			saved.has_code = false;
+			snap->pages.emplace_back ( virt, saved );
+		} );
+		std::sort ( snap->pages.begin ( ), snap->pages.end ( ), [ ] ( const auto& a, const auto& b ) { return a.first < b.first; } );
+
+		// Cached write translations would skip the copy-on-write check
+		flush_tlb ( );
+		baseline_snapshot = snap->id;
+		layout_changed = false;
+		dirty_pages.clear ( );
+		return snap;
+	}
+
+	void VirtualMemory::restore_page ( uint64_t virt_page, Page* page, const Page& saved, const HostBackings& saved_backings ) {
+		if ( page->has_code ) {
+			log_code_write ( virt_page, page );
+		}
+		release_frame ( page );
+
+		const bool has_code = page->has_code;
+		const uint32_t code_generation = page->code_generation;
+		*page = saved;
+		page->has_code = has_code;
+		page->code_generation = code_generation;
+		// Hooks are instrumentation rather than guest state, the ones installed now stay in effect
+		page->flags = ( page->flags & ~( PageFlags::PAGE_FLAG_DIRTY | hook_flag_mask ) ) | hook_flags ( virt_page );
+		if ( page->present ) {
+			share_frame ( *page );
+			if ( ( page->flags & PageFlags::PAGE_FLAG_HOST ) != 0 ) {
+				retain_host ( page->data, &saved_backings );
 			}
-			return nullptr;
 		}
-		Page* pg = it->second.get ( );
-		cache [ cache_pos ] = { virt_page, pg };
-		cache_pos = ( cache_pos + 1 ) % cache.size ( );
+		flush_tlb ( virt_page );
+	}
 
-		if ( !pg->present ) {
-			pg->data = commit ( page_size );
-			if ( !pg->data ) {
-				if constexpr ( verbose_memory ) {
-					if ( !silent )
-						std::println ( "Access violation at address {:#x} (insufficient memory)", addr );
+	void VirtualMemory::restore ( const MemorySnapshot& snap ) {
+		if ( snap.id == baseline_snapshot && !layout_changed ) {
+			for ( const auto virt : dirty_pages ) {
+				auto* page = lookup_page ( virt );
+				const auto* saved = snap.find ( virt );
+				if ( page && saved ) {
+					restore_page ( virt, page, *saved, snap.host_backings );
 				}
-				return nullptr;
 			}
-			std::memset ( pg->data, 0, page_size );
-			pg->present = true;
+			dirty_pages.clear ( );
+			return;
 		}
 
-		return pg->data + ( addr - virt_page );
+		// The layout diverged, rebuild the page tables from the snapshot
+		std::vector<uint8_t*> batch;
+		for_each_mapped_page ( [ this, &batch ] ( uint64_t virt, Page& page )
+		{
+			if ( page.has_code ) {
+				log_code_write ( virt, &page );
+			}
+			release_frame ( &page, &batch );
+		} );
+		uncommit ( batch );
+		page_map_root.clear ( );
+		flush_tlb ( );
+		++protection_seq;
+
+		regions = snap.regions;
+		next_alloc = snap.next_alloc;
+		host_backings = snap.host_backings;
+		for ( const auto& [virt, saved] : snap.pages ) {
+			auto* page = map_page ( virt );
+			*page = saved;
+			page->flags = ( page->flags & ~hook_flag_mask ) | hook_flags ( virt );
+			if ( page->present ) {
+				share_frame ( *page );
+			}
+		}
+
+		baseline_snapshot = snap.id;
+		layout_changed = false;
+		dirty_pages.clear ( );
+	}
+
+	uint64_t MemorySnapshot::fingerprint ( ) const {
+		std::call_once ( fingerprint_once, [ this ]
+		{
+			uint64_t hash = checkpoint::fnv_offset;
+			for ( const auto& [start, region] : regions ) {
+				checkpoint::mix ( hash, region.base_address );
+				checkpoint::mix ( hash, region.size );
+				checkpoint::mix ( hash, region.allocation_protect | ( region.current_protect << 8 ) );
+				checkpoint::mix ( hash, region.allocation_base );
+			}
+			checkpoint::mix ( hash, next_alloc );
+			for ( const auto& [virt, page] : pages ) {
+				checkpoint::mix ( hash, virt );
+				checkpoint::mix ( hash, page.prot | ( page.present ? 0x100 : 0 ) );
+				// Layout alone would match any image of the same size at the same address
+				if ( page.present ) {
+					checkpoint::mix_words ( hash, page.data, page_size );
+				}
+			}
+			fingerprint_value = hash;
+		} );
+		return fingerprint_value;
+	}
+
+	void VirtualMemory::write_checkpoint ( const MemorySnapshot& base, CheckpointWriter& out ) {
+		out.put ( static_cast< uint8_t >( checkpoint::RecordKind::Layout ) );
+		out.put_varint ( regions.size ( ) );
+		for ( const auto& [start, region] : regions ) {
+			out.put_varint ( region.base_address );
+			out.put_varint ( region.size );
+			out.put ( region.allocation_protect );
+			out.put ( region.current_protect );
+			out.put_varint ( region.allocation_base );
+		}
+		out.put_varint ( next_alloc );
+
+		// Pages that may differ from base, nullptr for the ones base maps and this memory no longer does
+		std::vector<std::pair<uint64_t, const Page*>> candidates;
+		if ( base.id == baseline_snapshot && !layout_changed ) {
+			for ( const auto virt : dirty_pages ) {
+				if ( const auto* page = lookup_page ( virt ) ) {
+					candidates.emplace_back ( virt, page );
+				}
+			}
+		}
+		else {
+			for_each_mapped_page ( [ &candidates ] ( uint64_t virt, Page& page )
+			{
+				candidates.emplace_back ( virt, &page );
+			} );
+			for ( const auto& [virt, saved] : base.pages ) {
+				if ( !lookup_page ( virt ) ) {
+					candidates.emplace_back ( virt, nullptr );
+				}
+			}
+		}
+		std::sort ( candidates.begin ( ), candidates.end ( ), [ ] ( const auto& a, const auto& b ) { return a.first < b.first; } );
+
+		uint64_t last_vpn = 0;
+		for ( const auto& [virt, page] : candidates ) {
+			const uint64_t vpn = virt >> page_shift;
+			if ( !page ) {
+				out.put ( static_cast< uint8_t >( checkpoint::RecordKind::Unmap ) );
+				out.put_varint ( vpn - last_vpn );
+				last_vpn = vpn;
+				continue;
+			}
+
+			// base keeps its frames alive, so a page still pointing at the same one was never written
+			const auto* saved = base.find ( virt );
+			const bool same_frame = saved && saved->present == page->present && saved->data == page->data;
+			if ( same_frame && saved->prot == page->prot ) {
+				continue;
+			}
+
+			auto contents = checkpoint::PageContents::Data;
+			if ( same_frame ) {
+				contents = checkpoint::PageContents::Base;
+			}
+			else if ( !page->present ) {
+				contents = checkpoint::PageContents::Uncommitted;
+			}
+			else if ( page->data [ 0 ] == 0 && std::memcmp ( page->data, page->data + 1, page_size - 1 ) == 0 ) {
+				contents = checkpoint::PageContents::Zero;
+			}
+
+			out.put ( static_cast< uint8_t >( checkpoint::RecordKind::Page ) );
+			out.put_varint ( vpn - last_vpn );
+			out.put ( page->prot );
+			out.put ( static_cast< uint8_t >( contents ) );
+			if ( contents == checkpoint::PageContents::Data ) {
+				out.put_bytes ( page->data, page_size );
+			}
+			last_vpn = vpn;
+		}
+	}
+
+	bool VirtualMemory::load_checkpoint ( const MemorySnapshot& base, CheckpointReader& in ) {
+		if ( in.page_size ( ) != page_size ) {
+			return false;
+		}
+		restore ( base );
+
+		auto load_layout = [ this, &in ] ( )
+		{
+			uint64_t count = 0;
+			if ( !in.get_varint ( count ) ) {
+				return false;
+			}
+			std::map<uint64_t, Region> loaded;
+			for ( uint64_t i = 0; i < count; ++i ) {
+				Region region;
+				uint64_t size = 0;
+				if ( !in.get_varint ( region.base_address ) || !in.get_varint ( size ) || !in.get ( region.allocation_protect ) ||
+					!in.get ( region.current_protect ) || !in.get_varint ( region.allocation_base ) ) {
+					return false;
+				}
+				region.size = static_cast< std::size_t >( size );
+				loaded.emplace ( region.base_address, region );
+			}
+			uint64_t alloc_cursor = 0;
+			if ( !in.get_varint ( alloc_cursor ) ) {
+				return false;
+			}
+
+			const bool same = loaded.size ( ) == regions.size ( ) && alloc_cursor == next_alloc &&
+				std::equal ( loaded.begin ( ), loaded.end ( ), regions.begin ( ), [ ] ( const auto& a, const auto& b )
+				{
+					return a.second.base_address == b.second.base_address && a.second.size == b.second.size &&
+						a.second.allocation_protect == b.second.allocation_protect && a.second.current_protect == b.second.current_protect &&
+						a.second.allocation_base == b.second.allocation_base;
+				} );
+			if ( !same ) {
+				// A fast restore would leave the regions of the checkpoint behind
+				regions = std::move ( loaded );
+				next_alloc = alloc_cursor;
+				layout_changed = true;
+			}
+			return true;
+		};
+
+		uint64_t vpn = 0;
+		uint8_t kind = 0;
+		while ( in.get ( kind ) ) {
+			switch ( static_cast< checkpoint::RecordKind >( kind ) ) {
+				case checkpoint::RecordKind::Layout:
+					if ( !load_layout ( ) ) {
+						return false;
+					}
+					break;
+				case checkpoint::RecordKind::Page: {
+					uint64_t delta = 0;
+					uint8_t prot = 0;
+					uint8_t contents = 0;
+					if ( !in.get_varint ( delta ) || !in.get ( prot ) || !in.get ( contents ) ||
+						contents > static_cast< uint8_t >( checkpoint::PageContents::Data ) ) {
+						return false;
+					}
+					vpn += delta;
+					const uint64_t virt = vpn << page_shift;
+					auto* page = lookup_page ( virt );
+					if ( !page ) {
+						page = map_page ( virt );
+					}
+					if ( page->has_code ) {
+						log_code_write ( virt, page );
+					}
+					if ( page->prot != prot ) {
+						++protection_seq;
+					}
+					page->prot = prot;
+
+					if ( contents != static_cast< uint8_t >( checkpoint::PageContents::Base ) ) {
+						release_frame ( page );
+						page->flags &= ~( PageFlags::PAGE_FLAG_COW | PageFlags::PAGE_FLAG_HOST );
+						page->present = false;
+						if ( contents != static_cast< uint8_t >( checkpoint::PageContents::Uncommitted ) ) {
+							page->data = commit ( page_size );
+							if ( !page->data ) {
+								return false;
+							}
+							page->present = true;
+							if ( contents == static_cast< uint8_t >( checkpoint::PageContents::Data ) && !in.get_bytes ( page->data, page_size ) ) {
+								return false;
+							}
+						}
+					}
+					mark_dirty ( virt, page );
+					flush_tlb ( virt );
+					break;
+				}
+				case checkpoint::RecordKind::Unmap: {
+					uint64_t delta = 0;
+					if ( !in.get_varint ( delta ) ) {
+						return false;
+					}
+					vpn += delta;
+					unmap_page ( vpn << page_shift );
+					break;
+				}
+				case checkpoint::RecordKind::End:
+					return true;
+				default:
+					return false;
+			}
+		}
+		return false;
+	}
+
+	void VirtualMemory::mark_code ( uint64_t addr ) {
+		const uint64_t virt_page = addr & ~( page_size - 1 );
+		if ( auto* page = lookup_page ( virt_page ) ) {
+			page->has_code = true;
+			// Writes to the page have to go through the slow path again to be logged
+			flush_tlb ( virt_page );
+		}
 	}
 
 	bool VirtualMemory::check ( uint64_t addr, std::size_t size, uint8_t access ) {
-		for ( std::size_t offset = 0; offset < size; offset += page_size ) {
-			void* p = translate ( addr + offset, access );
-			if ( !p ) return false;
+		if ( size == 0 ) {
+			return true;
+		}
+		// A probe, the access it checks for fires the hooks when it is made. Every page up to the one holding the
+		// last byte is checked, an access shorter than a page still straddles two when it crosses a boundary.
+		const uint64_t first_page = addr & ~( page_size - 1 );
+		const uint64_t pages = ( ( ( addr + size - 1 ) & ~( page_size - 1 ) ) - first_page ) >> page_shift;
+		if ( !probe ( addr, access ) ) return false;
+		for ( uint64_t i = 1; i <= pages; ++i ) {
+			if ( !probe ( first_page + ( i << page_shift ), access ) ) return false;
+		}
+		return true;
+	}
+
+	bool VirtualMemory::peek ( uint64_t addr, void* dest, std::size_t size ) const {
+		auto* out = static_cast< uint8_t* >( dest );
+		while ( size > 0 ) {
+			const uint64_t virt_page = addr & ~( page_size - 1 );
+			const std::size_t offset = addr - virt_page;
+			const std::size_t to_copy = std::min ( size, page_size - offset );
+			const auto* page = lookup_page ( virt_page );
+			if ( !page ) {
+				return false;
+			}
+			if ( page->present ) {
+				std::memcpy ( out, page->data + offset, to_copy );
+			}
+			else {
+				std::memset ( out, 0, to_copy );
+			}
+			out += to_copy;
+			addr += to_copy;
+			size -= to_copy;
 		}
 		return true;
 	}
@@ -372,7 +1553,7 @@ namespace kubera
 		auto* region = find_region ( addr );
 		if ( region ) {
 			mbi.base_address = region->base_address;
-			mbi.allocation_base = region->base_address;
+			mbi.allocation_base = region->allocation_base;
 			mbi.allocation_protect = map_to_win_protect ( region->base_address );
 			mbi.region_size = region->size;
 			mbi.protect = map_to_win_protect ( addr );
@@ -383,9 +1564,7 @@ namespace kubera
 	}
 
 	Page* VirtualMemory::get_page ( uint64_t addr ) {
-		auto it = pages.find ( addr & ~( page_size - 1 ) );
-		if ( it == pages.end ( ) ) return nullptr;
-		return it->second.get ( );
+		return lookup_page ( addr & ~( page_size - 1 ) );
 	}
 
 	uint32_t VirtualMemory::map_to_win_protect ( uint64_t addr ) {
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace kubera
+{
+	class KUBERA;
+
+	// Where the SYSCALL arguments are read from
+	enum class SyscallConvention : uint8_t {
+		Windows, // r10, rdx, r8, r9, the rest on the stack above the home space
+		Linux, // rdi, rsi, rdx, r10, r8, r9
+	};
+
+	// Register arguments of a SYSCALL, decoded once before the handler runs
+	struct SyscallArgs {
+		uint32_t number { 0 };
+		// Unused slots are zero, e.g. the last two under the Windows convention
+		std::array<uint64_t, 6> args { };
+	};
+
+	// RCX and R11 already hold the return RIP and RFLAGS as SYSCALL leaves them. The result goes into RAX through context.
+	using SyscallHandler = void ( * )( KUBERA& context, const SyscallArgs& args, void* user );
+
+	// Called for INT n, INT3 and INT1 with RIP still at the instruction. Leaving RIP alone resumes after it, like a handler returning with IRET.
+	using InterruptHandler = void ( * )( KUBERA& context, uint8_t vector, void* user );
+
+	// System call numbers to plain function pointers, invoked straight from the SYSCALL handler
+	class SyscallTable {
+	public:
+		struct Entry {
+			SyscallHandler handler { nullptr };
+			void* user { nullptr };
+		};
+
+		void set ( uint32_t number, SyscallHandler handler, void* user = nullptr ) {
+			if ( number >= entries.size ( ) ) {
+				entries.resize ( number + 1 );
+			}
+			entries [ number ] = { handler, user };
+		}
+
+		void clear ( uint32_t number ) noexcept {
+			if ( number < entries.size ( ) ) {
+				entries [ number ] = { };
+			}
+		}
+
+		// Runs for numbers without an entry of their own, nullptr leaves them unhandled
+		void set_default ( SyscallHandler handler, void* user = nullptr ) noexcept {
+			fallback = { handler, user };
+		}
+
+		const Entry& find ( uint32_t number ) const noexcept {
+			if ( number < entries.size ( ) && entries [ number ].handler ) [[likely]] {
+				return entries [ number ];
+			}
+			return fallback;
+		}
+
+		SyscallConvention convention { SyscallConvention::Windows };
+
+	private:
+		std::vector<Entry> entries;
+		Entry fallback { };
+	};
+
+	// Interrupt vectors to handlers, vector 3 is INT3 and vector 1 INT1
+	class InterruptTable {
+	public:
+		struct Entry {
+			InterruptHandler handler { nullptr };
+			void* user { nullptr };
+		};
+
+		void set ( uint8_t vector, InterruptHandler handler, void* user = nullptr ) noexcept {
+			entries [ vector ] = { handler, user };
+		}
+
+		void clear ( uint8_t vector ) noexcept {
+			entries [ vector ] = { };
+		}
+
+		const Entry& find ( uint8_t vector ) const noexcept {
+			return entries [ vector ];
+		}
+
+	private:
+		std::array<Entry, 256> entries { };
+	};
+};
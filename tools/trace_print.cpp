@@ -0,0 +1,26 @@
+#include "../KUBERA.hpp"
+#include <cstdlib>
+#include <print>
+
+// Prints a trace written by TraceWriter, one line per executed instruction
+int main ( int argc, char** argv ) {
+	using namespace kubera;
+
+	if ( argc < 2 ) {
+		std::println ( "usage: {} <trace> [max steps]", argv [ 0 ] );
+		return 1;
+	}
+
+	TraceReader reader ( argv [ 1 ] );
+	if ( !reader.is_open ( ) ) {
+		std::println ( "{}: not a readable KUBERA trace", argv [ 1 ] );
+		return 1;
+	}
+
+	const uint64_t limit = argc > 2 ? std::strtoull ( argv [ 2 ], nullptr, 0 ) : UINT64_MAX;
+	TraceStep step;
+	for ( uint64_t count = 0; count < limit && reader.next ( step ); ++count ) {
+		std::println ( "{}", format_trace_step ( step ) );
+	}
+	return 0;
+}
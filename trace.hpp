@@ -0,0 +1,235 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "types.hpp"
+
+namespace kubera
+{
+	class VirtualMemory;
+
+	// Execution trace file layout, all integers little-endian:
+	//   header  "KUBTRACE", u16 version, u8 compression, u8 reserved
+	//   body    chunks of { u32 stream, u32 length, records }, zstd-compressed as a whole when requested
+	// Records of a stream are delta encoded against the previous ones of the same stream, a step is a
+	// Step record followed by the reads, writes and register changes of the instruction at its RIP.
+	namespace trace
+	{
+		constexpr std::array<char, 8> magic = { 'K', 'U', 'B', 'T', 'R', 'A', 'C', 'E' };
+		constexpr uint16_t format_version = 1;
+
+		enum class Compression : uint8_t {
+			None,
+			// Falls back to None when KUBERA was built without KUBERA_TRACE_ZSTD
+			Zstd,
+		};
+
+		enum class RecordKind : uint8_t {
+			Step = 1, // zigzag varint RIP delta to the previous step
+			Register, // u8 register index, varint XOR with its previous value
+			Flags, // varint XOR with the previous rflags
+			Mxcsr, // varint XOR with the previous mxcsr
+			Read, // zigzag varint address delta to the previous access, varint size, value bytes
+			Write,
+		};
+
+		// Value bytes stored with an access, wider accesses only keep their address and size
+		constexpr std::size_t max_value_bytes = 64;
+		// Largest record the encoder emits
+		constexpr std::size_t max_record_size = 1 + 10 + 10 + max_value_bytes;
+	}
+
+	class TraceWriter;
+
+	// Producer side of one emulation thread's trace. Records go into a ring of fixed-size blocks which
+	// the writer thread drains, the producer only waits when all of its blocks are still queued.
+	class TraceStream {
+	public:
+		TraceStream ( const TraceStream& ) = delete;
+		TraceStream& operator=( const TraceStream& ) = delete;
+
+		void begin_step ( uint64_t rip );
+		// Reads are captured while the instruction runs, writes only note their extent until end_step
+		void record_read ( uint64_t address, std::size_t size, const VirtualMemory& memory );
+		void record_write ( uint64_t address, std::size_t size );
+		void end_step ( const std::array<uint64_t, KubRegister::COUNT>& registers, uint64_t rflags, uint32_t mxcsr, const VirtualMemory& memory );
+
+		// Hands the partially filled block to the writer and waits until it has written out everything queued
+		void flush ( );
+
+		uint32_t id ( ) const noexcept {
+			return stream_id;
+		}
+
+	private:
+		friend class TraceWriter;
+
+		struct Block {
+			std::unique_ptr<uint8_t[ ]> data;
+			std::size_t size { 0 };
+		};
+
+		TraceStream ( TraceWriter& writer, uint32_t id, std::size_t block_size, std::size_t block_count );
+
+		void reserve ( std::size_t bytes );
+		void publish ( );
+		void put ( uint8_t byte ) {
+			cursor [ fill++ ] = byte;
+		}
+		void put_varint ( uint64_t value );
+		void put_signed ( int64_t value ) {
+			put_varint ( ( static_cast< uint64_t >( value ) << 1 ) ^ static_cast< uint64_t >( value >> 63 ) );
+		}
+		void put_access ( trace::RecordKind kind, uint64_t address, std::size_t size, const VirtualMemory& memory );
+
+		TraceWriter& writer;
+		uint32_t stream_id;
+		std::size_t block_size;
+		std::vector<Block> blocks;
+		// Blocks published by the producer and written out by the writer thread, the difference is what is queued
+		std::atomic<std::size_t> produced { 0 };
+		std::atomic<std::size_t> consumed { 0 };
+		uint8_t* cursor { nullptr };
+		std::size_t fill { 0 };
+
+		// Delta state, mirrored by TraceReader
+		bool in_step { false };
+		uint64_t last_rip { 0 };
+		uint64_t last_address { 0 };
+		std::array<uint64_t, KubRegister::COUNT> last_registers { };
+		uint64_t last_rflags { 0 };
+		uint32_t last_mxcsr { 0 };
+		std::vector<std::pair<uint64_t, std::size_t>> pending_writes;
+	};
+
+	// Owns the trace file and the thread draining every stream opened on it
+	class TraceWriter {
+	public:
+		explicit TraceWriter ( const std::filesystem::path& path, trace::Compression compression = trace::Compression::None,
+			std::size_t block_size = 0x10000, std::size_t blocks_per_stream = 8 );
+		// Writes out what every stream recorded so far, streams must no longer be in use
+		~TraceWriter ( );
+
+		TraceWriter ( const TraceWriter& ) = delete;
+		TraceWriter& operator=( const TraceWriter& ) = delete;
+
+		[[nodiscard]] bool is_open ( ) const noexcept {
+			return file != nullptr;
+		}
+
+		// New stream for one emulation thread, owned by the writer
+		TraceStream& open_stream ( );
+
+	private:
+		friend class TraceStream;
+
+		void drain_loop ( );
+		// Writes the queued blocks of every stream, returns whether there were any
+		bool drain ( );
+		void write_chunk ( uint32_t stream, const uint8_t* data, std::size_t size );
+		void write_out ( const void* data, std::size_t size, bool finish = false );
+
+		std::FILE* file { nullptr };
+		trace::Compression compression;
+		void* zstd_context { nullptr };
+		std::vector<uint8_t> compressed;
+		std::size_t block_size;
+		std::size_t blocks_per_stream;
+
+		std::mutex mutex;
+		std::condition_variable work_cv;
+		std::condition_variable space_cv;
+		std::vector<std::unique_ptr<TraceStream>> streams;
+		bool stopping { false };
+		std::thread thread;
+	};
+
+	struct TraceRegisterChange {
+		uint8_t index { 0 };
+		uint64_t old_value { 0 };
+		uint64_t new_value { 0 };
+	};
+
+	struct TraceAccess {
+		bool write { false };
+		uint64_t address { 0 };
+		uint64_t size { 0 };
+		// The first min(size, max_value_bytes) bytes, the value after the instruction for writes
+		std::array<uint8_t, trace::max_value_bytes> value { };
+	};
+
+	struct TraceStep {
+		uint32_t stream { 0 };
+		uint64_t rip { 0 };
+		std::vector<TraceRegisterChange> registers;
+		std::vector<TraceAccess> accesses;
+		std::optional<std::pair<uint64_t, uint64_t>> rflags;
+		std::optional<std::pair<uint32_t, uint32_t>> mxcsr;
+	};
+
+	// Offline reader, yields the steps of every stream in file order
+	class TraceReader {
+	public:
+		explicit TraceReader ( const std::filesystem::path& path );
+		~TraceReader ( );
+
+		TraceReader ( const TraceReader& ) = delete;
+		TraceReader& operator=( const TraceReader& ) = delete;
+
+		// False for a missing file, a bad header or a compressed trace without zstd support
+		[[nodiscard]] bool is_open ( ) const noexcept {
+			return file != nullptr;
+		}
+
+		// Fills step with the next complete step, false once the trace is exhausted or malformed
+		bool next ( TraceStep& step );
+
+	private:
+		struct StreamState {
+			uint64_t last_rip { 0 };
+			uint64_t last_address { 0 };
+			std::array<uint64_t, KubRegister::COUNT> registers { };
+			uint64_t rflags { 0 };
+			uint32_t mxcsr { 0 };
+			std::optional<TraceStep> current;
+		};
+
+		bool refill ( );
+		bool read_in ( void* data, std::size_t size );
+		// Queues the unfinished step of every stream, the trace ended
+		void finish ( );
+		bool parse_chunk ( uint32_t stream, const std::vector<uint8_t>& chunk );
+
+		std::FILE* file { nullptr };
+		trace::Compression compression { trace::Compression::None };
+		void* zstd_context { nullptr };
+		// Compressed bytes read ahead of the decompressor
+		std::vector<uint8_t> raw;
+		std::size_t raw_pos { 0 };
+		std::size_t raw_size { 0 };
+		// Plain trace bytes
+		std::vector<uint8_t> input;
+		std::size_t input_pos { 0 };
+		std::size_t input_size { 0 };
+
+		std::vector<std::pair<uint32_t, StreamState>> streams;
+		std::vector<TraceStep> ready;
+		std::size_t ready_pos { 0 };
+		bool finished { false };
+		std::vector<uint8_t> chunk;
+	};
+
+	// One line per step, register and flag changes as NAME old;new
+	std::string format_trace_step ( const TraceStep& step );
+};
@@ -1,14 +1,17 @@
 #pragma once
 
-#include <boost/multiprecision/cpp_bin_float.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
 #include <array>
 #include <cstdint>
+#include <bit>
+#include <cstring>
+#include <limits>
 #include <unordered_map>
 #include <optional>
 #include <functional>
 #include <vector>
 #include "x86.hpp"
+#include "float80.hpp"
 
 namespace mp = boost::multiprecision;
 using int128_t = mp::int128_t;
@@ -17,13 +20,6 @@ using uint256_t = mp::uint256_t;
 using uint512_t = mp::uint512_t;
 using int256_t = mp::int256_t;
 using int512_t = mp::int512_t;
-using float80_t =
-mp::number<mp::cpp_bin_float<
-	64,                 // Number of significand bits (including explicit leading bit when non-zero)
-	mp::digit_base_2,   // Binary representation
-	void, std::int16_t, // Use 16-bit exponent type
-	-16382, 16383       // Min/Max exponent values
->, mp::et_off>;       // Disable expression templates for simplicity
 #if defined(_MSC_VER)
 #include <intrin.h>
 #include <iced.hpp>
@@ -146,9 +142,7 @@ namespace kubera
 		}
 
 		uint8_t classify_fpu_operand ( const float80_t& val ) const {
-			using namespace boost::multiprecision;
-			int c = fpclassify ( val );
-			switch ( c ) {
+			switch ( fp80::classify ( val ) ) {
 				case FP_NAN:       return x86::FPU_TAG_SPECIAL;
 				case FP_INFINITE:  return x86::FPU_TAG_SPECIAL;
 				case FP_ZERO:      return x86::FPU_TAG_ZERO;
@@ -159,6 +153,111 @@ namespace kubera
 		}
 	};
 
+	// Native storage for one ZMM register, XMM and YMM are its low 16 and 32 bytes
+	struct alignas( 64 ) VectorRegister {
+		uint8_t bytes [ 64 ] = { 0 };
+
+		template <typename T>
+		T lane ( std::size_t index ) const noexcept {
+			T value;
+			std::memcpy ( &value, bytes + index * sizeof ( T ), sizeof ( T ) );
+			return value;
+		}
+
+		template <typename T>
+		void set_lane ( std::size_t index, T value ) noexcept {
+			std::memcpy ( bytes + index * sizeof ( T ), &value, sizeof ( T ) );
+		}
+
+		// Clears every byte from size up to the full register width
+		void zero_upper ( std::size_t size ) noexcept {
+			std::memset ( bytes + size, 0, sizeof ( bytes ) - size );
+		}
+	};
+
+	// Converts the low bytes of a vector register to a boost integer of the same width
+	template <typename Wide>
+	Wide vector_to_wide ( const VectorRegister& vec ) {
+		constexpr std::size_t size = std::numeric_limits<Wide>::digits / 8;
+		uint64_t parts [ size / 8 ];
+		std::memcpy ( parts, vec.bytes, size );
+		Wide result;
+		mp::import_bits ( result, parts, parts + size / 8, 64, false );
+		return result;
+	}
+
+	// Stores a boost integer into the low bytes of a vector register, zeroing the rest
+	template <typename Wide>
+	void wide_to_vector ( VectorRegister& vec, const Wide& value ) {
+		constexpr std::size_t size = std::numeric_limits<Wide>::digits / 8;
+		uint64_t parts [ size / 8 ] = { 0 };
+		mp::export_bits ( value, parts, 64, false );
+		std::memcpy ( vec.bytes, parts, size );
+		vec.zero_upper ( size );
+	}
+
+	// Kind of the last flag-producing operation whose flags have not been written to rflags yet
+	enum class FlagOp : uint8_t {
+		None, // rflags holds the current flags
+		Add,
+		Sub,
+		Logic, // AND/OR/XOR/TEST, CF/OF/AF cleared
+		Inc, // Like Add with src2 = 1, CF preserved in rflags
+		Dec, // Like Sub with src2 = 1, CF preserved in rflags
+	};
+
+	// Operands and result of the last flag-producing operation, masked to its size.
+	// Individual flags are derived from these on demand.
+	struct LazyFlags {
+		FlagOp op = FlagOp::None;
+		uint8_t size = 0;
+		uint64_t src1 = 0;
+		uint64_t src2 = 0;
+		uint64_t result = 0;
+
+		bool msb ( uint64_t value ) const noexcept {
+			return ( value >> ( size * 8 - 1 ) ) & 1;
+		}
+
+		// Only meaningful for Add, Sub and Logic
+		bool cf ( ) const noexcept {
+			switch ( op ) {
+				case FlagOp::Add: return result < src1;
+				case FlagOp::Sub: return src1 < src2;
+				default: return false;
+			}
+		}
+
+		bool pf ( ) const noexcept {
+			return ( std::popcount ( result & 0xFF ) & 1 ) == 0;
+		}
+
+		bool af ( ) const noexcept {
+			return op != FlagOp::Logic && ( ( src1 ^ src2 ^ result ) & 0x10 ) != 0;
+		}
+
+		bool zf ( ) const noexcept {
+			return result == 0;
+		}
+
+		bool sf ( ) const noexcept {
+			return msb ( result );
+		}
+
+		bool of ( ) const noexcept {
+			switch ( op ) {
+				case FlagOp::Add:
+				case FlagOp::Inc:
+					return msb ( ( src1 ^ result ) & ( src2 ^ result ) );
+				case FlagOp::Sub:
+				case FlagOp::Dec:
+					return msb ( ( src1 ^ src2 ) & ( src1 ^ result ) );
+				default:
+					return false;
+			}
+		}
+	};
+
 	struct alignas( 64 ) CPU {
 		std::array<std::uint64_t, KubRegister::COUNT> registers = { 0 };
 		std::uint64_t stack_base = 0ULL;
@@ -166,15 +265,14 @@ namespace kubera
 		std::vector<std::uint64_t> shadow_stack { };
 		std::uint64_t ssp = 0ULL;
 		x86::Flags rflags = static_cast< x86::Flags >( 0x0000000000000202ULL );
+		LazyFlags lazy_flags { };
 		x86::Mxcsr mxcsr = static_cast< x86::Mxcsr >( 0x1F80U );
 		std::uint64_t timestamp_counter = 0ULL;
 		std::uint8_t current_privilege_level = 3;
 		FPU fpu { };
-		std::unique_ptr<std::array<uint512_t, 32>> sse_registers = nullptr;
+		std::array<VectorRegister, 32> vector_registers { };
 
 		CPU ( std::uint64_t stack_base_addr, std::size_t _stack_size ) : stack_base ( stack_base_addr ), stack_size ( _stack_size ) {
-			sse_registers = std::make_unique<std::array<uint512_t, 32>> ( );
-			sse_registers->fill ( uint512_t ( 0 ) );
 			timestamp_counter = READ_TSC ( );
 		}
 
@@ -191,11 +289,29 @@ namespace kubera
 	};
 
 
+	enum PageFlags : uint8_t {
+		PAGE_FLAG_NONE = 0,
+		PAGE_FLAG_READ_HOOK = 1 << 0,
+		// The frame may be shared with a snapshot and has to be copied before the first write
+		PAGE_FLAG_COW = 1 << 1,
+		// The frame changed since the last snapshot or restore
+		PAGE_FLAG_DIRTY = 1 << 2,
+		// The frame is host memory mapped with map_host/map_file, never written or freed by us
+		PAGE_FLAG_HOST = 1 << 3,
+		// A hook covers part of the page for writes or instruction execution, like PAGE_FLAG_READ_HOOK for reads
+		PAGE_FLAG_WRITE_HOOK = 1 << 4,
+		PAGE_FLAG_EXEC_HOOK = 1 << 5
+	};
+
 	struct Page {
 		uint8_t* data { nullptr };
 		uint8_t prot { PageProtection::NONE };
+		uint8_t flags { PageFlags::PAGE_FLAG_NONE };
+		bool mapped { false };
 		bool present { false };
-		uint64_t region_base { 0 };
+		// Set while decoded blocks exist for this page, writes to it get logged for invalidation
+		bool has_code { false };
+		uint32_t code_generation { 0 };
 	};
 
 	struct Region {
@@ -203,7 +319,8 @@ namespace kubera
 		std::size_t size { 0 };
 		uint8_t allocation_protect { PageProtection::NONE };
 		uint8_t current_protect { PageProtection::NONE };
-		std::optional<std::function<void ( class VirtualMemory*, uint64_t addr, std::size_t size )>> read_hook;
+		// Base of the alloc call the region came from, kept when protect splits it
+		uint64_t allocation_base { 0 };
 	};
 
 	struct WinMemoryBasicInformation {